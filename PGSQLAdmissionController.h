@@ -0,0 +1,182 @@
+//
+//  PGSQLAdmissionController.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLAdmissionController
+    @abstract   Limits and orders the requests sent to a set of connections.
+    @discussion Left alone, every thread that wants the database goes
+				straight to a connection and waits on its lock, in no
+				particular order, and a spike of slow batch work delays the
+				quick interactive queries queued behind it.  The admission
+				controller sits in front of the connections and decides who
+				goes next.
+
+				Each request names a workload class, "interactive" or
+				"reports" for instance, a priority and a deadline.  A class
+				can have at most its concurrency limit of requests running,
+				and all classes together at most totalConcurrencyLimit.
+				Requests that cannot run yet wait in one queue, higher
+				priorities first and in arrival order within a priority.  A
+				waiting request whose deadline passes is rejected without
+				reaching the server, since nobody is still waiting for its
+				answer.
+
+				A class given a latency target has its limit adjusted as it
+				runs: raised by one every limit's worth of requests that
+				finish within the target, halved when one takes longer, never
+				beyond the configured limit or below one.  Those requests
+				queue instead of piling onto a server that is already slow.
+*/
+
+#import "PGSQLConnection.h"
+
+enum {
+	PGSQLPriorityBatch = 0,
+	PGSQLPriorityNormal = 10,
+	PGSQLPriorityInteractive = 20
+};
+
+/*!
+    @class
+    @abstract    Admission control in front of one or more connections.
+    @discussion  Safe to share between threads.  Admitted requests run on
+				 the connection with the fewest requests in flight.
+*/
+@interface PGSQLAdmissionController : NSObject {
+	NSArray *connections;
+	NSUInteger *outstanding;		// requests in flight, per connection
+
+	NSCondition *admissionCondition;	// guards everything below
+	NSMutableArray *queue;			// waiting tickets, in admission order
+	NSMutableDictionary *workloads;	// name -> PGSQLWorkload
+	NSUInteger totalConcurrencyLimit;
+	NSUInteger defaultConcurrencyLimit;
+	NSUInteger maximumQueueDepth;
+	NSUInteger running;
+}
+
+-(id)initWithConnection:(PGSQLConnection *)conn;
+/*!
+    @method
+    @abstract   A controller over several connections to the same database.
+    @discussion totalConcurrencyLimit starts at the number of connections.
+*/
+-(id)initWithConnections:(NSArray *)conns;
+
+-(NSArray *)connections;
+
+#pragma mark -
+#pragma mark Execution
+
+/*!
+    @method
+    @abstract   Run a statement once admitted.
+    @discussion Waits at most timeout seconds to be admitted.  A request that
+				is not admitted in time returns a failed result without
+				having been sent.  Never raises.
+*/
+-(PGSQLCommandResult *)execute:(NSString *)sql parameters:(NSArray *)params
+					  workload:(NSString *)workload priority:(int)priority timeout:(NSTimeInterval)timeout;
+
+/*!
+    @method
+    @abstract   open: once admitted.  Raises PGSQLError on failure, and when
+				the request is not admitted in time.
+*/
+-(PGSQLRecordset *)open:(NSString *)sql parameters:(NSArray *)params
+			   workload:(NSString *)workload priority:(int)priority timeout:(NSTimeInterval)timeout;
+
+/*!
+    @method
+    @abstract   Run a block with a connection once admitted.
+    @discussion For work that is more than one statement.  The connection is
+				locked to the calling thread while the block runs.  Returns
+				NO, without calling the block, if the request was not
+				admitted within timeout.
+*/
+-(BOOL)performForWorkload:(NSString *)workload priority:(int)priority timeout:(NSTimeInterval)timeout
+			   usingBlock:(void (^)(PGSQLConnection *connection))block;
+
+#pragma mark -
+#pragma mark Limits
+
+/*!
+    @method
+    @abstract   Requests that may run at once across every workload.
+*/
+-(NSUInteger)totalConcurrencyLimit;
+-(void)setTotalConcurrencyLimit:(NSUInteger)value;
+
+/*!
+    @method
+    @abstract   The limit for workloads that were not given one.  Defaults
+				to totalConcurrencyLimit.
+*/
+-(NSUInteger)defaultConcurrencyLimit;
+-(void)setDefaultConcurrencyLimit:(NSUInteger)value;
+
+-(NSUInteger)concurrencyLimitForWorkload:(NSString *)workload;
+-(void)setConcurrencyLimit:(NSUInteger)limit forWorkload:(NSString *)workload;
+
+/*!
+    @method
+    @abstract   The limit the workload runs under right now, below its
+				concurrency limit while latency adaptation holds it back.
+*/
+-(NSUInteger)currentLimitForWorkload:(NSString *)workload;
+
+/*!
+    @method
+    @abstract   Seconds a request of the workload should take, which turns
+				on latency adaptation for it.  0, the default, turns it off.
+*/
+-(NSTimeInterval)latencyTargetForWorkload:(NSString *)workload;
+-(void)setLatencyTarget:(NSTimeInterval)target forWorkload:(NSString *)workload;
+
+/*!
+    @method
+    @abstract   Requests that may wait at once.  Past it new requests are
+				rejected straight away.  0, the default, is no limit.
+*/
+-(NSUInteger)maximumQueueDepth;
+-(void)setMaximumQueueDepth:(NSUInteger)value;
+
+#pragma mark -
+#pragma mark Statistics
+
+/*!
+    @method
+    @abstract   Requests waiting to be admitted.
+*/
+-(NSUInteger)queueDepth;
+-(NSUInteger)queueDepthForWorkload:(NSString *)workload;
+-(NSUInteger)runningCountForWorkload:(NSString *)workload;
+
+-(unsigned long long)admittedCountForWorkload:(NSString *)workload;
+/*!
+    @method
+    @abstract   Requests turned away, because their deadline passed or the
+				queue was full.
+*/
+-(unsigned long long)rejectedCountForWorkload:(NSString *)workload;
+
+/*!
+    @method
+    @abstract   Time admitted requests waited, as a moving average over
+				recent requests, and the longest wait since statistics were
+				last reset.
+*/
+-(NSTimeInterval)averageWaitForWorkload:(NSString *)workload;
+-(NSTimeInterval)maximumWaitForWorkload:(NSString *)workload;
+
+/*!
+    @method
+    @abstract   Zero the counters and wait times.  Limits are kept.
+*/
+-(void)resetStatistics;
+
+@end
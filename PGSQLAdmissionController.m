@@ -0,0 +1,513 @@
+//
+//  PGSQLAdmissionController.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLAdmissionController.h"
+#import <stdlib.h>
+
+// Weight of the newest wait in the moving average.
+#define PGSQLWaitAverageWeight	0.1
+
+// One workload class's limits and statistics, guarded by the controller's
+// admissionCondition.
+@interface PGSQLWorkload : NSObject {
+@public
+	NSUInteger limit;				// 0 until set, then the configured limit
+	double currentLimit;			// what latency adaptation allows, <= limit
+	NSTimeInterval latencyTarget;
+	NSTimeInterval lastDecrease;	// when currentLimit was last halved
+
+	NSUInteger running;
+	NSUInteger queued;
+	unsigned long long admitted;
+	unsigned long long rejected;
+	NSTimeInterval averageWait;
+	NSTimeInterval maximumWait;
+}
+@end
+
+@implementation PGSQLWorkload
+@end
+
+// A request waiting for admission, and once admitted, running.
+@interface PGSQLAdmissionTicket : NSObject {
+@public
+	PGSQLWorkload *workload;
+	int priority;
+	NSTimeInterval enqueued;
+	NSTimeInterval deadline;
+	NSTimeInterval admitted;
+	NSUInteger connectionIndex;
+}
+@end
+
+@implementation PGSQLAdmissionTicket
+@end
+
+@interface PGSQLAdmissionController (Private)
+
+-(PGSQLWorkload *)workloadNamed:(NSString *)name;
+-(NSUInteger)effectiveLimitOfWorkload:(PGSQLWorkload *)workload;
+-(PGSQLAdmissionTicket *)nextAdmissibleAt:(NSTimeInterval)now;
+-(PGSQLAdmissionTicket *)admitWorkload:(NSString *)name priority:(int)priority
+							   timeout:(NSTimeInterval)timeout error:(NSString **)error;
+-(void)completeTicket:(PGSQLAdmissionTicket *)ticket;
+
+@end
+
+@implementation PGSQLAdmissionController
+
+-(id)initWithConnection:(PGSQLConnection *)conn
+{
+	return [self initWithConnections:[NSArray arrayWithObject:conn]];
+}
+
+-(id)initWithConnections:(NSArray *)conns
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		connections = [conns copy];
+		outstanding = calloc([connections count] > 0 ? [connections count] : 1, sizeof(NSUInteger));
+		admissionCondition = [[NSCondition alloc] init];
+		queue = [[NSMutableArray alloc] init];
+		workloads = [[NSMutableDictionary alloc] init];
+		totalConcurrencyLimit = ([connections count] > 0) ? [connections count] : 1;
+		defaultConcurrencyLimit = 0;
+		maximumQueueDepth = 0;
+		running = 0;
+	}
+	return self;
+}
+
+-(void)dealloc
+{
+	[connections release];
+	free(outstanding);
+	[admissionCondition release];
+	[queue release];
+	[workloads release];
+	[super dealloc];
+}
+
+-(NSArray *)connections
+{
+	return connections;
+}
+
+#pragma mark -
+#pragma mark Execution
+
+-(PGSQLCommandResult *)execute:(NSString *)sql parameters:(NSArray *)params
+					  workload:(NSString *)workload priority:(int)priority timeout:(NSTimeInterval)timeout
+{
+	NSString *error = nil;
+	PGSQLAdmissionTicket *ticket = [self admitWorkload:workload priority:priority timeout:timeout error:&error];
+	if (ticket == nil)
+	{
+		return [[[PGSQLCommandResult alloc] initWithError:error sql:sql executionTime:0] autorelease];
+	}
+
+	PGSQLCommandResult *result = [[connections objectAtIndex:ticket->connectionIndex] execute:sql parameters:params];
+	[self completeTicket:ticket];
+	return result;
+}
+
+-(PGSQLRecordset *)open:(NSString *)sql parameters:(NSArray *)params
+			   workload:(NSString *)workload priority:(int)priority timeout:(NSTimeInterval)timeout
+{
+	PGSQLCommandResult *result = [self execute:sql parameters:params workload:workload priority:priority timeout:timeout];
+	if (![result succeeded])
+	{
+        [[NSException exceptionWithName:@"PGSQLError" reason:[result lastError] userInfo:nil] raise];
+		return nil;
+	}
+	return [result recordset];
+}
+
+-(BOOL)performForWorkload:(NSString *)workload priority:(int)priority timeout:(NSTimeInterval)timeout
+			   usingBlock:(void (^)(PGSQLConnection *connection))block
+{
+	PGSQLAdmissionTicket *ticket = [self admitWorkload:workload priority:priority timeout:timeout error:NULL];
+	if (ticket == nil)
+	{
+		return NO;
+	}
+
+	PGSQLConnection *connection = [connections objectAtIndex:ticket->connectionIndex];
+	[connection lock];
+	@try
+	{
+		block(connection);
+	}
+	@finally
+	{
+		[connection unlock];
+		[self completeTicket:ticket];
+	}
+	return YES;
+}
+
+#pragma mark -
+#pragma mark Limits
+
+-(NSUInteger)totalConcurrencyLimit
+{
+	[admissionCondition lock];
+	NSUInteger value = totalConcurrencyLimit;
+	[admissionCondition unlock];
+	return value;
+}
+
+-(void)setTotalConcurrencyLimit:(NSUInteger)value
+{
+	[admissionCondition lock];
+	totalConcurrencyLimit = (value > 0) ? value : 1;
+	[admissionCondition broadcast];
+	[admissionCondition unlock];
+}
+
+-(NSUInteger)defaultConcurrencyLimit
+{
+	[admissionCondition lock];
+	NSUInteger value = (defaultConcurrencyLimit > 0) ? defaultConcurrencyLimit : totalConcurrencyLimit;
+	[admissionCondition unlock];
+	return value;
+}
+
+-(void)setDefaultConcurrencyLimit:(NSUInteger)value
+{
+	[admissionCondition lock];
+	defaultConcurrencyLimit = value;
+	[admissionCondition broadcast];
+	[admissionCondition unlock];
+}
+
+-(NSUInteger)concurrencyLimitForWorkload:(NSString *)workload
+{
+	[admissionCondition lock];
+	PGSQLWorkload *entry = [self workloadNamed:workload];
+	NSUInteger value = (entry->limit > 0) ? entry->limit
+		: ((defaultConcurrencyLimit > 0) ? defaultConcurrencyLimit : totalConcurrencyLimit);
+	[admissionCondition unlock];
+	return value;
+}
+
+-(void)setConcurrencyLimit:(NSUInteger)limit forWorkload:(NSString *)workload
+{
+	[admissionCondition lock];
+	PGSQLWorkload *entry = [self workloadNamed:workload];
+	entry->limit = (limit > 0) ? limit : 1;
+	entry->currentLimit = entry->limit;
+	[admissionCondition broadcast];
+	[admissionCondition unlock];
+}
+
+-(NSUInteger)currentLimitForWorkload:(NSString *)workload
+{
+	[admissionCondition lock];
+	NSUInteger value = [self effectiveLimitOfWorkload:[self workloadNamed:workload]];
+	[admissionCondition unlock];
+	return value;
+}
+
+-(NSTimeInterval)latencyTargetForWorkload:(NSString *)workload
+{
+	[admissionCondition lock];
+	NSTimeInterval value = [self workloadNamed:workload]->latencyTarget;
+	[admissionCondition unlock];
+	return value;
+}
+
+-(void)setLatencyTarget:(NSTimeInterval)target forWorkload:(NSString *)workload
+{
+	[admissionCondition lock];
+	PGSQLWorkload *entry = [self workloadNamed:workload];
+	entry->latencyTarget = target;
+	if (entry->limit == 0)
+	{
+		// adaptation works down from a limit of the workload's own
+		entry->limit = (defaultConcurrencyLimit > 0) ? defaultConcurrencyLimit : totalConcurrencyLimit;
+	}
+	entry->currentLimit = entry->limit;
+	[admissionCondition broadcast];
+	[admissionCondition unlock];
+}
+
+-(NSUInteger)maximumQueueDepth
+{
+	[admissionCondition lock];
+	NSUInteger value = maximumQueueDepth;
+	[admissionCondition unlock];
+	return value;
+}
+
+-(void)setMaximumQueueDepth:(NSUInteger)value
+{
+	[admissionCondition lock];
+	maximumQueueDepth = value;
+	[admissionCondition unlock];
+}
+
+#pragma mark -
+#pragma mark Statistics
+
+-(NSUInteger)queueDepth
+{
+	[admissionCondition lock];
+	NSUInteger value = [queue count];
+	[admissionCondition unlock];
+	return value;
+}
+
+-(NSUInteger)queueDepthForWorkload:(NSString *)workload
+{
+	[admissionCondition lock];
+	NSUInteger value = [self workloadNamed:workload]->queued;
+	[admissionCondition unlock];
+	return value;
+}
+
+-(NSUInteger)runningCountForWorkload:(NSString *)workload
+{
+	[admissionCondition lock];
+	NSUInteger value = [self workloadNamed:workload]->running;
+	[admissionCondition unlock];
+	return value;
+}
+
+-(unsigned long long)admittedCountForWorkload:(NSString *)workload
+{
+	[admissionCondition lock];
+	unsigned long long value = [self workloadNamed:workload]->admitted;
+	[admissionCondition unlock];
+	return value;
+}
+
+-(unsigned long long)rejectedCountForWorkload:(NSString *)workload
+{
+	[admissionCondition lock];
+	unsigned long long value = [self workloadNamed:workload]->rejected;
+	[admissionCondition unlock];
+	return value;
+}
+
+-(NSTimeInterval)averageWaitForWorkload:(NSString *)workload
+{
+	[admissionCondition lock];
+	NSTimeInterval value = [self workloadNamed:workload]->averageWait;
+	[admissionCondition unlock];
+	return value;
+}
+
+-(NSTimeInterval)maximumWaitForWorkload:(NSString *)workload
+{
+	[admissionCondition lock];
+	NSTimeInterval value = [self workloadNamed:workload]->maximumWait;
+	[admissionCondition unlock];
+	return value;
+}
+
+-(void)resetStatistics
+{
+	[admissionCondition lock];
+	NSEnumerator *e = [workloads objectEnumerator];
+	PGSQLWorkload *entry;
+	while ((entry = [e nextObject]) != nil)
+	{
+		entry->admitted = 0;
+		entry->rejected = 0;
+		entry->averageWait = 0;
+		entry->maximumWait = 0;
+	}
+	[admissionCondition unlock];
+}
+
+@end
+
+@implementation PGSQLAdmissionController (Private)
+
+// Called with admissionCondition locked.
+-(PGSQLWorkload *)workloadNamed:(NSString *)name
+{
+	if (name == nil)
+	{
+		name = @"";
+	}
+	PGSQLWorkload *entry = [workloads objectForKey:name];
+	if (entry == nil)
+	{
+		entry = [[PGSQLWorkload alloc] init];
+		[workloads setObject:entry forKey:name];
+		[entry release];
+	}
+	return entry;
+}
+
+-(NSUInteger)effectiveLimitOfWorkload:(PGSQLWorkload *)workload
+{
+	if (workload->limit == 0)
+	{
+		return (defaultConcurrencyLimit > 0) ? defaultConcurrencyLimit : totalConcurrencyLimit;
+	}
+	NSUInteger value = (workload->latencyTarget > 0) ? (NSUInteger)workload->currentLimit : workload->limit;
+	return (value > 0) ? value : 1;
+}
+
+// The first waiting request, in priority order, that has room to run.  A
+// request of a workload at its limit does not hold up the ones behind it,
+// and requests already past their deadline are passed over for their own
+// threads to reject.
+-(PGSQLAdmissionTicket *)nextAdmissibleAt:(NSTimeInterval)now
+{
+	if (running >= totalConcurrencyLimit)
+	{
+		return nil;
+	}
+
+	NSUInteger i;
+	for (i = 0; i < [queue count]; i++)
+	{
+		PGSQLAdmissionTicket *ticket = [queue objectAtIndex:i];
+		if ((ticket->deadline <= now) || (ticket->workload->running >= [self effectiveLimitOfWorkload:ticket->workload]))
+		{
+			continue;
+		}
+		return ticket;
+	}
+	return nil;
+}
+
+-(PGSQLAdmissionTicket *)admitWorkload:(NSString *)name priority:(int)priority
+							   timeout:(NSTimeInterval)timeout error:(NSString **)error
+{
+	NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+	NSDate *deadline = [NSDate dateWithTimeIntervalSinceReferenceDate:now + timeout];
+
+	[admissionCondition lock];
+	PGSQLWorkload *workload = [self workloadNamed:name];
+	if ((maximumQueueDepth > 0) && ([queue count] >= maximumQueueDepth))
+	{
+		workload->rejected++;
+		[admissionCondition unlock];
+		if (error != NULL)
+		{
+			*error = @"The admission queue is full.";
+		}
+		return nil;
+	}
+
+	PGSQLAdmissionTicket *ticket = [[[PGSQLAdmissionTicket alloc] init] autorelease];
+	ticket->workload = workload;
+	ticket->priority = priority;
+	ticket->enqueued = now;
+	ticket->deadline = now + timeout;
+
+	// after every ticket of the same or higher priority
+	NSUInteger position = [queue count];
+	while ((position > 0) && (((PGSQLAdmissionTicket *)[queue objectAtIndex:position - 1])->priority < priority))
+	{
+		position--;
+	}
+	[queue insertObject:ticket atIndex:position];
+	workload->queued++;
+
+	BOOL admitted = NO;
+	for (;;)
+	{
+		now = [NSDate timeIntervalSinceReferenceDate];
+		if ([self nextAdmissibleAt:now] == ticket)
+		{
+			admitted = YES;
+			break;
+		}
+		if (now >= ticket->deadline)
+		{
+			break;
+		}
+		[admissionCondition waitUntilDate:deadline];
+	}
+
+	[queue removeObjectIdenticalTo:ticket];
+	workload->queued--;
+	if (!admitted)
+	{
+		workload->rejected++;
+		// the ticket may have been holding a place others can now use
+		[admissionCondition broadcast];
+		[admissionCondition unlock];
+		if (error != NULL)
+		{
+			*error = [NSString stringWithFormat:@"Not admitted within %.3f seconds, the request was not sent.", timeout];
+		}
+		return nil;
+	}
+
+	ticket->admitted = now;
+	NSTimeInterval waited = now - ticket->enqueued;
+	workload->averageWait = (workload->admitted == 0) ? waited
+		: (workload->averageWait * (1 - PGSQLWaitAverageWeight)) + (waited * PGSQLWaitAverageWeight);
+	if (waited > workload->maximumWait)
+	{
+		workload->maximumWait = waited;
+	}
+	workload->admitted++;
+	workload->running++;
+	running++;
+
+	NSUInteger chosen = 0;
+	NSUInteger i;
+	for (i = 1; i < [connections count]; i++)
+	{
+		if (outstanding[i] < outstanding[chosen])
+		{
+			chosen = i;
+		}
+	}
+	outstanding[chosen]++;
+	ticket->connectionIndex = chosen;
+
+	// another ticket may be admissible too
+	[admissionCondition broadcast];
+	[admissionCondition unlock];
+	return ticket;
+}
+
+// Adjusts the workload's limit from the request's latency: additive
+// increase on requests within the target, multiplicative decrease on ones
+// over it.  Only requests admitted after the last decrease can cause
+// another, so one slow moment halves the limit once rather than once per
+// request that was caught in it.
+-(void)completeTicket:(PGSQLAdmissionTicket *)ticket
+{
+	NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+
+	[admissionCondition lock];
+	PGSQLWorkload *workload = ticket->workload;
+	workload->running--;
+	running--;
+	outstanding[ticket->connectionIndex]--;
+
+	if ((workload->latencyTarget > 0) && (workload->limit > 0))
+	{
+		if (now - ticket->admitted > workload->latencyTarget)
+		{
+			if (ticket->admitted >= workload->lastDecrease)
+			{
+				workload->currentLimit = MAX(1.0, workload->currentLimit / 2);
+				workload->lastDecrease = now;
+			}
+		} else {
+			workload->currentLimit = MIN((double)workload->limit, workload->currentLimit + (1.0 / workload->currentLimit));
+		}
+	}
+
+	[admissionCondition broadcast];
+	[admissionCondition unlock];
+}
+
+@end
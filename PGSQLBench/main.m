@@ -0,0 +1,664 @@
+//
+//  main.m
+//  PGSQLBench
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLBench
+    @abstract   A load generator for measuring PGSQLKit under concurrency.
+    @discussion pgsqlbench opens a number of client connections and drives
+				them from a number of threads with a weighted mix of open:,
+				execCommand: and parameterized execute:parameters: calls,
+				then reports throughput, latency percentiles and the client
+				CPU time spent per query.
+
+				Each thread takes an idle connection, runs one statement and
+				gives the connection back, so with fewer clients than
+				threads the threads queue for connections, as an
+				application's would, and the connection count can be sized
+				against throughput and latency.
+
+				In closed loop mode (the default) each thread starts its
+				next statement when the last one finishes.  In open loop
+				mode (-R) statements are started at a fixed total rate with
+				exponentially distributed gaps; latency is measured from the
+				scheduled start, so time spent waiting behind slow
+				statements counts.
+
+				Only statements that start after the warmup and finish
+				before the end of the run are counted.  Use -J for one line
+				of JSON to compare runs, and -L to label it with the library
+				build being measured.
+
+				usage: pgsqlbench [-h host] [-p port] [-U user] [-P password]
+				[-d database] [-c clients] [-j threads] [-T seconds]
+				[-W seconds] [-R rate] [-m open:1,exec:1,param:1]
+				[-o sql] [-e sql] [-q sql] [-s seed] [-L label] [-J]
+*/
+
+#import <Foundation/Foundation.h>
+#import "PGSQLKit.h"
+#import <math.h>
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+#import <unistd.h>
+#import <sys/resource.h>
+#import <sys/time.h>
+#ifdef __APPLE__
+#import <mach/mach_time.h>
+#endif
+
+enum {
+	PGSQLBenchOpen = 0,
+	PGSQLBenchExec,
+	PGSQLBenchParam,
+	PGSQLBenchKinds
+};
+
+static const char *PGSQLBenchKindNames[PGSQLBenchKinds] = { "open", "exec", "param" };
+
+typedef struct {
+	double *values;				// latencies in microseconds
+	size_t count;
+	size_t capacity;
+} PGSQLBenchSamples;
+
+// Seconds on a monotonic clock.
+static double
+PGSQLBenchNow(void)
+{
+#ifdef __APPLE__
+	static mach_timebase_info_data_t timebase;
+	if (timebase.denom == 0)
+	{
+		mach_timebase_info(&timebase);
+	}
+	return (double)mach_absolute_time() * timebase.numer / timebase.denom / 1e9;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + (now.tv_nsec / 1e9);
+#endif
+}
+
+static double
+PGSQLBenchCPUSeconds(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + (usage.ru_utime.tv_usec / 1e6) +
+		   usage.ru_stime.tv_sec + (usage.ru_stime.tv_usec / 1e6);
+}
+
+static void
+PGSQLBenchSleepUntil(double when)
+{
+	double wait = when - PGSQLBenchNow();
+	if (wait > 0)
+	{
+		usleep((useconds_t)(wait * 1e6));
+	}
+}
+
+static void
+PGSQLBenchAddSample(PGSQLBenchSamples *samples, double value)
+{
+	if (samples->count == samples->capacity)
+	{
+		samples->capacity = (samples->capacity > 0) ? samples->capacity * 2 : 4096;
+		samples->values = realloc(samples->values, sizeof(double) * samples->capacity);
+	}
+	samples->values[samples->count++] = value;
+}
+
+static int
+PGSQLBenchCompareDoubles(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+// The sorted samples' value at percentile p, nearest rank.
+static double
+PGSQLBenchPercentile(const PGSQLBenchSamples *sorted, double p)
+{
+	if (sorted->count == 0)
+	{
+		return 0;
+	}
+	size_t rank = (size_t)ceil((p / 100.0) * sorted->count);
+	return sorted->values[(rank > 0) ? rank - 1 : 0];
+}
+
+// A uniform double in (0, 1] from a per thread xorshift state.
+static double
+PGSQLBenchRandom(uint64_t *state)
+{
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+	return ((x >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+#pragma mark -
+#pragma mark Settings
+
+@interface PGSQLBenchSettings : NSObject {
+@public
+	NSString *server;
+	NSString *port;
+	NSString *userName;
+	NSString *password;
+	NSString *databaseName;
+	int clients;
+	int threads;
+	double duration;
+	double warmup;
+	double rate;				// statements per second in all, 0 for closed loop
+	double weights[PGSQLBenchKinds];
+	NSString *sql[PGSQLBenchKinds];
+	uint64_t seed;
+	NSString *label;
+	BOOL json;
+}
+-(BOOL)parseArguments:(int)argc values:(char **)argv;
+@end
+
+@implementation PGSQLBenchSettings
+
+-(id)init
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		server = @"localhost";
+		port = @"5432";
+		userName = [NSUserName() copy];
+		password = @"";
+		databaseName = @"postgres";
+		clients = 8;
+		threads = 8;
+		duration = 10;
+		warmup = 2;
+		rate = 0;
+		weights[PGSQLBenchOpen] = 1;
+		weights[PGSQLBenchExec] = 1;
+		weights[PGSQLBenchParam] = 1;
+		sql[PGSQLBenchOpen] = @"SELECT g, md5(g::text) FROM generate_series(1, 100) g";
+		sql[PGSQLBenchExec] = @"SELECT 1";
+		sql[PGSQLBenchParam] = @"SELECT $1::int + $2::int";
+		seed = 1;
+		label = @"";
+		json = NO;
+	}
+
+	return self;
+}
+
+-(void)dealloc
+{
+	[server release];
+	[port release];
+	[userName release];
+	[password release];
+	[databaseName release];
+	int k;
+	for (k = 0; k < PGSQLBenchKinds; k++)
+	{
+		[sql[k] release];
+	}
+	[label release];
+	[super dealloc];
+}
+
+// "open:2,param:1" sets those weights and zeroes the rest.
+-(BOOL)parseMix:(const char *)mix
+{
+	double parsed[PGSQLBenchKinds] = { 0, 0, 0 };
+	NSArray *parts = [[NSString stringWithUTF8String:mix] componentsSeparatedByString:@","];
+	for (NSString *part in parts)
+	{
+		NSArray *pair = [part componentsSeparatedByString:@":"];
+		if ([pair count] != 2)
+		{
+			return NO;
+		}
+		int k;
+		for (k = 0; k < PGSQLBenchKinds; k++)
+		{
+			if ([[pair objectAtIndex:0] isEqualToString:[NSString stringWithUTF8String:PGSQLBenchKindNames[k]]])
+			{
+				break;
+			}
+		}
+		if ((k == PGSQLBenchKinds) || ([[pair objectAtIndex:1] doubleValue] < 0))
+		{
+			return NO;
+		}
+		parsed[k] = [[pair objectAtIndex:1] doubleValue];
+	}
+	if (parsed[PGSQLBenchOpen] + parsed[PGSQLBenchExec] + parsed[PGSQLBenchParam] <= 0)
+	{
+		return NO;
+	}
+	memcpy(weights, parsed, sizeof(weights));
+	return YES;
+}
+
+#define PGSQLBenchSet(ivar, value) do { NSString *v = [[NSString alloc] initWithUTF8String:(value)]; [ivar release]; ivar = v; } while (0)
+
+-(BOOL)parseArguments:(int)argc values:(char **)argv
+{
+	int option;
+	while ((option = getopt(argc, argv, "h:p:U:P:d:c:j:T:W:R:m:o:e:q:s:L:J")) != -1)
+	{
+		switch (option)
+		{
+			case 'h':	PGSQLBenchSet(server, optarg); break;
+			case 'p':	PGSQLBenchSet(port, optarg); break;
+			case 'U':	PGSQLBenchSet(userName, optarg); break;
+			case 'P':	PGSQLBenchSet(password, optarg); break;
+			case 'd':	PGSQLBenchSet(databaseName, optarg); break;
+			case 'c':	clients = atoi(optarg); break;
+			case 'j':	threads = atoi(optarg); break;
+			case 'T':	duration = atof(optarg); break;
+			case 'W':	warmup = atof(optarg); break;
+			case 'R':	rate = atof(optarg); break;
+			case 'm':	if (![self parseMix:optarg]) { return NO; } break;
+			case 'o':	PGSQLBenchSet(sql[PGSQLBenchOpen], optarg); break;
+			case 'e':	PGSQLBenchSet(sql[PGSQLBenchExec], optarg); break;
+			case 'q':	PGSQLBenchSet(sql[PGSQLBenchParam], optarg); break;
+			case 's':	seed = strtoull(optarg, NULL, 10); break;
+			case 'L':	PGSQLBenchSet(label, optarg); break;
+			case 'J':	json = YES; break;
+			default:	return NO;
+		}
+	}
+	return ((clients > 0) && (threads > 0) && (duration > 0) && (warmup >= 0) && (rate >= 0));
+}
+
+@end
+
+#pragma mark -
+#pragma mark Connection Pool
+
+// Idle connections, handed to one thread at a time.
+@interface PGSQLBenchPool : NSObject {
+	NSMutableArray *idle;
+	NSCondition *condition;
+}
+-(id)initWithConnections:(NSArray *)connections;
+-(PGSQLConnection *)checkOut;
+-(void)checkIn:(PGSQLConnection *)connection;
+@end
+
+@implementation PGSQLBenchPool
+
+-(id)initWithConnections:(NSArray *)connections
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		idle = [connections mutableCopy];
+		condition = [[NSCondition alloc] init];
+	}
+
+	return self;
+}
+
+-(void)dealloc
+{
+	[idle release];
+	[condition release];
+	[super dealloc];
+}
+
+-(PGSQLConnection *)checkOut
+{
+	[condition lock];
+	while ([idle count] == 0)
+	{
+		[condition wait];
+	}
+	PGSQLConnection *connection = [[idle lastObject] retain];
+	[idle removeLastObject];
+	[condition unlock];
+	return [connection autorelease];
+}
+
+-(void)checkIn:(PGSQLConnection *)connection
+{
+	[condition lock];
+	[idle addObject:connection];
+	[condition signal];
+	[condition unlock];
+}
+
+@end
+
+#pragma mark -
+#pragma mark Worker
+
+@interface PGSQLBenchWorker : NSObject {
+@public
+	PGSQLBenchSettings *settings;
+	PGSQLBenchPool *pool;
+	double measureStart;
+	double measureEnd;
+	double threadRate;			// open loop, this thread's share
+	uint64_t randomState;
+
+	PGSQLBenchSamples latencies;
+	PGSQLBenchSamples kindLatencies[PGSQLBenchKinds];
+	unsigned long errors;
+	unsigned long started;
+
+	NSCondition *finished;
+	int *running;
+}
+-(void)run:(id)unused;
+@end
+
+@implementation PGSQLBenchWorker
+
+-(void)dealloc
+{
+	free(latencies.values);
+	int k;
+	for (k = 0; k < PGSQLBenchKinds; k++)
+	{
+		free(kindLatencies[k].values);
+	}
+	[super dealloc];
+}
+
+-(int)pickKind
+{
+	double total = settings->weights[0] + settings->weights[1] + settings->weights[2];
+	double pick = PGSQLBenchRandom(&randomState) * total;
+	int k;
+	for (k = 0; k < PGSQLBenchKinds - 1; k++)
+	{
+		if (pick <= settings->weights[k])
+		{
+			return k;
+		}
+		pick -= settings->weights[k];
+	}
+	return PGSQLBenchKinds - 1;
+}
+
+-(BOOL)runKind:(int)kind onConnection:(PGSQLConnection *)connection
+{
+	NSString *sql = settings->sql[kind];
+	switch (kind)
+	{
+		case PGSQLBenchOpen:
+		{
+			PGSQLRecordset *rs = [connection open:sql];
+			BOOL succeeded = (rs != nil);
+			[rs close];
+			return succeeded;
+		}
+		case PGSQLBenchExec:
+			return [connection execCommand:sql];
+		default:
+		{
+			NSArray *parameters = [NSArray arrayWithObjects:
+								   [NSNumber numberWithInt:(int)(PGSQLBenchRandom(&randomState) * 1000000)],
+								   [NSNumber numberWithInt:(int)(PGSQLBenchRandom(&randomState) * 1000000)],
+								   nil];
+			return [[connection execute:sql parameters:parameters] succeeded];
+		}
+	}
+}
+
+-(void)run:(id)unused
+{
+	double next = PGSQLBenchNow();
+	for (;;)
+	{
+		NSAutoreleasePool *loopPool = [[NSAutoreleasePool alloc] init];
+
+		// open loop: the scheduled start, however late we are for it
+		double scheduled;
+		if (threadRate > 0)
+		{
+			next += -log(PGSQLBenchRandom(&randomState)) / threadRate;
+			scheduled = next;
+			PGSQLBenchSleepUntil(scheduled);
+		} else {
+			scheduled = PGSQLBenchNow();
+		}
+		if (scheduled >= measureEnd)
+		{
+			[loopPool drain];
+			break;
+		}
+
+		int kind = [self pickKind];
+		PGSQLConnection *connection = [pool checkOut];
+		BOOL succeeded;
+		@try
+		{
+			succeeded = [self runKind:kind onConnection:connection];
+		}
+		@catch (NSException *exception)
+		{
+			succeeded = NO;
+		}
+		double end = PGSQLBenchNow();
+		[pool checkIn:connection];
+
+		if ((scheduled >= measureStart) && (end <= measureEnd))
+		{
+			started++;
+			if (succeeded)
+			{
+				double latency = (end - scheduled) * 1e6;
+				PGSQLBenchAddSample(&latencies, latency);
+				PGSQLBenchAddSample(&kindLatencies[kind], latency);
+			} else {
+				errors++;
+			}
+		}
+		[loopPool drain];
+	}
+
+	[finished lock];
+	(*running)--;
+	[finished signal];
+	[finished unlock];
+}
+
+@end
+
+#pragma mark -
+#pragma mark Report
+
+static void
+PGSQLBenchMerge(PGSQLBenchSamples *into, const PGSQLBenchSamples *from)
+{
+	size_t i;
+	for (i = 0; i < from->count; i++)
+	{
+		PGSQLBenchAddSample(into, from->values[i]);
+	}
+}
+
+static void
+PGSQLBenchReport(PGSQLBenchSettings *settings, NSArray *workers, double cpuSeconds, NSString *serverVersion)
+{
+	PGSQLBenchSamples all = { NULL, 0, 0 };
+	PGSQLBenchSamples kinds[PGSQLBenchKinds];
+	memset(kinds, 0, sizeof(kinds));
+	unsigned long errors = 0;
+	for (PGSQLBenchWorker *worker in workers)
+	{
+		PGSQLBenchMerge(&all, &worker->latencies);
+		int k;
+		for (k = 0; k < PGSQLBenchKinds; k++)
+		{
+			PGSQLBenchMerge(&kinds[k], &worker->kindLatencies[k]);
+		}
+		errors += worker->errors;
+	}
+	qsort(all.values, all.count, sizeof(double), PGSQLBenchCompareDoubles);
+	int k;
+	for (k = 0; k < PGSQLBenchKinds; k++)
+	{
+		qsort(kinds[k].values, kinds[k].count, sizeof(double), PGSQLBenchCompareDoubles);
+	}
+
+	double throughput = all.count / settings->duration;
+	double mean = 0;
+	size_t i;
+	for (i = 0; i < all.count; i++)
+	{
+		mean += all.values[i];
+	}
+	mean = (all.count > 0) ? mean / all.count : 0;
+	double cpuPerQuery = (all.count > 0) ? (cpuSeconds * 1e6) / all.count : 0;
+
+	if (settings->json)
+	{
+		printf("{\"label\":\"%s\",\"server_version\":\"%s\",\"clients\":%d,\"threads\":%d,"
+			   "\"mode\":\"%s\",\"rate\":%.1f,\"duration\":%.1f,\"queries\":%lu,\"errors\":%lu,"
+			   "\"tps\":%.1f,\"latency_us\":{\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p95\":%.1f,"
+			   "\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f},\"cpu_us_per_query\":%.2f",
+			   [settings->label UTF8String], [serverVersion UTF8String], settings->clients, settings->threads,
+			   (settings->rate > 0) ? "open" : "closed", settings->rate, settings->duration,
+			   (unsigned long)all.count, errors, throughput, mean,
+			   PGSQLBenchPercentile(&all, 50), PGSQLBenchPercentile(&all, 90), PGSQLBenchPercentile(&all, 95),
+			   PGSQLBenchPercentile(&all, 99), PGSQLBenchPercentile(&all, 99.9), PGSQLBenchPercentile(&all, 100),
+			   cpuPerQuery);
+		for (k = 0; k < PGSQLBenchKinds; k++)
+		{
+			printf(",\"%s\":{\"queries\":%lu,\"p50\":%.1f,\"p99\":%.1f}", PGSQLBenchKindNames[k],
+				   (unsigned long)kinds[k].count, PGSQLBenchPercentile(&kinds[k], 50), PGSQLBenchPercentile(&kinds[k], 99));
+		}
+		printf("}\n");
+	} else {
+		printf("label:              %s\n", [settings->label UTF8String]);
+		printf("server version:     %s\n", [serverVersion UTF8String]);
+		printf("clients / threads:  %d / %d\n", settings->clients, settings->threads);
+		if (settings->rate > 0)
+		{
+			printf("mode:               open loop, %.1f statements/s\n", settings->rate);
+		} else {
+			printf("mode:               closed loop\n");
+		}
+		printf("duration:           %.1f s after %.1f s warmup\n", settings->duration, settings->warmup);
+		printf("queries:            %lu (%lu errors)\n", (unsigned long)all.count, errors);
+		printf("throughput:         %.1f queries/s\n", throughput);
+		printf("latency (us):       mean %.1f  p50 %.1f  p90 %.1f  p95 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+			   mean, PGSQLBenchPercentile(&all, 50), PGSQLBenchPercentile(&all, 90), PGSQLBenchPercentile(&all, 95),
+			   PGSQLBenchPercentile(&all, 99), PGSQLBenchPercentile(&all, 99.9), PGSQLBenchPercentile(&all, 100));
+		printf("client cpu:         %.2f us/query\n", cpuPerQuery);
+		for (k = 0; k < PGSQLBenchKinds; k++)
+		{
+			printf("  %-6s %10lu queries  p50 %.1f us  p99 %.1f us\n", PGSQLBenchKindNames[k],
+				   (unsigned long)kinds[k].count, PGSQLBenchPercentile(&kinds[k], 50), PGSQLBenchPercentile(&kinds[k], 99));
+		}
+	}
+
+	free(all.values);
+	for (k = 0; k < PGSQLBenchKinds; k++)
+	{
+		free(kinds[k].values);
+	}
+}
+
+#pragma mark -
+#pragma mark Main
+
+int
+main(int argc, char *argv[])
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+	PGSQLBenchSettings *settings = [[[PGSQLBenchSettings alloc] init] autorelease];
+	if (![settings parseArguments:argc values:argv])
+	{
+		fprintf(stderr, "usage: pgsqlbench [-h host] [-p port] [-U user] [-P password] [-d database]\n"
+				"                  [-c clients] [-j threads] [-T seconds] [-W seconds] [-R rate]\n"
+				"                  [-m open:1,exec:1,param:1] [-o sql] [-e sql] [-q sql]\n"
+				"                  [-s seed] [-L label] [-J]\n");
+		[pool drain];
+		return 2;
+	}
+
+	NSMutableArray *connections = [NSMutableArray arrayWithCapacity:settings->clients];
+	int c;
+	for (c = 0; c < settings->clients; c++)
+	{
+		PGSQLConnection *connection = [[[PGSQLConnection alloc] init] autorelease];
+		[connection setServer:settings->server];
+		[connection setPort:settings->port];
+		[connection setUserName:settings->userName];
+		[connection setPassword:settings->password];
+		[connection setDatabaseName:settings->databaseName];
+		if (![connection connect])
+		{
+			fprintf(stderr, "pgsqlbench: client %d could not connect: %s\n", c, [[connection lastError] UTF8String]);
+			[pool drain];
+			return 1;
+		}
+		// the log grows with every statement, which would be measured too
+		[connection setLogsSQL:NO];
+		[connection clearSQLLog];
+		[connections addObject:connection];
+	}
+	NSString *serverVersion = [[connections objectAtIndex:0] parameterStatus:@"server_version"];
+
+	PGSQLBenchPool *benchPool = [[[PGSQLBenchPool alloc] initWithConnections:connections] autorelease];
+	NSCondition *finished = [[[NSCondition alloc] init] autorelease];
+	int running = settings->threads;
+	double start = PGSQLBenchNow();
+	NSMutableArray *workers = [NSMutableArray arrayWithCapacity:settings->threads];
+	int t;
+	for (t = 0; t < settings->threads; t++)
+	{
+		PGSQLBenchWorker *worker = [[[PGSQLBenchWorker alloc] init] autorelease];
+		worker->settings = settings;
+		worker->pool = benchPool;
+		worker->measureStart = start + settings->warmup;
+		worker->measureEnd = start + settings->warmup + settings->duration;
+		worker->threadRate = settings->rate / settings->threads;
+		worker->randomState = (settings->seed * 0x9E3779B97F4A7C15ULL) + t + 1;
+		worker->finished = finished;
+		worker->running = &running;
+		[workers addObject:worker];
+		[NSThread detachNewThreadSelector:@selector(run:) toTarget:worker withObject:nil];
+	}
+
+	// the process's CPU over the measured window, divided among its queries
+	PGSQLBenchSleepUntil(start + settings->warmup);
+	double cpuStart = PGSQLBenchCPUSeconds();
+	PGSQLBenchSleepUntil(start + settings->warmup + settings->duration);
+	double cpuSeconds = PGSQLBenchCPUSeconds() - cpuStart;
+
+	[finished lock];
+	while (running > 0)
+	{
+		[finished wait];
+	}
+	[finished unlock];
+
+	PGSQLBenchReport(settings, workers, cpuSeconds, (serverVersion != nil) ? serverVersion : @"");
+
+	for (PGSQLConnection *connection in connections)
+	{
+		[connection close];
+	}
+	[pool drain];
+	return 0;
+}
@@ -0,0 +1,114 @@
+//
+//  PGSQLBulkMerge.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLBulkMerge
+    @abstract   Synchronizes a table with a feed of rows in a few statements.
+    @discussion Row by row, keeping a table in line with an outside source is
+				an UPDATE and often an INSERT per row, a round trip each.  A
+				bulk merge streams the rows into a temporary staging table
+				with COPY as they are added, and then applies them all at
+				once:
+
+				INSERT INTO table SELECT ... FROM staging
+				ON CONFLICT (key) DO UPDATE SET ...
+
+				optionally followed by a DELETE of the rows whose key was not
+				in the feed.  A million row feed is a COPY and two or three
+				statements.  Servers older than 9.5, which have no ON CONFLICT,
+				get an UPDATE ... FROM followed by an INSERT ... WHERE NOT
+				EXISTS instead, which is also set based but races with other
+				writers inserting the same keys.
+
+				When a key appears more than once in the feed the last row
+				wins.  Rows whose values already match the table are not
+				rewritten.
+*/
+
+#import "PGSQLConnection.h"
+#import "PGSQLMergeResult.h"
+
+/*!
+    @class
+    @abstract    One merge of rows into a table.
+    @discussion  Add rows, then call finish.  From the first row to finish
+				 the connection is locked to the calling thread, and the
+				 merge runs in a transaction of its own unless the connection
+				 already had one open.  A merge is used once.
+*/
+@interface PGSQLBulkMerge : NSObject {
+	PGSQLConnection *connection;
+	NSString *table;
+	NSArray *columns;
+	NSArray *keyColumns;
+	BOOL deletesMissingRows;
+
+	int state;
+	BOOL ownsTransaction;
+	NSString *quotedTable;
+	NSArray *quotedColumns;
+	NSString *stagingTable;
+	NSMutableData *buffer;		// COPY data not yet sent
+	long rowsStaged;
+	NSTimeInterval started;
+	NSString *errorDescription;
+}
+
+/*!
+    @method
+    @abstract   A merge of rows with the given columns into table.
+    @discussion table is resolved as in SQL.  keyColumns must be among
+				columns and be covered by a unique index or constraint of the
+				table, which is what ON CONFLICT matches on.
+*/
+-(id)initWithConnection:(PGSQLConnection *)conn table:(NSString *)tableName
+				columns:(NSArray *)columnNames keyColumns:(NSArray *)keyColumnNames;
+
+/*!
+    @method
+    @abstract   Delete the table's rows whose key is not in the feed.  NO by
+				default.
+    @discussion Makes the table hold exactly the feed's keys, so an empty or
+				truncated feed empties the table.
+*/
+-(BOOL)deletesMissingRows;
+-(void)setDeletesMissingRows:(BOOL)value;
+
+/*!
+    @method
+    @abstract   Stage one row, its values in the order of columns.
+    @discussion Values are written as execute:parameters: binds them: NSNull
+				for NULL, NSData as bytea, dictionaries and arrays as JSON and
+				anything else as its description.  Rows are sent to the
+				server in batches as they are added.  Returns NO if the merge
+				has failed, the error is reported by finish.
+*/
+-(BOOL)addRow:(NSArray *)values;
+/*!
+    @method
+    @abstract   Stage one row from a dictionary keyed by column name.
+    @discussion Columns missing from dict stage as NULL, keys that are not
+				columns of the merge are ignored.
+*/
+-(BOOL)addRowFromDictionary:(NSDictionary *)dict;
+
+/*!
+    @method
+    @abstract   Apply the staged rows and unlock the connection.
+*/
+-(PGSQLMergeResult *)finish;
+
+/*!
+    @method
+    @abstract   Give up on the merge without applying anything, and unlock the
+				connection.
+*/
+-(void)abort;
+
+-(long)rowsStaged;
+
+@end
@@ -0,0 +1,551 @@
+//
+//  PGSQLBulkMerge.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLBulkMerge.h"
+#import "PGSQLCommandResult.h"
+#import "PGSQLCatalog.h"
+#import <sys/time.h>
+
+// COPY data is sent whenever this much has built up.
+#define PGSQLMergeFlushBytes	(256 * 1024)
+
+enum {
+	PGSQLMergeIdle = 0,
+	PGSQLMergeStaging,
+	PGSQLMergeFinished,
+	PGSQLMergeFailed
+};
+
+static NSTimeInterval
+PGSQLMergeNow(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+// Appends bytes to COPY text data, escaping what COPY treats as special.
+static void
+PGSQLAppendCopyText(NSMutableData *buffer, const char *bytes, NSUInteger length)
+{
+	NSUInteger start = 0;
+	NSUInteger i;
+	for (i = 0; i < length; i++)
+	{
+		const char *escape;
+		switch (bytes[i])
+		{
+			case '\\':	escape = "\\\\"; break;
+			case '\t':	escape = "\\t"; break;
+			case '\n':	escape = "\\n"; break;
+			case '\r':	escape = "\\r"; break;
+			default:	continue;
+		}
+		[buffer appendBytes:bytes + start length:i - start];
+		[buffer appendBytes:escape length:2];
+		start = i + 1;
+	}
+	[buffer appendBytes:bytes + start length:length - start];
+}
+
+static void
+PGSQLAppendCopyValue(NSMutableData *buffer, id value, NSStringEncoding encoding)
+{
+	if ((value == nil) || (value == [NSNull null]))
+	{
+		[buffer appendBytes:"\\N" length:2];
+		return;
+	}
+
+	if ([value isKindOfClass:[NSData class]])
+	{
+		// bytea hex format, its backslash escaped for COPY
+		static const char hex[] = "0123456789abcdef";
+		const unsigned char *bytes = [value bytes];
+		NSUInteger length = [value length];
+		NSUInteger offset = [buffer length];
+		[buffer appendBytes:"\\\\x" length:3];
+		[buffer increaseLengthBy:length * 2];
+		char *out = (char *)[buffer mutableBytes] + offset + 3;
+		NSUInteger i;
+		for (i = 0; i < length; i++)
+		{
+			out[i * 2] = hex[bytes[i] >> 4];
+			out[i * 2 + 1] = hex[bytes[i] & 0x0f];
+		}
+		return;
+	}
+
+	if (([value isKindOfClass:[NSDictionary class]] || [value isKindOfClass:[NSArray class]]) &&
+		[NSJSONSerialization isValidJSONObject:value])
+	{
+		NSData *json = [NSJSONSerialization dataWithJSONObject:value options:0 error:NULL];
+		PGSQLAppendCopyText(buffer, [json bytes], [json length]);
+		return;
+	}
+
+	NSString *text = [value description];
+	const char *bytes = (encoding == NSUTF8StringEncoding) ? [text UTF8String] : [text cStringUsingEncoding:encoding];
+	if (bytes == NULL)
+	{
+		bytes = [text UTF8String];
+	}
+	PGSQLAppendCopyText(buffer, bytes, strlen(bytes));
+}
+
+@interface PGSQLBulkMerge (Private)
+
+- (BOOL)start;
+- (BOOL)flush;
+- (void)failWithError:(NSString *)error;
+- (NSString *)keyMatch:(NSString *)left with:(NSString *)right;
+- (NSString *)deduplicatedRows;
+- (BOOL)applyWithUpsert:(long *)inserted updated:(long *)updated;
+- (BOOL)applyWithUpdateAndInsert:(long *)inserted updated:(long *)updated;
+
+@end
+
+@implementation PGSQLBulkMerge
+
+-(id)initWithConnection:(PGSQLConnection *)conn table:(NSString *)tableName
+				columns:(NSArray *)columnNames keyColumns:(NSArray *)keyColumnNames
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		connection = [conn retain];
+		table = [tableName copy];
+		columns = [columnNames copy];
+		keyColumns = [keyColumnNames copy];
+		deletesMissingRows = NO;
+		state = PGSQLMergeIdle;
+		buffer = [[NSMutableData alloc] initWithCapacity:PGSQLMergeFlushBytes + 4096];
+	}
+	return self;
+}
+
+-(void)dealloc
+{
+	if (state == PGSQLMergeStaging)
+	{
+		[self abort];
+	}
+	[connection release];
+	[table release];
+	[columns release];
+	[keyColumns release];
+	[quotedTable release];
+	[quotedColumns release];
+	[stagingTable release];
+	[buffer release];
+	[errorDescription release];
+	[super dealloc];
+}
+
+-(BOOL)addRow:(NSArray *)values
+{
+	if ((state == PGSQLMergeIdle) && ![self start])
+	{
+		return NO;
+	}
+	if (state != PGSQLMergeStaging)
+	{
+		return NO;
+	}
+	if ([values count] != [columns count])
+	{
+		NSString *error = [NSString stringWithFormat:@"A row of %lu values was added to a merge of %lu columns.",
+						   (unsigned long)[values count], (unsigned long)[columns count]];
+		[connection endCopyIn:error];
+		[self failWithError:error];
+		return NO;
+	}
+
+	NSStringEncoding encoding = [connection defaultEncoding];
+	NSUInteger i;
+	for (i = 0; i < [values count]; i++)
+	{
+		if (i > 0)
+		{
+			[buffer appendBytes:"\t" length:1];
+		}
+		PGSQLAppendCopyValue(buffer, [values objectAtIndex:i], encoding);
+	}
+	[buffer appendBytes:"\n" length:1];
+	rowsStaged++;
+
+	if ([buffer length] >= PGSQLMergeFlushBytes)
+	{
+		return [self flush];
+	}
+	return YES;
+}
+
+-(BOOL)addRowFromDictionary:(NSDictionary *)dict
+{
+	NSMutableArray *values = [NSMutableArray arrayWithCapacity:[columns count]];
+	NSUInteger i;
+	for (i = 0; i < [columns count]; i++)
+	{
+		id value = [dict objectForKey:[columns objectAtIndex:i]];
+		[values addObject:(value != nil) ? value : [NSNull null]];
+	}
+	return [self addRow:values];
+}
+
+-(PGSQLMergeResult *)finish
+{
+	if ((state == PGSQLMergeIdle) && ![self start])
+	{
+		return [[[PGSQLMergeResult alloc] initWithError:errorDescription staged:rowsStaged
+										  executionTime:PGSQLMergeNow() - started] autorelease];
+	}
+	if (state != PGSQLMergeStaging)
+	{
+		NSString *error = (errorDescription != nil) ? errorDescription : @"The merge has already finished.";
+		return [[[PGSQLMergeResult alloc] initWithError:error staged:rowsStaged executionTime:0] autorelease];
+	}
+
+	if (![self flush])
+	{
+		return [[[PGSQLMergeResult alloc] initWithError:errorDescription staged:rowsStaged
+										  executionTime:PGSQLMergeNow() - started] autorelease];
+	}
+	PGSQLCommandResult *copy = [connection endCopyIn:nil];
+	if (![copy succeeded])
+	{
+		[self failWithError:[copy lastError]];
+		return [[[PGSQLMergeResult alloc] initWithError:errorDescription staged:rowsStaged
+										  executionTime:PGSQLMergeNow() - started] autorelease];
+	}
+
+	long inserted = 0;
+	long updated = 0;
+	long deleted = 0;
+	BOOL applied = ([[connection catalog] serverVersion] >= 90500)
+		? [self applyWithUpsert:&inserted updated:&updated]
+		: [self applyWithUpdateAndInsert:&inserted updated:&updated];
+
+	if (applied && deletesMissingRows)
+	{
+		PGSQLCommandResult *result = [connection execute:[NSString stringWithFormat:
+			@"DELETE FROM %@ AS pgsqlkit_t WHERE NOT EXISTS (SELECT 1 FROM %@ AS pgsqlkit_s WHERE %@)",
+			quotedTable, stagingTable, [self keyMatch:@"pgsqlkit_s" with:@"pgsqlkit_t"]]];
+		applied = [result succeeded];
+		deleted = [result rowsAffected];
+	}
+	if (applied)
+	{
+		applied = [[connection execute:[NSString stringWithFormat:@"DROP TABLE IF EXISTS %@", stagingTable]] succeeded];
+	}
+	if (applied && ownsTransaction)
+	{
+		PGSQLCommandResult *commit = [connection execute:@"COMMIT"];
+		applied = ([commit succeeded] && [[commit lastCmdStatus] isEqualToString:@"COMMIT"]);
+		ownsTransaction = NO;
+	}
+	if (!applied)
+	{
+		[self failWithError:[connection lastError]];
+		return [[[PGSQLMergeResult alloc] initWithError:errorDescription staged:rowsStaged
+										  executionTime:PGSQLMergeNow() - started] autorelease];
+	}
+
+	state = PGSQLMergeFinished;
+	[connection unlock];
+	return [[[PGSQLMergeResult alloc] initWithStaged:rowsStaged inserted:inserted updated:updated
+											 deleted:deleted executionTime:PGSQLMergeNow() - started] autorelease];
+}
+
+-(void)abort
+{
+	if (state == PGSQLMergeStaging)
+	{
+		// staging always has the COPY open
+		[buffer setLength:0];
+		[connection endCopyIn:@"The merge was aborted."];
+		[self failWithError:@"The merge was aborted."];
+	} else if (state == PGSQLMergeIdle) {
+		state = PGSQLMergeFailed;
+	}
+}
+
+#pragma mark -
+#pragma mark Simple Accessors
+
+-(BOOL)deletesMissingRows
+{
+	return deletesMissingRows;
+}
+
+-(void)setDeletesMissingRows:(BOOL)value
+{
+	deletesMissingRows = value;
+}
+
+-(long)rowsStaged
+{
+	return rowsStaged;
+}
+
+@end
+
+@implementation PGSQLBulkMerge (Private)
+
+// Locks the connection, opens the transaction, creates the staging table
+// and starts the COPY into it.
+- (BOOL)start
+{
+	static unsigned long stagingCounter = 0;
+
+	started = PGSQLMergeNow();
+	if ([keyColumns count] == 0)
+	{
+		state = PGSQLMergeFailed;
+		errorDescription = [@"A merge needs at least one key column." retain];
+		return NO;
+	}
+	NSUInteger i;
+	for (i = 0; i < [keyColumns count]; i++)
+	{
+		if (![columns containsObject:[keyColumns objectAtIndex:i]])
+		{
+			state = PGSQLMergeFailed;
+			errorDescription = [[NSString alloc] initWithFormat:@"Key column %@ is not one of the merged columns.",
+								[keyColumns objectAtIndex:i]];
+			return NO;
+		}
+	}
+
+	[connection lock];
+	state = PGSQLMergeStaging;
+	if (![connection isInTransaction])
+	{
+		if (![[connection execute:@"BEGIN"] succeeded])
+		{
+			[self failWithError:[connection lastError]];
+			return NO;
+		}
+		ownsTransaction = YES;
+	}
+
+	PGSQLCommandResult *result = [connection execute:@"SELECT $1::regclass::text"
+										  parameters:[NSArray arrayWithObject:table]];
+	if (![result succeeded])
+	{
+		[self failWithError:[result lastError]];
+		return NO;
+	}
+	quotedTable = [[[[[result recordset] moveFirst] fieldByIndex:0] asString] copy];
+	[[result recordset] close];
+
+	NSMutableArray *quoted = [NSMutableArray arrayWithCapacity:[columns count]];
+	for (i = 0; i < [columns count]; i++)
+	{
+		[quoted addObject:[connection sqlQuoteIdentifier:[columns objectAtIndex:i]]];
+	}
+	quotedColumns = [quoted copy];
+
+	@synchronized ([PGSQLBulkMerge class])
+	{
+		stagingCounter++;
+		stagingTable = [[NSString alloc] initWithFormat:@"pgsqlkit_merge_%lu", stagingCounter];
+	}
+
+	// the staging table takes the target's column types, and pgsqlkit_row
+	// numbers the rows in the order they came so the last of a key can win
+	NSString *columnList = [quotedColumns componentsJoinedByString:@", "];
+	if (![[connection execute:[NSString stringWithFormat:@"CREATE TEMP TABLE %@ ON COMMIT DROP AS SELECT %@ FROM %@ LIMIT 0",
+							   stagingTable, columnList, quotedTable]] succeeded] ||
+		![[connection execute:[NSString stringWithFormat:@"ALTER TABLE %@ ADD COLUMN pgsqlkit_row bigserial",
+							   stagingTable]] succeeded])
+	{
+		[self failWithError:[connection lastError]];
+		return NO;
+	}
+
+	if (![connection beginCopyIn:[NSString stringWithFormat:@"COPY %@ (%@) FROM STDIN", stagingTable, columnList]])
+	{
+		[self failWithError:[connection lastError]];
+		return NO;
+	}
+	// beginCopyIn: takes the lock again, endCopyIn: gives that back
+	return YES;
+}
+
+- (BOOL)flush
+{
+	if ([buffer length] == 0)
+	{
+		return YES;
+	}
+	if (![connection putCopyData:buffer])
+	{
+		NSString *error = [connection lastError];
+		[connection endCopyIn:error];
+		[self failWithError:error];
+		return NO;
+	}
+	[buffer setLength:0];
+	return YES;
+}
+
+// Rolls back what the merge did and lets go of the connection.  Call with
+// the COPY, if one was started, already ended.
+- (void)failWithError:(NSString *)error
+{
+	if (state != PGSQLMergeStaging)
+	{
+		return;
+	}
+	if (errorDescription == nil)
+	{
+		errorDescription = [error copy];
+	}
+	state = PGSQLMergeFailed;
+	[buffer setLength:0];
+
+	if (ownsTransaction)
+	{
+		[connection execute:@"ROLLBACK"];
+		ownsTransaction = NO;
+	} else if (stagingTable != nil && ![connection isInTransaction]) {
+		[connection execute:[NSString stringWithFormat:@"DROP TABLE IF EXISTS %@", stagingTable]];
+	}
+	[connection unlock];
+}
+
+- (NSString *)keyMatch:(NSString *)left with:(NSString *)right
+{
+	NSMutableArray *conditions = [NSMutableArray arrayWithCapacity:[keyColumns count]];
+	NSUInteger i;
+	for (i = 0; i < [keyColumns count]; i++)
+	{
+		NSString *key = [quotedColumns objectAtIndex:[columns indexOfObject:[keyColumns objectAtIndex:i]]];
+		[conditions addObject:[NSString stringWithFormat:@"%@.%@ = %@.%@", left, key, right, key]];
+	}
+	return [conditions componentsJoinedByString:@" AND "];
+}
+
+// The staged rows with only the last one of each key.
+- (NSString *)deduplicatedRows
+{
+	NSMutableArray *keys = [NSMutableArray arrayWithCapacity:[keyColumns count]];
+	NSUInteger i;
+	for (i = 0; i < [keyColumns count]; i++)
+	{
+		[keys addObject:[quotedColumns objectAtIndex:[columns indexOfObject:[keyColumns objectAtIndex:i]]]];
+	}
+	NSString *keyList = [keys componentsJoinedByString:@", "];
+	return [NSString stringWithFormat:@"SELECT DISTINCT ON (%@) %@ FROM %@ ORDER BY %@, pgsqlkit_row DESC",
+			keyList, [quotedColumns componentsJoinedByString:@", "], stagingTable, keyList];
+}
+
+// One INSERT ... ON CONFLICT.  A row the INSERT wrote has no xmax, one the
+// UPDATE wrote carries the updating transaction's, which is how the two
+// are counted apart.
+- (BOOL)applyWithUpsert:(long *)inserted updated:(long *)updated
+{
+	NSMutableArray *keys = [NSMutableArray array];
+	NSMutableArray *assignments = [NSMutableArray array];
+	NSMutableArray *current = [NSMutableArray array];
+	NSMutableArray *excluded = [NSMutableArray array];
+	NSUInteger i;
+	for (i = 0; i < [columns count]; i++)
+	{
+		NSString *column = [quotedColumns objectAtIndex:i];
+		if ([keyColumns containsObject:[columns objectAtIndex:i]])
+		{
+			[keys addObject:column];
+			continue;
+		}
+		[assignments addObject:[NSString stringWithFormat:@"%@ = EXCLUDED.%@", column, column]];
+		[current addObject:[NSString stringWithFormat:@"pgsqlkit_t.%@", column]];
+		[excluded addObject:[NSString stringWithFormat:@"EXCLUDED.%@", column]];
+	}
+
+	NSString *action = @"DO NOTHING";
+	if ([assignments count] > 0)
+	{
+		action = [NSString stringWithFormat:@"DO UPDATE SET %@ WHERE ROW(%@) IS DISTINCT FROM ROW(%@)",
+				  [assignments componentsJoinedByString:@", "],
+				  [current componentsJoinedByString:@", "], [excluded componentsJoinedByString:@", "]];
+	}
+
+	NSString *columnList = [quotedColumns componentsJoinedByString:@", "];
+	NSString *sql = [NSString stringWithFormat:
+		@"WITH pgsqlkit_merged AS (INSERT INTO %@ AS pgsqlkit_t (%@) SELECT %@ FROM (%@) AS pgsqlkit_s "
+		@"ON CONFLICT (%@) %@ RETURNING (pgsqlkit_t.xmax = 0) AS inserted) "
+		@"SELECT coalesce(sum(CASE WHEN inserted THEN 1 ELSE 0 END), 0), "
+		@"coalesce(sum(CASE WHEN inserted THEN 0 ELSE 1 END), 0) FROM pgsqlkit_merged",
+		quotedTable, columnList, columnList, [self deduplicatedRows],
+		[keys componentsJoinedByString:@", "], action];
+
+	PGSQLCommandResult *result = [connection execute:sql];
+	if (![result succeeded])
+	{
+		return NO;
+	}
+	PGSQLRecord *record = [[result recordset] moveFirst];
+	*inserted = [[record fieldByIndex:0] asLong];
+	*updated = [[record fieldByIndex:1] asLong];
+	[[result recordset] close];
+	return YES;
+}
+
+// Servers without ON CONFLICT: an UPDATE of the keys that exist, then an
+// INSERT of the ones that do not.  Both are set based, but a row another
+// session inserts between the two fails the INSERT on its unique key.
+- (BOOL)applyWithUpdateAndInsert:(long *)inserted updated:(long *)updated
+{
+	NSMutableArray *assignments = [NSMutableArray array];
+	NSMutableArray *current = [NSMutableArray array];
+	NSMutableArray *incoming = [NSMutableArray array];
+	NSUInteger i;
+	for (i = 0; i < [columns count]; i++)
+	{
+		if ([keyColumns containsObject:[columns objectAtIndex:i]])
+		{
+			continue;
+		}
+		NSString *column = [quotedColumns objectAtIndex:i];
+		[assignments addObject:[NSString stringWithFormat:@"%@ = pgsqlkit_s.%@", column, column]];
+		[current addObject:[NSString stringWithFormat:@"pgsqlkit_t.%@", column]];
+		[incoming addObject:[NSString stringWithFormat:@"pgsqlkit_s.%@", column]];
+	}
+
+	*updated = 0;
+	if ([assignments count] > 0)
+	{
+		PGSQLCommandResult *result = [connection execute:[NSString stringWithFormat:
+			@"UPDATE %@ AS pgsqlkit_t SET %@ FROM (%@) AS pgsqlkit_s WHERE %@ AND ROW(%@) IS DISTINCT FROM ROW(%@)",
+			quotedTable, [assignments componentsJoinedByString:@", "], [self deduplicatedRows],
+			[self keyMatch:@"pgsqlkit_t" with:@"pgsqlkit_s"],
+			[current componentsJoinedByString:@", "], [incoming componentsJoinedByString:@", "]]];
+		if (![result succeeded])
+		{
+			return NO;
+		}
+		*updated = [result rowsAffected];
+	}
+
+	NSString *columnList = [quotedColumns componentsJoinedByString:@", "];
+	PGSQLCommandResult *result = [connection execute:[NSString stringWithFormat:
+		@"INSERT INTO %@ (%@) SELECT %@ FROM (%@) AS pgsqlkit_s "
+		@"WHERE NOT EXISTS (SELECT 1 FROM %@ AS pgsqlkit_t WHERE %@)",
+		quotedTable, columnList, columnList, [self deduplicatedRows],
+		quotedTable, [self keyMatch:@"pgsqlkit_t" with:@"pgsqlkit_s"]]];
+	if (![result succeeded])
+	{
+		return NO;
+	}
+	*inserted = [result rowsAffected];
+	return YES;
+}
+
+@end
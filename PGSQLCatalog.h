@@ -0,0 +1,171 @@
+//
+//  PGSQLCatalog.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLCatalog
+    @abstract   What the kit knows about a server's types and settings.
+    @discussion A result only carries the OID of each column's type.  The
+				catalog maps those OIDs to pg_type entries, with the element
+				type of arrays, the labels of enums and the attributes of
+				composite types, so a decoder can tell what a column holds
+				without asking the server.  It also keeps the server's version
+				and the ParameterStatus values reported when it was loaded.
+
+				A catalog is loaded by the first connection that asks for one
+				and shared by every later connection to the same host, port
+				and database, so the catalog queries run once per server for
+				the life of the process.  Once loaded it never changes, and
+				can be read from any thread.  Types created afterwards are not
+				seen until the catalog is reloaded, see
+				-[PGSQLConnection reloadCatalog].
+*/
+
+#import <Foundation/Foundation.h>
+
+@class PGSQLConnection;
+
+/*!
+    @class
+    @abstract    One pg_type entry.
+*/
+@interface PGSQLType : NSObject {
+	unsigned int oid;
+	NSString *name;
+	NSString *schemaName;
+	char typeType;			// typtype: b base, c composite, d domain, e enum, p pseudo
+	char category;			// typcategory: A array, B boolean, N numeric, S string ...
+	int length;				// typlen, -1 for varlena
+	unsigned int elementOID;
+	unsigned int arrayOID;
+	unsigned int relationOID;
+	unsigned int baseOID;
+
+	NSArray *enumLabels;
+	NSArray *attributeNames;
+	NSArray *attributeTypes;
+}
+
+-(unsigned int)oid;
+-(NSString *)name;
+-(NSString *)schemaName;
+-(char)typeType;
+-(char)category;
+-(int)length;
+// The type of an array's elements, 0 for anything not an array.
+-(unsigned int)elementOID;
+// The array type over this type, 0 if it has none.
+-(unsigned int)arrayOID;
+// The type a domain is over, 0 for anything not a domain.
+-(unsigned int)baseOID;
+
+-(BOOL)isArray;
+-(BOOL)isEnum;
+-(BOOL)isComposite;
+-(BOOL)isDomain;
+
+// An enum's labels in their sort order, nil for other types.
+-(NSArray *)enumLabels;
+// A composite type's attribute names, and their type OIDs as NSNumbers, in
+// attribute order.  nil for other types, and for table row types.
+-(NSArray *)attributeNames;
+-(NSArray *)attributeTypes;
+
+@end
+
+/*!
+    @class
+    @abstract    A server's type catalog and settings.
+    @discussion  Get one from -[PGSQLConnection catalog].
+*/
+@interface PGSQLCatalog : NSObject {
+	NSString *serverKey;
+	NSDictionary *typesByOID;
+	NSDictionary *typesByName;
+	NSDictionary *parameterStatuses;
+	NSString *versionString;
+	int serverVersion;
+}
+
+/*!
+    @method
+    @abstract   The shared catalog for the connection's server, loading it
+				over the connection if no connection to that server has yet.
+    @result     nil if the connection is closed or the catalog queries fail,
+				the connection's lastError says why.
+*/
++(PGSQLCatalog *)catalogForConnection:(PGSQLConnection *)connection;
+
+/*!
+    @method
+    @abstract   The shared catalog for the connection's server, or nil if none
+				has been loaded.  Never queries the server.
+*/
++(PGSQLCatalog *)cachedCatalogForConnection:(PGSQLConnection *)connection;
+
+/*!
+    @method
+    @abstract   Forget every shared catalog, so each is loaded again on its
+				next use.  Catalogs already handed out are unaffected.
+*/
++(void)removeAllCatalogs;
+
+/*!
+    @method
+    @abstract   Forget the shared catalog for the connection's server.
+*/
++(void)removeCatalogForConnection:(PGSQLConnection *)connection;
+
+/*!
+    @method
+    @abstract   The pg_type entry for an OID, nil if unknown.
+*/
+-(PGSQLType *)typeWithOID:(unsigned int)typeOID;
+
+/*!
+    @method
+    @abstract   The pg_type entry for a type name, optionally schema
+				qualified.
+    @discussion An unqualified name prefers pg_catalog, then any schema.
+*/
+-(PGSQLType *)typeNamed:(NSString *)typeName;
+
+/*!
+    @method
+    @abstract   Every type in the catalog.
+*/
+-(NSArray *)types;
+
+/*!
+    @method
+    @abstract   A ParameterStatus value as the server reported it to the
+				connection that loaded the catalog.
+    @discussion Holds only the values that are the same for every session:
+				server_version, server_encoding and integer_datetimes.  Read
+				per-session ones, such as client_encoding, DateStyle or
+				TimeZone, with -[PGSQLConnection parameterStatus:].
+*/
+-(NSString *)parameterStatus:(NSString *)parameterName;
+-(NSDictionary *)parameterStatuses;
+
+/*!
+    @method
+    @abstract   The server's version() string.
+*/
+-(NSString *)versionString;
+/*!
+    @method
+    @abstract   The server's version as a number, as PQserverVersion has
+				it: 90001 for 9.0.1, 100005 for 10.5.
+*/
+-(int)serverVersion;
+/*!
+    @method
+    @abstract   Whether timestamps are sent as 64 bit integers in binary.
+*/
+-(BOOL)hasIntegerDatetimes;
+
+@end
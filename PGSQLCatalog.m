@@ -0,0 +1,454 @@
+//
+//  PGSQLCatalog.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLCatalog.h"
+#import "PGSQLConnection.h"
+
+// The ParameterStatus values a catalog keeps.  Only ones fixed for the
+// server, since the catalog is shared by every connection to it.
+static const char *PGSQLCatalogParameters[] = {
+	"server_version", "server_encoding", "integer_datetimes", NULL
+};
+
+static NSMutableDictionary *sharedCatalogs = nil;
+static NSLock *sharedCatalogsLock = nil;
+
+@interface PGSQLType (Private)
+
+-(id)initWithRecord:(PGSQLRecord *)record;
+-(void)setEnumLabels:(NSArray *)labels;
+-(void)setAttributeNames:(NSArray *)names types:(NSArray *)typeOIDs;
+
+@end
+
+@interface PGSQLCatalog (Private)
+
++(NSLock *)sharedCatalogsLock;
+-(id)initWithConnection:(PGSQLConnection *)connection key:(NSString *)key;
+
+@end
+
+@implementation PGSQLType
+
+// record is a row of the pg_type query in initWithConnection:key:
+-(id)initWithRecord:(PGSQLRecord *)record
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		oid = (unsigned int)strtoul([[[record fieldByIndex:0] asString] UTF8String], NULL, 10);
+		name = [[[record fieldByIndex:1] asString] copy];
+		schemaName = [[[record fieldByIndex:2] asString] copy];
+		typeType = [[[record fieldByIndex:3] asString] UTF8String][0];
+		category = [[[record fieldByIndex:4] asString] UTF8String][0];
+		length = (int)[[record fieldByIndex:5] asLong];
+		elementOID = (unsigned int)strtoul([[[record fieldByIndex:6] asString] UTF8String], NULL, 10);
+		arrayOID = (unsigned int)strtoul([[[record fieldByIndex:7] asString] UTF8String], NULL, 10);
+		relationOID = (unsigned int)strtoul([[[record fieldByIndex:8] asString] UTF8String], NULL, 10);
+		baseOID = (unsigned int)strtoul([[[record fieldByIndex:9] asString] UTF8String], NULL, 10);
+	}
+	return self;
+}
+
+-(void)dealloc
+{
+	[name release];
+	[schemaName release];
+	[enumLabels release];
+	[attributeNames release];
+	[attributeTypes release];
+	[super dealloc];
+}
+
+-(void)setEnumLabels:(NSArray *)labels
+{
+	[enumLabels release];
+	enumLabels = [labels copy];
+}
+
+-(void)setAttributeNames:(NSArray *)names types:(NSArray *)typeOIDs
+{
+	[attributeNames release];
+	attributeNames = [names copy];
+	[attributeTypes release];
+	attributeTypes = [typeOIDs copy];
+}
+
+-(NSString *)description
+{
+	return [NSString stringWithFormat:@"%@.%@ (%u)", schemaName, name, oid];
+}
+
+#pragma mark -
+#pragma mark Simple Accessors
+
+-(unsigned int)oid
+{
+	return oid;
+}
+
+-(NSString *)name
+{
+	return name;
+}
+
+-(NSString *)schemaName
+{
+	return schemaName;
+}
+
+-(char)typeType
+{
+	return typeType;
+}
+
+-(char)category
+{
+	return category;
+}
+
+-(int)length
+{
+	return length;
+}
+
+-(unsigned int)elementOID
+{
+	// typelem is also set on fixed length types such as point and name,
+	// which are not arrays
+	return [self isArray] ? elementOID : 0;
+}
+
+-(unsigned int)arrayOID
+{
+	return arrayOID;
+}
+
+-(unsigned int)baseOID
+{
+	return baseOID;
+}
+
+-(BOOL)isArray
+{
+	return ((elementOID != 0) && (length == -1));
+}
+
+-(BOOL)isEnum
+{
+	return (typeType == 'e');
+}
+
+-(BOOL)isComposite
+{
+	return (typeType == 'c');
+}
+
+-(BOOL)isDomain
+{
+	return (typeType == 'd');
+}
+
+-(NSArray *)enumLabels
+{
+	return enumLabels;
+}
+
+-(NSArray *)attributeNames
+{
+	return attributeNames;
+}
+
+-(NSArray *)attributeTypes
+{
+	return attributeTypes;
+}
+
+@end
+
+@implementation PGSQLCatalog
+
++(NSLock *)sharedCatalogsLock
+{
+	@synchronized(self)
+	{
+		if (sharedCatalogsLock == nil)
+		{
+			sharedCatalogsLock = [[NSLock alloc] init];
+			sharedCatalogs = [[NSMutableDictionary alloc] init];
+		}
+	}
+	return sharedCatalogsLock;
+}
+
++(PGSQLCatalog *)cachedCatalogForConnection:(PGSQLConnection *)connection
+{
+	NSString *key = [connection serverIdentity];
+	if (key == nil)
+	{
+		return nil;
+	}
+
+	NSLock *lock = [self sharedCatalogsLock];
+	[lock lock];
+	PGSQLCatalog *catalog = [[sharedCatalogs objectForKey:key] retain];
+	[lock unlock];
+
+	return [catalog autorelease];
+}
+
++(PGSQLCatalog *)catalogForConnection:(PGSQLConnection *)connection
+{
+	PGSQLCatalog *catalog = [self cachedCatalogForConnection:connection];
+	if (catalog != nil)
+	{
+		return catalog;
+	}
+
+	NSString *key = [connection serverIdentity];
+	if (key == nil)
+	{
+		return nil;
+	}
+
+	// loaded without the lock so a slow server does not hold up lookups for
+	// the others.  Two connections racing to load the same server both
+	// query it, and the first to finish is the one kept.
+	catalog = [[[PGSQLCatalog alloc] initWithConnection:connection key:key] autorelease];
+	if (catalog == nil)
+	{
+		return nil;
+	}
+
+	NSLock *lock = [self sharedCatalogsLock];
+	[lock lock];
+	PGSQLCatalog *existing = [sharedCatalogs objectForKey:key];
+	if (existing != nil)
+	{
+		catalog = [[existing retain] autorelease];
+	} else {
+		[sharedCatalogs setObject:catalog forKey:key];
+	}
+	[lock unlock];
+
+	return catalog;
+}
+
++(void)removeAllCatalogs
+{
+	NSLock *lock = [self sharedCatalogsLock];
+	[lock lock];
+	[sharedCatalogs removeAllObjects];
+	[lock unlock];
+}
+
++(void)removeCatalogForConnection:(PGSQLConnection *)connection
+{
+	NSString *key = [connection serverIdentity];
+	if (key == nil)
+	{
+		return;
+	}
+
+	NSLock *lock = [self sharedCatalogsLock];
+	[lock lock];
+	[sharedCatalogs removeObjectForKey:key];
+	[lock unlock];
+}
+
+-(id)initWithConnection:(PGSQLConnection *)connection key:(NSString *)key
+{
+	self = [super init];
+
+	if (self == nil)
+	{
+		return nil;
+	}
+
+	serverKey = [key copy];
+
+	// every type, with what is needed to decode it.  Enum labels and the
+	// attributes of free standing composite types come next, table row types
+	// are left out as there is one for every table.
+	PGSQLCommandResult *result = [connection execute:@"SELECT t.oid, t.typname, n.nspname, t.typtype, t.typcategory, t.typlen, "
+								  @"t.typelem, t.typarray, t.typrelid, t.typbasetype "
+								  @"FROM pg_catalog.pg_type t JOIN pg_catalog.pg_namespace n ON n.oid = t.typnamespace"
+										  parameters:nil];
+	if (![result succeeded])
+	{
+		[self release];
+		return nil;
+	}
+
+	PGSQLRecordset *rs = [result recordset];
+	NSMutableDictionary *byOID = [[NSMutableDictionary alloc] initWithCapacity:[rs recordCount]];
+	NSMutableDictionary *byName = [[NSMutableDictionary alloc] initWithCapacity:[rs recordCount]];
+	[rs enumerateRowsUsingBlock:^(PGSQLRecord *record, long rowIndex, BOOL *stop) {
+		PGSQLType *type = [[PGSQLType alloc] initWithRecord:record];
+		[byOID setObject:type forKey:[NSNumber numberWithUnsignedInt:[type oid]]];
+
+		[byName setObject:type forKey:[NSString stringWithFormat:@"%@.%@", [type schemaName], [type name]]];
+		if (([byName objectForKey:[type name]] == nil) || [[type schemaName] isEqualToString:@"pg_catalog"])
+		{
+			[byName setObject:type forKey:[type name]];
+		}
+		[type release];
+	}];
+	[rs close];
+
+	// the version first, the queries below depend on it
+	result = [connection execute:@"SELECT version(), current_setting('server_version_num')" parameters:nil];
+	if ([result succeeded] && ([[result recordset] recordCount] > 0))
+	{
+		versionString = [[[[result recordset] fieldByIndex:0] asString] copy];
+		serverVersion = [[[[result recordset] fieldByIndex:1] asString] intValue];
+		[[result recordset] close];
+	}
+
+	NSMutableDictionary *statuses = [[NSMutableDictionary alloc] init];
+	int i;
+	for (i = 0; PGSQLCatalogParameters[i] != NULL; i++)
+	{
+		NSString *parameterName = [NSString stringWithUTF8String:PGSQLCatalogParameters[i]];
+		NSString *value = [connection parameterStatus:parameterName];
+		if (value != nil)
+		{
+			[statuses setObject:value forKey:parameterName];
+		}
+	}
+	parameterStatuses = statuses;
+
+	// enumsortorder came with ALTER TYPE ... ADD VALUE in 9.1; before that
+	// labels are in the order of their oids
+	NSString *enumSQL = ([self serverVersion] >= 90100)
+		? @"SELECT enumtypid, enumlabel FROM pg_catalog.pg_enum ORDER BY enumtypid, enumsortorder"
+		: @"SELECT enumtypid, enumlabel FROM pg_catalog.pg_enum ORDER BY enumtypid, oid";
+	result = [connection execute:enumSQL parameters:nil];
+	if ([result succeeded])
+	{
+		NSMutableDictionary *labels = [NSMutableDictionary dictionary];
+		rs = [result recordset];
+		[rs enumerateRowsUsingBlock:^(PGSQLRecord *record, long rowIndex, BOOL *stop) {
+			NSNumber *typeOID = [NSNumber numberWithUnsignedLong:strtoul([[[record fieldByIndex:0] asString] UTF8String], NULL, 10)];
+			NSMutableArray *list = [labels objectForKey:typeOID];
+			if (list == nil)
+			{
+				list = [NSMutableArray array];
+				[labels setObject:list forKey:typeOID];
+			}
+			[list addObject:[[record fieldByIndex:1] asString]];
+		}];
+		[rs close];
+
+		for (NSNumber *typeOID in labels)
+		{
+			[[byOID objectForKey:typeOID] setEnumLabels:[labels objectForKey:typeOID]];
+		}
+	}
+
+	result = [connection execute:@"SELECT c.reltype, a.attname, a.atttypid "
+			  @"FROM pg_catalog.pg_attribute a JOIN pg_catalog.pg_class c ON c.oid = a.attrelid "
+			  @"WHERE c.relkind = 'c' AND a.attnum > 0 AND NOT a.attisdropped "
+			  @"ORDER BY c.reltype, a.attnum"
+					  parameters:nil];
+	if ([result succeeded])
+	{
+		NSMutableDictionary *names = [NSMutableDictionary dictionary];
+		NSMutableDictionary *typeOIDs = [NSMutableDictionary dictionary];
+		rs = [result recordset];
+		[rs enumerateRowsUsingBlock:^(PGSQLRecord *record, long rowIndex, BOOL *stop) {
+			NSNumber *typeOID = [NSNumber numberWithUnsignedLong:strtoul([[[record fieldByIndex:0] asString] UTF8String], NULL, 10)];
+			if ([names objectForKey:typeOID] == nil)
+			{
+				[names setObject:[NSMutableArray array] forKey:typeOID];
+				[typeOIDs setObject:[NSMutableArray array] forKey:typeOID];
+			}
+			[[names objectForKey:typeOID] addObject:[[record fieldByIndex:1] asString]];
+			[[typeOIDs objectForKey:typeOID] addObject:[NSNumber numberWithUnsignedLong:strtoul([[[record fieldByIndex:2] asString] UTF8String], NULL, 10)]];
+		}];
+		[rs close];
+
+		for (NSNumber *typeOID in names)
+		{
+			[[byOID objectForKey:typeOID] setAttributeNames:[names objectForKey:typeOID]
+														types:[typeOIDs objectForKey:typeOID]];
+		}
+	}
+
+	typesByOID = byOID;
+	typesByName = byName;
+
+	return self;
+}
+
+-(void)dealloc
+{
+	[serverKey release];
+	[typesByOID release];
+	[typesByName release];
+	[parameterStatuses release];
+	[versionString release];
+	[super dealloc];
+}
+
+-(PGSQLType *)typeWithOID:(unsigned int)typeOID
+{
+	return [typesByOID objectForKey:[NSNumber numberWithUnsignedInt:typeOID]];
+}
+
+-(PGSQLType *)typeNamed:(NSString *)typeName
+{
+	return [typesByName objectForKey:typeName];
+}
+
+-(NSArray *)types
+{
+	return [typesByOID allValues];
+}
+
+-(NSString *)parameterStatus:(NSString *)parameterName
+{
+	return [parameterStatuses objectForKey:parameterName];
+}
+
+-(NSDictionary *)parameterStatuses
+{
+	return parameterStatuses;
+}
+
+-(NSString *)versionString
+{
+	return versionString;
+}
+
+-(int)serverVersion
+{
+	if (serverVersion > 0)
+	{
+		return serverVersion;
+	}
+	
+	// server_version_num was not read: "9.0.1", "9.1beta2" for a
+	// pre-release, or from 10 on a major and a minor, "10.5"
+	NSArray *parts = [[self parameterStatus:@"server_version"] componentsSeparatedByString:@"."];
+	int major = ([parts count] > 0) ? [[parts objectAtIndex:0] intValue] : 0;
+	int minor = ([parts count] > 1) ? [[parts objectAtIndex:1] intValue] : 0;
+	if (major >= 10)
+	{
+		return (major * 10000) + minor;
+	}
+	int patch = ([parts count] > 2) ? [[parts objectAtIndex:2] intValue] : 0;
+	return (major * 10000) + (minor * 100) + patch;
+}
+
+-(BOOL)hasIntegerDatetimes
+{
+	return [[self parameterStatus:@"integer_datetimes"] isEqualToString:@"on"];
+}
+
+@end
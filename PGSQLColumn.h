@@ -8,20 +8,52 @@
 
 //#import <Cocoa/Cocoa.h>
 
+@class PGSQLType;
+
 @interface PGSQLColumn : NSObject {
 	NSString *name;
 	int index;
 	int type;
 	int size;
 	int offset;
+	int format;
+	
+	BOOL internsStrings;
+	void *internTable;
+	NSRecursiveLock *internLock;	// decoding may run on several threads
+	
+	PGSQLType *typeInfo;
 }
 
 -(id)initWithResult:(void *)result atIndex:(int)columnIndex;
+// For columns of a result that is not a PGresult, such as a recordset 
+// loaded from a file.
+-(id)initWithName:(NSString *)columnName index:(int)columnIndex type:(int)columnType 
+			 size:(int)columnSize offset:(int)columnOffset format:(int)columnFormat;
 
 -(NSString *)name;
 -(int)index;
 -(int)type;
 -(int)size;
 -(int)offset;
+// 0 for text, 1 for binary, as PQfformat reports it
+-(int)format;
+
+// The pg_type entry for type, from the connection's PGSQLCatalog.  nil 
+// until the connection that ran the query has loaded its catalog.
+-(PGSQLType *)typeInfo;
+-(void)setTypeInfo:(PGSQLType *)value;
+
+// String interning for low cardinality text columns.  When enabled, fields 
+// in this column hand back one shared NSString per distinct value.  Interning 
+// switches itself off once the column turns out to hold mostly unique values.
+-(BOOL)internsStrings;
+-(void)setInternsStrings:(BOOL)value;
+-(NSUInteger)internedStringCount;
+
+// Returns the shared string for the given bytes, or nil if interning is off
+// (or has given up) for this column.  Safe to call from several threads.
+-(NSString *)internedStringWithBytes:(const char *)bytes length:(NSUInteger)length 
+							encoding:(NSStringEncoding)encoding;
 
 @end
@@ -9,6 +9,96 @@
 #import "PGSQLColumn.h"
 #include "libpq-fe.h"
 
+// Interning gives up past this many distinct values, or when more than half
+// of the first PGSQLInternSampleSize lookups were new values.
+#define PGSQLInternMaxValues	4096
+#define PGSQLInternSampleSize	1024
+
+typedef struct PGSQLInternEntry {
+	uint64_t hash;
+	NSUInteger length;
+	char *bytes;
+	NSString *string;
+} PGSQLInternEntry;
+
+typedef struct PGSQLInternTable {
+	PGSQLInternEntry *entries;
+	NSUInteger capacity;		// always a power of two
+	NSUInteger count;
+	NSUInteger lookups;
+	NSStringEncoding encoding;
+} PGSQLInternTable;
+
+static uint64_t
+PGSQLInternHash(const char *bytes, NSUInteger length)
+{
+	// FNV-1a, cheap and good enough for short keys
+	uint64_t hash = 14695981039346656037ULL;
+	NSUInteger i;
+	for (i = 0; i < length; i++)
+	{
+		hash ^= (unsigned char)bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static PGSQLInternTable *
+PGSQLInternTableCreate(NSStringEncoding encoding)
+{
+	PGSQLInternTable *table = calloc(1, sizeof(PGSQLInternTable));
+	table->capacity = 64;
+	table->entries = calloc(table->capacity, sizeof(PGSQLInternEntry));
+	table->encoding = encoding;
+	return table;
+}
+
+static void
+PGSQLInternTableFree(PGSQLInternTable *table)
+{
+	if (table == NULL) { return; }
+	
+	NSUInteger i;
+	for (i = 0; i < table->capacity; i++)
+	{
+		free(table->entries[i].bytes);
+		[table->entries[i].string release];
+	}
+	free(table->entries);
+	free(table);
+}
+
+static void
+PGSQLInternTableGrow(PGSQLInternTable *table)
+{
+	NSUInteger oldCapacity = table->capacity;
+	PGSQLInternEntry *oldEntries = table->entries;
+	
+	table->capacity = oldCapacity * 2;
+	table->entries = calloc(table->capacity, sizeof(PGSQLInternEntry));
+	
+	NSUInteger i;
+	for (i = 0; i < oldCapacity; i++)
+	{
+		if (oldEntries[i].string == nil) { continue; }
+		
+		NSUInteger slot = (NSUInteger)oldEntries[i].hash & (table->capacity - 1);
+		while (table->entries[slot].string != nil)
+		{
+			slot = (slot + 1) & (table->capacity - 1);
+		}
+		table->entries[slot] = oldEntries[i];
+	}
+	free(oldEntries);
+}
+
+@interface PGSQLColumn (Private)
+
+-(NSString *)lockedInternedStringWithBytes:(const char *)bytes length:(NSUInteger)length 
+								  encoding:(NSStringEncoding)encoding;
+
+@end
+
 @implementation PGSQLColumn
 
 -(id)initWithResult:(void *)result atIndex:(int)columnIndex
@@ -16,17 +106,48 @@
     [super init];
 	
 	index = columnIndex;
-	name = [[NSString alloc] initWithCString:PQfname(result, columnIndex)];
+	// names arrive in the client_encoding, which the connection sets to UTF8
+	name = [[NSString alloc] initWithUTF8String:PQfname(result, columnIndex)];
+	if (name == nil)
+	{
+		name = [[NSString alloc] initWithCString:PQfname(result, columnIndex) 
+										encoding:NSISOLatin1StringEncoding];
+	}
 	type = PQftype(result, columnIndex);
 	size = PQfsize(result, columnIndex);
 	offset = PQfmod(result, columnIndex);
+	format = PQfformat(result, columnIndex);
+	
+	internLock = [[NSRecursiveLock alloc] init];
 	
 	return self;
 }
 
+-(id)initWithName:(NSString *)columnName index:(int)columnIndex type:(int)columnType 
+			 size:(int)columnSize offset:(int)columnOffset format:(int)columnFormat
+{
+	self = [super init];
+	
+	if (self != nil)
+	{
+		name = [columnName copy];
+		index = columnIndex;
+		type = columnType;
+		size = columnSize;
+		offset = columnOffset;
+		format = columnFormat;
+		
+		internLock = [[NSRecursiveLock alloc] init];
+	}
+	return self;
+}
+
 - (void)dealloc
 {
+	PGSQLInternTableFree(internTable);
+	[internLock release];
 	[name release];
+	[typeInfo release];
 	[super dealloc];
 }
 
@@ -55,5 +176,121 @@
 	return offset;
 }
 
+-(int)format
+{
+	return format;
+}
+
+-(PGSQLType *)typeInfo
+{
+	return [[typeInfo retain] autorelease];
+}
+
+-(void)setTypeInfo:(PGSQLType *)value
+{
+	if (typeInfo != value) {
+		[typeInfo release];
+		typeInfo = [value retain];
+	}
+}
+
+#pragma mark -
+#pragma mark String Interning
+
+-(BOOL)internsStrings
+{
+	return internsStrings;
+}
+
+-(void)setInternsStrings:(BOOL)value
+{
+	[internLock lock];
+	if (internsStrings != value) {
+		internsStrings = value;
+		if (!internsStrings)
+		{
+			PGSQLInternTableFree(internTable);
+			internTable = NULL;
+		}
+	}
+	[internLock unlock];
+}
+
+-(NSUInteger)internedStringCount
+{
+	[internLock lock];
+	NSUInteger count = (internTable == NULL) ? 0 : ((PGSQLInternTable *)internTable)->count;
+	[internLock unlock];
+	return count;
+}
+
+-(NSString *)internedStringWithBytes:(const char *)bytes length:(NSUInteger)length 
+							encoding:(NSStringEncoding)encoding
+{
+	if (!internsStrings) { return nil; }
+	
+	[internLock lock];
+	NSString *value = [self lockedInternedStringWithBytes:bytes length:length encoding:encoding];
+	// retained here, the table may be dropped by another thread once unlocked
+	[[value retain] autorelease];
+	[internLock unlock];
+	return value;
+}
+
+-(NSString *)lockedInternedStringWithBytes:(const char *)bytes length:(NSUInteger)length 
+								  encoding:(NSStringEncoding)encoding
+{
+	if (!internsStrings) { return nil; }
+	
+	PGSQLInternTable *table = internTable;
+	if (table == NULL)
+	{
+		table = PGSQLInternTableCreate(encoding);
+		internTable = table;
+	}
+	if (table->encoding != encoding) { return nil; }
+	
+	table->lookups++;
+	
+	uint64_t hash = PGSQLInternHash(bytes, length);
+	NSUInteger slot = (NSUInteger)hash & (table->capacity - 1);
+	while (table->entries[slot].string != nil)
+	{
+		PGSQLInternEntry *entry = &table->entries[slot];
+		if ((entry->hash == hash) && (entry->length == length) &&
+			(memcmp(entry->bytes, bytes, length) == 0))
+		{
+			return entry->string;
+		}
+		slot = (slot + 1) & (table->capacity - 1);
+	}
+	
+	// a new value, check whether this column is still worth interning
+	if ((table->count >= PGSQLInternMaxValues) ||
+		((table->lookups >= PGSQLInternSampleSize) && (table->count * 2 > table->lookups)))
+	{
+		[self setInternsStrings:NO];
+		return nil;
+	}
+	
+	NSString *value = [[NSString alloc] initWithBytes:bytes length:length encoding:encoding];
+	if (value == nil) { return nil; }
+	
+	PGSQLInternEntry *entry = &table->entries[slot];
+	entry->hash = hash;
+	entry->length = length;
+	entry->bytes = malloc(length > 0 ? length : 1);
+	memcpy(entry->bytes, bytes, length);
+	entry->string = value;
+	table->count++;
+	
+	// keep the load factor at or below one half
+	if (table->count * 2 > table->capacity)
+	{
+		PGSQLInternTableGrow(table);
+	}
+	return value;
+}
+
 @end
 
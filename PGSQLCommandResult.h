@@ -0,0 +1,109 @@
+//
+//  PGSQLCommandResult.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLCommandResult
+    @abstract   The outcome of a single statement executed on a connection.
+    @discussion Where lastError and lastCmdStatus on the connection describe
+				whichever statement finished last, a PGSQLCommandResult
+				belongs to exactly one execution.  It is safe to hand between
+				threads and is not touched by later statements on the same
+				connection.
+*/
+
+#import "PGSQLRecordset.h"
+
+/*!
+    @class
+    @abstract    Status, error, command tag, affected rows, timing and (for
+				 queries) the recordset produced by one execution.
+    @discussion  Results are created by the PGSQLConnection execute: methods
+				 and are never built directly.
+*/
+@interface PGSQLCommandResult : NSObject {
+	NSString *sql;
+
+	int resultStatus;
+	NSString *errorDescription;
+	NSString *commandStatus;
+	long rowsAffected;
+	NSTimeInterval executionTime;
+	BOOL connectionLost;
+
+	PGSQLRecordset *recordset;
+}
+
+/*!
+    @method
+    @abstract   Builds a result from a libpq PGresult.
+    @discussion Takes ownership of result.  Results that carry tuples are
+				wrapped in a PGSQLRecordset, anything else is cleared once the
+				status information has been read.
+*/
+-(id)initWithResult:(void *)result sql:(NSString *)sqlCommand
+	  executionTime:(NSTimeInterval)elapsed encoding:(NSStringEncoding)encoding;
+/*!
+    @method
+    @abstract   Builds a failed result for an execution that never produced a
+				PGresult (no connection, out of memory, connection lost).
+*/
+-(id)initWithError:(NSString *)error sql:(NSString *)sqlCommand
+	 executionTime:(NSTimeInterval)elapsed;
+
+/*!
+    @method
+    @abstract   YES unless the server reported an error or no result came back.
+*/
+-(BOOL)succeeded;
+
+-(NSString *)sql;
+
+/*!
+    @method
+    @abstract   The libpq ExecStatusType of the result, PGRES_FATAL_ERROR when
+				there was none.
+*/
+-(int)resultStatus;
+-(NSString *)lastError;
+
+/*!
+    @method
+    @abstract   The command tag, as reported by PQcmdStatus (eg "INSERT 0 1").
+*/
+-(NSString *)lastCmdStatus;
+
+/*!
+    @method
+    @abstract   Rows affected by an INSERT, UPDATE, DELETE, MOVE, FETCH or
+				COPY, or returned by a SELECT, as reported by PQcmdTuples.
+				Returns -1 when the server did not report a count.
+*/
+-(long)rowsAffected;
+
+/*!
+    @method
+    @abstract   Wall clock time spent executing, in seconds.
+*/
+-(NSTimeInterval)executionTime;
+
+/*!
+    @method
+    @abstract   The recordset for statements that return rows, otherwise nil.
+*/
+-(PGSQLRecordset *)recordset;
+
+/*!
+    @method
+    @abstract   YES when the statement failed because the connection to the
+				server was lost, rather than because the server rejected it.
+    @discussion Set by the connection.  Only these failures are retried by 
+				-[PGSQLConnection execute:parameters:idempotent:].
+*/
+-(BOOL)connectionLost;
+-(void)setConnectionLost:(BOOL)value;
+
+@end
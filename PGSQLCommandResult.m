@@ -0,0 +1,148 @@
+//
+//  PGSQLCommandResult.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLCommandResult.h"
+#include "libpq-fe.h"
+
+@implementation PGSQLCommandResult
+
+-(id)initWithResult:(void *)result sql:(NSString *)sqlCommand
+	  executionTime:(NSTimeInterval)elapsed encoding:(NSStringEncoding)encoding
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		sql = [sqlCommand copy];
+		executionTime = elapsed;
+		rowsAffected = -1;
+
+		resultStatus = PQresultStatus(result);
+		switch (resultStatus)
+		{
+			case PGRES_BAD_RESPONSE:
+			case PGRES_NONFATAL_ERROR:
+			case PGRES_FATAL_ERROR:
+				errorDescription = [[NSString alloc] initWithFormat:@"%s", PQresultErrorMessage(result)];
+				break;
+			default:
+				break;
+		}
+
+		if (strlen(PQcmdStatus(result)))
+		{
+			commandStatus = [[NSString alloc] initWithFormat:@"%s", PQcmdStatus(result)];
+		}
+
+		const char *tuples = PQcmdTuples(result);
+		if (strlen(tuples))
+		{
+			rowsAffected = strtol(tuples, NULL, 10);
+		}
+
+		if (resultStatus == PGRES_TUPLES_OK)
+		{
+			if (rowsAffected < 0)
+			{
+				rowsAffected = PQntuples(result);
+			}
+			recordset = [[PGSQLRecordset alloc] initWithResult:result];
+			[recordset setDefaultEncoding:encoding];
+		} else {
+			PQclear(result);
+		}
+	}
+	return self;
+}
+
+-(id)initWithError:(NSString *)error sql:(NSString *)sqlCommand
+	 executionTime:(NSTimeInterval)elapsed
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		sql = [sqlCommand copy];
+		executionTime = elapsed;
+		rowsAffected = -1;
+		resultStatus = PGRES_FATAL_ERROR;
+		errorDescription = [error copy];
+	}
+	return self;
+}
+
+-(void)dealloc
+{
+	[sql release];
+	[errorDescription release];
+	[commandStatus release];
+	[recordset release];
+	[super dealloc];
+}
+
+-(BOOL)succeeded
+{
+	switch (resultStatus)
+	{
+		case PGRES_BAD_RESPONSE:
+		case PGRES_NONFATAL_ERROR:
+		case PGRES_FATAL_ERROR:
+			return NO;
+		default:
+			return YES;
+	}
+}
+
+#pragma mark -
+#pragma mark Simple Accessors
+
+-(NSString *)sql
+{
+	return [[sql retain] autorelease];
+}
+
+-(int)resultStatus
+{
+	return resultStatus;
+}
+
+-(NSString *)lastError
+{
+	return [[errorDescription retain] autorelease];
+}
+
+-(NSString *)lastCmdStatus
+{
+	return [[commandStatus retain] autorelease];
+}
+
+-(long)rowsAffected
+{
+	return rowsAffected;
+}
+
+-(NSTimeInterval)executionTime
+{
+	return executionTime;
+}
+
+-(PGSQLRecordset *)recordset
+{
+	return [[recordset retain] autorelease];
+}
+
+-(BOOL)connectionLost
+{
+	return connectionLost;
+}
+
+-(void)setConnectionLost:(BOOL)value
+{
+	connectionLost = value;
+}
+
+@end
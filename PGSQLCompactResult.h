@@ -0,0 +1,97 @@
+//
+//  PGSQLCompactResult.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLCompactResult
+    @abstract   A packed, read-only copy of a PGresult's values.
+    @discussion Used by -[PGSQLRecordset compact].  A PGresult keeps each
+				value in its own slot with a per-value header and an array of
+				tuple pointers, which is convenient while the result streams
+				in and wasteful for a result that is kept around.  The compact
+				form holds the same values column by column in one block of
+				memory, the arena: a null bitmap, an offset table and the
+				value bytes for each column.  Offsets are 4 bytes, or 8 for a
+				column holding more than 4GB.
+
+				Every value keeps a terminating NUL, as it has in a PGresult,
+				so text values can be handed straight to C string functions.
+				Nothing in a compact result changes once it is built, so it
+				can be read from any number of threads without locking.
+
+				The arena holds no pointers, only offsets from its own start,
+				which is what lets -[PGSQLRecordset writeToFile:] store it as
+				is and initWithContentsOfMappedFile: serve it from an mmap.
+
+				This header is internal to the kit.
+*/
+
+#import <Foundation/Foundation.h>
+
+typedef struct PGSQLCompactResult PGSQLCompactResult;
+
+/*!
+    @function
+    @abstract   Reads one value for PGSQLCompactResultCreateWithAccessor.
+    @discussion Returns NULL for SQL NULL, and the length without any
+				terminator in length.
+*/
+typedef const char *(*PGSQLCompactValueAccessor)(void *context, long row, int column, NSUInteger *length);
+
+/*!
+    @function
+    @abstract   Packs every value of a PGresult.  The PGresult is not freed.
+*/
+PGSQLCompactResult *PGSQLCompactResultCreate(void *pgresult);
+
+/*!
+    @function
+    @abstract   Packs values read through an accessor.
+    @discussion formats holds the PQfformat of each column.
+*/
+PGSQLCompactResult *PGSQLCompactResultCreateWithAccessor(long rows, int columnCount, const int *formats,
+														 PGSQLCompactValueAccessor accessor, void *context);
+
+/*!
+    @function
+    @abstract   Wraps an arena that lives in an mmap'ed file.
+    @discussion Checks that every column's tables lie inside the arena, and
+				returns NULL if not.  The mapping (the whole file) is
+				munmap'ed by PGSQLCompactResultFree.
+*/
+PGSQLCompactResult *PGSQLCompactResultCreateWithMapping(void *mapping, size_t mappingLength,
+														size_t arenaOffset, size_t arenaLength,
+														long rows, int columnCount);
+
+void PGSQLCompactResultFree(PGSQLCompactResult *result);
+
+/*!
+    @function
+    @abstract   The value at row and column, or NULL for SQL NULL.
+    @discussion length receives the value's length without the terminator.
+				An entry of a mapped file whose offsets or terminator are not
+				valid is also returned as NULL; those are checked here, per
+				value, rather than when the file is opened.
+*/
+const char *PGSQLCompactResultValue(const PGSQLCompactResult *result, long row, int column, NSUInteger *length);
+
+/*!
+    @function
+    @abstract   The column's format as PQfformat reports it, 0 text 1 binary.
+*/
+int PGSQLCompactResultFormat(const PGSQLCompactResult *result, int column);
+
+/*!
+    @function
+    @abstract   Bytes held by the compact result, metadata included.
+*/
+size_t PGSQLCompactResultSize(const PGSQLCompactResult *result);
+
+/*!
+    @function
+    @abstract   The arena, for writing it out.
+*/
+const char *PGSQLCompactResultArena(const PGSQLCompactResult *result, size_t *length);
@@ -0,0 +1,298 @@
+//
+//  PGSQLCompactResult.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLCompactResult.h"
+#include "libpq-fe.h"
+#import <stdlib.h>
+#import <string.h>
+#import <stdint.h>
+#import <sys/mman.h>
+
+// Where a column's pieces live in the arena.  Fixed width, since it is
+// written to disk as part of the arena.
+typedef struct PGSQLCompactColumn {
+	int32_t format;
+	int32_t wideOffsets;	// uint64_t offsets, otherwise uint32_t
+	uint64_t nullsOffset;	// one bit per row, set for NULL
+	uint64_t offsetsOffset;	// rows + 1 entries, value i is [off[i], off[i+1])
+	uint64_t valuesOffset;
+} PGSQLCompactColumn;
+
+struct PGSQLCompactResult {
+	long rows;
+	int columnCount;
+	const PGSQLCompactColumn *columns;	// the first thing in the arena
+	char *arena;
+	size_t arenaLength;
+
+	void *mapping;						// set when the arena is in a file
+	size_t mappingLength;
+};
+
+#define PGSQLCompactAlign(n)	(((n) + 7) & ~((uint64_t)7))
+
+static const char *
+PGSQLCompactPGresultValue(void *context, long row, int column, NSUInteger *length)
+{
+	if (PQgetisnull(context, (int)row, column))
+	{
+		*length = 0;
+		return NULL;
+	}
+	*length = PQgetlength(context, (int)row, column);
+	return PQgetvalue(context, (int)row, column);
+}
+
+PGSQLCompactResult *
+PGSQLCompactResultCreate(void *pgresult)
+{
+	int columnCount = PQnfields(pgresult);
+	int *formats = malloc(sizeof(int) * (columnCount > 0 ? columnCount : 1));
+	int c;
+	for (c = 0; c < columnCount; c++)
+	{
+		formats[c] = PQfformat(pgresult, c);
+	}
+
+	PGSQLCompactResult *result = PGSQLCompactResultCreateWithAccessor(PQntuples(pgresult), columnCount, formats,
+																	  PGSQLCompactPGresultValue, pgresult);
+	free(formats);
+	return result;
+}
+
+PGSQLCompactResult *
+PGSQLCompactResultCreateWithAccessor(long rows, int columnCount, const int *formats,
+									 PGSQLCompactValueAccessor accessor, void *context)
+{
+	// first pass sizes everything so the arena is one allocation
+	PGSQLCompactColumn *layout = calloc(columnCount > 0 ? columnCount : 1, sizeof(PGSQLCompactColumn));
+	uint64_t size = PGSQLCompactAlign(sizeof(PGSQLCompactColumn) * columnCount);
+	int c;
+	for (c = 0; c < columnCount; c++)
+	{
+		uint64_t valueBytes = 0;
+		long row;
+		for (row = 0; row < rows; row++)
+		{
+			NSUInteger length;
+			if (accessor(context, row, c, &length) != NULL)
+			{
+				valueBytes += (uint64_t)length + 1;
+			}
+		}
+
+		layout[c].format = formats[c];
+		layout[c].wideOffsets = (valueBytes > UINT32_MAX);
+
+		layout[c].nullsOffset = size;
+		size += PGSQLCompactAlign((uint64_t)(rows + 7) / 8);
+		layout[c].offsetsOffset = size;
+		size += PGSQLCompactAlign((uint64_t)(rows + 1) * (layout[c].wideOffsets ? sizeof(uint64_t) : sizeof(uint32_t)));
+		layout[c].valuesOffset = size;
+		size += PGSQLCompactAlign(valueBytes);
+	}
+
+	char *arena = calloc(1, (size_t)(size > 0 ? size : 1));
+	PGSQLCompactResult *result = calloc(1, sizeof(PGSQLCompactResult));
+	if ((arena == NULL) || (result == NULL))
+	{
+		free(arena);
+		free(result);
+		free(layout);
+		return NULL;
+	}
+	memcpy(arena, layout, sizeof(PGSQLCompactColumn) * columnCount);
+	free(layout);
+
+	result->rows = rows;
+	result->columnCount = columnCount;
+	result->columns = (const PGSQLCompactColumn *)arena;
+	result->arena = arena;
+	result->arenaLength = (size_t)size;
+
+	// second pass copies, a column at a time
+	for (c = 0; c < columnCount; c++)
+	{
+		const PGSQLCompactColumn *column = &result->columns[c];
+		uint8_t *nulls = (uint8_t *)(arena + column->nullsOffset);
+		uint32_t *narrow = (uint32_t *)(arena + column->offsetsOffset);
+		uint64_t *wide = (uint64_t *)(arena + column->offsetsOffset);
+		char *values = arena + column->valuesOffset;
+		uint64_t offset = 0;
+
+		long row;
+		for (row = 0; row < rows; row++)
+		{
+			if (column->wideOffsets) { wide[row] = offset; } else { narrow[row] = (uint32_t)offset; }
+
+			NSUInteger length;
+			const char *value = accessor(context, row, c, &length);
+			if (value == NULL)
+			{
+				nulls[row >> 3] |= (uint8_t)(1 << (row & 7));
+				continue;
+			}
+			memcpy(values + offset, value, length);
+			values[offset + length] = '\0';
+			offset += (uint64_t)length + 1;
+		}
+		if (column->wideOffsets) { wide[rows] = offset; } else { narrow[rows] = (uint32_t)offset; }
+	}
+
+	return result;
+}
+
+PGSQLCompactResult *
+PGSQLCompactResultCreateWithMapping(void *mapping, size_t mappingLength,
+									size_t arenaOffset, size_t arenaLength,
+									long rows, int columnCount)
+{
+	if ((rows < 0) || (columnCount < 0) || (arenaOffset % 8 != 0) ||
+		(arenaOffset > mappingLength) || (arenaLength > mappingLength - arenaOffset) ||
+		((uint64_t)sizeof(PGSQLCompactColumn) * columnCount > arenaLength))
+	{
+		return NULL;
+	}
+
+	char *arena = (char *)mapping + arenaOffset;
+	const PGSQLCompactColumn *columns = (const PGSQLCompactColumn *)arena;
+
+	// every column's tables, and the values its last offset ends, have to
+	// lie inside the arena.  The offsets of each row are only checked when
+	// that value is read, so that opening does not page in the whole file.
+	// Sizes are compared by subtraction, since the offsets come from the
+	// file and a sum could wrap.
+	int c;
+	for (c = 0; c < columnCount; c++)
+	{
+		const PGSQLCompactColumn *column = &columns[c];
+		uint64_t offsetWidth = column->wideOffsets ? sizeof(uint64_t) : sizeof(uint32_t);
+		uint64_t nullsLength = ((uint64_t)rows + 7) / 8;
+		if (((uint64_t)rows + 1 > arenaLength / offsetWidth) ||
+			(column->nullsOffset > arenaLength) || (nullsLength > arenaLength - column->nullsOffset) ||
+			(column->offsetsOffset > arenaLength) ||
+			(((uint64_t)rows + 1) * offsetWidth > arenaLength - column->offsetsOffset) ||
+			(column->offsetsOffset % offsetWidth != 0) || (column->valuesOffset > arenaLength))
+		{
+			return NULL;
+		}
+
+		const uint32_t *narrow = (const uint32_t *)(arena + column->offsetsOffset);
+		const uint64_t *wide = (const uint64_t *)(arena + column->offsetsOffset);
+		uint64_t valuesEnd = column->wideOffsets ? wide[rows] : narrow[rows];
+		if (valuesEnd > arenaLength - column->valuesOffset)
+		{
+			return NULL;
+		}
+	}
+
+	PGSQLCompactResult *result = calloc(1, sizeof(PGSQLCompactResult));
+	if (result == NULL)
+	{
+		return NULL;
+	}
+	result->rows = rows;
+	result->columnCount = columnCount;
+	result->columns = columns;
+	result->arena = arena;
+	result->arenaLength = arenaLength;
+	result->mapping = mapping;
+	result->mappingLength = mappingLength;
+	return result;
+}
+
+void
+PGSQLCompactResultFree(PGSQLCompactResult *result)
+{
+	if (result == NULL)
+	{
+		return;
+	}
+
+	if (result->mapping != NULL)
+	{
+		munmap(result->mapping, result->mappingLength);
+	} else {
+		free(result->arena);
+	}
+	free(result);
+}
+
+const char *
+PGSQLCompactResultValue(const PGSQLCompactResult *result, long row, int column, NSUInteger *length)
+{
+	if ((row < 0) || (row >= result->rows) || (column < 0) || (column >= result->columnCount))
+	{
+		if (length != NULL) { *length = 0; }
+		return NULL;
+	}
+
+	const PGSQLCompactColumn *layout = &result->columns[column];
+	const uint8_t *nulls = (const uint8_t *)(result->arena + layout->nullsOffset);
+	if (nulls[row >> 3] & (1 << (row & 7)))
+	{
+		if (length != NULL) { *length = 0; }
+		return NULL;
+	}
+
+	uint64_t start;
+	uint64_t end;
+	uint64_t valuesEnd;
+	if (layout->wideOffsets)
+	{
+		const uint64_t *offsets = (const uint64_t *)(result->arena + layout->offsetsOffset);
+		start = offsets[row];
+		end = offsets[row + 1];
+		valuesEnd = offsets[result->rows];
+	} else {
+		const uint32_t *offsets = (const uint32_t *)(result->arena + layout->offsetsOffset);
+		start = offsets[row];
+		end = offsets[row + 1];
+		valuesEnd = offsets[result->rows];
+	}
+
+	// the load only checked the column's tables; a value has to lie inside
+	// them and carry its terminator, or the entry is treated as missing
+	const char *values = result->arena + layout->valuesOffset;
+	if ((start > end) || (end > valuesEnd) || (start == end) || (values[end - 1] != '\0'))
+	{
+		if (length != NULL) { *length = 0; }
+		return NULL;
+	}
+
+	if (length != NULL)
+	{
+		*length = (NSUInteger)(end - start - 1);
+	}
+	return values + start;
+}
+
+int
+PGSQLCompactResultFormat(const PGSQLCompactResult *result, int column)
+{
+	if ((column < 0) || (column >= result->columnCount))
+	{
+		return 0;
+	}
+	return result->columns[column].format;
+}
+
+size_t
+PGSQLCompactResultSize(const PGSQLCompactResult *result)
+{
+	return sizeof(PGSQLCompactResult) + result->arenaLength;
+}
+
+const char *
+PGSQLCompactResultArena(const PGSQLCompactResult *result, size_t *length)
+{
+	if (length != NULL)
+	{
+		*length = result->arenaLength;
+	}
+	return result->arena;
+}
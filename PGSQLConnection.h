@@ -52,6 +52,12 @@
 
 // #import <Cocoa/Cocoa.h>
 #import "PGSQLRecordset.h"
+#import "PGSQLCommandResult.h"
+#import "PGSQLCatalog.h"
+#import "PGSQLQueryTemplate.h"
+#import "PGSQLSlowQueryLog.h"
+
+@class PGSQLMergeResult;
 
 /*!
  @class
@@ -64,8 +70,15 @@
 				can support multiple queries, however, because of local storage
 				of the results, it is possible that memory could become a 
 				concern if mulitple result sets are open as the same time.
+ 
+				A connection may be shared between threads.  Statements are 
+				executed one at a time in the order the threads reach the 
+				connection.  lastError and lastCmdStatus only describe 
+				whichever statement finished last, so threads sharing a 
+				connection should use the execute: methods and read the 
+				returned PGSQLCommandResult instead.
  */
-@interface PGSQLConnection : NSObject {	
+@interface PGSQLConnection : NSObject <NSLocking> {	
 	BOOL isConnected;
 	
 	NSString *connectionString;
@@ -81,6 +94,7 @@
 	BOOL logSQL;
 	
 	void			*pgconn;
+	void			*pgcancel;	// PGcancel for pgconn, guarded by stateLock
 	
 	NSString		*host;
 	NSString		*port;
@@ -92,8 +106,43 @@
 	NSString		*sslMode;	// allow, prefer, require
 	NSString		*service;	// service name
 	NSString		*krbsrvName;
+	
+	NSArray			*hosts;			// "host:port" endpoints raced by connect
+	NSString		*targetSessionRole;
+	NSTimeInterval	connectStagger;
+	NSTimeInterval	connectTimeout;
+	NSString		*connectedHost;
+	
+	BOOL			autoReconnect;
+	BOOL			wantsConnection;	// connected, and not closed since
+	BOOL			isHealthy;
+	BOOL			lossReported;
+	BOOL			isMonitoringHealth;
+	NSTimeInterval	healthCheckInterval;
+	NSTimeInterval	reconnectBaseDelay;
+	NSTimeInterval	reconnectMaximumDelay;
+	NSUInteger		maximumRetries;
+	NSTimeInterval	retryTimeout;
+	NSCondition		*healthCondition;	// guards the health state above
+	
+	NSMutableDictionary	*preparedStatements;	// name -> sql, prepared again on every connect
+	NSMutableArray		*sessionCommands;		// run again on every connect
+	
+	PGSQLSlowQueryLog	*slowQueryLog;
+	
+	PGSQLCatalog	*catalog;	// shared with other connections to the server, guarded by stateLock
+	
+	NSMutableDictionary	*tableSchemas;			// table -> PGSQLTableSchema, for the dictionary tools
+	NSMutableDictionary	*dictionaryStatements;	// generated sql -> prepared statement name
+	
+	char			*escapeBuffer;		// reused by the quoting methods, guarded by executionLock
+	size_t			escapeBufferSize;
+	NSMutableDictionary	*quotedIdentifiers;	// name -> quoted, for this server session
 		
 	NSString		*commandStatus;
+	
+	NSRecursiveLock	*executionLock;	// one statement on the wire at a time
+	NSLock			*stateLock;		// errorDescription, commandStatus, sqlLog
 }
 
 /*!
@@ -152,12 +201,302 @@
 -(PGSQLRecordset *)open:(NSString *)sql;
 -(void)openAsync:(NSString *)sql;
 
+/*!
+    @method
+    @abstract   Execute a statement and return everything about its outcome.
+    @discussion Unlike execCommand: and open:, the execute: methods never 
+				raise.  Errors, the command tag, the affected row count, the
+				timing and any recordset are returned in a PGSQLCommandResult 
+				that belongs to this execution alone, which makes these the 
+				methods to use from threads that share a connection.
+*/
+-(PGSQLCommandResult *)execute:(NSString *)sql;
+-(PGSQLCommandResult *)execute:(NSString *)sql numberOfArguments:(int)nParams withParameters:(id)params, ...;
+/*!
+    @method
+    @abstract   Execute a statement with its parameters in an array.
+    @discussion Parameters are bound as $1..$n in array order.  NSNull binds 
+				SQL NULL, NSData binds binary, an NSDictionary or NSArray binds
+				its JSON (for json and jsonb parameters) and anything else 
+				binds the text of its description.
+*/
+-(PGSQLCommandResult *)execute:(NSString *)sql parameters:(NSArray *)params;
+/*!
+    @method
+    @abstract   Execute several semicolon separated statements in one round 
+				trip.
+    @discussion Uses the simple query protocol, so the statements can not 
+				take parameters (see sqlQuoteLiteral:).  Returns one 
+				PGSQLCommandResult per statement the server ran, in order.  
+				The server stops at the first failing statement, so a short 
+				array ending in a failed result identifies the statement that 
+				broke the script.
+*/
+-(NSArray *)executeScript:(NSString *)sql;
+
+/*!
+    @method
+    @abstract   Execute a :name template with its values bound by name.
+    @discussion The values are bound as parameters, see 
+				execute:parameters: and PGSQLQueryTemplate.  A placeholder 
+				without a value fails the call without reaching the server.
+*/
+-(PGSQLCommandResult *)executeTemplate:(PGSQLQueryTemplate *)queryTemplate values:(NSDictionary *)values;
+/*!
+    @method
+    @abstract   executeTemplate:values: with the shared template for sql.
+*/
+-(PGSQLCommandResult *)execute:(NSString *)sql values:(NSDictionary *)values;
+
+/*!
+    @method
+    @abstract   Execute a statement that is safe to run more than once.
+    @discussion When idempotent is YES and autoReconnect is on, a statement 
+				that fails because the connection was lost is not reported at
+				once.  The call waits (up to retryTimeout) for the connection 
+				to come back and runs the statement again, up to 
+				maximumRetries times.  Errors reported by the server are never
+				retried.  Only mark statements idempotent when running them 
+				twice is harmless: reads, or writes that set rather than 
+				accumulate.
+*/
+-(PGSQLCommandResult *)execute:(NSString *)sql parameters:(NSArray *)params idempotent:(BOOL)idempotent;
+/*!
+    @method
+    @abstract   open: with the retry behaviour of execute:parameters:idempotent:.
+*/
+-(PGSQLRecordset *)open:(NSString *)sql idempotent:(BOOL)idempotent;
+
+#pragma mark -
+#pragma mark Session State
+
+/*!
+    @method
+    @abstract   Prepare a named statement on the server.
+    @discussion The statement is remembered and prepared again whenever the
+				connection is (re)established, so it survives a reconnect.  If
+				not connected it is only remembered.
+    @result     YES if the server accepted it (NO when not connected).
+*/
+-(BOOL)prepareStatement:(NSString *)sql withName:(NSString *)name;
+/*!
+    @method
+    @abstract   Run a statement prepared with prepareStatement:withName:.
+    @discussion Parameters follow the rules of execute:parameters:.  Never 
+				raises.
+*/
+-(PGSQLCommandResult *)executePrepared:(NSString *)name parameters:(NSArray *)params;
+/*!
+    @method
+    @abstract   Forget a prepared statement and DEALLOCATE it on the server.
+*/
+-(BOOL)deallocatePreparedStatement:(NSString *)name;
+
+/*!
+    @method
+    @abstract   Run a command now and again after every reconnect.
+    @discussion For session settings (SET search_path, SET timezone) that a
+				new server session would otherwise lose.  client_encoding is 
+				restored on its own and does not need one.
+*/
+-(BOOL)addSessionCommand:(NSString *)sql;
+-(NSArray *)sessionCommands;
+-(void)removeAllSessionCommands;
+
+/*!
+    @method
+    @abstract   Take the connection for the calling thread.
+    @discussion Statements from other threads wait until the matching unlock.
+				Use it to keep a multi-statement unit, such as a transaction,
+				from having other threads' statements interleaved with it.  
+				Calls may be nested.
+*/
+-(void)lock;
+-(void)unlock;
+
+/*!
+    @method
+    @abstract   Whether a transaction is open on the connection, failed ones
+				included.
+*/
+-(BOOL)isInTransaction;
+
+/*!
+    @method
+    @abstract   Ask the server to cancel the statement now running.
+    @discussion Safe to call from any thread while another thread is waiting
+				on a statement.  The statement fails with a "canceling 
+				statement due to user request" error.  Returns NO if the 
+				request could not be sent, there being nothing to cancel is 
+				not an error.
+*/
+-(BOOL)cancel;
+
+#pragma mark -
+#pragma mark Server Catalog
+
+/*!
+    @method
+    @abstract   The server's type catalog and settings.
+    @discussion Loaded with a few queries by the first connection to a server
+				that asks for it, and shared with every other connection to 
+				the same host, port and database (see PGSQLCatalog).  Once a 
+				connection has a catalog, the recordsets it returns pass each 
+				column its PGSQLType.  nil when not connected or if the 
+				catalog could not be read.
+*/
+-(PGSQLCatalog *)catalog;
+/*!
+    @method
+    @abstract   Read the catalog again, after creating or altering types.
+    @discussion Replaces the shared catalog for this server.  Other 
+				connections pick the new one up on their next connect.
+*/
+-(PGSQLCatalog *)reloadCatalog;
+
+/*!
+    @method
+    @abstract   A ParameterStatus value the server reported, such as 
+				server_version, integer_datetimes or TimeZone.
+    @discussion Kept up to date by libpq from what the server sends, so it 
+				costs no round trip.  nil when not connected or the server has 
+				not reported the parameter.
+*/
+-(NSString *)parameterStatus:(NSString *)parameterName;
+
+/*!
+    @method
+    @abstract   "host:port/database" as libpq resolved them for the live 
+				connection, nil when not connected.
+    @discussion Names the server and database independently of how the 
+				connection was configured, PGSQLCatalog shares catalogs by it.
+*/
+-(NSString *)serverIdentity;
+
+#pragma mark -
+#pragma mark Dictionary Tools
+
+/*!
+    @method
+    @abstract   Insert a row made from a dictionary of column names and values.
+    @discussion table is resolved as the server resolves a table name in SQL
+				(schema qualified, or on the search_path).  Its columns, their
+				types and its primary key are read once and cached, and the 
+				INSERT for each distinct set of keys is prepared once and 
+				reused.  Values bind as in execute:parameters:, NSNull for 
+				NULL.  Columns missing from dict get their defaults.  Returns 
+				NO, with lastError set, if a key is not a column of the table
+				or the insert fails.
+*/
+-(BOOL)insertIntoTable:(NSString *)table fromDictionary:(NSDictionary *)dict;
+/*!
+    @method
+    @abstract   Update the row a dictionary identifies by its primary key.
+    @discussion dict must hold every primary key column, the other keys are 
+				the columns to set.  Cached and prepared as 
+				insertIntoTable:fromDictionary: is.  Returns YES only if a row
+				was updated.
+*/
+-(BOOL)updateTable:(NSString *)table fromDictionary:(NSDictionary *)dict;
+/*!
+    @method
+    @abstract   Insert many rows in as few statements as possible.
+    @discussion Dictionaries with the same keys go up together as one 
+				prepared INSERT ... SELECT unnest($1), unnest($2) ... with a 
+				whole column in each parameter, however many rows there are.
+				Tables with array or composite columns use multi-row VALUES 
+				instead.  Groups of different keys are inserted one after 
+				another, so rows are not always inserted in array order.  Runs
+				in a transaction of its own unless one is already open, and 
+				returns NO if any row failed.
+*/
+-(BOOL)insertIntoTable:(NSString *)table fromDictionaries:(NSArray *)dicts;
+/*!
+    @method
+    @abstract   Update many rows by primary key in as few statements as 
+				possible.
+    @discussion Dictionaries with the same keys go up together as one 
+				prepared UPDATE ... FROM (SELECT unnest($1) ...) joined on the
+				primary key.  Tables with array or composite columns are 
+				updated a row at a time.  Transactions as for 
+				insertIntoTable:fromDictionaries:.  Returns NO if any 
+				statement failed, rows that matched nothing are not an error.
+*/
+-(BOOL)updateTable:(NSString *)table fromDictionaries:(NSArray *)dicts;
+/*!
+    @method
+    @abstract   Forget the table layouts cached by the dictionary tools, after
+				altering tables.
+*/
+-(void)removeCachedTableSchemas;
+
+/*!
+    @method
+    @abstract   Bring a table in line with a set of rows in a few set based 
+				statements.
+    @discussion Each dictionary is a row keyed by column name, all with the 
+				same keys (missing keys stage as NULL).  The rows are streamed
+				into a temporary table with COPY and merged with a single 
+				INSERT ... ON CONFLICT (keyColumns) DO UPDATE, so keyColumns 
+				must carry a unique index.  When deleteMissing is YES, rows of
+				table whose key is not among the rows are then deleted.  See 
+				PGSQLBulkMerge to stream rows without holding them all in 
+				memory, and for the details.
+*/
+-(PGSQLMergeResult *)mergeIntoTable:(NSString *)table rows:(NSArray *)dicts 
+						 keyColumns:(NSArray *)keyColumns deleteMissing:(BOOL)deleteMissing;
+
+#pragma mark -
+#pragma mark Copy
+
+/*!
+    @method
+    @abstract   Start a COPY ... FROM STDIN.
+    @discussion On success the connection stays locked to the calling thread
+				until endCopyIn:, as nothing else can run while a COPY is in 
+				progress.  Returns NO, with lastError set and the connection 
+				unlocked, if the server did not enter COPY IN.
+*/
+-(BOOL)beginCopyIn:(NSString *)sql;
+/*!
+    @method
+    @abstract   Send the next part of a COPY's data, in the format the COPY 
+				statement named.  Rows may be split across calls.
+*/
+-(BOOL)putCopyData:(NSData *)data;
+/*!
+    @method
+    @abstract   Finish the COPY, or abandon it when errorMessage is not nil.
+    @discussion Unlocks the connection.  The result carries the row count, or
+				the error that ended the COPY.
+*/
+-(PGSQLCommandResult *)endCopyIn:(NSString *)errorMessage;
+
 #pragma mark -
 #pragma mark Utility Functions
 
 -(NSData *)sqlDecodeData:(NSData *)toDecode;
 -(NSString *)sqlEncodeData:(NSData *)toEncode;
+/*!
+    @method
+    @abstract   Returns toEncode escaped for use between single quotes, with 
+				PQescapeStringConn.
+*/
 -(NSString *)sqlEncodeString:(NSString *)toEncode;
+/*!
+    @method
+    @abstract   Returns name quoted as an SQL identifier, with 
+				PQescapeIdentifier.  nil when not connected.
+*/
+-(NSString *)sqlQuoteIdentifier:(NSString *)name;
+/*!
+    @method
+    @abstract   Returns value as a complete SQL literal, quotes included.
+    @discussion nil and NSNull give NULL, NSData gives a bytea literal, an 
+				NSDictionary or NSArray its JSON and anything else is quoted 
+				from its description with PQescapeLiteral.
+*/
+-(NSString *)sqlQuoteLiteral:(id)value;
 
 #pragma mark -
 #pragma mark Simple Accessors
@@ -182,18 +521,148 @@
 -(NSString *)databaseName;
 -(void)setDatabaseName:(NSString *)value;
 
+/*!
+    @method
+    @abstract   Servers to connect to, in order of preference, as "host:port"
+				strings.
+    @discussion When set, connect starts an attempt on the first endpoint 
+				and then, every connectStagger seconds or as soon as every 
+				attempt so far has failed, on the next.  All of them are 
+				polled together and the first to finish connecting (and match
+				targetSessionRole) is kept, the rest are dropped.  A server 
+				that is down costs one stagger interval instead of a full TCP
+				timeout.
+ 
+				An endpoint without a port uses port, and IPv6 addresses go in
+				brackets, as in "[::1]:5432".  While hosts is set it replaces 
+				the server and any host in connectionString.  Set it to nil to
+				go back to a single server.
+*/
+-(NSArray *)hosts;
+-(void)setHosts:(NSArray *)value;
+
+/*!
+    @method
+    @abstract   The kind of server a multi-host connect will accept.
+    @discussion One of @"any" (the default, also nil), @"read-write", 
+				@"read-only", @"primary" or @"standby".  The read-write and 
+				read-only roles are checked against transaction_read_only, 
+				primary and standby against pg_is_in_recovery().  Servers that
+				do not match are disconnected and the race goes on without 
+				them.
+*/
+-(NSString *)targetSessionRole;
+-(void)setTargetSessionRole:(NSString *)value;
+
+/*!
+    @method
+    @abstract   Seconds to wait on one endpoint before also trying the next.
+				Defaults to 0.05.
+*/
+-(NSTimeInterval)connectStagger;
+-(void)setConnectStagger:(NSTimeInterval)value;
+
+/*!
+    @method
+    @abstract   Seconds a multi-host connect may take in all before it gives
+				up.  Defaults to 10, 0 waits for as long as libpq does.
+*/
+-(NSTimeInterval)connectTimeout;
+-(void)setConnectTimeout:(NSTimeInterval)value;
+
+/*!
+    @method
+    @abstract   The entry from hosts that won the last connect, or nil when 
+				hosts is not in use.
+*/
+-(NSString *)connectedHost;
+
+/*!
+    @method
+    @abstract   Reconnect on its own after the server goes away.
+    @discussion Off by default.  When on, a background thread probes the 
+				connection every healthCheckInterval seconds with an empty 
+				query (skipped while the connection is busy) and watches for
+				statements that find the connection broken.  A lost connection
+				is re-established with connect, retrying after an exponential
+				backoff with random jitter between reconnectBaseDelay and 
+				reconnectMaximumDelay, and prepared statements, session 
+				commands and client_encoding are restored.  close stops it.
+*/
+-(BOOL)autoReconnect;
+-(void)setAutoReconnect:(BOOL)value;
+
+/*!
+    @method
+    @abstract   NO from the moment the connection is found broken until it
+				has been re-established.
+*/
+-(BOOL)isHealthy;
+
+/*!
+    @method
+    @abstract   Seconds between probes of an idle connection.  Defaults to 5.
+*/
+-(NSTimeInterval)healthCheckInterval;
+-(void)setHealthCheckInterval:(NSTimeInterval)value;
+
+/*!
+    @method
+    @abstract   Backoff before the first and the longest between later 
+				reconnect attempts, in seconds.  Default to 0.1 and 10.
+*/
+-(NSTimeInterval)reconnectBaseDelay;
+-(void)setReconnectBaseDelay:(NSTimeInterval)value;
+-(NSTimeInterval)reconnectMaximumDelay;
+-(void)setReconnectMaximumDelay:(NSTimeInterval)value;
+
+/*!
+    @method
+    @abstract   Retry limits for idempotent statements.  Default to 3 retries
+				within 15 seconds.
+*/
+-(NSUInteger)maximumRetries;
+-(void)setMaximumRetries:(NSUInteger)value;
+-(NSTimeInterval)retryTimeout;
+-(void)setRetryTimeout:(NSTimeInterval)value;
+
 -(NSString *)lastError;
 
 -(NSMutableString *)sqlLog;
 -(void)appendSQLLog:(NSString *)value;
+/*!
+    @method
+    @abstract   Empty the log; sqlLog returns a copy, so emptying that does not.
+*/
+-(void)clearSQLLog;
+/*!
+    @method
+    @abstract   Whether the connection logs its statements and events to
+				sqlLog and NSLog.  YES unless set.
+    @discussion Every statement adds to the log, which grows for the life of
+				the connection; turn it off for long running or high volume
+				use.
+*/
+-(BOOL)logsSQL;
+-(void)setLogsSQL:(BOOL)value;
+
+/*!
+    @method
+    @abstract   Where statements slower than the log's threshold are 
+				recorded, see PGSQLSlowQueryLog.  nil, the default, records 
+				nothing.
+*/
+-(PGSQLSlowQueryLog *)slowQueryLog;
+-(void)setSlowQueryLog:(PGSQLSlowQueryLog *)value;
 
 /*!
     @function
     @abstract   Get the connection's defaultEncoding for all string operations 
 				returning.
-    @discussion The default setting is NSMacOSRoman.  While this default is 
-			    used to maintain existing functionality, this will be changed 
-                NSUTF8StringEncoding when PostgreSQL9 is released.
+    @discussion The default setting is NSUTF8StringEncoding.  On connect the 
+				server's client_encoding is set to match, so text arrives in 
+				the encoding the kit decodes it with and no transcoding is 
+				done server side or client side.
     @result     returns the defaultEncoding as an NSSTringEncoding ( 
 				http://developer.apple.com/mac/library/documentation/Cocoa/Reference/Foundation/Classes/NSString_Class/Reference/NSString.html#//apple_ref/doc/c_ref/NSStringEncoding )
 */
@@ -202,15 +671,25 @@
     @function
     @abstract   Set the defaultEncoding for all string operations on the current
                 connection
-    @discussion The default setting is NSMacOSRoman.  While this default is 
-				used to maintain existing functionality, this will be changed 
-				NSUTF8StringEncoding when PostgreSQL9 is released.
+    @discussion The default setting is NSUTF8StringEncoding.  Where the 
+				encoding has a PostgreSQL equivalent the connection's 
+				client_encoding is changed to match; encodings without one 
+				(such as NSMacOSRoman) leave the server default in place.
 	@param      value the defaultEncoding as an NSSTringEncoding ( 
 			    http://developer.apple.com/mac/library/documentation/Cocoa/Reference/Foundation/Classes/NSString_Class/Reference/NSString.html#//apple_ref/doc/c_ref/NSStringEncoding )
 
     @result     void
 */
 -(void)setDefaultEncoding:(NSStringEncoding)value;
+
+/*!
+    @function
+    @abstract   The client_encoding currently reported by the server.
+    @discussion Read from the ParameterStatus the server sends, so it reflects
+				the encoding actually in effect rather than the one requested.
+				Returns nil when not connected.
+*/
+-(NSString *)clientEncoding;
 	
 /*!
     @method     
@@ -7,11 +7,16 @@
 //
 
 #import "PGSQLConnection.h"
+#import "PGSQLCommandResult.h"
+#import "PGSQLBulkMerge.h"
 #include "libpq-fe.h"
 #import <sys/time.h>
 #import <Security/Security.h>
 #import <Foundation/Foundation.h>
 #import <stdlib.h>
+#import <sys/select.h>
+#import <errno.h>
+#import <math.h>
 
 // When a pqlib notice is raised this function gets called
 void
@@ -22,9 +27,158 @@ handle_pq_notice(void *arg, const char *message)
 	[theConn  appendSQLLog:[NSString stringWithFormat: @"Notice: %s\n", message]];
 }
 
+@class PGSQLTableSchema;
+
 @interface PGSQLConnection (Private)
 
-- (PGresult *) openResult:(NSString *)sql numberOfArguments:(int)nParams withParameters:(va_list)list firstParam:(id)params;
+- (PGSQLCommandResult *) openResult:(NSString *)sql numberOfArguments:(int)nParams withParameters:(va_list)list firstParam:(id)params;
+- (PGSQLCommandResult *)resultForSQL:(NSString *)sql statementName:(NSString *)name
+				   numberOfArguments:(int)nParams types:(Oid *)paramTypes 
+							  values:(const char **)paramValues lengths:(int *)paramLengths 
+							 formats:(int *)paramFormats;
+- (void)setLastError:(NSString *)error cmdStatus:(NSString *)status;
+- (BOOL)applyClientEncoding;
+- (PGconn *)connectToHosts:(NSString **)error;
+- (BOOL)openConnection:(BOOL)onlyIfWanted;
+- (void)disconnect;
+- (void)restoreSessionState;
+- (BOOL)prepareOnServer:(NSString *)name sql:(NSString *)sql;
+- (void)connectionWasLost;
+- (void)startHealthMonitor;
+- (void)monitorHealth;
+- (BOOL)probeConnection;
+- (BOOL)waitUntilHealthyBeforeDate:(NSDate *)limit;
+- (PGSQLTableSchema *)schemaForTable:(NSString *)table;
+- (NSArray *)columnsOfSchema:(PGSQLTableSchema *)schema forKeys:(NSArray *)keys;
+- (PGSQLCommandResult *)executeDictionaryStatement:(NSString *)sql parameters:(NSArray *)params;
+- (BOOL)beginBatch:(BOOL *)ownsTransaction;
+- (BOOL)endBatch:(BOOL)ownsTransaction succeeded:(BOOL)succeeded;
+- (NSString *)escapeString:(const char *)text length:(size_t)length quoted:(BOOL)quoted;
+
+@end
+
+// Maps an NSStringEncoding to the name PostgreSQL uses for client_encoding. 
+// Encodings without a server side equivalent (MacRoman, for one) return NULL
+// and leave the server default in place.
+static const char *
+PGSQLServerEncodingName(NSStringEncoding encoding)
+{
+	switch (encoding)
+	{
+		case NSUTF8StringEncoding:			return "UTF8";
+		case NSISOLatin1StringEncoding:		return "LATIN1";
+		case NSISOLatin2StringEncoding:		return "LATIN2";
+		case NSWindowsCP1250StringEncoding:	return "WIN1250";
+		case NSWindowsCP1251StringEncoding:	return "WIN1251";
+		case NSWindowsCP1252StringEncoding:	return "WIN1252";
+		case NSJapaneseEUCStringEncoding:	return "EUC_JP";
+		case NSShiftJISStringEncoding:		return "SJIS";
+		default:							return NULL;
+	}
+}
+
+// UTF8String hands back the string's internal buffer when it already holds 
+// UTF-8 (or ASCII), where cStringUsingEncoding: always goes the long way.
+static const char *
+PGSQLCStringFromString(NSString *value, NSStringEncoding encoding)
+{
+	if (encoding == NSUTF8StringEncoding)
+	{
+		return [value UTF8String];
+	}
+	return [value cStringUsingEncoding:encoding];
+}
+
+// A table as the dictionary tools see it, read once by schemaForTable:.
+@interface PGSQLTableSchema : NSObject {
+	NSString *tableName;		// as regclass prints it, quoted where needed
+	NSArray *columnNames;		// in attribute order
+	NSDictionary *columnTypes;	// name -> format_type
+	NSArray *primaryKey;
+	BOOL hasComplexColumns;		// arrays or composites, which unnest can't carry
+}
+
+-(id)initWithRecordset:(PGSQLRecordset *)rs;
+-(NSString *)tableName;
+-(NSArray *)columnNames;
+-(NSString *)typeOfColumn:(NSString *)columnName;
+-(NSArray *)primaryKey;
+-(BOOL)hasComplexColumns;
+
+@end
+
+@implementation PGSQLTableSchema
+
+-(id)initWithRecordset:(PGSQLRecordset *)rs
+{
+	self = [super init];
+	
+	if (self != nil)
+	{
+		NSMutableArray *names = [NSMutableArray array];
+		NSMutableDictionary *types = [NSMutableDictionary dictionary];
+		NSMutableArray *key = [NSMutableArray array];
+		
+		PGSQLRecord *record;
+		for (record = [rs moveFirst]; record != nil; record = [rs moveNext])
+		{
+			NSString *columnName = [[record fieldByIndex:0] asString];
+			[names addObject:columnName];
+			[types setObject:[[record fieldByIndex:1] asString] forKey:columnName];
+			if ([[record fieldByIndex:2] asBoolean])
+			{
+				[key addObject:columnName];
+			}
+			if ([[record fieldByIndex:4] asBoolean])
+			{
+				hasComplexColumns = YES;
+			}
+			if (tableName == nil)
+			{
+				tableName = [[[record fieldByIndex:3] asString] copy];
+			}
+		}
+		
+		columnNames = [names copy];
+		columnTypes = [types copy];
+		primaryKey = [key copy];
+	}
+	return self;
+}
+
+-(void)dealloc
+{
+	[tableName release];
+	[columnNames release];
+	[columnTypes release];
+	[primaryKey release];
+	[super dealloc];
+}
+
+-(NSString *)tableName
+{
+	return tableName;
+}
+
+-(NSArray *)columnNames
+{
+	return columnNames;
+}
+
+-(NSString *)typeOfColumn:(NSString *)columnName
+{
+	return [columnTypes objectForKey:columnName];
+}
+
+-(NSArray *)primaryKey
+{
+	return primaryKey;
+}
+
+-(BOOL)hasComplexColumns
+{
+	return hasComplexColumns;
+}
 
 @end
 
@@ -55,11 +209,16 @@ NSString *const PGSQLCommandDidCompleteNotification = @"PGSQLCommandDidCompleteN
 		isConnected	= NO;
 		errorDescription = nil;
 		sqlLog = [[NSMutableString alloc] init];		
+		logSQL = YES;
+		
+		executionLock = [[NSRecursiveLock alloc] init];
+		stateLock = [[NSLock alloc] init];
 		
-		// this will default to NSUTF8StringEncoding with PG9
-		defaultEncoding = NSMacOSRomanStringEncoding;
+		// client_encoding is negotiated to match this on connect
+		defaultEncoding = NSUTF8StringEncoding;
 		
 		pgconn = nil;
+		pgcancel = nil;
 		host = [[NSString alloc] initWithString:@"localhost"];
 		port = [[NSString alloc] initWithString:@"5432"];
 		options = nil;
@@ -72,6 +231,33 @@ NSString *const PGSQLCommandDidCompleteNotification = @"PGSQLCommandDidCompleteN
 		krbsrvName = nil;
 		connectionString = nil;
 		
+		hosts = nil;
+		targetSessionRole = nil;
+		connectStagger = 0.05;
+		connectTimeout = 10;
+		connectedHost = nil;
+		catalog = nil;
+		slowQueryLog = nil;
+		
+		autoReconnect = NO;
+		wantsConnection = NO;
+		isHealthy = NO;
+		lossReported = NO;
+		isMonitoringHealth = NO;
+		healthCheckInterval = 5;
+		reconnectBaseDelay = 0.1;
+		reconnectMaximumDelay = 10;
+		maximumRetries = 3;
+		retryTimeout = 15;
+		healthCondition = [[NSCondition alloc] init];
+		preparedStatements = [[NSMutableDictionary alloc] init];
+		sessionCommands = [[NSMutableArray alloc] init];
+		tableSchemas = [[NSMutableDictionary alloc] init];
+		dictionaryStatements = [[NSMutableDictionary alloc] init];
+		escapeBuffer = NULL;
+		escapeBufferSize = 0;
+		quotedIdentifiers = [[NSMutableDictionary alloc] init];
+		
 		commandStatus = nil;
 		
 		if (globalPGSQLConnection == nil)
@@ -99,9 +285,23 @@ NSString *const PGSQLCommandDidCompleteNotification = @"PGSQLCommandDidCompleteN
 	[service release];
 	[krbsrvName release];
 	[connectionString release];
+	[hosts release];
+	[targetSessionRole release];
+	[connectedHost release];
+	[catalog release];
+	[slowQueryLog release];
 	[errorDescription release];
 	[commandStatus release];
 	[sqlLog release];
+	[executionLock release];
+	[stateLock release];
+	[healthCondition release];
+	[preparedStatements release];
+	[sessionCommands release];
+	[tableSchemas release];
+	[dictionaryStatements release];
+	[quotedIdentifiers release];
+	free(escapeBuffer);
 	
 	[super dealloc];
 }
@@ -139,9 +339,30 @@ NSString *const PGSQLCommandDidCompleteNotification = @"PGSQLCommandDidCompleteN
 }
 
 - (BOOL)connect {
+	return [self openConnection:NO];
+}
 
+// The health monitor reconnects with onlyIfWanted set: wantsConnection is
+// read under the execution lock that -close waits on after clearing it,
+// so a close is never undone, and it is left as it is.
+- (BOOL)openConnection:(BOOL)onlyIfWanted
+{
+	[executionLock lock];
+	
+	if (onlyIfWanted)
+	{
+		[healthCondition lock];
+		BOOL wanted = wantsConnection;
+		[healthCondition unlock];
+		if (!wanted)
+		{
+			[executionLock unlock];
+			return NO;
+		}
+	}
+	
 	// replace with postgres connect code
-	[self close];
+	[self disconnect];
 	
 	if (connectionString == nil)
 	{
@@ -149,28 +370,42 @@ NSString *const PGSQLCommandDidCompleteNotification = @"PGSQLCommandDidCompleteN
 		[connectionString retain];
 	}
 	NSAssert( (connectionString != nil), @"Attempted to connect to PostgreSQL with empty connectionString.");
-	pgconn = (PGconn *)PQconnectdb([connectionString cStringUsingEncoding:NSUTF8StringEncoding]);
+	
+	NSString *error = nil;
+	if ([hosts count] > 0)
+	{
+		pgconn = [self connectToHosts:&error];
+	} else {
+		pgconn = (PGconn *)PQconnectdb([connectionString cStringUsingEncoding:NSUTF8StringEncoding]);
+		if (PQstatus(pgconn) == CONNECTION_BAD) 
+		{
+			error = [NSString stringWithFormat:@"%s", PQerrorMessage(pgconn)];
+		}
+	}
 #ifdef DEBUG
-	if (PQoptions(pgconn))
+	if ((pgconn != nil) && PQoptions(pgconn))
 	{
 		NSLog(@"Options: %s", PQoptions(pgconn));
 	}
 #endif
 	
-	if (PQstatus(pgconn) == CONNECTION_BAD) 
+	if (error != nil) 
 	{
-		errorDescription = [NSString stringWithFormat:@"%s", PQerrorMessage(pgconn)];
-		[errorDescription retain];
+		[self setLastError:error cmdStatus:nil];
 
 		NSLog(@"Connection to database '%@' failed.", dbName);
-		NSLog(@"\t%@", errorDescription);
+		NSLog(@"\t%@", error);
 		[self appendSQLLog:[NSString stringWithFormat:@"Connection to database %@ Failed.\n", dbName]]; 
 		[self appendSQLLog:[NSString stringWithFormat:@"Connection string: %@\n\n", connectionString]]; 
 		// append error too??
 
-		PQfinish(pgconn);
+		if (pgconn != nil)
+		{
+			PQfinish(pgconn);
+		}
 		pgconn = nil;
 		isConnected = NO;
+		[executionLock unlock];
 		return NO;
     }
 	
@@ -179,387 +414,1937 @@ NSString *const PGSQLCommandDidCompleteNotification = @"PGSQLCommandDidCompleteN
 	
 	// TODO password should be asked for in dialog used and then erased?
 	
-	if (errorDescription)
-	{
-		[errorDescription release];
-		errorDescription = nil;
-	}
+	[self setLastError:nil cmdStatus:nil];
+
 	// set up notification
 	PQsetNoticeProcessor(pgconn, handle_pq_notice, self);
 	
-	if (sqlLog != nil) {
-		[sqlLog release];
-	}
+	[stateLock lock];
+	[sqlLog release];
 	sqlLog = [[NSMutableString alloc] init];
+	[stateLock unlock];
 	[self appendSQLLog:[NSString stringWithFormat:@"Connected to database %@.\n", dbName]];
 	isConnected = YES;
-	return YES;
-}
-
-- (BOOL)close
-{
-	if (pgconn == nil) { return NO; }
-	if (isConnected == NO) { return NO; }
 	
-	[self appendSQLLog:[NSString stringWithString:@"Disconnected from database.\n"]];
-	PQfinish(pgconn);
-	pgconn = nil;
-	isConnected = NO;
+	[stateLock lock];
+	pgcancel = PQgetCancel(pgconn);
+	[stateLock unlock];
+	
+	// picked up without a query when another connection already loaded it
+	PGSQLCatalog *sharedCatalog = [PGSQLCatalog cachedCatalogForConnection:self];
+	[stateLock lock];
+	catalog = [sharedCatalog retain];
+	[stateLock unlock];
+	
+	[self applyClientEncoding];
+	[self restoreSessionState];
+	
+	[healthCondition lock];
+	if (!onlyIfWanted)
+	{
+		wantsConnection = YES;
+	}
+	// a close waiting on the execution lock disconnects next
+	isHealthy = wantsConnection;
+	lossReported = NO;
+	[healthCondition broadcast];
+	[healthCondition unlock];
+	[self startHealthMonitor];
+	
+	[executionLock unlock];
 	return YES;
 }
 
-- (BOOL)reset
-{
-    PQreset(pgconn);
-    return PQstatus(pgconn) == CONNECTION_OK;
-}
-
-void parseParameters(int numArgs, va_list args, Oid *paramTypes, const char **paramValues, int *paramLengths, int *paramFormats, id firstArg) {
-    id arg = firstArg;
-    for (int i = 0; i < numArgs; i++) {
-        paramTypes[i] = 0; // autodetect datatype
-        paramFormats[i] = 0; // default to textual representation
-        NSString *val = nil;
-        if ([arg isKindOfClass:[NSData class]]) {
-            paramFormats[i] = 1;
-            paramValues[i] = [arg bytes];
-            paramLengths[i] = [arg length];
-        } else {
-            val = arg ? [arg description] : NULL;
-            paramValues[i] = [val cStringUsingEncoding:NSUTF8StringEncoding];
-            paramLengths[i] = 0; // unused for text encoding
-        }
-        
-        
-        arg = va_arg(args, id);
-    }
-    
-}
-
-- (PGresult *) openResult:(NSString *)sql numberOfArguments:(int)nParams withParameters:(va_list)list firstParam:(id)params
+- (BOOL)applyClientEncoding
 {
-    PGresult* res;
-    
-    Oid paramTypes[nParams];
-    const char *paramValues[nParams];
-    int paramLengths[nParams];
-    int paramFormats[nParams];
-
-    parseParameters(nParams, list, paramTypes, paramValues, paramLengths, paramFormats, params);
-
+	if (pgconn == nil) { return NO; }
 	
-	if(errorDescription) {
-		[errorDescription release];
-		errorDescription = nil;	
-	}
-	if(commandStatus) {
-		[commandStatus release];
-		commandStatus = nil;	
-	}
-    
-	if (pgconn == nil) 
+	const char *encodingName = PGSQLServerEncodingName(defaultEncoding);
+	if (encodingName == NULL) 
 	{ 
-		errorDescription = [NSString stringWithString:@"Object is not Connected."];		
-		[errorDescription retain];
-        [[NSException exceptionWithName:@"PGSQLError" reason:errorDescription userInfo:nil] raise];
+		// nothing to negotiate, strings are converted client side as before
 		return NO; 
 	}
 	
-    res = PQexecParams(pgconn, [sql cStringUsingEncoding:defaultEncoding], nParams, paramTypes, paramValues, paramLengths, paramFormats, 0);
-	if (res == nil) 
-	{ 
-		errorDescription = [NSString stringWithString:@"ERROR: No response (PGRES_FATAL_ERROR)"];		
-		[errorDescription retain];
-		return NO; 
-	}
-    ExecStatusType status = PQresultStatus(res);
-	if (status == PGRES_BAD_RESPONSE || status == PGRES_NONFATAL_ERROR || status == PGRES_FATAL_ERROR) 
+	NSString *failure = nil;
+	
+	[executionLock lock];
+	if (PQsetClientEncoding(pgconn, encodingName) != 0)
 	{
-		errorDescription = [NSString stringWithFormat:@"%s", PQerrorMessage(pgconn)];
-		[errorDescription retain];
-        [[NSException exceptionWithName:@"PGSQLError" reason:errorDescription userInfo:nil] raise];
-		PQclear(res);
-		return NULL;
-    }
-	if (strlen(PQcmdStatus(res)))
+		failure = [NSString stringWithFormat:@"Unable to set client_encoding to %s: %s\n", 
+				   encodingName, PQerrorMessage(pgconn)];
+	} else {
+		// trust the server's ParameterStatus report over our own request
+		const char *reported = PQparameterStatus(pgconn, "client_encoding");
+		if ((reported == NULL) || (strcmp(reported, encodingName) != 0))
+		{
+			failure = [NSString stringWithFormat:@"Server reported client_encoding %s, expected %s.\n", 
+					   (reported ? reported : "(null)"), encodingName];
+		}
+	}
+	[executionLock unlock];
+	
+	if (failure != nil)
 	{
-		commandStatus = [NSString stringWithFormat:@"%s", PQcmdStatus(res)];
-		[commandStatus retain];
-		[self appendSQLLog:[NSString stringWithFormat:@"%@\n", commandStatus]];
+		[self appendSQLLog:failure];
+		return NO;
 	}
-    
-    return res;
-}
-
-- (void)execCommandAsync:(NSString *)sql
-{
-	// perform the connection on a thread
-	[NSThread detachNewThreadSelector:@selector(performExecCommand:) toTarget:self withObject:sql];		
+	return YES;
 }
 
-- (void)performExecCommand:(id)sqlCommand
+- (BOOL)close
 {
-	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
-	
-	NSString *sql = (NSString *)sqlCommand;
-	
-	NSMutableDictionary *info = [[[NSMutableDictionary alloc] init] autorelease];
+	// stops the health monitor as well, a closed connection stays closed
+	[healthCondition lock];
+	wantsConnection = NO;
+	isHealthy = NO;
+	[healthCondition broadcast];
+	[healthCondition unlock];
 	
-	NSNumber *recordCount = [[[NSNumber alloc] initWithInt:[self execCommand:sql]] autorelease];
-	[info setValue:recordCount forKey:@"RecordCount"];
-	[info setValue:[self lastError] forKey:@"Error"];
-	[info setValue:[self lastCmdStatus] forKey:@"Status"];
+	[executionLock lock];
+	if ((pgconn == nil) || (isConnected == NO))
+	{
+		[executionLock unlock];
+		return NO;
+	}
 	
-	[[NSNotificationCenter defaultCenter] postNotificationName:PGSQLCommandDidCompleteNotification
-														object:nil
-													  userInfo:info];
-	[pool release];
+	[self disconnect];
+	[executionLock unlock];
+	return YES;
 }
 
-- (BOOL)execCommand:(NSString *)sql
+- (void)disconnect
 {
-	return [self execCommand:sql numberOfArguments:0 withParameters:nil];
+	[executionLock lock];
+	[stateLock lock];
+	if (pgcancel != nil)
+	{
+		PQfreeCancel(pgcancel);
+		pgcancel = nil;
+	}
+	[catalog release];
+	catalog = nil;
+	[stateLock unlock];
+	[quotedIdentifiers removeAllObjects];
+	if (pgconn != nil)
+	{
+		if (isConnected)
+		{
+			[self appendSQLLog:[NSString stringWithString:@"Disconnected from database.\n"]];
+		}
+		PQfinish(pgconn);
+		pgconn = nil;
+	}
+	isConnected = NO;
+	[connectedHost release];
+	connectedHost = nil;
+	[executionLock unlock];
 }
 
-
-
-- (BOOL)execCommand:(NSString *)sql numberOfArguments:(int)nParams withParameters:(id)params,...
+#pragma mark -
+#pragma mark Multi-host Connect
+
+// One endpoint's attempt in a multi-host connect.
+typedef struct {
+	NSString *endpoint;
+	PGconn *conn;
+	PostgresPollingStatusType poll;
+	int state;
+} PGSQLConnectAttempt;
+
+enum {
+	PGSQLAttemptConnecting = 0,
+	PGSQLAttemptCheckingRole,
+	PGSQLAttemptFailed
+};
+
+// Splits "host:port", "[v6addr]:port" or a bare host.  A bare IPv6 address 
+// has more than one colon and is taken as a host with no port.
+static void
+PGSQLSplitEndpoint(NSString *endpoint, NSString *defaultPort, NSString **hostOut, NSString **portOut)
 {
-    PGresult* res;
-    va_list list;
-    
-        
-    va_start(list, params);
-    
-    res = [self openResult:sql numberOfArguments:nParams withParameters:list firstParam:params];
-    
-    va_end(list);
+	*hostOut = endpoint;
+	*portOut = defaultPort;
 	
+	if ([endpoint hasPrefix:@"["])
+	{
+		NSRange bracket = [endpoint rangeOfString:@"]"];
+		if (bracket.location != NSNotFound)
+		{
+			*hostOut = [endpoint substringWithRange:NSMakeRange(1, bracket.location - 1)];
+			NSString *rest = [endpoint substringFromIndex:bracket.location + 1];
+			if (([rest length] > 1) && [rest hasPrefix:@":"])
+			{
+				*portOut = [rest substringFromIndex:1];
+			}
+		}
+		return;
+	}
 	
-	if (PQresultStatus(res) != PGRES_COMMAND_OK) 
+	NSRange colon = [endpoint rangeOfString:@":"];
+	NSRange lastColon = [endpoint rangeOfString:@":" options:NSBackwardsSearch];
+	if ((colon.location != NSNotFound) && (colon.location == lastColon.location) && 
+		(colon.location + 1 < [endpoint length]))
 	{
-		errorDescription = [NSString stringWithFormat:@"%s", PQerrorMessage(pgconn)];
-		[errorDescription retain];
-        [[NSException exceptionWithName:@"PGSQLError" reason:errorDescription userInfo:nil] raise];
-		PQclear(res);
-		return NO;
-    }
-    
-	PQclear(res);	
-	return YES;	
+		*hostOut = [endpoint substringToIndex:colon.location];
+		*portOut = [endpoint substringFromIndex:colon.location + 1];
+	}
 }
 
-- (void)openAsync:(NSString *)sql
+// The statement that answers the role question, or NULL when any server will
+// do.
+static const char *
+PGSQLRoleQuery(NSString *role)
 {
-	// perform the connection on a thread
-	[NSThread detachNewThreadSelector:@selector(performOpen:) toTarget:self withObject:sql];		
+	if ([role isEqualToString:@"read-write"] || [role isEqualToString:@"read-only"])
+	{
+		return "SHOW transaction_read_only";
+	}
+	if ([role isEqualToString:@"primary"] || [role isEqualToString:@"standby"])
+	{
+		return "SELECT pg_catalog.pg_is_in_recovery()";
+	}
+	return NULL;
 }
 
-- (void)performOpen:(id)sqlCommand
+static BOOL
+PGSQLRoleMatches(NSString *role, const char *value)
 {
-	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
-	
-	NSString *sql = (NSString *)sqlCommand;
-	
-	NSMutableDictionary *info = [[[NSMutableDictionary alloc] init] autorelease];
-	
-	PGSQLRecordset *rs = [self open:sql];
-	[info setValue:rs forKey:@"Recordset"];
-	[info setValue:[self lastError] forKey:@"Error"];
+	if (value == NULL) { return NO; }
 	
-	[[NSNotificationCenter defaultCenter] postNotificationName:PGSQLCommandDidCompleteNotification
-														object:nil
-													  userInfo:info];
-	[pool release];
+	if ([role isEqualToString:@"read-write"]) { return (strcmp(value, "off") == 0); }
+	if ([role isEqualToString:@"read-only"])  { return (strcmp(value, "on") == 0); }
+	if ([role isEqualToString:@"primary"])    { return (strcmp(value, "f") == 0); }
+	if ([role isEqualToString:@"standby"])    { return (strcmp(value, "t") == 0); }
+	return YES;
 }
 
-- (PGSQLRecordset *)open:(NSString *)sql
+static void
+PGSQLAbandonAttempt(PGSQLConnectAttempt *attempt, NSMutableString *failures, NSString *reason)
 {
-    return [self open:sql numberOfArguments:0 withParameters:nil];
+	[failures appendFormat:@"%@: %@\n", attempt->endpoint, reason];
+	if (attempt->conn != NULL)
+	{
+		PQfinish(attempt->conn);
+		attempt->conn = NULL;
+	}
+	attempt->state = PGSQLAttemptFailed;
 }
 
-- (PGSQLRecordset *)open:(NSString *)sql numberOfArguments:(int)nParams withParameters:(id)params, ...
+// Races the endpoints in hosts.  Attempts start connectStagger apart, or at 
+// once when every attempt so far has failed, and are all polled through one 
+// select().  The first to reach CONNECTION_OK and pass the role check wins 
+// and every other attempt is finished.  Returns NULL with *error describing
+// each endpoint's failure when none qualifies.
+- (PGconn *)connectToHosts:(NSString **)error
 {
-	PGresult* res;
-
-    va_list list;
-    va_start(list, params);
-    
-    res = [self openResult:sql numberOfArguments:nParams withParameters:list firstParam:params];
-    
-    va_end(list);
+	NSUInteger count = [hosts count];
+	PGSQLConnectAttempt *attempts = calloc(count, sizeof(PGSQLConnectAttempt));
+	NSMutableString *failures = [NSMutableString string];
+	const char *roleQuery = PGSQLRoleQuery(targetSessionRole);
 	
+	// the rest of the settings ride along in dbname, host and port override it
+	const char *keywords[] = { "dbname", "host", "port", NULL };
+	const char *baseInfo = [connectionString UTF8String];
 	
-	switch (PQresultStatus(res))
+	PGSQLConnectAttempt *winner = NULL;
+	NSUInteger started = 0;
+	NSTimeInterval begin = [NSDate timeIntervalSinceReferenceDate];
+	NSTimeInterval nextStart = begin;
+	
+	while (winner == NULL)
 	{
-		case PGRES_TUPLES_OK:
+		NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+		NSUInteger live = 0;
+		NSUInteger i;
+		for (i = 0; i < started; i++)
+		{
+			if (attempts[i].state != PGSQLAttemptFailed) { live++; }
+		}
+		
+		if ((started < count) && ((now >= nextStart) || (live == 0)))
 		{
-			// build the recordset
-			PGSQLRecordset *rs = [[[PGSQLRecordset alloc] initWithResult:res] autorelease];
-			[rs setDefaultEncoding:defaultEncoding];
+			PGSQLConnectAttempt *attempt = &attempts[started];
+			NSString *endpointHost;
+			NSString *endpointPort;
 			
-			if (logInfo)
+			attempt->endpoint = [hosts objectAtIndex:started];
+			PGSQLSplitEndpoint(attempt->endpoint, port, &endpointHost, &endpointPort);
+			
+			const char *values[] = { baseInfo, [endpointHost UTF8String], [endpointPort UTF8String], NULL };
+			attempt->conn = PQconnectStartParams(keywords, values, 1);
+			attempt->poll = PGRES_POLLING_WRITING;
+			attempt->state = PGSQLAttemptConnecting;
+			if ((attempt->conn == NULL) || (PQstatus(attempt->conn) == CONNECTION_BAD))
 			{
-				long nRecords = PQntuples(res);
-				[self appendSQLLog:[NSString stringWithFormat: @"%d rows affected.\n\n", nRecords]];
+				PGSQLAbandonAttempt(attempt, failures, 
+					(attempt->conn ? [NSString stringWithUTF8String:PQerrorMessage(attempt->conn)] : @"out of memory"));
 			}
-						
-			return rs;
-			break;
-		}
 			
-		case PGRES_COMMAND_OK:
+			started++;
+			nextStart = now + connectStagger;
+			continue;
+		}
+		
+		if (live == 0)
 		{
-			if (logInfo)
-			{
-				[self appendSQLLog:@"Query ran successfully.\n"];
-			}
-			PQclear(res);
-			return nil;
 			break;
 		}
-			
-		case PGRES_EMPTY_QUERY:
+		if ((connectTimeout > 0) && (now - begin >= connectTimeout))
 		{
-			[self appendSQLLog:@"Postgres reported Empty Query\n"];
-			PQclear(res);
-			return nil;
+			[failures appendFormat:@"Timed out after %.1f seconds.\n", connectTimeout];
 			break;
 		}
-			
-		case PGRES_COPY_OUT:
-		case PGRES_COPY_IN:
-		default:
+		
+		fd_set readable;
+		fd_set writable;
+		int maxSocket = -1;
+		FD_ZERO(&readable);
+		FD_ZERO(&writable);
+		for (i = 0; i < started; i++)
 		{
-			errorDescription = [NSString stringWithFormat:@"PostgreSQL Error: %s", PQresultErrorMessage(res)];
-			[errorDescription retain];
-			[self appendSQLLog:[NSString stringWithFormat:@"%@\n", errorDescription]];
-            [[NSException exceptionWithName:@"PGSQLError" reason:errorDescription userInfo:nil] raise];
-			PQclear(res);
-			return nil;
+			if (attempts[i].state == PGSQLAttemptFailed) { continue; }
+			
+			int sock = PQsocket(attempts[i].conn);
+			if ((attempts[i].state == PGSQLAttemptConnecting) && (attempts[i].poll == PGRES_POLLING_WRITING))
+			{
+				FD_SET(sock, &writable);
+			} else {
+				FD_SET(sock, &readable);
+			}
+			if (sock > maxSocket) { maxSocket = sock; }
+		}
+		
+		// sleep until a socket is ready, the next attempt is due or time is up
+		NSTimeInterval wait = (connectTimeout > 0) ? (begin + connectTimeout - now) : 60;
+		if ((started < count) && (nextStart - now < wait))
+		{
+			wait = nextStart - now;
+		}
+		if (wait < 0) { wait = 0; }
+		struct timeval timeout;
+		timeout.tv_sec = (long)wait;
+		timeout.tv_usec = (long)((wait - timeout.tv_sec) * 1000000);
+		
+		int ready = select(maxSocket + 1, &readable, &writable, NULL, &timeout);
+		if (ready < 0)
+		{
+			if (errno == EINTR) { continue; }
+			[failures appendFormat:@"select() failed: %s\n", strerror(errno)];
+			break;
+		}
+		
+		for (i = 0; (i < started) && (winner == NULL); i++)
+		{
+			PGSQLConnectAttempt *attempt = &attempts[i];
+			if (attempt->state == PGSQLAttemptFailed) { continue; }
+			
+			int sock = PQsocket(attempt->conn);
+			if (!FD_ISSET(sock, &readable) && !FD_ISSET(sock, &writable)) { continue; }
+			
+			if (attempt->state == PGSQLAttemptConnecting)
+			{
+				attempt->poll = PQconnectPoll(attempt->conn);
+				if (attempt->poll == PGRES_POLLING_FAILED)
+				{
+					PGSQLAbandonAttempt(attempt, failures, [NSString stringWithUTF8String:PQerrorMessage(attempt->conn)]);
+				} else if (attempt->poll == PGRES_POLLING_OK) {
+					if (roleQuery == NULL)
+					{
+						winner = attempt;
+					} else if (PQsendQuery(attempt->conn, roleQuery)) {
+						attempt->state = PGSQLAttemptCheckingRole;
+					} else {
+						PGSQLAbandonAttempt(attempt, failures, [NSString stringWithUTF8String:PQerrorMessage(attempt->conn)]);
+					}
+				}
+			} else {
+				if (!PQconsumeInput(attempt->conn))
+				{
+					PGSQLAbandonAttempt(attempt, failures, [NSString stringWithUTF8String:PQerrorMessage(attempt->conn)]);
+				} else if (!PQisBusy(attempt->conn)) {
+					BOOL matched = NO;
+					PGresult *res;
+					while ((res = PQgetResult(attempt->conn)) != NULL)
+					{
+						if ((PQresultStatus(res) == PGRES_TUPLES_OK) && (PQntuples(res) > 0))
+						{
+							matched = PGSQLRoleMatches(targetSessionRole, PQgetvalue(res, 0, 0));
+						}
+						PQclear(res);
+					}
+					if (matched)
+					{
+						winner = attempt;
+					} else {
+						PGSQLAbandonAttempt(attempt, failures, [NSString stringWithFormat:@"server is not %@", targetSessionRole]);
+					}
+				}
+			}
+		}
+	}
+	
+	PGconn *conn = NULL;
+	NSUInteger i;
+	for (i = 0; i < started; i++)
+	{
+		if (&attempts[i] == winner) { continue; }
+		if (attempts[i].conn != NULL)
+		{
+			PQfinish(attempts[i].conn);
+		}
+	}
+	if (winner != NULL)
+	{
+		conn = winner->conn;
+		[connectedHost release];
+		connectedHost = [winner->endpoint copy];
+	} else if (error != NULL) {
+		*error = failures;
+	}
+	free(attempts);
+	return conn;
+}
+
+- (BOOL)reset
+{
+	[executionLock lock];
+	if (pgconn == nil) 
+	{ 
+		[executionLock unlock];
+		return NO; 
+	}
+    PQreset(pgconn);
+	BOOL result = (PQstatus(pgconn) == CONNECTION_OK);
+	[executionLock unlock];
+    return result;
+}
+
+// The JSON text of a dictionary or array, NUL terminated for libpq, or nil 
+// for anything NSJSONSerialization can not write.
+static NSData *
+PGSQLJSONParameterData(id arg)
+{
+	if (!([arg isKindOfClass:[NSDictionary class]] || [arg isKindOfClass:[NSArray class]]) || 
+		![NSJSONSerialization isValidJSONObject:arg])
+	{
+		return nil;
+	}
+	NSMutableData *json = [[[NSJSONSerialization dataWithJSONObject:arg options:0 error:NULL] mutableCopy] autorelease];
+	[json appendBytes:"" length:1];
+	return json;
+}
+
+// NSData goes up as binary, nil and NSNull as SQL NULL, dictionaries and 
+// arrays as JSON text and everything else as the UTF-8 text of its 
+// description.
+static void
+PGSQLBindParameter(id arg, int i, Oid *paramTypes, const char **paramValues, int *paramLengths, int *paramFormats)
+{
+	NSData *json;
+
+	paramTypes[i] = 0; // autodetect datatype
+	paramFormats[i] = 0; // default to textual representation
+	paramLengths[i] = 0; // unused for text encoding
+	if ((arg == nil) || (arg == [NSNull null])) {
+		paramValues[i] = NULL;
+	} else if ([arg isKindOfClass:[NSData class]]) {
+		paramFormats[i] = 1;
+		paramValues[i] = [arg bytes];
+		paramLengths[i] = [arg length];
+	} else if ((json = PGSQLJSONParameterData(arg)) != nil) {
+		// serialized straight to bytes, the server casts the untyped text to
+		// json or jsonb from the statement
+		paramValues[i] = [json bytes];
+	} else {
+		paramValues[i] = [[arg description] UTF8String];
+	}
+}
+
+void parseParameters(int numArgs, va_list args, Oid *paramTypes, const char **paramValues, int *paramLengths, int *paramFormats, id firstArg) {
+    id arg = firstArg;
+    for (int i = 0; i < numArgs; i++) {
+		PGSQLBindParameter(arg, i, paramTypes, paramValues, paramLengths, paramFormats);
+        
+        if (i + 1 < numArgs) {
+			arg = va_arg(args, id);
+		}
+    }
+    
+}
+
+void parseParameterArray(NSArray *params, Oid *paramTypes, const char **paramValues, int *paramLengths, int *paramFormats) {
+	int numArgs = (int)[params count];
+	for (int i = 0; i < numArgs; i++) {
+		PGSQLBindParameter([params objectAtIndex:i], i, paramTypes, paramValues, paramLengths, paramFormats);
+	}
+}
+
+- (void)setLastError:(NSString *)error cmdStatus:(NSString *)status
+{
+	[stateLock lock];
+	if (errorDescription != error) {
+		[errorDescription release];
+		errorDescription = [error copy];
+	}
+	if (commandStatus != status) {
+		[commandStatus release];
+		commandStatus = [status copy];
+	}
+	[stateLock unlock];
+}
+
+// The one place statements reach the server.  The execution lock keeps one 
+// statement on the wire at a time, and everything about the outcome goes in 
+// the returned result so concurrent callers never read each other's status.
+// A statementName runs that prepared statement, sql is then only recorded in 
+// the result.
+- (PGSQLCommandResult *)resultForSQL:(NSString *)sql statementName:(NSString *)name
+				   numberOfArguments:(int)nParams types:(Oid *)paramTypes 
+							  values:(const char **)paramValues lengths:(int *)paramLengths 
+							 formats:(int *)paramFormats
+{
+	PGSQLCommandResult *result;
+	BOOL lost = NO;
+	NSTimeInterval started = [NSDate timeIntervalSinceReferenceDate];
+	
+	[executionLock lock];
+	if (pgconn == nil) 
+	{ 
+		[executionLock unlock];
+		result = [[PGSQLCommandResult alloc] initWithError:@"Object is not Connected." 
+													   sql:sql 
+											 executionTime:0];
+		// still down from an earlier loss, not a connection that was never made
+		lost = (wantsConnection && autoReconnect);
+	} else {
+		PGresult *res;
+		if (name != nil)
+		{
+			res = PQexecPrepared(pgconn, [name UTF8String], nParams, paramValues, paramLengths, paramFormats, 0);
+		} else {
+			res = PQexecParams(pgconn, PGSQLCStringFromString(sql, defaultEncoding), nParams, paramTypes, paramValues, paramLengths, paramFormats, 0);
+		}
+		NSTimeInterval elapsed = [NSDate timeIntervalSinceReferenceDate] - started;
+		if (PQstatus(pgconn) == CONNECTION_BAD)
+		{
+			lost = YES;
+			[self connectionWasLost];
+		}
+		if (res == nil)
+		{
+			NSString *error = [NSString stringWithFormat:@"ERROR: No response (PGRES_FATAL_ERROR) %s", PQerrorMessage(pgconn)];
+			[executionLock unlock];
+			result = [[PGSQLCommandResult alloc] initWithError:error sql:sql executionTime:elapsed];
+		} else {
+			[executionLock unlock];
+			result = [[PGSQLCommandResult alloc] initWithResult:res 
+															sql:sql 
+												  executionTime:elapsed 
+													   encoding:defaultEncoding];
+		}
+	}
+	if (lost && ![result succeeded])
+	{
+		[result setConnectionLost:YES];
+	}
+	if ([result recordset] != nil)
+	{
+		[stateLock lock];
+		[[result recordset] setCatalog:catalog];
+		[stateLock unlock];
+	}
+	
+	[self setLastError:[result lastError] cmdStatus:[result lastCmdStatus]];
+	if (logSQL && ([result lastCmdStatus] != nil))
+	{
+		[self appendSQLLog:[NSString stringWithFormat:@"%@\n", [result lastCmdStatus]]];
+	}
+	
+	[stateLock lock];
+	PGSQLSlowQueryLog *log = [[slowQueryLog retain] autorelease];
+	[stateLock unlock];
+	if (log != nil)
+	{
+		long rows = ([result recordset] != nil) ? [[result recordset] recordCount] : [result rowsAffected];
+		[log connection:self ranSQL:sql numberOfArguments:nParams values:paramValues 
+				lengths:paramLengths formats:paramFormats 
+		  executionTime:[result executionTime] rows:rows error:[result lastError]];
+	}
+	
+	return [result autorelease];
+}
+
+- (PGSQLCommandResult *) openResult:(NSString *)sql numberOfArguments:(int)nParams withParameters:(va_list)list firstParam:(id)params
+{
+    Oid paramTypes[nParams];
+    const char *paramValues[nParams];
+    int paramLengths[nParams];
+    int paramFormats[nParams];
+
+    parseParameters(nParams, list, paramTypes, paramValues, paramLengths, paramFormats, params);
+
+	return [self resultForSQL:sql statementName:nil numberOfArguments:nParams types:paramTypes values:paramValues lengths:paramLengths formats:paramFormats];
+}
+
+- (PGSQLCommandResult *)execute:(NSString *)sql
+{
+	return [self resultForSQL:sql statementName:nil numberOfArguments:0 types:NULL values:NULL lengths:NULL formats:NULL];
+}
+
+- (PGSQLCommandResult *)execute:(NSString *)sql numberOfArguments:(int)nParams withParameters:(id)params, ...
+{
+	PGSQLCommandResult *result;
+    va_list list;
+    
+    va_start(list, params);
+    result = [self openResult:sql numberOfArguments:nParams withParameters:list firstParam:params];
+    va_end(list);
+	
+	return result;
+}
+
+- (PGSQLCommandResult *)execute:(NSString *)sql parameters:(NSArray *)params
+{
+	int nParams = (int)[params count];
+    Oid paramTypes[nParams > 0 ? nParams : 1];
+    const char *paramValues[nParams > 0 ? nParams : 1];
+    int paramLengths[nParams > 0 ? nParams : 1];
+    int paramFormats[nParams > 0 ? nParams : 1];
+	
+	parseParameterArray(params, paramTypes, paramValues, paramLengths, paramFormats);
+	
+	return [self resultForSQL:sql statementName:nil numberOfArguments:nParams types:paramTypes values:paramValues lengths:paramLengths formats:paramFormats];
+}
+
+- (PGSQLCommandResult *)executeTemplate:(PGSQLQueryTemplate *)queryTemplate values:(NSDictionary *)values
+{
+	NSString *error = nil;
+	NSArray *params = [queryTemplate parametersFromDictionary:values error:&error];
+	if (params == nil)
+	{
+		[self setLastError:error cmdStatus:nil];
+		return [[[PGSQLCommandResult alloc] initWithError:error sql:[queryTemplate sql] executionTime:0] autorelease];
+	}
+	return [self execute:[queryTemplate compiledSQL] parameters:params];
+}
+
+- (PGSQLCommandResult *)execute:(NSString *)sql values:(NSDictionary *)values
+{
+	return [self executeTemplate:[PGSQLQueryTemplate templateWithSQL:sql] values:values];
+}
+
+- (NSArray *)executeScript:(NSString *)sql
+{
+	NSMutableArray *results = [NSMutableArray array];
+	NSTimeInterval started = [NSDate timeIntervalSinceReferenceDate];
+	NSString *error = nil;
+	
+	[executionLock lock];
+	if (pgconn == nil)
+	{
+		error = @"Object is not Connected.";
+	} else if (!PQsendQuery(pgconn, PGSQLCStringFromString(sql, defaultEncoding))) {
+		error = [NSString stringWithFormat:@"%s", PQerrorMessage(pgconn)];
+	} else {
+		// one PGresult per statement, then NULL once the server is done
+		PGresult *res;
+		while ((res = PQgetResult(pgconn)) != NULL)
+		{
+			NSTimeInterval elapsed = [NSDate timeIntervalSinceReferenceDate] - started;
+			PGSQLCommandResult *result = [[PGSQLCommandResult alloc] initWithResult:res 
+																				sql:sql 
+																	  executionTime:elapsed 
+																		   encoding:defaultEncoding];
+			[results addObject:result];
+			[result release];
+		}
+	}
+	[executionLock unlock];
+	
+	if (error != nil)
+	{
+		PGSQLCommandResult *result = [[PGSQLCommandResult alloc] initWithError:error sql:sql executionTime:0];
+		[results addObject:result];
+		[result release];
+	}
+	
+	PGSQLCommandResult *last = [results lastObject];
+	[self setLastError:[last lastError] cmdStatus:[last lastCmdStatus]];
+	return results;
+}
+
+- (PGSQLCommandResult *)execute:(NSString *)sql parameters:(NSArray *)params idempotent:(BOOL)idempotent
+{
+	PGSQLCommandResult *result = [self execute:sql parameters:params];
+	if (!idempotent || !autoReconnect)
+	{
+		return result;
+	}
+	
+	NSDate *limit = [NSDate dateWithTimeIntervalSinceNow:retryTimeout];
+	NSUInteger retries = 0;
+	while ([result connectionLost] && (retries < maximumRetries))
+	{
+		if (![self waitUntilHealthyBeforeDate:limit])
+		{
+			break;
+		}
+		retries++;
+		[self appendSQLLog:[NSString stringWithFormat:@"Retrying after reconnect (%lu): %@\n", (unsigned long)retries, sql]];
+		result = [self execute:sql parameters:params];
+	}
+	return result;
+}
+
+- (PGSQLRecordset *)open:(NSString *)sql idempotent:(BOOL)idempotent
+{
+	PGSQLCommandResult *result = [self execute:sql parameters:nil idempotent:idempotent];
+	if (![result succeeded])
+	{
+        [[NSException exceptionWithName:@"PGSQLError" reason:[result lastError] userInfo:nil] raise];
+		return nil;
+	}
+	return [result recordset];
+}
+
+- (void)lock
+{
+	[executionLock lock];
+}
+
+- (void)unlock
+{
+	[executionLock unlock];
+}
+
+- (BOOL)isInTransaction
+{
+	[executionLock lock];
+	PGTransactionStatusType status = (pgconn != nil) ? PQtransactionStatus(pgconn) : PQTRANS_UNKNOWN;
+	[executionLock unlock];
+	return ((status == PQTRANS_INTRANS) || (status == PQTRANS_INERROR));
+}
+
+- (BOOL)cancel
+{
+	char errbuf[256];
+	BOOL sent = YES;
+	
+	// not the execution lock, the statement being cancelled is holding it
+	[stateLock lock];
+	if (pgcancel != nil)
+	{
+		sent = (PQcancel(pgcancel, errbuf, sizeof(errbuf)) != 0);
+	}
+	[stateLock unlock];
+	
+	if (!sent)
+	{
+		[self appendSQLLog:[NSString stringWithFormat:@"Unable to cancel: %s\n", errbuf]];
+	}
+	return sent;
+}
+
+- (void)execCommandAsync:(NSString *)sql
+{
+	// perform the connection on a thread
+	[NSThread detachNewThreadSelector:@selector(performExecCommand:) toTarget:self withObject:sql];		
+}
+
+- (void)performExecCommand:(id)sqlCommand
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	
+	NSString *sql = (NSString *)sqlCommand;
+	
+	NSMutableDictionary *info = [[[NSMutableDictionary alloc] init] autorelease];
+	
+	// report from this execution's own result, not the shared lastError
+	PGSQLCommandResult *result = [self execute:sql];
+	NSNumber *recordCount = [[[NSNumber alloc] initWithLong:[result rowsAffected]] autorelease];
+	[info setValue:result forKey:@"Result"];
+	[info setValue:recordCount forKey:@"RecordCount"];
+	[info setValue:[result lastError] forKey:@"Error"];
+	[info setValue:[result lastCmdStatus] forKey:@"Status"];
+	
+	[[NSNotificationCenter defaultCenter] postNotificationName:PGSQLCommandDidCompleteNotification
+														object:nil
+													  userInfo:info];
+	[pool release];
+}
+
+- (BOOL)execCommand:(NSString *)sql
+{
+	return [self execCommand:sql numberOfArguments:0 withParameters:nil];
+}
+
+
+
+- (BOOL)execCommand:(NSString *)sql numberOfArguments:(int)nParams withParameters:(id)params,...
+{
+	PGSQLCommandResult *result;
+    va_list list;
+    
+        
+    va_start(list, params);
+    
+    result = [self openResult:sql numberOfArguments:nParams withParameters:list firstParam:params];
+    
+    va_end(list);
+	
+	
+	if (![result succeeded]) 
+	{
+        [[NSException exceptionWithName:@"PGSQLError" reason:[result lastError] userInfo:nil] raise];
+		return NO;
+    }
+    
+	return YES;	
+}
+
+- (void)openAsync:(NSString *)sql
+{
+	// perform the connection on a thread
+	[NSThread detachNewThreadSelector:@selector(performOpen:) toTarget:self withObject:sql];		
+}
+
+- (void)performOpen:(id)sqlCommand
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	
+	NSString *sql = (NSString *)sqlCommand;
+	
+	NSMutableDictionary *info = [[[NSMutableDictionary alloc] init] autorelease];
+	
+	PGSQLCommandResult *result = [self execute:sql];
+	[info setValue:result forKey:@"Result"];
+	[info setValue:[result recordset] forKey:@"Recordset"];
+	[info setValue:[result lastError] forKey:@"Error"];
+	
+	[[NSNotificationCenter defaultCenter] postNotificationName:PGSQLCommandDidCompleteNotification
+														object:nil
+													  userInfo:info];
+	[pool release];
+}
+
+- (PGSQLRecordset *)open:(NSString *)sql
+{
+    return [self open:sql numberOfArguments:0 withParameters:nil];
+}
+
+- (PGSQLRecordset *)open:(NSString *)sql numberOfArguments:(int)nParams withParameters:(id)params, ...
+{
+	PGSQLCommandResult *result;
+
+    va_list list;
+    va_start(list, params);
+    
+    result = [self openResult:sql numberOfArguments:nParams withParameters:list firstParam:params];
+    
+    va_end(list);
+	
+	if (![result succeeded])
+	{
+        [[NSException exceptionWithName:@"PGSQLError" reason:[result lastError] userInfo:nil] raise];
+		return nil;
+	}
+	
+	switch ([result resultStatus])
+	{
+		case PGRES_TUPLES_OK:
+		{
+			// the result built the recordset
+			PGSQLRecordset *rs = [result recordset];
+			
+			if (logInfo)
+			{
+				long nRecords = [rs recordCount];
+				[self appendSQLLog:[NSString stringWithFormat: @"%ld rows affected.\n\n", nRecords]];
+			}
+						
+			return rs;
+			break;
+		}
+			
+		case PGRES_COMMAND_OK:
+		{
+			if (logInfo)
+			{
+				[self appendSQLLog:@"Query ran successfully.\n"];
+			}
+			return nil;
+			break;
+		}
+			
+		case PGRES_EMPTY_QUERY:
+		{
+			[self appendSQLLog:@"Postgres reported Empty Query\n"];
+			return nil;
+			break;
+		}
+			
+		case PGRES_COPY_OUT:
+		case PGRES_COPY_IN:
+		default:
+		{
+			NSString *error = [NSString stringWithFormat:@"PostgreSQL Error: %@", [result lastCmdStatus]];
+			[self setLastError:error cmdStatus:[result lastCmdStatus]];
+			[self appendSQLLog:[NSString stringWithFormat:@"%@\n", error]];
+            [[NSException exceptionWithName:@"PGSQLError" reason:error userInfo:nil] raise];
+			return nil;
+		}
+	}
+}
+
+#pragma mark -
+#pragma mark Server Catalog
+
+- (PGSQLCatalog *)catalog
+{
+	[stateLock lock];
+	PGSQLCatalog *result = [[catalog retain] autorelease];
+	[stateLock unlock];
+	if (result != nil)
+	{
+		return result;
+	}
+	
+	result = [PGSQLCatalog catalogForConnection:self];
+	if (result != nil)
+	{
+		[stateLock lock];
+		[catalog release];
+		catalog = [result retain];
+		[stateLock unlock];
+	}
+	return result;
+}
+
+- (PGSQLCatalog *)reloadCatalog
+{
+	[PGSQLCatalog removeCatalogForConnection:self];
+	[stateLock lock];
+	[catalog release];
+	catalog = nil;
+	[stateLock unlock];
+	
+	return [self catalog];
+}
+
+#pragma mark -
+#pragma mark Session State
+
+- (BOOL)prepareStatement:(NSString *)sql withName:(NSString *)name
+{
+	BOOL prepared = NO;
+	
+	[executionLock lock];
+	[preparedStatements setObject:sql forKey:name];
+	if (pgconn != nil)
+	{
+		prepared = [self prepareOnServer:name sql:sql];
+	}
+	[executionLock unlock];
+	return prepared;
+}
+
+- (BOOL)prepareOnServer:(NSString *)name sql:(NSString *)sql
+{
+	PGresult *res = PQprepare(pgconn, [name UTF8String], PGSQLCStringFromString(sql, defaultEncoding), 0, NULL);
+	BOOL prepared = ((res != NULL) && (PQresultStatus(res) == PGRES_COMMAND_OK));
+	if (!prepared)
+	{
+		[self appendSQLLog:[NSString stringWithFormat:@"Unable to prepare %@: %s\n", name, 
+							(res ? PQresultErrorMessage(res) : PQerrorMessage(pgconn))]];
+	}
+	PQclear(res);
+	return prepared;
+}
+
+- (PGSQLCommandResult *)executePrepared:(NSString *)name parameters:(NSArray *)params
+{
+	[executionLock lock];
+	NSString *sql = [[[preparedStatements objectForKey:name] retain] autorelease];
+	[executionLock unlock];
+	
+	if (sql == nil)
+	{
+		NSString *error = [NSString stringWithFormat:@"No statement has been prepared as %@.", name];
+		return [[[PGSQLCommandResult alloc] initWithError:error sql:nil executionTime:0] autorelease];
+	}
+	
+	int nParams = (int)[params count];
+    Oid paramTypes[nParams > 0 ? nParams : 1];
+    const char *paramValues[nParams > 0 ? nParams : 1];
+    int paramLengths[nParams > 0 ? nParams : 1];
+    int paramFormats[nParams > 0 ? nParams : 1];
+	
+	parseParameterArray(params, paramTypes, paramValues, paramLengths, paramFormats);
+	
+	return [self resultForSQL:sql statementName:name numberOfArguments:nParams types:paramTypes values:paramValues lengths:paramLengths formats:paramFormats];
+}
+
+- (BOOL)deallocatePreparedStatement:(NSString *)name
+{
+	BOOL deallocated = NO;
+	
+	[executionLock lock];
+	[preparedStatements removeObjectForKey:name];
+	if (pgconn != nil)
+	{
+		char *identifier = PQescapeIdentifier(pgconn, [name UTF8String], strlen([name UTF8String]));
+		if (identifier != NULL)
+		{
+			NSString *sql = [NSString stringWithFormat:@"DEALLOCATE %s", identifier];
+			PQfreemem(identifier);
+			deallocated = [[self execute:sql] succeeded];
+		}
+	}
+	[executionLock unlock];
+	return deallocated;
+}
+
+- (BOOL)addSessionCommand:(NSString *)sql
+{
+	BOOL succeeded = NO;
+	
+	[executionLock lock];
+	[sessionCommands addObject:sql];
+	if (pgconn != nil)
+	{
+		succeeded = [[self execute:sql] succeeded];
+	}
+	[executionLock unlock];
+	return succeeded;
+}
+
+- (NSArray *)sessionCommands
+{
+	[executionLock lock];
+	NSArray *result = [[sessionCommands copy] autorelease];
+	[executionLock unlock];
+	return result;
+}
+
+- (void)removeAllSessionCommands
+{
+	[executionLock lock];
+	[sessionCommands removeAllObjects];
+	[executionLock unlock];
+}
+
+// Called by connect with the lock held, so a new server session picks up 
+// where the last one left off.
+- (void)restoreSessionState
+{
+	NSUInteger i;
+	for (i = 0; i < [sessionCommands count]; i++)
+	{
+		NSString *sql = [sessionCommands objectAtIndex:i];
+		PGresult *res = PQexec(pgconn, PGSQLCStringFromString(sql, defaultEncoding));
+		if ((res == NULL) || (PQresultStatus(res) != PGRES_COMMAND_OK))
+		{
+			[self appendSQLLog:[NSString stringWithFormat:@"Session command failed: %@: %s\n", sql, 
+								(res ? PQresultErrorMessage(res) : PQerrorMessage(pgconn))]];
+		}
+		PQclear(res);
+	}
+	
+	NSEnumerator *names = [preparedStatements keyEnumerator];
+	NSString *name;
+	while ((name = [names nextObject]) != nil)
+	{
+		[self prepareOnServer:name sql:[preparedStatements objectForKey:name]];
+	}
+}
+
+#pragma mark -
+#pragma mark Health Monitoring
+
+// Called with the execution lock held when a statement finds the connection
+// broken.  Wakes the monitor rather than reconnecting here, so the caller is
+// not held up by it.
+- (void)connectionWasLost
+{
+	[healthCondition lock];
+	if (isHealthy)
+	{
+		[self appendSQLLog:@"Connection to the server was lost.\n"];
+	}
+	isHealthy = NO;
+	lossReported = YES;
+	[healthCondition broadcast];
+	[healthCondition unlock];
+}
+
+- (void)startHealthMonitor
+{
+	[healthCondition lock];
+	if (autoReconnect && wantsConnection && !isMonitoringHealth)
+	{
+		isMonitoringHealth = YES;
+		[NSThread detachNewThreadSelector:@selector(monitorHealth) toTarget:self withObject:nil];
+	}
+	[healthCondition unlock];
+}
+
+// An empty query is the cheapest full round trip.  A connection that is busy
+// is left alone, the statement running on it reports a loss itself.
+- (BOOL)probeConnection
+{
+	if (![executionLock tryLock])
+	{
+		return YES;
+	}
+	
+	BOOL healthy = NO;
+	if ((pgconn != nil) && (PQstatus(pgconn) == CONNECTION_OK))
+	{
+		PGresult *res = PQexec(pgconn, "");
+		healthy = ((res != NULL) && (PQresultStatus(res) == PGRES_EMPTY_QUERY));
+		PQclear(res);
+	}
+	if (!healthy && (pgconn != nil))
+	{
+		[self connectionWasLost];
+	}
+	[executionLock unlock];
+	return healthy;
+}
+
+- (void)monitorHealth
+{
+	NSUInteger attempt = 0;
+	
+	while (YES)
+	{
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		
+		[healthCondition lock];
+		BOOL keepRunning = (wantsConnection && autoReconnect);
+		BOOL healthy = isHealthy;
+		[healthCondition unlock];
+		if (!keepRunning)
+		{
+			[pool release];
+			break;
+		}
+		
+		if (healthy)
+		{
+			healthy = [self probeConnection];
+		}
+		
+		NSTimeInterval delay = healthCheckInterval;
+		if (!healthy)
+		{
+			[self appendSQLLog:[NSString stringWithFormat:@"Reconnecting (attempt %lu).\n", (unsigned long)(attempt + 1)]];
+			if ([self openConnection:YES])
+			{
+				attempt = 0;
+				healthy = YES;
+			} else {
+				// exponential backoff, jittered over its upper half so a 
+				// restarted server is not met by every client at once
+				delay = reconnectBaseDelay * pow(2, (attempt < 30) ? attempt : 30);
+				if (delay > reconnectMaximumDelay) { delay = reconnectMaximumDelay; }
+				delay = (delay / 2) + ((delay / 2) * (arc4random() % 1001) / 1000.0);
+				attempt++;
+			}
+		}
+		
+		// a loss reported while idle cuts the wait short, backoff is sat out
+		NSDate *limit = [NSDate dateWithTimeIntervalSinceNow:delay];
+		[healthCondition lock];
+		while (wantsConnection && autoReconnect && !(healthy && lossReported))
+		{
+			if (![healthCondition waitUntilDate:limit])
+			{
+				break;
+			}
+		}
+		lossReported = NO;
+		[healthCondition unlock];
+		
+		[pool release];
+	}
+	
+	[healthCondition lock];
+	isMonitoringHealth = NO;
+	[healthCondition unlock];
+}
+
+- (BOOL)waitUntilHealthyBeforeDate:(NSDate *)limit
+{
+	[healthCondition lock];
+	while (wantsConnection && !isHealthy)
+	{
+		if (![healthCondition waitUntilDate:limit])
+		{
+			break;
+		}
+	}
+	BOOL healthy = (wantsConnection && isHealthy);
+	[healthCondition unlock];
+	return healthy;
+}
+
+-(NSMutableString *)makeConnectionString
+{
+	NSMutableString *connStr = [[[NSMutableString alloc] init] autorelease];
+	
+	if (connectionString)
+	{
+		[connStr appendString:connectionString];
+		return connStr;
+	}
+	if (host)
+	{
+		[connStr appendFormat:@" host='%@' ", host];
+	}
+	if (port)
+	{
+		[connStr appendFormat:@" port='%@' ", port];
+	}	
+	if (options)
+	{
+		[connStr appendFormat:@" options='%@' ", options];
+	}	
+	if (dbName)
+	{
+		[connStr appendFormat:@" dbname='%@' ", dbName];
+	}	
+	if (userName)
+	{
+		[connStr appendFormat:@" user='%@' ", userName];
+	}	
+	if (password)
+	{
+		[connStr appendFormat:@" password='%@' ", password];
+	}
+	if (sslMode)
+	{
+		[connStr appendFormat:@" sslmode='%@' ", sslMode];
+	}
+	if (service)
+	{
+		[connStr appendFormat:@" service='%@' ", service];
+	}
+	if (krbsrvName)
+	{
+		[connStr appendFormat:@" krbsrvname='%@' ", krbsrvName];
+	}
+	return connStr;
+}
+
+-(NSString *)sqlEncodeData:(NSData *)toEncode
+{
+	unsigned char *result;
+	size_t resultLength = 0;
+	
+	[executionLock lock];
+	result = PQescapeByteaConn ((PGconn *)pgconn, (const unsigned char *)[toEncode bytes],
+								 [toEncode length], &resultLength);
+	[executionLock unlock];
+	
+	NSString *encodedString = [[[NSString alloc] initWithCString:(const char *)result] autorelease];
+	
+	PQfreemem(result);
+	
+	return encodedString;	
+}
+
+
+-(NSData *)sqlDecodeData:(NSData *)toDecode
+{
+	unsigned char *result;
+	size_t resultLength = 0;
+	
+	result = PQunescapeBytea((const unsigned char *)[toDecode bytes], &resultLength);
+	
+	NSData *decodedData = [[[NSData alloc] initWithBytes:result length:resultLength] autorelease];
+	
+	PQfreemem(result);
+	
+	return decodedData;	
+} 
+
+-(NSString *)sqlEncodeString:(NSString *)toEncode
+{
+	const char *text = PGSQLCStringFromString(toEncode, defaultEncoding);
+	if (text == NULL) { return nil; }
+	
+	return [self escapeString:text length:strlen(text) quoted:NO];
+}
+
+-(NSString *)sqlQuoteIdentifier:(NSString *)name
+{
+	[executionLock lock];
+	NSString *quoted = [[[quotedIdentifiers objectForKey:name] retain] autorelease];
+	if (quoted == nil)
+	{
+		const char *text = PGSQLCStringFromString(name, defaultEncoding);
+		char *escaped = ((text != NULL) && (pgconn != nil)) ? PQescapeIdentifier((PGconn *)pgconn, text, strlen(text)) : NULL;
+		if (escaped != NULL)
+		{
+			quoted = [[[NSString alloc] initWithBytes:escaped 
+											   length:strlen(escaped) 
+											 encoding:defaultEncoding] autorelease];
+			PQfreemem(escaped);
+			if (quoted != nil)
+			{
+				[quotedIdentifiers setObject:quoted forKey:name];
+			}
+		}
+	}
+	[executionLock unlock];
+	return quoted;
+}
+
+-(NSString *)sqlQuoteLiteral:(id)value
+{
+	if ((value == nil) || (value == [NSNull null]))
+	{
+		return @"NULL";
+	}
+	if ([value isKindOfClass:[NSData class]])
+	{
+		return [NSString stringWithFormat:@"'%@'::bytea", [self sqlEncodeData:value]];
+	}
+	
+	NSData *json = PGSQLJSONParameterData(value);
+	const char *text = (json != nil) ? [json bytes] : PGSQLCStringFromString([value description], defaultEncoding);
+	if (text == NULL) { return nil; }
+	
+	return [self escapeString:text length:strlen(text) quoted:YES];
+}
+
+// Escapes into escapeBuffer, which grows to fit the largest string seen and
+// is kept, instead of a malloc and free per call.  nil when not connected.
+- (NSString *)escapeString:(const char *)text length:(size_t)length quoted:(BOOL)quoted
+{
+	NSString *escaped = nil;
+	
+	[executionLock lock];
+	size_t needed = (length * 2) + 3; // per the libpq doc, and the quotes
+	if (needed > escapeBufferSize)
+	{
+		char *grown = realloc(escapeBuffer, needed);
+		if (grown != NULL)
+		{
+			escapeBuffer = grown;
+			escapeBufferSize = needed;
+		}
+	}
+	if ((pgconn != nil) && (escapeBufferSize >= needed))
+	{
+		int error = 0;
+		size_t escapedLength = PQescapeStringConn((PGconn *)pgconn, escapeBuffer + 1, text, length, &error);
+		if (error == 0)
+		{
+			escapeBuffer[0] = '\'';
+			escapeBuffer[escapedLength + 1] = '\'';
+			escaped = [[[NSString alloc] initWithBytes:(quoted ? escapeBuffer : escapeBuffer + 1)
+												length:(quoted ? escapedLength + 2 : escapedLength)
+											  encoding:defaultEncoding] autorelease];
+		}
+	}
+	[executionLock unlock];
+	return escaped;
+}
+
+- (void)appendSQLLog:(NSString *)value {
+	if (!logSQL)
+	{
+		return;
+	}
+    NSLog(@"PGSQL: %@", value);
+	[stateLock lock];
+	if (sqlLog == nil)
+	{
+		sqlLog = [[NSMutableString alloc] initWithString:value];
+	}
+	else
+	{
+		[sqlLog appendString:value];
+	}
+	[stateLock unlock];
+}
+
+#pragma mark Dictionary Tools
+
+// Appends value as an element of an array literal, for a parameter that 
+// carries a whole column to unnest.
+static void
+PGSQLAppendArrayElement(NSMutableString *literal, id value)
+{
+	if ((value == nil) || (value == [NSNull null]))
+	{
+		[literal appendString:@"NULL"];
+		return;
+	}
+	
+	NSString *text;
+	NSData *json = PGSQLJSONParameterData(value);
+	if ([value isKindOfClass:[NSData class]])
+	{
+		// bytea's hex input form
+		const unsigned char *bytes = [value bytes];
+		NSMutableString *hex = [NSMutableString stringWithCapacity:([value length] * 2) + 2];
+		[hex appendString:@"\\x"];
+		NSUInteger i;
+		for (i = 0; i < [value length]; i++)
+		{
+			[hex appendFormat:@"%02x", bytes[i]];
+		}
+		text = hex;
+	} else if (json != nil) {
+		text = [NSString stringWithUTF8String:[json bytes]];
+	} else {
+		text = [value description];
+	}
+	
+	NSMutableString *escaped = [text mutableCopy];
+	[escaped replaceOccurrencesOfString:@"\\" withString:@"\\\\" options:0 range:NSMakeRange(0, [escaped length])];
+	[escaped replaceOccurrencesOfString:@"\"" withString:@"\\\"" options:0 range:NSMakeRange(0, [escaped length])];
+	[literal appendFormat:@"\"%@\"", escaped];
+	[escaped release];
+}
+
+// One array literal per key, holding that column of every dictionary.
+static NSArray *
+PGSQLColumnArrays(NSArray *dicts, NSArray *keys)
+{
+	NSMutableArray *arrays = [NSMutableArray arrayWithCapacity:[keys count]];
+	NSUInteger k;
+	for (k = 0; k < [keys count]; k++)
+	{
+		NSString *key = [keys objectAtIndex:k];
+		NSMutableString *literal = [NSMutableString stringWithString:@"{"];
+		NSUInteger i;
+		for (i = 0; i < [dicts count]; i++)
+		{
+			if (i > 0)
+			{
+				[literal appendString:@","];
+			}
+			PGSQLAppendArrayElement(literal, [[dicts objectAtIndex:i] objectForKey:key]);
+		}
+		[literal appendString:@"}"];
+		[arrays addObject:literal];
+	}
+	return arrays;
+}
+
+// Splits dictionaries into runs with the same keys, in order of first 
+// appearance.  Each key list is sorted so equal sets compare equal.
+static NSArray *
+PGSQLGroupDictionariesByKeys(NSArray *dicts, NSMutableArray *keySets)
+{
+	NSMutableDictionary *groups = [NSMutableDictionary dictionary];
+	NSUInteger i;
+	for (i = 0; i < [dicts count]; i++)
+	{
+		NSDictionary *dict = [dicts objectAtIndex:i];
+		NSArray *keys = [[dict allKeys] sortedArrayUsingSelector:@selector(compare:)];
+		NSMutableArray *group = [groups objectForKey:keys];
+		if (group == nil)
+		{
+			group = [NSMutableArray array];
+			[groups setObject:group forKey:keys];
+			[keySets addObject:keys];
+		}
+		[group addObject:dict];
+	}
+	
+	NSMutableArray *ordered = [NSMutableArray arrayWithCapacity:[keySets count]];
+	for (i = 0; i < [keySets count]; i++)
+	{
+		[ordered addObject:[groups objectForKey:[keySets objectAtIndex:i]]];
+	}
+	return ordered;
+}
+
+- (PGSQLTableSchema *)schemaForTable:(NSString *)table
+{
+	[executionLock lock];
+	PGSQLTableSchema *schema = [[[tableSchemas objectForKey:table] retain] autorelease];
+	[executionLock unlock];
+	if (schema != nil)
+	{
+		return schema;
+	}
+	
+	PGSQLCommandResult *result = [self execute:@"SELECT a.attname, pg_catalog.format_type(a.atttypid, a.atttypmod), "
+								  @"coalesce(a.attnum = ANY (i.indkey), false), a.attrelid::regclass::text, "
+								  @"t.typcategory IN ('A', 'C') "
+								  @"FROM pg_catalog.pg_attribute a "
+								  @"JOIN pg_catalog.pg_type t ON t.oid = a.atttypid "
+								  @"LEFT JOIN pg_catalog.pg_index i ON i.indrelid = a.attrelid AND i.indisprimary "
+								  @"WHERE a.attrelid = $1::regclass AND a.attnum > 0 AND NOT a.attisdropped "
+								  @"ORDER BY a.attnum"
+									parameters:[NSArray arrayWithObject:table]];
+	if (![result succeeded])
+	{
+		return nil;
+	}
+	
+	schema = [[[PGSQLTableSchema alloc] initWithRecordset:[result recordset]] autorelease];
+	[[result recordset] close];
+	
+	[executionLock lock];
+	[tableSchemas setObject:schema forKey:table];
+	[executionLock unlock];
+	return schema;
+}
+
+// The keys in the table's column order, or nil (with lastError set) if one
+// is not a column.
+- (NSArray *)columnsOfSchema:(PGSQLTableSchema *)schema forKeys:(NSArray *)keys
+{
+	NSSet *wanted = [NSSet setWithArray:keys];
+	NSMutableArray *ordered = [NSMutableArray arrayWithCapacity:[keys count]];
+	NSUInteger i;
+	for (i = 0; i < [[schema columnNames] count]; i++)
+	{
+		NSString *columnName = [[schema columnNames] objectAtIndex:i];
+		if ([wanted containsObject:columnName])
+		{
+			[ordered addObject:columnName];
+		}
+	}
+	
+	if ([ordered count] != [wanted count])
+	{
+		NSMutableSet *unknown = [NSMutableSet setWithSet:wanted];
+		[unknown minusSet:[NSSet setWithArray:ordered]];
+		[self setLastError:[NSString stringWithFormat:@"%@ has no column named %@.", 
+							[schema tableName], [[unknown allObjects] componentsJoinedByString:@", "]] 
+				 cmdStatus:nil];
+		return nil;
+	}
+	return ordered;
+}
+
+// Runs generated sql as a prepared statement, preparing it the first time.
+- (PGSQLCommandResult *)executeDictionaryStatement:(NSString *)sql parameters:(NSArray *)params
+{
+	[executionLock lock];
+	NSString *name = [[[dictionaryStatements objectForKey:sql] retain] autorelease];
+	if (name == nil)
+	{
+		name = [NSString stringWithFormat:@"pgsqlkit_dictionary_%lu", (unsigned long)[dictionaryStatements count] + 1];
+		if ([self prepareStatement:sql withName:name])
+		{
+			[dictionaryStatements setObject:name forKey:sql];
+		} else {
+			// not kept, or every reconnect would try it again.  Running it 
+			// unprepared reports the server's reason.
+			[preparedStatements removeObjectForKey:name];
+			name = nil;
+		}
+	}
+	[executionLock unlock];
+	
+	if (name == nil)
+	{
+		return [self execute:sql parameters:params];
+	}
+	return [self executePrepared:name parameters:params];
+}
+
+- (BOOL)insertIntoTable:(NSString *)table fromDictionary:(NSDictionary *)dict
+{
+	PGSQLTableSchema *schema = [self schemaForTable:table];
+	NSArray *columns = [self columnsOfSchema:schema forKeys:[dict allKeys]];
+	if ((schema == nil) || (columns == nil))
+	{
+		return NO;
+	}
+	
+	NSMutableString *sql = [NSMutableString stringWithFormat:@"INSERT INTO %@ ", [schema tableName]];
+	if ([columns count] == 0)
+	{
+		[sql appendString:@"DEFAULT VALUES"];
+	} else {
+		NSMutableArray *names = [NSMutableArray arrayWithCapacity:[columns count]];
+		NSMutableArray *placeholders = [NSMutableArray arrayWithCapacity:[columns count]];
+		NSUInteger i;
+		for (i = 0; i < [columns count]; i++)
+		{
+			[names addObject:[self sqlQuoteIdentifier:[columns objectAtIndex:i]]];
+			[placeholders addObject:[NSString stringWithFormat:@"$%lu", (unsigned long)i + 1]];
 		}
+		[sql appendFormat:@"(%@) VALUES (%@)", [names componentsJoinedByString:@", "], 
+		 [placeholders componentsJoinedByString:@", "]];
 	}
+	
+	PGSQLCommandResult *result = [self executeDictionaryStatement:sql 
+													   parameters:[dict objectsForKeys:columns notFoundMarker:[NSNull null]]];
+	return [result succeeded];
 }
 
--(NSMutableString *)makeConnectionString
+- (BOOL)updateTable:(NSString *)table fromDictionary:(NSDictionary *)dict
 {
-	NSMutableString *connStr = [[[NSMutableString alloc] init] autorelease];
-	
-	if (connectionString)
+	PGSQLTableSchema *schema = [self schemaForTable:table];
+	NSArray *columns = [self columnsOfSchema:schema forKeys:[dict allKeys]];
+	if ((schema == nil) || (columns == nil))
 	{
-		[connStr appendString:connectionString];
-		return connStr;
+		return NO;
 	}
-	if (host)
+	
+	NSArray *key = [schema primaryKey];
+	NSMutableArray *assigned = [NSMutableArray arrayWithArray:columns];
+	[assigned removeObjectsInArray:key];
+	if (([key count] == 0) || ([assigned count] + [key count] != [columns count]) || ([assigned count] == 0))
 	{
-		[connStr appendFormat:@" host='%@' ", host];
+		[self setLastError:[NSString stringWithFormat:@"Updating %@ needs its primary key and at least one other column.", 
+							[schema tableName]] 
+				 cmdStatus:nil];
+		return NO;
 	}
-	if (port)
-	{
-		[connStr appendFormat:@" port='%@' ", port];
-	}	
-	if (options)
-	{
-		[connStr appendFormat:@" options='%@' ", options];
-	}	
-	if (dbName)
-	{
-		[connStr appendFormat:@" dbname='%@' ", dbName];
-	}	
-	if (userName)
-	{
-		[connStr appendFormat:@" user='%@' ", userName];
-	}	
-	if (password)
+	
+	NSMutableArray *assignments = [NSMutableArray arrayWithCapacity:[assigned count]];
+	NSMutableArray *conditions = [NSMutableArray arrayWithCapacity:[key count]];
+	NSUInteger i;
+	for (i = 0; i < [assigned count]; i++)
 	{
-		[connStr appendFormat:@" password='%@' ", password];
+		[assignments addObject:[NSString stringWithFormat:@"%@ = $%lu", 
+								[self sqlQuoteIdentifier:[assigned objectAtIndex:i]], (unsigned long)i + 1]];
 	}
-	if (sslMode)
+	for (i = 0; i < [key count]; i++)
 	{
-		[connStr appendFormat:@" sslmode='%@' ", sslMode];
+		[conditions addObject:[NSString stringWithFormat:@"%@ = $%lu", 
+							   [self sqlQuoteIdentifier:[key objectAtIndex:i]], (unsigned long)([assigned count] + i + 1)]];
 	}
-	if (service)
+	NSString *sql = [NSString stringWithFormat:@"UPDATE %@ SET %@ WHERE %@", [schema tableName], 
+					 [assignments componentsJoinedByString:@", "], [conditions componentsJoinedByString:@" AND "]];
+	
+	PGSQLCommandResult *result = [self executeDictionaryStatement:sql 
+													   parameters:[[dict objectsForKeys:assigned notFoundMarker:[NSNull null]] 
+																   arrayByAddingObjectsFromArray:[dict objectsForKeys:key notFoundMarker:[NSNull null]]]];
+	return ([result succeeded] && ([result rowsAffected] > 0));
+}
+
+// Opens a transaction for a batch unless the caller already has one.  The
+// connection stays locked until endBatch:succeeded:.
+- (BOOL)beginBatch:(BOOL *)ownsTransaction
+{
+	[self lock];
+	*ownsTransaction = ((pgconn != nil) && (PQtransactionStatus(pgconn) == PQTRANS_IDLE));
+	if (*ownsTransaction && ![[self execute:@"BEGIN"] succeeded])
 	{
-		[connStr appendFormat:@" service='%@' ", service];
+		[self unlock];
+		return NO;
 	}
-	if (krbsrvName)
+	return YES;
+}
+
+- (BOOL)endBatch:(BOOL)ownsTransaction succeeded:(BOOL)succeeded
+{
+	if (ownsTransaction)
 	{
-		[connStr appendFormat:@" krbsrvname='%@' ", krbsrvName];
+		if (succeeded)
+		{
+			PGSQLCommandResult *commit = [self execute:@"COMMIT"];
+			succeeded = ([commit succeeded] && [[commit lastCmdStatus] isEqualToString:@"COMMIT"]);
+		} else {
+			// keep the error that failed the batch
+			NSString *error = [self lastError];
+			[self execute:@"ROLLBACK"];
+			[self setLastError:error cmdStatus:nil];
+		}
 	}
-	return connStr;
+	[self unlock];
+	return succeeded;
 }
 
--(NSString *)sqlEncodeData:(NSData *)toEncode
+- (BOOL)insertIntoTable:(NSString *)table fromDictionaries:(NSArray *)dicts
 {
-	unsigned char *result;
-	size_t resultLength = 0;
+	PGSQLTableSchema *schema = [self schemaForTable:table];
+	if (schema == nil)
+	{
+		return NO;
+	}
 	
-	result = PQescapeByteaConn ((PGconn *)pgconn, (const unsigned char *)[toEncode bytes],
-								 [toEncode length], &resultLength);
+	NSMutableArray *keySets = [NSMutableArray array];
+	NSArray *groups = PGSQLGroupDictionariesByKeys(dicts, keySets);
 	
-	NSString *encodedString = [[[NSString alloc] initWithCString:(const char *)result] autorelease];
+	BOOL ownsTransaction;
+	if (![self beginBatch:&ownsTransaction])
+	{
+		return NO;
+	}
 	
-	PQfreemem(result);
+	BOOL succeeded = YES;
+	NSUInteger g;
+	for (g = 0; (g < [groups count]) && succeeded; g++)
+	{
+		NSArray *group = [groups objectAtIndex:g];
+		NSArray *columns = [self columnsOfSchema:schema forKeys:[keySets objectAtIndex:g]];
+		if (columns == nil)
+		{
+			succeeded = NO;
+			break;
+		}
+		
+		NSUInteger i;
+		if ([columns count] == 0)
+		{
+			for (i = 0; (i < [group count]) && succeeded; i++)
+			{
+				succeeded = [self insertIntoTable:table fromDictionary:[group objectAtIndex:i]];
+			}
+			continue;
+		}
+		
+		NSMutableArray *names = [NSMutableArray arrayWithCapacity:[columns count]];
+		for (i = 0; i < [columns count]; i++)
+		{
+			[names addObject:[self sqlQuoteIdentifier:[columns objectAtIndex:i]]];
+		}
+		
+		if (![schema hasComplexColumns])
+		{
+			// one statement for the group, each parameter a whole column
+			NSMutableArray *selections = [NSMutableArray arrayWithCapacity:[columns count]];
+			for (i = 0; i < [columns count]; i++)
+			{
+				[selections addObject:[NSString stringWithFormat:@"unnest($%lu::%@[])", 
+									   (unsigned long)i + 1, [schema typeOfColumn:[columns objectAtIndex:i]]]];
+			}
+			NSString *sql = [NSString stringWithFormat:@"INSERT INTO %@ (%@) SELECT %@", [schema tableName], 
+							 [names componentsJoinedByString:@", "], [selections componentsJoinedByString:@", "]];
+			succeeded = [[self executeDictionaryStatement:sql parameters:PGSQLColumnArrays(group, columns)] succeeded];
+			continue;
+		}
+		
+		// multi-row VALUES, as many rows a statement as the parameter limit
+		// allows
+		NSUInteger rowsPerStatement = MAX(1, 32767 / [columns count]);
+		NSUInteger first;
+		for (first = 0; (first < [group count]) && succeeded; first += rowsPerStatement)
+		{
+			NSUInteger rows = MIN(rowsPerStatement, [group count] - first);
+			NSMutableArray *tuples = [NSMutableArray arrayWithCapacity:rows];
+			NSMutableArray *params = [NSMutableArray arrayWithCapacity:rows * [columns count]];
+			NSUInteger r;
+			for (r = 0; r < rows; r++)
+			{
+				NSMutableArray *placeholders = [NSMutableArray arrayWithCapacity:[columns count]];
+				for (i = 0; i < [columns count]; i++)
+				{
+					[placeholders addObject:[NSString stringWithFormat:@"$%lu::%@", (unsigned long)[params count] + i + 1, 
+											 [schema typeOfColumn:[columns objectAtIndex:i]]]];
+				}
+				[tuples addObject:[NSString stringWithFormat:@"(%@)", [placeholders componentsJoinedByString:@", "]]];
+				[params addObjectsFromArray:[[group objectAtIndex:first + r] objectsForKeys:columns notFoundMarker:[NSNull null]]];
+			}
+			NSString *sql = [NSString stringWithFormat:@"INSERT INTO %@ (%@) VALUES %@", [schema tableName], 
+							 [names componentsJoinedByString:@", "], [tuples componentsJoinedByString:@", "]];
+			succeeded = [[self execute:sql parameters:params] succeeded];
+		}
+	}
 	
-	return encodedString;	
+	return [self endBatch:ownsTransaction succeeded:succeeded];
 }
 
-
--(NSData *)sqlDecodeData:(NSData *)toDecode
+- (BOOL)updateTable:(NSString *)table fromDictionaries:(NSArray *)dicts
 {
-	unsigned char *result;
-	size_t resultLength = 0;
+	PGSQLTableSchema *schema = [self schemaForTable:table];
+	if (schema == nil)
+	{
+		return NO;
+	}
 	
-	result = PQunescapeBytea((const unsigned char *)[toDecode bytes], &resultLength);
+	NSMutableArray *keySets = [NSMutableArray array];
+	NSArray *groups = PGSQLGroupDictionariesByKeys(dicts, keySets);
+	NSArray *key = [schema primaryKey];
 	
-	NSData *decodedData = [[[NSData alloc] initWithBytes:result length:resultLength] autorelease];
+	BOOL ownsTransaction;
+	if (![self beginBatch:&ownsTransaction])
+	{
+		return NO;
+	}
 	
-	PQfreemem(result);
+	BOOL succeeded = YES;
+	NSUInteger g;
+	for (g = 0; (g < [groups count]) && succeeded; g++)
+	{
+		NSArray *group = [groups objectAtIndex:g];
+		NSArray *columns = [self columnsOfSchema:schema forKeys:[keySets objectAtIndex:g]];
+		if (columns == nil)
+		{
+			succeeded = NO;
+			break;
+		}
+		
+		NSMutableArray *assigned = [NSMutableArray arrayWithArray:columns];
+		[assigned removeObjectsInArray:key];
+		if (([key count] == 0) || ([assigned count] + [key count] != [columns count]) || ([assigned count] == 0) ||
+			[schema hasComplexColumns])
+		{
+			// row at a time, which also reports what is missing
+			NSUInteger i;
+			for (i = 0; (i < [group count]) && succeeded; i++)
+			{
+				[self updateTable:table fromDictionary:[group objectAtIndex:i]];
+				succeeded = ([self lastError] == nil);
+			}
+			continue;
+		}
+		
+		// the key columns come first in the derived table, v.c1 ... v.cn
+		NSArray *ordered = [key arrayByAddingObjectsFromArray:assigned];
+		NSMutableArray *selections = [NSMutableArray arrayWithCapacity:[ordered count]];
+		NSMutableArray *aliases = [NSMutableArray arrayWithCapacity:[ordered count]];
+		NSMutableArray *assignments = [NSMutableArray arrayWithCapacity:[assigned count]];
+		NSMutableArray *conditions = [NSMutableArray arrayWithCapacity:[key count]];
+		NSUInteger i;
+		for (i = 0; i < [ordered count]; i++)
+		{
+			NSString *columnName = [ordered objectAtIndex:i];
+			[selections addObject:[NSString stringWithFormat:@"unnest($%lu::%@[])", 
+								   (unsigned long)i + 1, [schema typeOfColumn:columnName]]];
+			[aliases addObject:[NSString stringWithFormat:@"c%lu", (unsigned long)i + 1]];
+			if (i < [key count])
+			{
+				[conditions addObject:[NSString stringWithFormat:@"pgsqlkit_t.%@ = v.c%lu", 
+									   [self sqlQuoteIdentifier:columnName], (unsigned long)i + 1]];
+			} else {
+				[assignments addObject:[NSString stringWithFormat:@"%@ = v.c%lu", 
+										[self sqlQuoteIdentifier:columnName], (unsigned long)i + 1]];
+			}
+		}
+		NSString *sql = [NSString stringWithFormat:@"UPDATE %@ AS pgsqlkit_t SET %@ FROM (SELECT %@) AS v (%@) WHERE %@", 
+						 [schema tableName], [assignments componentsJoinedByString:@", "], 
+						 [selections componentsJoinedByString:@", "], [aliases componentsJoinedByString:@", "], 
+						 [conditions componentsJoinedByString:@" AND "]];
+		succeeded = [[self executeDictionaryStatement:sql parameters:PGSQLColumnArrays(group, ordered)] succeeded];
+	}
 	
-	return decodedData;	
-} 
+	return [self endBatch:ownsTransaction succeeded:succeeded];
+}
 
--(NSString *)sqlEncodeString:(NSString *)toEncode
+- (void)removeCachedTableSchemas
 {
-	size_t result;
-	int	error;
-	char *sqlEncodeCharArray = malloc(1 + ([toEncode length] * 2)); // per the libpq doc.
-	const char *sqlCharArrayToEncode = [toEncode cStringUsingEncoding:defaultEncoding];
-	size_t length = strlen(sqlCharArrayToEncode);
-	
-	result = PQescapeStringConn ((PGconn *)pgconn, sqlEncodeCharArray,
-								 (const char *)[toEncode cStringUsingEncoding:defaultEncoding], 
-								 length, &error);
-	
-	NSString *encodedString = [[[NSString alloc] initWithCString:sqlEncodeCharArray] autorelease];
-	free(sqlEncodeCharArray);
-	
-	return encodedString;	
+	[executionLock lock];
+	[tableSchemas removeAllObjects];
+	[executionLock unlock];
+}
+
+- (PGSQLMergeResult *)mergeIntoTable:(NSString *)table rows:(NSArray *)dicts 
+						  keyColumns:(NSArray *)keyColumns deleteMissing:(BOOL)deleteMissing
+{
+	NSArray *columns = ([dicts count] > 0) ? [[dicts objectAtIndex:0] allKeys] : keyColumns;
+	PGSQLBulkMerge *merge = [[[PGSQLBulkMerge alloc] initWithConnection:self 
+																  table:table 
+																columns:columns 
+															 keyColumns:keyColumns] autorelease];
+	[merge setDeletesMissingRows:deleteMissing];
 	
+	NSUInteger i;
+	for (i = 0; i < [dicts count]; i++)
+	{
+		if (![merge addRowFromDictionary:[dicts objectAtIndex:i]])
+		{
+			break;
+		}
+	}
+	return [merge finish];
 }
 
-- (void)appendSQLLog:(NSString *)value {
-    NSLog(@"PGSQL: %@", value);
-	if (sqlLog == nil)
+#pragma mark -
+#pragma mark Copy
+
+- (BOOL)beginCopyIn:(NSString *)sql
+{
+	[executionLock lock];
+	if (pgconn == nil)
 	{
-		sqlLog = [[NSMutableString alloc] initWithString:value];
+		[self setLastError:@"Object is not Connected." cmdStatus:nil];
+		[executionLock unlock];
+		return NO;
 	}
-	else
+	
+	PGresult *res = PQexec(pgconn, PGSQLCStringFromString(sql, defaultEncoding));
+	if (PQresultStatus(res) != PGRES_COPY_IN)
 	{
-		[sqlLog appendString:value];
+		NSString *error = (res != NULL) ? [NSString stringWithFormat:@"%s", PQresultErrorMessage(res)] 
+										: [NSString stringWithFormat:@"%s", PQerrorMessage(pgconn)];
+		if ([error length] == 0)
+		{
+			error = [NSString stringWithFormat:@"%@ did not start a COPY FROM STDIN.", sql];
+		}
+		PQclear(res);
+		
+		// a COPY TO STDOUT would leave data waiting, drain it
+		while ((res = PQgetResult(pgconn)) != NULL)
+		{
+			PQclear(res);
+		}
+		[self setLastError:error cmdStatus:nil];
+		[executionLock unlock];
+		return NO;
 	}
+	PQclear(res);
+	
+	// held until endCopyIn:
+	return YES;
 }
 
-#pragma mark Dictionary Tools
-
-- (BOOL)insertIntoTable:(NSString *)table fromDictionary:(NSDictionary *)dict
+- (BOOL)putCopyData:(NSData *)data
 {
-	return NO;
+	const char *bytes = [data bytes];
+	NSUInteger remaining = [data length];
+	
+	while (remaining > 0)
+	{
+		int chunk = (int)MIN(remaining, (NSUInteger)(1 << 30));
+		if (PQputCopyData(pgconn, bytes, chunk) != 1)
+		{
+			[self setLastError:[NSString stringWithFormat:@"%s", PQerrorMessage(pgconn)] cmdStatus:nil];
+			return NO;
+		}
+		bytes += chunk;
+		remaining -= chunk;
+	}
+	return YES;
 }
 
-- (BOOL)updateTable:(NSString *)table fromDictionary:(NSDictionary *)dict
+- (PGSQLCommandResult *)endCopyIn:(NSString *)errorMessage
 {
-	return NO;
+	PGSQLCommandResult *result = nil;
+	
+	if (PQputCopyEnd(pgconn, (errorMessage != nil) ? [errorMessage UTF8String] : NULL) != 1)
+	{
+		result = [[PGSQLCommandResult alloc] initWithError:[NSString stringWithFormat:@"%s", PQerrorMessage(pgconn)] 
+													   sql:nil 
+											 executionTime:0];
+	}
+	
+	// the first result is the COPY's, and there should be no other
+	PGresult *res;
+	while ((res = PQgetResult(pgconn)) != NULL)
+	{
+		if (result == nil)
+		{
+			result = [[PGSQLCommandResult alloc] initWithResult:res sql:nil executionTime:0 encoding:defaultEncoding];
+		} else {
+			PQclear(res);
+		}
+	}
+	if (result == nil)
+	{
+		result = [[PGSQLCommandResult alloc] initWithError:[NSString stringWithFormat:@"%s", PQerrorMessage(pgconn)] 
+													   sql:nil 
+										 executionTime:0];
+	}
+	
+	[self setLastError:[result lastError] cmdStatus:[result lastCmdStatus]];
+	[executionLock unlock];
+	return [result autorelease];
 }
 
 #pragma mark Property Accessors
@@ -634,17 +2419,170 @@ void parseParameters(int numArgs, va_list args, Oid *paramTypes, const char **pa
     }
 }
 
+-(NSArray *)hosts {
+    return [[hosts retain] autorelease];
+}
+
+-(void)setHosts:(NSArray *)value {
+    if (hosts != value) {
+        [hosts release];
+        hosts = [value copy];
+    }
+}
+
+-(NSString *)targetSessionRole {
+    return [[targetSessionRole retain] autorelease];
+}
+
+-(void)setTargetSessionRole:(NSString *)value {
+    if (targetSessionRole != value) {
+        [targetSessionRole release];
+        targetSessionRole = [value copy];
+    }
+}
+
+-(NSTimeInterval)connectStagger {
+	return connectStagger;
+}
+
+-(void)setConnectStagger:(NSTimeInterval)value {
+	connectStagger = value;
+}
+
+-(NSTimeInterval)connectTimeout {
+	return connectTimeout;
+}
+
+-(void)setConnectTimeout:(NSTimeInterval)value {
+	connectTimeout = value;
+}
+
+-(BOOL)autoReconnect {
+	return autoReconnect;
+}
+
+-(void)setAutoReconnect:(BOOL)value {
+	[healthCondition lock];
+	autoReconnect = value;
+	[healthCondition broadcast];
+	[healthCondition unlock];
+	if (value)
+	{
+		[self startHealthMonitor];
+	}
+}
+
+-(BOOL)isHealthy {
+	[healthCondition lock];
+	BOOL result = isHealthy;
+	[healthCondition unlock];
+	return result;
+}
+
+-(NSTimeInterval)healthCheckInterval {
+	return healthCheckInterval;
+}
+
+-(void)setHealthCheckInterval:(NSTimeInterval)value {
+	healthCheckInterval = value;
+}
+
+-(NSTimeInterval)reconnectBaseDelay {
+	return reconnectBaseDelay;
+}
+
+-(void)setReconnectBaseDelay:(NSTimeInterval)value {
+	reconnectBaseDelay = value;
+}
+
+-(NSTimeInterval)reconnectMaximumDelay {
+	return reconnectMaximumDelay;
+}
+
+-(void)setReconnectMaximumDelay:(NSTimeInterval)value {
+	reconnectMaximumDelay = value;
+}
+
+-(NSUInteger)maximumRetries {
+	return maximumRetries;
+}
+
+-(void)setMaximumRetries:(NSUInteger)value {
+	maximumRetries = value;
+}
+
+-(NSTimeInterval)retryTimeout {
+	return retryTimeout;
+}
+
+-(void)setRetryTimeout:(NSTimeInterval)value {
+	retryTimeout = value;
+}
+
+-(NSString *)connectedHost {
+	[executionLock lock];
+	NSString *result = [[connectedHost retain] autorelease];
+	[executionLock unlock];
+	return result;
+}
+
 
 - (NSString *)lastError {
-    return errorDescription;
+	[stateLock lock];
+	NSString *result = [[errorDescription retain] autorelease];
+	[stateLock unlock];
+    return result;
 }
 
 -(NSString *)lastCmdStatus {
-	return commandStatus;
+	[stateLock lock];
+	NSString *result = [[commandStatus retain] autorelease];
+	[stateLock unlock];
+	return result;
+}
+
+-(PGSQLSlowQueryLog *)slowQueryLog
+{
+	[stateLock lock];
+	PGSQLSlowQueryLog *result = [[slowQueryLog retain] autorelease];
+	[stateLock unlock];
+	return result;
+}
+
+-(void)setSlowQueryLog:(PGSQLSlowQueryLog *)value
+{
+	[stateLock lock];
+	if (slowQueryLog != value)
+	{
+		[slowQueryLog release];
+		slowQueryLog = [value retain];
+	}
+	[stateLock unlock];
 }
 
 - (NSMutableString *)sqlLog {
-	return sqlLog;
+	// a snapshot, the log itself keeps growing under other threads
+	[stateLock lock];
+	NSMutableString *result = [[sqlLog mutableCopy] autorelease];
+	[stateLock unlock];
+	return result;
+}
+
+-(void)clearSQLLog
+{
+	[stateLock lock];
+	[sqlLog setString:@""];
+	[stateLock unlock];
+}
+
+-(BOOL)logsSQL
+{
+	return logSQL;
+}
+
+-(void)setLogsSQL:(BOOL)value
+{
+	logSQL = value;
 }
 
 -(NSStringEncoding)defaultEncoding
@@ -656,9 +2594,54 @@ void parseParameters(int numArgs, va_list args, Oid *paramTypes, const char **pa
 {
     if (defaultEncoding != value) {
         defaultEncoding = value;
+		[executionLock lock];
+		[quotedIdentifiers removeAllObjects];
+		[executionLock unlock];
+		if (isConnected)
+		{
+			[self applyClientEncoding];
+		}
     }	
 	
 }
 
+-(NSString *)clientEncoding
+{
+	return [self parameterStatus:@"client_encoding"];
+}
+
+-(NSString *)parameterStatus:(NSString *)parameterName
+{
+	NSString *result = nil;
+	
+	[executionLock lock];
+	if (pgconn != nil)
+	{
+		const char *reported = PQparameterStatus(pgconn, [parameterName UTF8String]);
+		if (reported != NULL)
+		{
+			result = [NSString stringWithUTF8String:reported];
+		}
+	}
+	[executionLock unlock];
+	return result;
+}
+
+-(NSString *)serverIdentity
+{
+	NSString *result = nil;
+	
+	[executionLock lock];
+	if ((pgconn != nil) && (PQstatus(pgconn) == CONNECTION_OK))
+	{
+		// PQhost is NULL for the default Unix socket
+		const char *serverHost = PQhost(pgconn);
+		result = [NSString stringWithFormat:@"%s:%s/%s", 
+				  (serverHost != NULL) ? serverHost : "", PQport(pgconn), PQdb(pgconn)];
+	}
+	[executionLock unlock];
+	return result;
+}
+
 
 @end
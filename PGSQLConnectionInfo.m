@@ -17,17 +17,9 @@
 	pgConnection = connection;
 	[pgConnection retain];
 	
-	NSMutableString *cmd = [[NSMutableString alloc] init];
-	[cmd appendString:@"select current_database() as db, current_user as user, version() as version, current_schema() as schema"]; 
-	PGSQLRecordset *rs = [pgConnection open:cmd];
-	if (![rs isEOF])
-	{
-		//userName = [[rs fieldByIndex:1] asString];
-		versionString = [[rs fieldByIndex:2] asString];
-		//schemaName = [[rs fieldByIndex:3] asString];
-	}
-	[rs close];
-	[cmd  release];
+	// the catalog is shared by every connection to the server, so only the
+	// first one pays for the query
+	versionString = [[[pgConnection catalog] versionString] copy];
 	
 	return self;
 }
@@ -35,6 +27,7 @@
 -(void)dealloc
 {
 	[pgConnection release];
+	[versionString release];
 	
 	[super dealloc];
 }
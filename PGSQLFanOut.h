@@ -0,0 +1,108 @@
+//
+//  PGSQLFanOut.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLFanOut
+    @abstract   Runs a set of queries at the same time on separate connections.
+    @discussion Meant for the same query run against many partitions or
+				shards.  Run one after another on a single connection the
+				total time is the sum of every query, run through a fan-out it
+				is close to the time of the slowest one.
+
+				Each task gets a thread and, unless it was given a connection
+				of its own, a connection made from its connection string and
+				closed when the task ends.  Tasks that fail or run past
+				taskTimeout are reported in the results without holding up the
+				others, and the recordsets of the tasks that succeeded can be
+				read as one PGSQLMergedRecordset.
+*/
+
+#import "PGSQLConnection.h"
+#import "PGSQLMergedRecordset.h"
+
+/*!
+    @class
+    @abstract    A fan-out of queries across connections.
+    @discussion  Add tasks, call run, then read results or one of the merged
+				 recordsets.  A fan-out runs once.
+*/
+@interface PGSQLFanOut : NSObject {
+	NSMutableArray *tasks;
+	NSArray *results;
+	NSTimeInterval taskTimeout;
+}
+
+/*!
+    @method
+    @abstract   Add a query to run on a new connection.
+    @discussion The connection is made from conninfo with the task's own
+				thread and closed once the query is done.
+    @result     The task's index in results.
+*/
+-(NSUInteger)addTaskWithConnectionString:(NSString *)conninfo sql:(NSString *)sql parameters:(NSArray *)params;
+
+/*!
+    @method
+    @abstract   Add a query to run on an existing, connected connection.
+    @discussion Tasks that share a connection wait on each other, so give each
+				task its own to get any benefit.
+    @result     The task's index in results.
+*/
+-(NSUInteger)addTaskWithConnection:(PGSQLConnection *)conn sql:(NSString *)sql parameters:(NSArray *)params;
+
+/*!
+    @method
+    @abstract   Run every task at once and wait for them all.
+    @discussion A task still running when taskTimeout expires is reported as
+				failed with a timeout error.  If its statement has been sent
+				it is also cancelled on the server; a task still connecting,
+				or waiting for a connection another thread is using, is only
+				abandoned, and its thread finishes on its own.
+    @result     One PGSQLCommandResult per task, in the order they were added.
+*/
+-(NSArray *)run;
+
+-(NSUInteger)taskCount;
+
+/*!
+    @method
+    @abstract   The results of run, or nil before it.
+*/
+-(NSArray *)results;
+
+/*!
+    @method
+    @abstract   Indexes of the tasks that failed, errors are in their results.
+*/
+-(NSIndexSet *)failedTaskIndexes;
+-(BOOL)allSucceeded;
+
+/*!
+    @method
+    @abstract   The rows of every task that succeeded, in task order.
+*/
+-(PGSQLRecordset *)mergedRecordset;
+
+/*!
+    @method
+    @abstract   The rows of every task that succeeded, merged on a column.
+    @discussion Each task's query must sort on columnName in the same
+				direction.  See -[PGSQLMergedRecordset
+				initWithRecordsets:orderedBy:ascending:].
+*/
+-(PGSQLRecordset *)mergedRecordsetOrderedBy:(NSString *)columnName ascending:(BOOL)ascending;
+
+/*!
+    @method
+    @abstract   Seconds each task may run, 0 (the default) for no limit.
+    @discussion Counts from the start of run, so it includes the time to
+				connect.
+*/
+-(NSTimeInterval)taskTimeout;
+-(void)setTaskTimeout:(NSTimeInterval)value;
+
+@end
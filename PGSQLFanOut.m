@@ -0,0 +1,293 @@
+//
+//  PGSQLFanOut.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLFanOut.h"
+#import "PGSQLFuture.h"
+
+// One query, the connection it runs on and the future its thread completes.
+@interface PGSQLFanOutTask : NSObject {
+	PGSQLConnection *connection;
+	BOOL ownsConnection;
+	NSString *sql;
+	NSArray *parameters;
+	PGSQLFuture *future;
+	NSLock *runningLock;
+	BOOL running;		// statement sent and not yet finished, guarded by runningLock
+}
+
+-(id)initWithConnection:(PGSQLConnection *)conn owned:(BOOL)owned sql:(NSString *)sqlCommand parameters:(NSArray *)params;
+-(PGSQLConnection *)connection;
+-(BOOL)ownsConnection;
+-(NSString *)sql;
+-(NSArray *)parameters;
+-(PGSQLFuture *)future;
+-(void)setRunning:(BOOL)value;
+-(void)cancelIfRunning;
+
+@end
+
+@implementation PGSQLFanOutTask
+
+-(id)initWithConnection:(PGSQLConnection *)conn owned:(BOOL)owned sql:(NSString *)sqlCommand parameters:(NSArray *)params
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		connection = [conn retain];
+		ownsConnection = owned;
+		sql = [sqlCommand copy];
+		parameters = [params copy];
+		future = [[PGSQLFuture alloc] init];
+		runningLock = [[NSLock alloc] init];
+		running = NO;
+	}
+	return self;
+}
+
+-(void)dealloc
+{
+	[connection release];
+	[sql release];
+	[parameters release];
+	[future release];
+	[runningLock release];
+	[super dealloc];
+}
+
+-(PGSQLConnection *)connection
+{
+	return connection;
+}
+
+-(BOOL)ownsConnection
+{
+	return ownsConnection;
+}
+
+-(NSString *)sql
+{
+	return sql;
+}
+
+-(NSArray *)parameters
+{
+	return parameters;
+}
+
+-(PGSQLFuture *)future
+{
+	return future;
+}
+
+-(void)setRunning:(BOOL)value
+{
+	[runningLock lock];
+	running = value;
+	[runningLock unlock];
+}
+
+-(void)cancelIfRunning
+{
+	// the task holds the connection's lock for as long as running is set,
+	// and can not clear it while this holds runningLock, so the statement
+	// cancelled is the task's and not another thread's on a shared one
+	[runningLock lock];
+	if (running)
+	{
+		[connection cancel];
+	}
+	[runningLock unlock];
+}
+
+@end
+
+@interface PGSQLFanOut (Private)
+
+-(void)runTask:(PGSQLFanOutTask *)task;
+-(NSArray *)succeededRecordsets;
+
+@end
+
+@implementation PGSQLFanOut
+
+-(id)init
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		tasks = [[NSMutableArray alloc] init];
+		results = nil;
+		taskTimeout = 0;
+	}
+	return self;
+}
+
+-(void)dealloc
+{
+	[tasks release];
+	[results release];
+	[super dealloc];
+}
+
+-(NSUInteger)addTaskWithConnectionString:(NSString *)conninfo sql:(NSString *)sql parameters:(NSArray *)params
+{
+	// made here rather than on the task's thread so a timeout can cancel it
+	PGSQLConnection *conn = [[PGSQLConnection alloc] init];
+	[conn setConnectionString:conninfo];
+
+	PGSQLFanOutTask *task = [[PGSQLFanOutTask alloc] initWithConnection:conn owned:YES sql:sql parameters:params];
+	[tasks addObject:task];
+	[task release];
+	[conn release];
+
+	return [tasks count] - 1;
+}
+
+-(NSUInteger)addTaskWithConnection:(PGSQLConnection *)conn sql:(NSString *)sql parameters:(NSArray *)params
+{
+	PGSQLFanOutTask *task = [[PGSQLFanOutTask alloc] initWithConnection:conn owned:NO sql:sql parameters:params];
+	[tasks addObject:task];
+	[task release];
+
+	return [tasks count] - 1;
+}
+
+-(void)runTask:(PGSQLFanOutTask *)task
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+	PGSQLConnection *conn = [task connection];
+	PGSQLCommandResult *result;
+
+	if ([task ownsConnection] && ![conn connect])
+	{
+		result = [[[PGSQLCommandResult alloc] initWithError:[conn lastError] sql:[task sql] executionTime:0] autorelease];
+	} else {
+		[conn lock];
+		[task setRunning:YES];
+		result = [conn execute:[task sql] parameters:[task parameters]];
+		[task setRunning:NO];
+		[conn unlock];
+	}
+	if ([task ownsConnection])
+	{
+		[conn close];
+	}
+
+	// ignored if run has already given up on the task
+	[[task future] finishWithResult:result];
+
+	[pool release];
+}
+
+-(NSArray *)run
+{
+	NSAssert((results == nil), @"A PGSQLFanOut can only be run once.");
+
+	NSUInteger i;
+	for (i = 0; i < [tasks count]; i++)
+	{
+		[NSThread detachNewThreadSelector:@selector(runTask:) toTarget:self withObject:[tasks objectAtIndex:i]];
+	}
+
+	NSDate *limit = (taskTimeout > 0) ? [NSDate dateWithTimeIntervalSinceNow:taskTimeout] : nil;
+	NSMutableArray *collected = [NSMutableArray arrayWithCapacity:[tasks count]];
+	for (i = 0; i < [tasks count]; i++)
+	{
+		PGSQLFanOutTask *task = [tasks objectAtIndex:i];
+		PGSQLFuture *future = [task future];
+
+		id result = (limit != nil) ? [future resultBeforeDate:limit] : [future result];
+		if (result == nil)
+		{
+			// a task still connecting, or waiting on a shared connection,
+			// has nothing on the server yet and is only abandoned
+			[task cancelIfRunning];
+
+			NSString *error = [NSString stringWithFormat:@"Timed out after %.1f seconds.", taskTimeout];
+			PGSQLCommandResult *timedOut = [[[PGSQLCommandResult alloc] initWithError:error sql:[task sql] executionTime:taskTimeout] autorelease];
+			[future finishWithResult:timedOut];
+
+			// the task may have finished between the wait and the cancel
+			result = [future result];
+		}
+		[collected addObject:result];
+	}
+
+	results = [collected copy];
+	return [[results retain] autorelease];
+}
+
+-(NSUInteger)taskCount
+{
+	return [tasks count];
+}
+
+-(NSArray *)results
+{
+	return [[results retain] autorelease];
+}
+
+-(NSIndexSet *)failedTaskIndexes
+{
+	NSMutableIndexSet *failed = [NSMutableIndexSet indexSet];
+	NSUInteger i;
+	for (i = 0; i < [results count]; i++)
+	{
+		if (![[results objectAtIndex:i] succeeded])
+		{
+			[failed addIndex:i];
+		}
+	}
+	return failed;
+}
+
+-(BOOL)allSucceeded
+{
+	return ((results != nil) && ([[self failedTaskIndexes] count] == 0));
+}
+
+-(NSArray *)succeededRecordsets
+{
+	NSMutableArray *recordsets = [NSMutableArray arrayWithCapacity:[results count]];
+	NSUInteger i;
+	for (i = 0; i < [results count]; i++)
+	{
+		PGSQLRecordset *recordset = [[results objectAtIndex:i] recordset];
+		if (recordset != nil)
+		{
+			[recordsets addObject:recordset];
+		}
+	}
+	return recordsets;
+}
+
+-(PGSQLRecordset *)mergedRecordset
+{
+	return [[[PGSQLMergedRecordset alloc] initWithRecordsets:[self succeededRecordsets]] autorelease];
+}
+
+-(PGSQLRecordset *)mergedRecordsetOrderedBy:(NSString *)columnName ascending:(BOOL)ascending
+{
+	return [[[PGSQLMergedRecordset alloc] initWithRecordsets:[self succeededRecordsets]
+												   orderedBy:columnName
+												   ascending:ascending] autorelease];
+}
+
+-(NSTimeInterval)taskTimeout
+{
+	return taskTimeout;
+}
+
+-(void)setTaskTimeout:(NSTimeInterval)value
+{
+	taskTimeout = value;
+}
+
+@end
@@ -59,20 +59,37 @@
 	@discussion	
  */
 @interface PGSQLField : NSObject {
-	NSData *data;
+	char *bytes;		// private copy of the value, NULL once string owns it
+	NSUInteger length;	// includes the terminator on text values
+	BOOL isNullValue;
 	
 	PGSQLColumn *column;
 	
 	NSStringEncoding defaultEncoding;
+	
+	NSString *string;	// cached asString result
 }
 
 -(id)initWithResult:(void *)result forColumn:(PGSQLColumn *)forColumn
 			  atRow:(int)atRow;
+/*!
+	@method     
+	@abstract   Builds a field from a value already pulled out of a result.
+	@discussion Used for recordsets that no longer hold a PGresult.  value is
+				NULL for SQL NULL, and text values (format 0) must be NUL 
+				terminated, with valueLength not counting the terminator.  The
+				value is copied.
+*/
+-(id)initWithValue:(const char *)value length:(NSUInteger)valueLength 
+			format:(int)format forColumn:(PGSQLColumn *)forColumn;
 /*!
 	@method     
 	@abstract   Returns a string representation of the raw data.  By default, 
-				strings using this method default to an NSMacRomanStringEncoding.
-	@discussion Returns a string representation of the raw data.  
+				strings using this method default to an NSUTF8StringEncoding.
+	@discussion Returns a string representation of the raw data.  The string
+				is built once and cached.  ASCII-only values in an 
+				ASCII-compatible encoding are wrapped without transcoding or a
+				second copy.
 */
 -(NSString *)asString;
 /*!
@@ -94,15 +111,87 @@
 -(NSData *)asData;
 -(BOOL)asBoolean;
 
+/*!
+	@method     
+	@abstract   Decodes an array value into an NSArray.
+	@discussion Reads the text form ({1,2,"a b",NULL}, with quoting, 
+				backslash escapes and any [lower:upper]= bounds) or the binary
+				wire format in one pass.  Elements are NSNumber for integer, 
+				floating point and boolean types, NSDecimalNumber for numeric,
+				NSString for text types and NSNull for NULL.  Binary elements 
+				of other types are returned as NSData.  A multi-dimensional 
+				array is returned as nested arrays, and the lower bounds are 
+				dropped.
+
+				The element type comes from the column's typeInfo when the 
+				connection has loaded its catalog, and otherwise is known for
+				the built in array types.  Returns nil for SQL NULL or a value
+				that is not an array.
+*/
+-(NSArray *)asArray;
+/*!
+	@method     
+	@abstract   Decodes a numeric array into a C array of int64_t.
+	@discussion Every element of every dimension, in row-major order (see 
+				arrayDimensions), without creating an object per element.  
+				Floating point elements are truncated and NULLs read as 0.  
+				Returns nil for SQL NULL, a value that is not an array, or an
+				array of any type but int2, int4, int8, oid, float4, float8
+				and, in text results only, numeric.
+	@result     NSData holding the int64_t values
+*/
+-(NSData *)asInt64Array;
+/*!
+	@method     
+	@abstract   Decodes a numeric array into a C array of double.
+	@discussion As asInt64Array, with NULLs read as NAN.
+	@result     NSData holding the double values
+*/
+-(NSData *)asDoubleArray;
+/*!
+	@method     
+	@abstract   The length of each dimension of an array value.
+	@result     NSArray of NSNumber, outermost dimension first.  Empty for an
+				empty array, nil if the value is NULL or not an array.
+*/
+-(NSArray *)arrayDimensions;
+
+/*!
+	@method     
+	@abstract   Parses a json or jsonb value into Foundation objects.
+	@discussion The document is handed to NSJSONSerialization straight from 
+				the field's own buffer, with no NSString or second copy in 
+				between.  The version byte that leads a binary format jsonb 
+				value is skipped.  Fragments (a bare string or number) are 
+				allowed.  Returns nil for SQL NULL or text that is not JSON.
+*/
+-(id)jsonValue;
+/*!
+	@method     
+	@abstract   jsonValue with NSJSONSerialization reading options, and the 
+				parse error.
+	@discussion NSJSONReadingMutableContainers and friends apply as usual.
+*/
+-(id)jsonValueWithOptions:(NSJSONReadingOptions)options error:(NSError **)error;
+/*!
+	@method     
+	@abstract   The JSON document as UTF-8 bytes, without parsing it.
+	@discussion For very large documents that are passed on (written to a 
+				file or socket, or handed to a streaming parser) rather than 
+				read whole.  The bytes are copied once, with no parsing or
+				conversion.  nil for SQL NULL.
+*/
+-(NSData *)jsonData;
+
 -(BOOL)isNull;
 
 /*!
 	@function
 	@abstract   Get the record's defaultEncoding for all string operations 
 				results.
-	@discussion The default setting is NSMacOSRoman.  While this default is 
-				used to maintain existing functionality, this will be changed 
-				NSUTF8StringEncoding when PostgreSQL9 is released.
+	@discussion The default setting is NSUTF8StringEncoding, inherited from 
+				the connection that produced the result.  The connection sets 
+				the server's client_encoding to match.
 	@result     returns the defaultEncoding as an NSSTringEncoding ( 
 				http://developer.apple.com/mac/library/documentation/Cocoa/Reference/Foundation/Classes/NSString_Class/Reference/NSString.html#//apple_ref/doc/c_ref/NSStringEncoding )
  */
@@ -111,9 +200,9 @@
 	 @function
 	 @abstract   Set the defaultEncoding for all string operations on the current
 				 record
-	 @discussion The default setting is NSMacOSRoman.  While this default is 
-				 used to maintain existing functionality, this will be changed 
-				 NSUTF8StringEncoding when PostgreSQL9 is released.
+	 @discussion The default setting is NSUTF8StringEncoding, inherited from 
+				 the connection that produced the result.  The connection sets 
+				 the server's client_encoding to match.
 	 @param      value the defaultEncoding as an NSSTringEncoding ( 
 				 http://developer.apple.com/mac/library/documentation/Cocoa/Reference/Foundation/Classes/NSString_Class/Reference/NSString.html#//apple_ref/doc/c_ref/NSStringEncoding )
 	 @result     void
@@ -8,39 +8,646 @@
 
 #import "PGSQLField.h"
 #include "libpq-fe.h"
+#import "PGSQLCatalog.h"
+#import <ctype.h>
+#import <math.h>
+
+// Scans a word at a time for any byte with the high bit set.
+static BOOL
+PGSQLBytesAreASCII(const char *value, NSUInteger length)
+{
+	const unsigned char *ptr = (const unsigned char *)value;
+	const unsigned char *end = ptr + length;
+	const unsigned long highBits = (~0UL / 0xFF) * 0x80;
+	
+	while ((NSUInteger)(end - ptr) >= sizeof(unsigned long))
+	{
+		unsigned long word;
+		memcpy(&word, ptr, sizeof(word));
+		if (word & highBits)
+			return NO;
+		ptr += sizeof(word);
+	}
+	while (ptr < end)
+	{
+		if (*ptr++ & 0x80)
+			return NO;
+	}
+	return YES;
+}
+
+// Encodings that agree with ASCII for every byte below 0x80, so ASCII-only 
+// data can be handed to NSString as ASCII with no decoding at all.
+static BOOL
+PGSQLEncodingIsASCIICompatible(NSStringEncoding encoding)
+{
+	switch (encoding)
+	{
+		case NSUTF8StringEncoding:
+		case NSASCIIStringEncoding:
+		case NSISOLatin1StringEncoding:
+		case NSWindowsCP1252StringEncoding:
+		case NSMacOSRomanStringEncoding:
+			return YES;
+		default:
+			return NO;
+	}
+}
+
+#pragma mark -
+#pragma mark Array Decoding
+
+// PostgreSQL's MAXDIM.
+#define PGSQLArrayMaximumDimensions	6
+
+// Finds whether column holds arrays, and of what.  The catalog knows for 
+// certain.  Without it the built in array types are known, and a user 
+// defined type whose text starts with a brace is taken to be an array of 
+// strings.
+static BOOL
+PGSQLColumnIsArray(PGSQLColumn *column, const char *value, unsigned int *elementOID)
+{
+	*elementOID = 0;
+	
+	PGSQLType *typeInfo = [column typeInfo];
+	if (typeInfo != nil)
+	{
+		*elementOID = [typeInfo elementOID];
+		return [typeInfo isArray];
+	}
+	
+	switch ([column type])
+	{
+		case 1000: *elementOID = 16; break;		// bool[]
+		case 1001: *elementOID = 17; break;		// bytea[]
+		case 1002: *elementOID = 18; break;		// char[]
+		case 1003: *elementOID = 19; break;		// name[]
+		case 1005: *elementOID = 21; break;		// int2[]
+		case 1007: *elementOID = 23; break;		// int4[]
+		case 1009: *elementOID = 25; break;		// text[]
+		case 1014: *elementOID = 1042; break;	// bpchar[]
+		case 1015: *elementOID = 1043; break;	// varchar[]
+		case 1016: *elementOID = 20; break;		// int8[]
+		case 1020: *elementOID = 603; break;	// box[]
+		case 1021: *elementOID = 700; break;	// float4[]
+		case 1022: *elementOID = 701; break;	// float8[]
+		case 1028: *elementOID = 26; break;		// oid[]
+		case 1115: *elementOID = 1114; break;	// timestamp[]
+		case 1182: *elementOID = 1082; break;	// date[]
+		case 1185: *elementOID = 1184; break;	// timestamptz[]
+		case 1231: *elementOID = 1700; break;	// numeric[]
+		case 2951: *elementOID = 2950; break;	// uuid[]
+		default:
+			// below FirstNormalObjectId is built in, and not an array
+			return (([column type] >= 16384) && ([column format] == 0) && 
+					((value[0] == '{') || (value[0] == '[')));
+	}
+	return YES;
+}
+
+// Returns a retained object for one element of a text array.  value is 
+// followed by a delimiter, brace, quote or NUL, so the number parsers stop 
+// at its end.
+static id
+PGSQLNewTextElementObject(const char *value, NSUInteger valueLength, unsigned int elementOID, NSStringEncoding encoding)
+{
+	switch (elementOID)
+	{
+		case 20:	// int8
+		case 21:	// int2
+		case 23:	// int4
+		case 26:	// oid
+			return [[NSNumber alloc] initWithLongLong:strtoll(value, NULL, 10)];
+		case 700:	// float4
+		case 701:	// float8
+			return [[NSNumber alloc] initWithDouble:strtod(value, NULL)];
+		case 1700:	// numeric
+		{
+			NSString *text = [[NSString alloc] initWithBytes:value length:valueLength encoding:NSASCIIStringEncoding];
+			NSDecimalNumber *number = [[NSDecimalNumber alloc] initWithString:text];
+			[text release];
+			return number;
+		}
+		case 16:	// bool
+			return [[NSNumber alloc] initWithBool:((valueLength > 0) && (value[0] == 't'))];
+		default:
+		{
+			NSString *text = [[NSString alloc] initWithBytes:value length:valueLength encoding:encoding];
+			return (text != nil) ? text : [[NSNull null] retain];
+		}
+	}
+}
+
+static uint32_t
+PGSQLReadUInt32(const unsigned char *value)
+{
+	return ((uint32_t)value[0] << 24) | ((uint32_t)value[1] << 16) | ((uint32_t)value[2] << 8) | (uint32_t)value[3];
+}
+
+static uint64_t
+PGSQLReadUInt64(const unsigned char *value)
+{
+	return ((uint64_t)PGSQLReadUInt32(value) << 32) | PGSQLReadUInt32(value + 4);
+}
+
+// Reads a binary array element of a numeric type as both an integer and a
+// double.  NO if the type is not numeric or the length does not match it.
+static BOOL
+PGSQLBinaryElementNumber(const unsigned char *value, int32_t valueLength, unsigned int elementOID, 
+						 int64_t *integer, double *real)
+{
+	switch (elementOID)
+	{
+		case 21:	// int2
+			if (valueLength != 2) { return NO; }
+			*integer = (int16_t)((value[0] << 8) | value[1]);
+			*real = (double)*integer;
+			return YES;
+		case 23:	// int4
+			if (valueLength != 4) { return NO; }
+			*integer = (int32_t)PGSQLReadUInt32(value);
+			*real = (double)*integer;
+			return YES;
+		case 26:	// oid
+			if (valueLength != 4) { return NO; }
+			*integer = PGSQLReadUInt32(value);
+			*real = (double)*integer;
+			return YES;
+		case 20:	// int8
+			if (valueLength != 8) { return NO; }
+			*integer = (int64_t)PGSQLReadUInt64(value);
+			*real = (double)*integer;
+			return YES;
+		case 700:	// float4
+		{
+			if (valueLength != 4) { return NO; }
+			uint32_t bits = PGSQLReadUInt32(value);
+			float single;
+			memcpy(&single, &bits, sizeof(single));
+			*real = single;
+			*integer = (int64_t)single;
+			return YES;
+		}
+		case 701:	// float8
+		{
+			if (valueLength != 8) { return NO; }
+			uint64_t bits = PGSQLReadUInt64(value);
+			memcpy(real, &bits, sizeof(*real));
+			*integer = (int64_t)*real;
+			return YES;
+		}
+		default:
+			return NO;
+	}
+}
+
+// Returns a retained object for one element of a binary array.
+static id
+PGSQLNewBinaryElementObject(const unsigned char *value, int32_t valueLength, unsigned int elementOID, NSStringEncoding encoding)
+{
+	int64_t integer;
+	double real;
+	if (PGSQLBinaryElementNumber(value, valueLength, elementOID, &integer, &real))
+	{
+		if ((elementOID == 700) || (elementOID == 701))
+		{
+			return [[NSNumber alloc] initWithDouble:real];
+		}
+		return [[NSNumber alloc] initWithLongLong:integer];
+	}
+	
+	switch (elementOID)
+	{
+		case 16:	// bool
+			if (valueLength == 1)
+			{
+				return [[NSNumber alloc] initWithBool:(value[0] != 0)];
+			}
+			break;
+		case 19:	// name
+		case 25:	// text
+		case 114:	// json
+		case 142:	// xml
+		case 1042:	// bpchar
+		case 1043:	// varchar
+		{
+			NSString *text = [[NSString alloc] initWithBytes:value length:valueLength encoding:encoding];
+			if (text != nil)
+			{
+				return text;
+			}
+			break;
+		}
+		default:
+			break;
+	}
+	return [[NSData alloc] initWithBytes:value length:valueLength];
+}
+
+// The header of a binary array: ndim, a has-nulls flag, the element type,
+// then a length and lower bound per dimension, then the elements, each a 
+// length (-1 for NULL) and its bytes.  All big endian.
+typedef struct PGSQLBinaryArray {
+	int dimensionCount;
+	unsigned int elementOID;
+	NSUInteger dimensions[PGSQLArrayMaximumDimensions];
+	NSUInteger count;
+	const unsigned char *elements;
+	const unsigned char *end;
+} PGSQLBinaryArray;
+
+static BOOL
+PGSQLReadBinaryArray(const unsigned char *value, NSUInteger valueLength, PGSQLBinaryArray *array)
+{
+	if (valueLength < 12)
+	{
+		return NO;
+	}
+	int32_t dimensionCount = (int32_t)PGSQLReadUInt32(value);
+	if ((dimensionCount < 0) || (dimensionCount > PGSQLArrayMaximumDimensions) || 
+		(valueLength < 12 + (8 * (NSUInteger)dimensionCount)))
+	{
+		return NO;
+	}
+	
+	array->dimensionCount = dimensionCount;
+	array->elementOID = PGSQLReadUInt32(value + 8);
+	array->elements = value + 12 + (8 * dimensionCount);
+	array->end = value + valueLength;
+	array->count = (dimensionCount > 0) ? 1 : 0;
+	
+	int i;
+	for (i = 0; i < dimensionCount; i++)
+	{
+		int32_t dimension = (int32_t)PGSQLReadUInt32(value + 12 + (8 * i));
+		if (dimension < 0)
+		{
+			return NO;
+		}
+		array->dimensions[i] = dimension;
+		array->count *= dimension;
+		
+		// every element takes at least its 4 byte length
+		if (array->count > (NSUInteger)(array->end - array->elements) / 4)
+		{
+			return NO;
+		}
+	}
+	return YES;
+}
+
+// Steps to the next element of a binary array.  *value is NULL for a NULL 
+// element.  NO when the data runs short.
+static BOOL
+PGSQLNextBinaryElement(const unsigned char **cursor, const unsigned char *end, 
+					   const unsigned char **value, int32_t *valueLength)
+{
+	if (end - *cursor < 4)
+	{
+		return NO;
+	}
+	int32_t elementLength = (int32_t)PGSQLReadUInt32(*cursor);
+	*cursor += 4;
+	
+	if (elementLength == -1)
+	{
+		*value = NULL;
+		*valueLength = 0;
+		return YES;
+	}
+	if ((elementLength < 0) || (end - *cursor < elementLength))
+	{
+		return NO;
+	}
+	*value = *cursor;
+	*valueLength = elementLength;
+	*cursor += elementLength;
+	return YES;
+}
+
+// Splits a flat array into nested arrays of the given dimensions.
+static NSArray *
+PGSQLNestArray(NSArray *flat, const NSUInteger *dimensions, int dimensionCount, int level, NSUInteger *position)
+{
+	if (dimensionCount == 0)
+	{
+		return [NSArray array];
+	}
+	if (level == dimensionCount - 1)
+	{
+		NSArray *row = [flat subarrayWithRange:NSMakeRange(*position, dimensions[level])];
+		*position += dimensions[level];
+		return row;
+	}
+	
+	NSMutableArray *nested = [NSMutableArray arrayWithCapacity:dimensions[level]];
+	NSUInteger i;
+	for (i = 0; i < dimensions[level]; i++)
+	{
+		[nested addObject:PGSQLNestArray(flat, dimensions, dimensionCount, level + 1, position)];
+	}
+	return nested;
+}
+
+// Called by PGSQLParseTextArray for each brace and element.
+typedef struct PGSQLTextArrayVisitor {
+	void (*open)(void *context);
+	void (*close)(void *context);
+	void (*element)(void *context, const char *value, NSUInteger valueLength, BOOL isNull);
+	void *context;
+} PGSQLTextArrayVisitor;
+
+// Walks the text form of an array in one pass.  Elements that need no 
+// unescaping are passed as pointers into value, the rest are unescaped 
+// into one scratch buffer and NUL terminated there.  NO if malformed.
+static BOOL
+PGSQLParseTextArray(const char *value, NSUInteger valueLength, char delimiter, PGSQLTextArrayVisitor *visitor)
+{
+	const char *p = value;
+	const char *end = value + valueLength;
+	
+	// "[1:3][0:1]=" bounds, dropped
+	if ((p < end) && (*p == '['))
+	{
+		const char *equals = memchr(p, '=', end - p);
+		if (equals == NULL)
+		{
+			return NO;
+		}
+		p = equals + 1;
+	}
+	
+	char *scratch = NULL;
+	int depth = 0;
+	BOOL valid = YES;
+	
+	while ((p < end) && valid)
+	{
+		char c = *p;
+		
+		if (c == '{')
+		{
+			depth++;
+			visitor->open(visitor->context);
+			p++;
+		} else if (c == '}') {
+			if (depth == 0)
+			{
+				valid = NO;
+				break;
+			}
+			depth--;
+			visitor->close(visitor->context);
+			p++;
+			if (depth == 0)
+			{
+				break;
+			}
+		} else if ((c == delimiter) || isspace((unsigned char)c)) {
+			p++;
+		} else if (depth == 0) {
+			valid = NO;
+		} else {
+			BOOL quoted = (c == '"');
+			if (quoted)
+			{
+				p++;
+			}
+			
+			const char *start = p;
+			BOOL escaped = NO;
+			if (quoted)
+			{
+				while ((p < end) && (*p != '"'))
+				{
+					if (*p == '\\') { escaped = YES; p++; }
+					p++;
+				}
+				if (p >= end)
+				{
+					valid = NO;
+					break;
+				}
+			} else {
+				while ((p < end) && (*p != delimiter) && (*p != '}'))
+				{
+					if (*p == '\\') { escaped = YES; p++; }
+					p++;
+				}
+				if (p > end)
+				{
+					valid = NO;
+					break;
+				}
+			}
+			
+			const char *stop = p;
+			if (!quoted)
+			{
+				while ((stop > start) && isspace((unsigned char)stop[-1]))
+				{
+					stop--;
+				}
+			} else {
+				p++;	// the closing quote
+			}
+			
+			if (!quoted && !escaped && (stop - start == 4) && (strncasecmp(start, "NULL", 4) == 0))
+			{
+				visitor->element(visitor->context, NULL, 0, YES);
+			} else if (!escaped) {
+				visitor->element(visitor->context, start, stop - start, NO);
+			} else {
+				if (scratch == NULL)
+				{
+					scratch = malloc(valueLength + 1);
+				}
+				NSUInteger scratchLength = 0;
+				const char *q;
+				for (q = start; q < stop; q++)
+				{
+					if ((*q == '\\') && (q + 1 < stop))
+					{
+						q++;
+					}
+					scratch[scratchLength++] = *q;
+				}
+				scratch[scratchLength] = '\0';
+				visitor->element(visitor->context, scratch, scratchLength, NO);
+			}
+		}
+	}
+	
+	free(scratch);
+	return (valid && (depth == 0));
+}
+
+// Builds nested NSMutableArrays from the text form.
+typedef struct PGSQLArrayBuilder {
+	NSMutableArray *stack;	// the arrays still open, innermost last
+	NSMutableArray *result;
+	unsigned int elementOID;
+	NSStringEncoding encoding;
+} PGSQLArrayBuilder;
+
+static void
+PGSQLArrayBuilderOpen(void *context)
+{
+	PGSQLArrayBuilder *builder = context;
+	NSMutableArray *array = [[NSMutableArray alloc] init];
+	[[builder->stack lastObject] addObject:array];
+	[builder->stack addObject:array];
+	[array release];
+}
+
+static void
+PGSQLArrayBuilderClose(void *context)
+{
+	PGSQLArrayBuilder *builder = context;
+	if ([builder->stack count] == 1)
+	{
+		builder->result = [[[builder->stack lastObject] retain] autorelease];
+	}
+	[builder->stack removeLastObject];
+}
+
+static void
+PGSQLArrayBuilderElement(void *context, const char *value, NSUInteger valueLength, BOOL isNull)
+{
+	PGSQLArrayBuilder *builder = context;
+	id element = isNull ? [[NSNull null] retain] 
+						: PGSQLNewTextElementObject(value, valueLength, builder->elementOID, builder->encoding);
+	[[builder->stack lastObject] addObject:element];
+	[element release];
+}
+
+// Appends each element of the text form to a C array.
+typedef struct PGSQLNumberCollector {
+	NSMutableData *values;
+	BOOL doubles;
+} PGSQLNumberCollector;
+
+static void
+PGSQLNumberCollectorBrace(void *context)
+{
+}
+
+static void
+PGSQLNumberCollectorElement(void *context, const char *value, NSUInteger valueLength, BOOL isNull)
+{
+	PGSQLNumberCollector *collector = context;
+	if (collector->doubles)
+	{
+		double real = isNull ? NAN : strtod(value, NULL);
+		[collector->values appendBytes:&real length:sizeof(real)];
+	} else {
+		int64_t integer = isNull ? 0 : strtoll(value, NULL, 10);
+		[collector->values appendBytes:&integer length:sizeof(integer)];
+	}
+}
+
+// Measures the dimensions of the text form from its first sub-array at 
+// each depth.
+typedef struct PGSQLDimensionCounter {
+	int depth;
+	int dimensionCount;
+	NSUInteger counts[PGSQLArrayMaximumDimensions];
+	NSUInteger dimensions[PGSQLArrayMaximumDimensions];
+	BOOL measured[PGSQLArrayMaximumDimensions];
+} PGSQLDimensionCounter;
+
+static void
+PGSQLDimensionCounterOpen(void *context)
+{
+	PGSQLDimensionCounter *counter = context;
+	if ((counter->depth > 0) && (counter->depth <= PGSQLArrayMaximumDimensions))
+	{
+		counter->counts[counter->depth - 1]++;
+	}
+	counter->depth++;
+	if (counter->depth <= PGSQLArrayMaximumDimensions)
+	{
+		counter->counts[counter->depth - 1] = 0;
+		if (counter->depth > counter->dimensionCount)
+		{
+			counter->dimensionCount = counter->depth;
+		}
+	}
+}
+
+static void
+PGSQLDimensionCounterClose(void *context)
+{
+	PGSQLDimensionCounter *counter = context;
+	if ((counter->depth <= PGSQLArrayMaximumDimensions) && !counter->measured[counter->depth - 1])
+	{
+		counter->dimensions[counter->depth - 1] = counter->counts[counter->depth - 1];
+		counter->measured[counter->depth - 1] = YES;
+	}
+	counter->depth--;
+}
+
+static void
+PGSQLDimensionCounterElement(void *context, const char *value, NSUInteger valueLength, BOOL isNull)
+{
+	PGSQLDimensionCounter *counter = context;
+	if (counter->depth <= PGSQLArrayMaximumDimensions)
+	{
+		counter->counts[counter->depth - 1]++;
+	}
+}
+
+#pragma mark -
 
 @implementation PGSQLField
 
 -(id)initWithResult:(void *)result forColumn:(PGSQLColumn *)forColumn
 			  atRow:(int)atRow
+{
+	const char *value = NULL;
+	if (PQgetisnull(result, atRow, [forColumn index]) != 1)
+	{
+		value = PQgetvalue(result, atRow, [forColumn index]);
+	}
+	
+	return [self initWithValue:value 
+						length:PQgetlength(result, atRow, [forColumn index]) 
+						format:PQfformat(result, [forColumn index]) 
+					 forColumn:forColumn];
+}
+
+-(id)initWithValue:(const char *)value length:(NSUInteger)valueLength 
+			format:(int)format forColumn:(PGSQLColumn *)forColumn
 {
 	self = [super init];
 	
 	if (self)
 	{
-		data = nil;
+		bytes = NULL;
+		length = 0;
+		isNullValue = YES;
+		string = nil;
 		
-		// this will default to NSUTF8StringEncoding with PG9
-		defaultEncoding = NSMacOSRomanStringEncoding;
+		defaultEncoding = NSUTF8StringEncoding;
 
-		if (PQgetisnull(result, atRow, [forColumn index]) != 1)
+		if (value != NULL)
 		{		
-			char* szBuf = nil;
-			
 			column = [forColumn retain];
 			
-			int format = PQfformat(result, [column index]);
-			
-			int iLen = PQgetlength(result, atRow, [column index]);			// Binary
+			NSUInteger iLen = valueLength;			// Binary
 			if (format == 0)
 			{
-				iLen = PQgetlength(result, atRow, [column index]) + 1;		// Text
+				iLen = valueLength + 1;				// Text
 			}
 			
-			// this may have to be adjust if the column type is not 0 (eg, it's binary)
-			szBuf = PQgetvalue(result, atRow, [column index]);
+			// copy once out of the result, the field may outlive it.
 			if (iLen > 0)
-				data = [[NSData alloc] initWithBytes:szBuf length:iLen];
+			{
+				bytes = malloc(iLen);
+				memcpy(bytes, value, iLen);
+				length = iLen;
+				isNullValue = NO;
+			}
 		}
 	}
 
@@ -49,59 +656,100 @@
 
 - (void)dealloc
 {
-	[data release];
+	free(bytes);
+	[string release];
 	[column release];
 	[super dealloc];
 }
 
--(NSString *)asString
-{	
-	NSString* result = @"";
-	if (data != nil)
+// Once the no-copy path has handed bytes to the cached string, the string 
+// is the only owner of the value.  Only ASCII is ever handed over, so its 
+// UTF-8 form is byte for byte what was there.
+-(const char *)valueBytes
+{
+	if (bytes != NULL)
 	{
-		int dataLength = [data length];
-		if (dataLength > 0)
-		{
-			// check for null terminator
-			char* ptr = (char*)[data bytes];
-			char lastChar = ptr[dataLength - 1];
-			if (lastChar == '\0')
-				dataLength--;
-			if (dataLength > 0)
-				result = [[[NSString alloc] initWithBytes:[data bytes] length:dataLength encoding:defaultEncoding] autorelease];
-		}
+		return bytes;
 	}
-	return result; 
+	return [string UTF8String];
 }
 
--(NSString *)asString:(NSStringEncoding)encoding
-{	
-		NSString* result = @"";
-		if (data != nil)
+// Returns a retained string for the value, or nil if it can not be decoded.
+// When cache is YES the ASCII path gives bytes to the string rather than 
+// copying them, and the caller must keep the result as the cached string.
+-(NSString *)newStringWithEncoding:(NSStringEncoding)encoding cache:(BOOL)cache
+{
+	const char *value = [self valueBytes];
+	NSUInteger valueLength = length;
+	
+	// check for null terminator
+	if ((valueLength > 0) && (value[valueLength - 1] == '\0'))
+		valueLength--;
+	if (valueLength == 0)
+		return [@"" retain];
+	
+	if (PGSQLEncodingIsASCIICompatible(encoding) && PGSQLBytesAreASCII(value, valueLength))
+	{
+		if (cache && (bytes != NULL))
 		{
-			int dataLength = [data length];
-			if (dataLength > 0)
+			NSString *result = [[NSString alloc] initWithBytesNoCopy:bytes 
+															  length:valueLength 
+															encoding:NSASCIIStringEncoding 
+														freeWhenDone:YES];
+			if (result != nil)
 			{
-				// check for null terminator
-				char* ptr = (char*)[data bytes];
-				char lastChar = ptr[dataLength - 1];
-				if (lastChar == '\0')
-					dataLength--;
-				if (dataLength > 0)
-					result = [[[NSString alloc] initWithBytes:[data bytes] length:dataLength encoding:encoding] autorelease];
+				bytes = NULL;
+				return result;
 			}
 		}
-		return result; 
+		return [[NSString alloc] initWithBytes:value length:valueLength encoding:NSASCIIStringEncoding];
+	}
+	return [[NSString alloc] initWithBytes:value length:valueLength encoding:encoding];
+}
+
+-(NSString *)asString
+{	
+	if (isNullValue)
+	{
+		return @"";
+	}
+	if ((bytes == NULL) && !PGSQLEncodingIsASCIICompatible(defaultEncoding))
+	{
+		// the cached string was read as ASCII, decode again for the new encoding
+		return [[self newStringWithEncoding:defaultEncoding cache:NO] autorelease];
+	}
+	if ((string == nil) && [column internsStrings])
+	{
+		NSUInteger valueLength = length;
+		if ((valueLength > 0) && (bytes[valueLength - 1] == '\0'))
+			valueLength--;
+		string = [[column internedStringWithBytes:bytes length:valueLength 
+										 encoding:defaultEncoding] retain];
+	}
+	if (string == nil)
+	{
+		string = [self newStringWithEncoding:defaultEncoding cache:YES];
+	}
+	return [[string retain] autorelease];
+}
+
+-(NSString *)asString:(NSStringEncoding)encoding
+{	
+	if (encoding == defaultEncoding)
+	{
+		return [self asString];
+	}
+	if (isNullValue)
+	{
+		return @"";
+	}
+	return [[self newStringWithEncoding:encoding cache:NO] autorelease];
 }
 
 -(NSNumber *)asNumber
 {
-	if (data != nil) {
-		if ([data length] <= 0)
-		{
-			return nil;
-		}
-		NSString *temp = [[[NSString alloc] initWithBytes:[data bytes] length:[data length] encoding:NSUTF8StringEncoding] autorelease];
+	if (!isNullValue) {
+		NSString *temp = [[[NSString alloc] initWithBytes:[self valueBytes] length:length encoding:NSUTF8StringEncoding] autorelease];
 		NSNumber *value = [[[NSNumber alloc] initWithFloat:[temp floatValue]] autorelease];
 		return value;
 	}
@@ -110,13 +758,8 @@
 
 -(long)asLong
 {
-	if (data != nil) {
-		if ([data length] <= 0)
-		{
-			return 0;
-		}
-		
-		NSString *value = [[[NSString alloc] initWithBytes:[data bytes] length:[data length] encoding:NSUTF8StringEncoding] autorelease];
+	if (!isNullValue) {
+		NSString *value = [[[NSString alloc] initWithBytes:[self valueBytes] length:length encoding:NSUTF8StringEncoding] autorelease];
 		
 		return (long)[[NSNumber numberWithFloat:[value floatValue]] longValue];
 	}
@@ -132,13 +775,8 @@
         [formatter setDateFormat:@"yyyy'-'MM'-'dd HH':'mm':'ssZZ"];
     }
     
-    if (data != nil) {
-		if ([data length] <= 0)
-		{
-			return nil;
-		}
-        
-        NSString *value = [NSString stringWithCString:(char *)[data bytes]
+    if (!isNullValue) {
+        NSString *value = [NSString stringWithCString:[self valueBytes]
 											 encoding:NSUTF8StringEncoding];
         value = [value stringByAppendingString:@"00"];
         NSDate *d = [formatter dateFromString:value];
@@ -147,13 +785,8 @@
     
     return nil;
     
-	if (data != nil) {
-		if ([data length] <= 0)
-		{
-			return nil;
-		}
-		
-		NSString *value = [NSString stringWithCString:(char *)[data bytes]
+	if (!isNullValue) {
+		NSString *value = [NSString stringWithCString:[self valueBytes]
 											 encoding:NSUTF8StringEncoding];
 		if ([value rangeOfString:@"."].location != NSNotFound)
 		{
@@ -171,14 +804,9 @@
 
 -(NSData *)asData
 {
-	if (data != nil) {
-		if ([data length] <= 0)
-		{
-			return nil;
-		}
-        
+	if (!isNullValue) {
         size_t len;
-        const unsigned char *unescaped = PQunescapeBytea([data bytes], &len);
+        const unsigned char *unescaped = PQunescapeBytea((const unsigned char *)[self valueBytes], &len);
 		
 		return [[[NSData alloc] initWithBytes:unescaped length:len] autorelease];
 	}
@@ -188,17 +816,245 @@
 -(BOOL)asBoolean
 {
 	BOOL result = NO;
-	if (data != nil)
+	if (!isNullValue)
 	{
-		char charResult = *(char*)[data bytes];
+		char charResult = *[self valueBytes];
 		result = (charResult == 't');
 	}
 	return result;
 }
 
+// The value without a text value's terminator.
+-(NSUInteger)valueLength
+{
+	NSUInteger valueLength = length;
+	if (([column format] == 0) && (valueLength > 0) && ([self valueBytes][valueLength - 1] == '\0'))
+	{
+		valueLength--;
+	}
+	return valueLength;
+}
+
+-(NSArray *)asArray
+{
+	unsigned int elementOID;
+	if (isNullValue || !PGSQLColumnIsArray(column, [self valueBytes], &elementOID))
+	{
+		return nil;
+	}
+	
+	if ([column format] == 1)
+	{
+		PGSQLBinaryArray array;
+		if (!PGSQLReadBinaryArray((const unsigned char *)[self valueBytes], length, &array))
+		{
+			return nil;
+		}
+		
+		NSMutableArray *flat = [NSMutableArray arrayWithCapacity:array.count];
+		const unsigned char *cursor = array.elements;
+		NSUInteger i;
+		for (i = 0; i < array.count; i++)
+		{
+			const unsigned char *value;
+			int32_t valueLength;
+			if (!PGSQLNextBinaryElement(&cursor, array.end, &value, &valueLength))
+			{
+				return nil;
+			}
+			id element = (value == NULL) ? [[NSNull null] retain] 
+										 : PGSQLNewBinaryElementObject(value, valueLength, array.elementOID, defaultEncoding);
+			[flat addObject:element];
+			[element release];
+		}
+		
+		NSUInteger position = 0;
+		return PGSQLNestArray(flat, array.dimensions, array.dimensionCount, 0, &position);
+	}
+	
+	PGSQLArrayBuilder builder;
+	builder.stack = [NSMutableArray array];
+	builder.result = nil;
+	builder.elementOID = elementOID;
+	builder.encoding = defaultEncoding;
+	
+	PGSQLTextArrayVisitor visitor = { PGSQLArrayBuilderOpen, PGSQLArrayBuilderClose, PGSQLArrayBuilderElement, &builder };
+	if (!PGSQLParseTextArray([self valueBytes], [self valueLength], (elementOID == 603) ? ';' : ',', &visitor))
+	{
+		return nil;
+	}
+	return builder.result;
+}
+
+-(NSData *)numericArrayAsDoubles:(BOOL)doubles
+{
+	unsigned int elementOID;
+	if (isNullValue || !PGSQLColumnIsArray(column, [self valueBytes], &elementOID))
+	{
+		return nil;
+	}
+	
+	if ([column format] == 1)
+	{
+		PGSQLBinaryArray array;
+		if (!PGSQLReadBinaryArray((const unsigned char *)[self valueBytes], length, &array))
+		{
+			return nil;
+		}
+		
+		NSMutableData *values = [NSMutableData dataWithLength:array.count * (doubles ? sizeof(double) : sizeof(int64_t))];
+		double *reals = [values mutableBytes];
+		int64_t *integers = [values mutableBytes];
+		const unsigned char *cursor = array.elements;
+		NSUInteger i;
+		for (i = 0; i < array.count; i++)
+		{
+			const unsigned char *value;
+			int32_t valueLength;
+			if (!PGSQLNextBinaryElement(&cursor, array.end, &value, &valueLength))
+			{
+				return nil;
+			}
+			
+			int64_t integer = 0;
+			double real = NAN;
+			if ((value != NULL) && !PGSQLBinaryElementNumber(value, valueLength, array.elementOID, &integer, &real))
+			{
+				return nil;
+			}
+			if (doubles) { reals[i] = real; } else { integers[i] = integer; }
+		}
+		return values;
+	}
+	
+	// the text parser would read any array, an element of text[] as 0
+	switch (elementOID)
+	{
+		case 20:	// int8
+		case 21:	// int2
+		case 23:	// int4
+		case 26:	// oid
+		case 700:	// float4
+		case 701:	// float8
+		case 1700:	// numeric
+			break;
+		default:
+			return nil;
+	}
+	
+	PGSQLNumberCollector collector;
+	collector.values = [NSMutableData data];
+	collector.doubles = doubles;
+	
+	PGSQLTextArrayVisitor visitor = { PGSQLNumberCollectorBrace, PGSQLNumberCollectorBrace, PGSQLNumberCollectorElement, &collector };
+	if (!PGSQLParseTextArray([self valueBytes], [self valueLength], (elementOID == 603) ? ';' : ',', &visitor))
+	{
+		return nil;
+	}
+	return collector.values;
+}
+
+-(NSData *)asInt64Array
+{
+	return [self numericArrayAsDoubles:NO];
+}
+
+-(NSData *)asDoubleArray
+{
+	return [self numericArrayAsDoubles:YES];
+}
+
+-(NSArray *)arrayDimensions
+{
+	unsigned int elementOID;
+	if (isNullValue || !PGSQLColumnIsArray(column, [self valueBytes], &elementOID))
+	{
+		return nil;
+	}
+	
+	NSUInteger dimensions[PGSQLArrayMaximumDimensions];
+	int dimensionCount;
+	
+	if ([column format] == 1)
+	{
+		PGSQLBinaryArray array;
+		if (!PGSQLReadBinaryArray((const unsigned char *)[self valueBytes], length, &array))
+		{
+			return nil;
+		}
+		dimensionCount = array.dimensionCount;
+		memcpy(dimensions, array.dimensions, sizeof(dimensions));
+	} else {
+		PGSQLDimensionCounter counter;
+		memset(&counter, 0, sizeof(counter));
+		
+		PGSQLTextArrayVisitor visitor = { PGSQLDimensionCounterOpen, PGSQLDimensionCounterClose, PGSQLDimensionCounterElement, &counter };
+		if (!PGSQLParseTextArray([self valueBytes], [self valueLength], (elementOID == 603) ? ';' : ',', &visitor))
+		{
+			return nil;
+		}
+		dimensionCount = counter.dimensionCount;
+		memcpy(dimensions, counter.dimensions, sizeof(dimensions));
+		
+		// {} is an empty array, which has no dimensions
+		if ((dimensionCount > 0) && (dimensions[0] == 0))
+		{
+			dimensionCount = 0;
+		}
+	}
+	
+	NSMutableArray *result = [NSMutableArray arrayWithCapacity:dimensionCount];
+	int i;
+	for (i = 0; i < dimensionCount; i++)
+	{
+		[result addObject:[NSNumber numberWithUnsignedInteger:dimensions[i]]];
+	}
+	return result;
+}
+
+-(NSData *)jsonData
+{
+	if (isNullValue)
+	{
+		return nil;
+	}
+	
+	const char *value = [self valueBytes];
+	NSUInteger valueLength = [self valueLength];
+	
+	// binary jsonb is a format version, 1, followed by the text
+	if (([column format] == 1) && ([column type] == 3802))
+	{
+		if ((valueLength == 0) || (value[0] != 1))
+		{
+			return nil;
+		}
+		value++;
+		valueLength--;
+	}
+	// copied: valueBytes may be an autoreleased UTF8String of the field's
+	// string rather than the field's own buffer
+	return [NSData dataWithBytes:value length:valueLength];
+}
+
+-(id)jsonValueWithOptions:(NSJSONReadingOptions)options error:(NSError **)error
+{
+	NSData *json = [self jsonData];
+	if (json == nil)
+	{
+		return nil;
+	}
+	return [NSJSONSerialization JSONObjectWithData:json options:(options | NSJSONReadingAllowFragments) error:error];
+}
+
+-(id)jsonValue
+{
+	return [self jsonValueWithOptions:0 error:NULL];
+}
+
 -(BOOL)isNull
 {
-	return (data == nil);
+	return isNullValue;
 }
 
 -(NSStringEncoding)defaultEncoding
@@ -210,6 +1066,14 @@
 {
     if (defaultEncoding != value) {
         defaultEncoding = value;
+		
+		// the cached string was decoded with the old encoding.  If it owns 
+		// the value it has to stay, asString works around it.
+		if (bytes != NULL)
+		{
+			[string release];
+			string = nil;
+		}
     }	
 	
 }
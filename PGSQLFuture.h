@@ -0,0 +1,51 @@
+//
+//  PGSQLFuture.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLFuture
+    @abstract   A placeholder for a result that another thread will produce.
+    @discussion Work that PGSQLKit queues for later (coalesced writes, fan-out
+				queries and the like) hands the caller a PGSQLFuture right
+				away.  The caller can block on it, poll it, or wait with a
+				time limit.  The future completes once and keeps its value.
+*/
+
+/*!
+    @class
+    @abstract    A write-once value with blocking and timed waits.
+    @discussion  Safe to share between threads.  finishWithResult: is for the
+				 producer, the rest of the methods are for consumers.
+*/
+@interface PGSQLFuture : NSObject {
+	NSCondition *condition;
+	BOOL isFinished;
+	id result;
+}
+
+/*!
+    @method
+    @abstract   Completes the future and wakes anything waiting on it.
+    @discussion Only the first call has any effect.
+*/
+-(void)finishWithResult:(id)value;
+
+-(BOOL)isFinished;
+
+/*!
+    @method
+    @abstract   Blocks until the future completes and returns its value.
+*/
+-(id)result;
+
+/*!
+    @method
+    @abstract   Blocks until the future completes or limit passes.
+    @result     The value, or nil if limit passed first.
+*/
+-(id)resultBeforeDate:(NSDate *)limit;
+
+@end
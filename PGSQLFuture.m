@@ -0,0 +1,79 @@
+//
+//  PGSQLFuture.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLFuture.h"
+
+@implementation PGSQLFuture
+
+-(id)init
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		condition = [[NSCondition alloc] init];
+		isFinished = NO;
+		result = nil;
+	}
+	return self;
+}
+
+-(void)dealloc
+{
+	[condition release];
+	[result release];
+	[super dealloc];
+}
+
+-(void)finishWithResult:(id)value
+{
+	[condition lock];
+	if (!isFinished)
+	{
+		result = [value retain];
+		isFinished = YES;
+		[condition broadcast];
+	}
+	[condition unlock];
+}
+
+-(BOOL)isFinished
+{
+	[condition lock];
+	BOOL finished = isFinished;
+	[condition unlock];
+	return finished;
+}
+
+-(id)result
+{
+	[condition lock];
+	while (!isFinished)
+	{
+		[condition wait];
+	}
+	id value = [[result retain] autorelease];
+	[condition unlock];
+	return value;
+}
+
+-(id)resultBeforeDate:(NSDate *)limit
+{
+	[condition lock];
+	while (!isFinished)
+	{
+		if (![condition waitUntilDate:limit])
+		{
+			break;
+		}
+	}
+	id value = [[result retain] autorelease];
+	[condition unlock];
+	return value;
+}
+
+@end
@@ -0,0 +1,118 @@
+//
+//  PGSQLGroupCommitWriter.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLGroupCommitWriter
+    @abstract   Coalesces small writes from many threads into shared commits.
+    @discussion Each execCommand: on its own pays a round trip and a commit,
+				and the commit's fsync on the server is usually the expensive
+				part.  The group commit writer collects the commands queued by
+				any number of threads for a short window, or until a batch is
+				full, and runs the whole batch as one transaction.  Each
+				caller still gets its own PGSQLCommandResult through a
+				PGSQLFuture.
+
+				A batch is first sent as a single script (BEGIN, the commands
+				with their parameters quoted inline, COMMIT), which costs one
+				round trip.  If any command in it fails, the batch is rolled
+				back and replayed one command at a time, each inside its own
+				savepoint.  The failing commands report their errors and the
+				rest are still committed together.
+*/
+
+#import "PGSQLConnection.h"
+#import "PGSQLFuture.h"
+
+/*!
+    @class
+    @abstract    A background writer that batches commands into transactions.
+    @discussion  The writer runs a thread of its own and keeps the connection
+				 locked for the length of each batch.  Give it a connection
+				 that is not also used for explicit transactions elsewhere.
+
+				 The thread keeps the writer retained until it ends, so
+				 releasing a writer does not stop it.  Call stop when done
+				 with it; until then the writer and its connection are never
+				 freed.
+*/
+@interface PGSQLGroupCommitWriter : NSObject {
+	PGSQLConnection *connection;
+
+	NSCondition *queueCondition;
+	NSMutableArray *pendingWrites;
+	NSUInteger maximumBatchSize;
+	NSTimeInterval maximumDelay;
+
+	BOOL isRunning;
+	BOOL isWriting;
+	NSUInteger batchCount;
+}
+
+/*!
+    @method
+    @abstract   Starts a writer on connection.
+    @discussion Defaults to batches of up to 100 commands collected over at
+				most 5 milliseconds.
+*/
+-(id)initWithConnection:(PGSQLConnection *)conn;
+
+/*!
+    @method
+    @abstract   Queue a command.  The future completes with its
+				PGSQLCommandResult once the batch it landed in is committed
+				(or rolled back).
+*/
+-(PGSQLFuture *)enqueueCommand:(NSString *)sql;
+/*!
+    @method
+    @abstract   Queue a command with parameters bound as $1..$n.
+    @discussion Parameters follow the rules of -[PGSQLConnection
+				execute:parameters:].
+*/
+-(PGSQLFuture *)enqueueCommand:(NSString *)sql parameters:(NSArray *)params;
+
+/*!
+    @method
+    @abstract   Queue a command and wait for its result.
+*/
+-(PGSQLCommandResult *)execCommand:(NSString *)sql parameters:(NSArray *)params;
+
+/*!
+    @method
+    @abstract   Blocks until everything queued so far has been written.
+*/
+-(void)flush;
+
+/*!
+    @method
+    @abstract   Writes what is queued and stops the writer thread.
+    @discussion Commands queued after stop complete at once with an error.
+				Required before the writer can be freed, see the class
+				discussion.
+*/
+-(void)stop;
+
+-(PGSQLConnection *)connection;
+
+-(NSUInteger)maximumBatchSize;
+-(void)setMaximumBatchSize:(NSUInteger)value;
+
+/*!
+    @method
+    @abstract   How long the oldest queued command may wait for company
+				before its batch is written, in seconds.
+*/
+-(NSTimeInterval)maximumDelay;
+-(void)setMaximumDelay:(NSTimeInterval)value;
+
+/*!
+    @method
+    @abstract   Number of batches written so far.
+*/
+-(NSUInteger)batchCount;
+
+@end
@@ -0,0 +1,466 @@
+//
+//  PGSQLGroupCommitWriter.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLGroupCommitWriter.h"
+
+// One queued command and the future its caller is waiting on.
+@interface PGSQLPendingWrite : NSObject {
+	NSString *sql;
+	NSArray *parameters;
+	PGSQLFuture *future;
+	NSTimeInterval enqueued;
+}
+
+-(id)initWithSQL:(NSString *)sqlCommand parameters:(NSArray *)params;
+-(NSString *)sql;
+-(NSArray *)parameters;
+-(PGSQLFuture *)future;
+-(NSTimeInterval)enqueued;
+
+@end
+
+@implementation PGSQLPendingWrite
+
+-(id)initWithSQL:(NSString *)sqlCommand parameters:(NSArray *)params
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		sql = [sqlCommand copy];
+		parameters = [params copy];
+		future = [[PGSQLFuture alloc] init];
+		enqueued = [NSDate timeIntervalSinceReferenceDate];
+	}
+	return self;
+}
+
+-(void)dealloc
+{
+	[sql release];
+	[parameters release];
+	[future release];
+	[super dealloc];
+}
+
+-(NSString *)sql
+{
+	return sql;
+}
+
+-(NSArray *)parameters
+{
+	return parameters;
+}
+
+-(PGSQLFuture *)future
+{
+	return future;
+}
+
+-(NSTimeInterval)enqueued
+{
+	return enqueued;
+}
+
+@end
+
+static BOOL
+PGSQLIsDigit(unichar c)
+{
+	return (c >= '0') && (c <= '9');
+}
+
+static BOOL
+PGSQLIsTagCharacter(unichar c)
+{
+	return PGSQLIsDigit(c) || (c == '_') || ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || (c > 127);
+}
+
+@interface PGSQLGroupCommitWriter (Private)
+
+-(void)writerThread;
+-(void)writeBatch:(NSArray *)batch;
+-(void)writeBatchWithSavepoints:(NSArray *)batch;
+-(NSString *)inlineParameters:(NSArray *)params intoSQL:(NSString *)sql;
+
+@end
+
+@implementation PGSQLGroupCommitWriter
+
+-(id)initWithConnection:(PGSQLConnection *)conn
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		connection = [conn retain];
+		queueCondition = [[NSCondition alloc] init];
+		pendingWrites = [[NSMutableArray alloc] init];
+		maximumBatchSize = 100;
+		maximumDelay = 0.005;
+		batchCount = 0;
+		isWriting = NO;
+		isRunning = YES;
+
+		[NSThread detachNewThreadSelector:@selector(writerThread) toTarget:self withObject:nil];
+	}
+	return self;
+}
+
+-(void)dealloc
+{
+	[connection release];
+	[queueCondition release];
+	[pendingWrites release];
+	[super dealloc];
+}
+
+#pragma mark -
+#pragma mark Queueing
+
+-(PGSQLFuture *)enqueueCommand:(NSString *)sql
+{
+	return [self enqueueCommand:sql parameters:nil];
+}
+
+-(PGSQLFuture *)enqueueCommand:(NSString *)sql parameters:(NSArray *)params
+{
+	PGSQLPendingWrite *write = [[[PGSQLPendingWrite alloc] initWithSQL:sql parameters:params] autorelease];
+
+	[queueCondition lock];
+	if (!isRunning)
+	{
+		[queueCondition unlock];
+		PGSQLCommandResult *result = [[[PGSQLCommandResult alloc] initWithError:@"Group commit writer is stopped."
+																			sql:sql
+																  executionTime:0] autorelease];
+		[[write future] finishWithResult:result];
+		return [write future];
+	}
+	[pendingWrites addObject:write];
+	// flush and stop wait on the same condition, wake everyone
+	[queueCondition broadcast];
+	[queueCondition unlock];
+
+	return [write future];
+}
+
+-(PGSQLCommandResult *)execCommand:(NSString *)sql parameters:(NSArray *)params
+{
+	return [[self enqueueCommand:sql parameters:params] result];
+}
+
+-(void)flush
+{
+	[queueCondition lock];
+	while (([pendingWrites count] > 0) || isWriting)
+	{
+		[queueCondition wait];
+	}
+	[queueCondition unlock];
+}
+
+-(void)stop
+{
+	[queueCondition lock];
+	isRunning = NO;
+	[queueCondition broadcast];
+	[queueCondition unlock];
+
+	[self flush];
+}
+
+#pragma mark -
+#pragma mark Writer Thread
+
+-(void)writerThread
+{
+	[queueCondition lock];
+	while (isRunning || ([pendingWrites count] > 0))
+	{
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+		while (isRunning && ([pendingWrites count] == 0))
+		{
+			[queueCondition wait];
+		}
+
+		if ([pendingWrites count] > 0)
+		{
+			// give the oldest write up to maximumDelay to collect company
+			NSTimeInterval oldest = [[pendingWrites objectAtIndex:0] enqueued];
+			NSDate *deadline = [NSDate dateWithTimeIntervalSinceReferenceDate:oldest + maximumDelay];
+			while (isRunning && ([pendingWrites count] < maximumBatchSize))
+			{
+				if (![queueCondition waitUntilDate:deadline])
+				{
+					break;
+				}
+			}
+
+			NSRange range = NSMakeRange(0, MIN([pendingWrites count], maximumBatchSize));
+			NSArray *batch = [pendingWrites subarrayWithRange:range];
+			[pendingWrites removeObjectsInRange:range];
+			isWriting = YES;
+			[queueCondition unlock];
+
+			[self writeBatch:batch];
+
+			[queueCondition lock];
+			isWriting = NO;
+			batchCount++;
+			[queueCondition broadcast];
+		}
+
+		[pool release];
+	}
+	[queueCondition unlock];
+}
+
+-(void)writeBatch:(NSArray *)batch
+{
+	NSUInteger i;
+	NSUInteger count = [batch count];
+
+	// nobody else's statements may land inside our transaction
+	[connection lock];
+
+	NSMutableString *script = [NSMutableString stringWithString:@"BEGIN;\n"];
+	BOOL canCoalesce = YES;
+	for (i = 0; i < count; i++)
+	{
+		PGSQLPendingWrite *write = [batch objectAtIndex:i];
+		NSString *statement = [self inlineParameters:[write parameters] intoSQL:[write sql]];
+		if (statement == nil)
+		{
+			canCoalesce = NO;
+			break;
+		}
+		[script appendString:statement];
+		[script appendString:@";\n"];
+	}
+	[script appendString:@"COMMIT;"];
+
+	if (canCoalesce)
+	{
+		NSArray *results = [connection executeScript:script];
+		PGSQLCommandResult *last = [results lastObject];
+
+		if ([last succeeded] && [[last lastCmdStatus] isEqualToString:@"COMMIT"])
+		{
+			// BEGIN, one result per write, COMMIT.  A command that was itself
+			// several statements throws the count off, so give those the
+			// COMMIT's result rather than guess.
+			BOOL matched = ([results count] == count + 2);
+			for (i = 0; i < count; i++)
+			{
+				PGSQLCommandResult *result = matched ? [results objectAtIndex:i + 1] : last;
+				[[[batch objectAtIndex:i] future] finishWithResult:result];
+			}
+			[connection unlock];
+			return;
+		}
+
+		// the failed script leaves an aborted transaction behind
+		[connection execute:@"ROLLBACK"];
+	}
+
+	[self writeBatchWithSavepoints:batch];
+	[connection unlock];
+}
+
+-(void)writeBatchWithSavepoints:(NSArray *)batch
+{
+	NSUInteger i;
+	NSUInteger count = [batch count];
+
+	PGSQLCommandResult *begin = [connection execute:@"BEGIN"];
+	if (![begin succeeded])
+	{
+		for (i = 0; i < count; i++)
+		{
+			[[[batch objectAtIndex:i] future] finishWithResult:begin];
+		}
+		return;
+	}
+
+	NSMutableArray *results = [NSMutableArray arrayWithCapacity:count];
+	for (i = 0; i < count; i++)
+	{
+		PGSQLPendingWrite *write = [batch objectAtIndex:i];
+
+		[connection execute:@"SAVEPOINT pgsqlkit_group_commit"];
+		PGSQLCommandResult *result = [connection execute:[write sql] parameters:[write parameters]];
+		if ([result succeeded])
+		{
+			[connection execute:@"RELEASE SAVEPOINT pgsqlkit_group_commit"];
+		} else {
+			[connection executeScript:@"ROLLBACK TO SAVEPOINT pgsqlkit_group_commit; RELEASE SAVEPOINT pgsqlkit_group_commit"];
+		}
+		[results addObject:result];
+	}
+
+	PGSQLCommandResult *commit = [connection execute:@"COMMIT"];
+	BOOL committed = [commit succeeded] && [[commit lastCmdStatus] isEqualToString:@"COMMIT"];
+	for (i = 0; i < count; i++)
+	{
+		PGSQLCommandResult *result = [results objectAtIndex:i];
+		if ([result succeeded] && !committed)
+		{
+			// it ran, but went down with the transaction
+			result = commit;
+		}
+		[[[batch objectAtIndex:i] future] finishWithResult:result];
+	}
+}
+
+// Rewrites $n placeholders as quoted literals so the command can join a
+// simple query script.  Placeholders inside quoted strings, quoted
+// identifiers, comments and dollar quoted bodies are left alone.  Returns
+// nil when the command can't be inlined safely.
+-(NSString *)inlineParameters:(NSArray *)params intoSQL:(NSString *)sql
+{
+	if ([params count] == 0)
+	{
+		return sql;
+	}
+
+	NSUInteger length = [sql length];
+	NSMutableString *result = [NSMutableString stringWithCapacity:length + 16 * [params count]];
+	NSUInteger i = 0;
+	NSUInteger copied = 0;
+
+	while (i < length)
+	{
+		unichar c = [sql characterAtIndex:i];
+
+		if ((c == '\'') || (c == '"'))
+		{
+			// quoted string or identifier, a doubled quote stays inside.
+			// E'' strings also allow backslash escapes.
+			BOOL escapes = (c == '\'') && (i > 0) && 
+				(([sql characterAtIndex:i - 1] == 'E') || ([sql characterAtIndex:i - 1] == 'e'));
+			i++;
+			while (i < length)
+			{
+				if (escapes && ([sql characterAtIndex:i] == '\\'))
+				{
+					i += 2;
+					continue;
+				}
+				if ([sql characterAtIndex:i] == c)
+				{
+					if ((i + 1 < length) && ([sql characterAtIndex:i + 1] == c))
+					{
+						i += 2;
+						continue;
+					}
+					break;
+				}
+				i++;
+			}
+			i++;
+		} else if ((c == '-') && (i + 1 < length) && ([sql characterAtIndex:i + 1] == '-')) {
+			while ((i < length) && ([sql characterAtIndex:i] != '\n'))
+			{
+				i++;
+			}
+		} else if ((c == '/') && (i + 1 < length) && ([sql characterAtIndex:i + 1] == '*')) {
+			NSRange end = [sql rangeOfString:@"*/" options:NSLiteralSearch
+									   range:NSMakeRange(i + 2, length - i - 2)];
+			i = (end.location == NSNotFound) ? length : NSMaxRange(end);
+		} else if (c == '$') {
+			NSUInteger j = i + 1;
+			while ((j < length) && PGSQLIsDigit([sql characterAtIndex:j]))
+			{
+				j++;
+			}
+			if (j > i + 1)
+			{
+				// $n, swap in the literal
+				NSInteger n = [[sql substringWithRange:NSMakeRange(i + 1, j - i - 1)] integerValue];
+				if ((n < 1) || (n > (NSInteger)[params count]))
+				{
+					return nil;
+				}
+				NSString *literal = [connection sqlQuoteLiteral:[params objectAtIndex:n - 1]];
+				if (literal == nil)
+				{
+					return nil;
+				}
+				[result appendString:[sql substringWithRange:NSMakeRange(copied, i - copied)]];
+				[result appendString:literal];
+				copied = j;
+				i = j;
+				continue;
+			}
+
+			// $tag$ ... $tag$, skip to the closing tag
+			while ((j < length) && PGSQLIsTagCharacter([sql characterAtIndex:j]))
+			{
+				j++;
+			}
+			if ((j < length) && ([sql characterAtIndex:j] == '$'))
+			{
+				NSString *tag = [sql substringWithRange:NSMakeRange(i, j - i + 1)];
+				NSRange end = [sql rangeOfString:tag options:NSLiteralSearch
+										   range:NSMakeRange(j + 1, length - j - 1)];
+				i = (end.location == NSNotFound) ? length : NSMaxRange(end);
+			} else {
+				i = j;
+			}
+		} else {
+			i++;
+		}
+	}
+
+	[result appendString:[sql substringFromIndex:MIN(copied, length)]];
+	return result;
+}
+
+#pragma mark -
+#pragma mark Simple Accessors
+
+-(PGSQLConnection *)connection
+{
+	return [[connection retain] autorelease];
+}
+
+-(NSUInteger)maximumBatchSize
+{
+	return maximumBatchSize;
+}
+
+-(void)setMaximumBatchSize:(NSUInteger)value
+{
+	[queueCondition lock];
+	maximumBatchSize = (value > 0) ? value : 1;
+	[queueCondition unlock];
+}
+
+-(NSTimeInterval)maximumDelay
+{
+	return maximumDelay;
+}
+
+-(void)setMaximumDelay:(NSTimeInterval)value
+{
+	[queueCondition lock];
+	maximumDelay = value;
+	[queueCondition unlock];
+}
+
+-(NSUInteger)batchCount
+{
+	[queueCondition lock];
+	NSUInteger count = batchCount;
+	[queueCondition unlock];
+	return count;
+}
+
+@end
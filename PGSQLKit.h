@@ -12,4 +12,20 @@
 #import "PGSQLConnectionInfo.h"
 #import "PGSQLField.h"
 #import "PGSQLRecord.h"
-#import "PGSQLRecordset.h"
\ No newline at end of file
+#import "PGSQLRecordset.h"
+#import "PGSQLCommandResult.h"
+#import "PGSQLFuture.h"
+#import "PGSQLGroupCommitWriter.h"
+#import "PGSQLRouter.h"
+#import "PGSQLMergedRecordset.h"
+#import "PGSQLFanOut.h"
+#import "PGSQLCatalog.h"
+#import "PGSQLMergeResult.h"
+#import "PGSQLBulkMerge.h"
+#import "PGSQLQueryTemplate.h"
+#import "PGSQLAdmissionController.h"
+#import "PGSQLSlowQueryLog.h"
+#import "PGSQLRecordsetDiff.h"
+#import "PGSQLRecordsetIndex.h"
+#import "PGSQLRecordsetWriter.h"
+#import "PGSQLRecordsetBinder.h"
\ No newline at end of file
@@ -0,0 +1,60 @@
+//
+//  PGSQLMergeResult.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLMergeResult
+    @abstract   The outcome of a bulk merge.
+    @discussion Returned by -[PGSQLBulkMerge finish] and 
+				-[PGSQLConnection mergeIntoTable:rows:keyColumns:deleteMissing:].
+*/
+
+#import <Foundation/Foundation.h>
+
+/*!
+    @class
+    @abstract    Row counts, timing and any error from one merge.
+    @discussion  When the merge failed nothing was applied (unless it ran 
+				 inside a transaction of the caller's, which the failure has
+				 aborted), and the counts are 0.
+*/
+@interface PGSQLMergeResult : NSObject {
+	long rowsStaged;
+	long rowsInserted;
+	long rowsUpdated;
+	long rowsDeleted;
+	NSTimeInterval executionTime;
+	NSString *errorDescription;
+}
+
+-(id)initWithStaged:(long)staged inserted:(long)inserted updated:(long)updated 
+			deleted:(long)deleted executionTime:(NSTimeInterval)elapsed;
+-(id)initWithError:(NSString *)error staged:(long)staged executionTime:(NSTimeInterval)elapsed;
+
+-(BOOL)succeeded;
+-(NSString *)lastError;
+
+/*!
+    @method
+    @abstract   Rows sent to the server, duplicates of a key included.
+*/
+-(long)rowsStaged;
+-(long)rowsInserted;
+/*!
+    @method
+    @abstract   Existing rows changed by the merge.  Rows whose values already
+				matched are left alone and not counted.
+*/
+-(long)rowsUpdated;
+-(long)rowsDeleted;
+
+/*!
+    @method
+    @abstract   Wall clock time from the first row to the end, in seconds.
+*/
+-(NSTimeInterval)executionTime;
+
+@end
@@ -0,0 +1,94 @@
+//
+//  PGSQLMergeResult.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLMergeResult.h"
+
+@implementation PGSQLMergeResult
+
+-(id)initWithStaged:(long)staged inserted:(long)inserted updated:(long)updated 
+			deleted:(long)deleted executionTime:(NSTimeInterval)elapsed
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		rowsStaged = staged;
+		rowsInserted = inserted;
+		rowsUpdated = updated;
+		rowsDeleted = deleted;
+		executionTime = elapsed;
+		errorDescription = nil;
+	}
+	return self;
+}
+
+-(id)initWithError:(NSString *)error staged:(long)staged executionTime:(NSTimeInterval)elapsed
+{
+	self = [self initWithStaged:staged inserted:0 updated:0 deleted:0 executionTime:elapsed];
+
+	if (self != nil)
+	{
+		errorDescription = [error copy];
+	}
+	return self;
+}
+
+-(void)dealloc
+{
+	[errorDescription release];
+	[super dealloc];
+}
+
+-(BOOL)succeeded
+{
+	return (errorDescription == nil);
+}
+
+-(NSString *)description
+{
+	if (![self succeeded])
+	{
+		return [NSString stringWithFormat:@"Merge failed: %@", errorDescription];
+	}
+	return [NSString stringWithFormat:@"Merged %ld rows: %ld inserted, %ld updated, %ld deleted in %.3fs", 
+			rowsStaged, rowsInserted, rowsUpdated, rowsDeleted, executionTime];
+}
+
+#pragma mark -
+#pragma mark Simple Accessors
+
+-(NSString *)lastError
+{
+	return [[errorDescription retain] autorelease];
+}
+
+-(long)rowsStaged
+{
+	return rowsStaged;
+}
+
+-(long)rowsInserted
+{
+	return rowsInserted;
+}
+
+-(long)rowsUpdated
+{
+	return rowsUpdated;
+}
+
+-(long)rowsDeleted
+{
+	return rowsDeleted;
+}
+
+-(NSTimeInterval)executionTime
+{
+	return executionTime;
+}
+
+@end
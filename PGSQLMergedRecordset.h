@@ -0,0 +1,58 @@
+//
+//  PGSQLMergedRecordset.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLMergedRecordset
+    @abstract   Several recordsets presented as one.
+    @discussion Built from the results of the same query run against
+				partitions or shards, usually by PGSQLFanOut.  The rows are
+				either the union of the sources, one after another, or a k-way
+				merge of sources that are each sorted on the same column.
+				Either way the usual moveNext / fieldByName: API walks the
+				combined rows, and no row data is copied.
+*/
+
+#import "PGSQLRecordset.h"
+
+/*!
+    @class
+    @abstract    A PGSQLRecordset over the rows of other recordsets.
+    @discussion  The sources should have the same columns in the same order,
+				 columns reports the first source's.  Records returned come
+				 from the source that holds the row, and the sources are kept
+				 open for as long as the merged recordset is.
+*/
+@interface PGSQLMergedRecordset : PGSQLRecordset {
+	NSArray *recordsets;
+
+	long *rowSources;	// for each merged row, the recordset it lives in
+	long *rowIndexes;	// and its row number there
+	long position;
+}
+
+/*!
+    @method
+    @abstract   The rows of every source, in source order.
+*/
+-(id)initWithRecordsets:(NSArray *)sources;
+
+/*!
+    @method
+    @abstract   The rows of every source, merged on a column.
+    @discussion Each source must already be sorted on columnName in the same
+				direction (an ORDER BY in the query).  The merge keeps that
+				order across sources, comparing integer and floating point
+				columns numerically and everything else as text.  NULLs sort
+				as PostgreSQL sorts them, last ascending and first descending.
+				Rows with equal keys keep source order.  Raises
+				NSInvalidArgumentException if the column does not exist.
+*/
+-(id)initWithRecordsets:(NSArray *)sources orderedBy:(NSString *)columnName ascending:(BOOL)ascending;
+
+-(NSArray *)recordsets;
+
+@end
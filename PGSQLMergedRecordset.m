@@ -0,0 +1,438 @@
+//
+//  PGSQLMergedRecordset.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLMergedRecordset.h"
+#import <stdlib.h>
+
+@interface PGSQLMergedRecordset (Private)
+
+-(id)initWithSources:(NSArray *)sources;
+-(void)setPosition:(long)value;
+
+@end
+
+// The value a row is merged on.  Integer and floating point columns compare
+// as numbers, anything else by its text.
+static id
+PGSQLMergeKey(PGSQLField *field, int type)
+{
+	if ([field isNull])
+	{
+		return [NSNull null];
+	}
+
+	switch (type)
+	{
+		case 20:	// int8
+		case 21:	// int2
+		case 23:	// int4
+		case 26:	// oid
+			return [NSNumber numberWithLongLong:strtoll([[field asString] UTF8String], NULL, 10)];
+		case 700:	// float4
+		case 701:	// float8
+		case 1700:	// numeric
+			return [NSNumber numberWithDouble:strtod([[field asString] UTF8String], NULL)];
+		default:
+			return [field asString];
+	}
+}
+
+// NULL is larger than any value, as it is to the server.
+static NSComparisonResult
+PGSQLCompareMergeKeys(id left, id right, BOOL ascending)
+{
+	NSComparisonResult order;
+	BOOL leftNull = (left == [NSNull null]);
+	BOOL rightNull = (right == [NSNull null]);
+
+	if (leftNull || rightNull)
+	{
+		order = (leftNull == rightNull) ? NSOrderedSame : (leftNull ? NSOrderedDescending : NSOrderedAscending);
+	} else {
+		order = [left compare:right];
+	}
+
+	if (!ascending)
+	{
+		order = -order;
+	}
+	return order;
+}
+
+@implementation PGSQLMergedRecordset
+
+-(id)initWithSources:(NSArray *)sources
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		recordsets = [sources copy];
+		isOpen = YES;
+		isEOF = YES;
+		defaultEncoding = NSUTF8StringEncoding;
+		position = -1;
+
+		rowCount = 0;
+		NSUInteger i;
+		for (i = 0; i < [recordsets count]; i++)
+		{
+			rowCount += [[recordsets objectAtIndex:i] recordCount];
+		}
+
+		if ([recordsets count] > 0)
+		{
+			PGSQLRecordset *first = [recordsets objectAtIndex:0];
+			columns = [[first columns] retain];
+			defaultEncoding = [first defaultEncoding];
+		} else {
+			columns = [[NSMutableArray alloc] init];
+		}
+
+		rowSources = malloc(sizeof(long) * (rowCount > 0 ? rowCount : 1));
+		rowIndexes = malloc(sizeof(long) * (rowCount > 0 ? rowCount : 1));
+	}
+	return self;
+}
+
+-(id)initWithRecordsets:(NSArray *)sources
+{
+	self = [self initWithSources:sources];
+
+	if (self != nil)
+	{
+		long merged = 0;
+		NSUInteger i;
+		for (i = 0; i < [recordsets count]; i++)
+		{
+			long rows = [[recordsets objectAtIndex:i] recordCount];
+			long row;
+			for (row = 0; row < rows; row++)
+			{
+				rowSources[merged] = i;
+				rowIndexes[merged] = row;
+				merged++;
+			}
+		}
+
+		if (rowCount > 0)
+		{
+			[self moveFirst];
+		}
+	}
+	return self;
+}
+
+-(id)initWithRecordsets:(NSArray *)sources orderedBy:(NSString *)columnName ascending:(BOOL)ascending
+{
+	self = [self initWithSources:sources];
+
+	if (self != nil)
+	{
+		long keyIndex = -1;
+		long c;
+		for (c = 0; c < (long)[columns count]; c++)
+		{
+			if ([[[columns objectAtIndex:c] name] caseInsensitiveCompare:columnName] == NSOrderedSame)
+			{
+				keyIndex = c;
+				break;
+			}
+		}
+		if ((keyIndex < 0) && ([recordsets count] > 0))
+		{
+			[self release];
+			[[NSException exceptionWithName:NSInvalidArgumentException
+									 reason:[NSString stringWithFormat:@"No column named %@ to merge on.", columnName]
+								   userInfo:nil] raise];
+			return nil;
+		}
+
+		NSUInteger sourceCount = [recordsets count];
+		int keyType = (sourceCount > 0) ? [[columns objectAtIndex:keyIndex] type] : 0;
+
+		// read every key once up front, the merge compares each many times
+		NSMutableArray *keys = [[NSMutableArray alloc] initWithCapacity:sourceCount];
+		long *cursors = calloc(sourceCount > 0 ? sourceCount : 1, sizeof(long));
+		long *heap = malloc(sizeof(long) * (sourceCount > 0 ? sourceCount : 1));
+		long heapSize = 0;
+
+		NSUInteger s;
+		for (s = 0; s < sourceCount; s++)
+		{
+			PGSQLRecordset *source = [recordsets objectAtIndex:s];
+			long rows = [source recordCount];
+			NSMutableArray *sourceKeys = [[NSMutableArray alloc] initWithCapacity:rows];
+			long row;
+			for (row = 0; row < rows; row++)
+			{
+				NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+				[sourceKeys addObject:PGSQLMergeKey([[source recordAtIndex:row] fieldByIndex:keyIndex], keyType)];
+				[pool release];
+			}
+			[keys addObject:sourceKeys];
+			[sourceKeys release];
+
+			if (rows > 0)
+			{
+				heap[heapSize++] = s;
+			}
+		}
+
+		// a binary min-heap of sources, ordered by the key at each source's
+		// cursor and then by source number so equal keys keep source order
+#define PGSQL_HEAP_KEY(h) [[keys objectAtIndex:heap[h]] objectAtIndex:cursors[heap[h]]]
+#define PGSQL_HEAP_LESS(a, b) \
+		((PGSQLCompareMergeKeys(PGSQL_HEAP_KEY(a), PGSQL_HEAP_KEY(b), ascending) == NSOrderedAscending) || \
+		 ((PGSQLCompareMergeKeys(PGSQL_HEAP_KEY(a), PGSQL_HEAP_KEY(b), ascending) == NSOrderedSame) && (heap[a] < heap[b])))
+
+		long h;
+		for (h = heapSize / 2 - 1; h >= 0; h--)
+		{
+			long parent = h;
+			while (YES)
+			{
+				long smallest = parent;
+				long left = (2 * parent) + 1;
+				long right = left + 1;
+				if ((left < heapSize) && PGSQL_HEAP_LESS(left, smallest)) { smallest = left; }
+				if ((right < heapSize) && PGSQL_HEAP_LESS(right, smallest)) { smallest = right; }
+				if (smallest == parent) { break; }
+				long swap = heap[parent]; heap[parent] = heap[smallest]; heap[smallest] = swap;
+				parent = smallest;
+			}
+		}
+
+		long merged = 0;
+		while (heapSize > 0)
+		{
+			long source = heap[0];
+			rowSources[merged] = source;
+			rowIndexes[merged] = cursors[source];
+			merged++;
+
+			cursors[source]++;
+			if (cursors[source] >= [[recordsets objectAtIndex:source] recordCount])
+			{
+				heap[0] = heap[--heapSize];
+			}
+
+			long parent = 0;
+			while (YES)
+			{
+				long smallest = parent;
+				long left = (2 * parent) + 1;
+				long right = left + 1;
+				if ((left < heapSize) && PGSQL_HEAP_LESS(left, smallest)) { smallest = left; }
+				if ((right < heapSize) && PGSQL_HEAP_LESS(right, smallest)) { smallest = right; }
+				if (smallest == parent) { break; }
+				long swap = heap[parent]; heap[parent] = heap[smallest]; heap[smallest] = swap;
+				parent = smallest;
+			}
+		}
+#undef PGSQL_HEAP_LESS
+#undef PGSQL_HEAP_KEY
+
+		free(heap);
+		free(cursors);
+		[keys release];
+
+		if (rowCount > 0)
+		{
+			[self moveFirst];
+		}
+	}
+	return self;
+}
+
+-(void)close
+{
+	[recordsets release];
+	recordsets = nil;
+	free(rowSources);
+	rowSources = NULL;
+	free(rowIndexes);
+	rowIndexes = NULL;
+	rowCount = 0;
+	[super close];
+}
+
+-(NSArray *)recordsets
+{
+	return [[recordsets retain] autorelease];
+}
+
+#pragma mark -
+#pragma mark Navigation
+
+-(PGSQLRecord *)recordAtIndex:(long)rowIndex
+{
+	if ((rowIndex < 0) || (rowIndex >= rowCount))
+	{
+		return nil;
+	}
+
+	PGSQLRecord *record = [[recordsets objectAtIndex:rowSources[rowIndex]] recordAtIndex:rowIndexes[rowIndex]];
+	[record setDefaultEncoding:defaultEncoding];
+	return record;
+}
+
+-(const char *)valueAtRow:(long)rowIndex column:(long)columnIndex length:(int *)valueLength
+{
+	if ((rowIndex < 0) || (rowIndex >= rowCount))
+	{
+		if (valueLength != NULL) { *valueLength = 0; }
+		return NULL;
+	}
+	
+	return [[recordsets objectAtIndex:rowSources[rowIndex]] valueAtRow:rowIndexes[rowIndex] 
+																column:columnIndex 
+																length:valueLength];
+}
+
+-(void)setPosition:(long)value
+{
+	position = value;
+	[currentRecord release];
+	currentRecord = [[self recordAtIndex:position] retain];
+}
+
+-(PGSQLRecord *)moveFirst
+{
+	if (rowCount == 0) {
+		return nil;
+	}
+	isEOF = NO;
+	[self setPosition:0];
+	return [[currentRecord retain] autorelease];
+}
+
+-(PGSQLRecord *)moveNext
+{
+	if (rowCount == 0) {
+		return nil;
+	}
+	if (position + 1 >= rowCount) {
+		isEOF = YES;
+		[self setPosition:rowCount];
+		return nil;
+	}
+	[self setPosition:position + 1];
+	return [[currentRecord retain] autorelease];
+}
+
+-(PGSQLRecord *)movePrevious
+{
+	if (rowCount == 0) {
+		return nil;
+	}
+	if (position - 1 < 0) {
+		isEOF = YES;
+		[self setPosition:-1];
+		return nil;
+	}
+	[self setPosition:position - 1];
+	return [[currentRecord retain] autorelease];
+}
+
+-(PGSQLRecord *)moveLast
+{
+	if (rowCount == 0) {
+		return nil;
+	}
+	isEOF = NO;
+	[self setPosition:rowCount - 1];
+	return [[currentRecord retain] autorelease];
+}
+
+-(PGSQLRecord *)moveToRow:(long)rowIndex
+{
+	if ((rowIndex < 0) || (rowIndex >= rowCount)) {
+		return nil;
+	}
+	isEOF = NO;
+	[self setPosition:rowIndex];
+	return [[currentRecord retain] autorelease];
+}
+
+// a record is bound to one source's result, so each row needs its own
+-(PGSQLRecord *)cursor:(PGSQLRecord *)cursor movedToRow:(long)rowIndex
+{
+	return [self recordAtIndex:rowIndex];
+}
+
+#pragma mark -
+#pragma mark Source Settings
+
+-(void)compact
+{
+	NSUInteger i;
+	for (i = 0; i < [recordsets count]; i++)
+	{
+		[[recordsets objectAtIndex:i] compact];
+	}
+	
+	// the current record pointed into a source's PGresult
+	if (currentRecord != nil)
+	{
+		[self setPosition:position];
+	}
+}
+
+-(BOOL)isCompact
+{
+	NSUInteger i;
+	for (i = 0; i < [recordsets count]; i++)
+	{
+		if (![[recordsets objectAtIndex:i] isCompact])
+		{
+			return NO;
+		}
+	}
+	return YES;
+}
+
+-(NSUInteger)compactSize
+{
+	NSUInteger size = 0;
+	NSUInteger i;
+	for (i = 0; i < [recordsets count]; i++)
+	{
+		size += [[recordsets objectAtIndex:i] compactSize];
+	}
+	return size;
+}
+
+-(void)setInternsStrings:(BOOL)value forColumn:(NSString *)fieldName
+{
+	NSUInteger i;
+	for (i = 0; i < [recordsets count]; i++)
+	{
+		[[recordsets objectAtIndex:i] setInternsStrings:value forColumn:fieldName];
+	}
+}
+
+-(void)setInternsStrings:(BOOL)value
+{
+	NSUInteger i;
+	for (i = 0; i < [recordsets count]; i++)
+	{
+		[[recordsets objectAtIndex:i] setInternsStrings:value];
+	}
+}
+
+-(void)setDefaultEncoding:(NSStringEncoding)value
+{
+	NSUInteger i;
+	for (i = 0; i < [recordsets count]; i++)
+	{
+		[[recordsets objectAtIndex:i] setDefaultEncoding:value];
+	}
+	[super setDefaultEncoding:value];
+}
+
+@end
@@ -0,0 +1,94 @@
+//
+//  PGSQLQueryTemplate.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLQueryTemplate
+    @abstract   SQL with named parameters, parsed once.
+    @discussion A template is written with :name placeholders,
+
+				SELECT * FROM orders WHERE customer = :customer AND placed > :since
+
+				and compiled to the positional form the server takes, $1 and
+				$2 here, with a map from each name to its position.  Values
+				are then bound by name from a dictionary, as parameters, so
+				nothing is pasted into the SQL text and nothing needs quoting.
+
+				Placeholders are not recognized inside quoted strings, quoted
+				identifiers, dollar quoted bodies or comments, and :: casts
+				are left alone.  A name used more than once is one parameter.
+				Names are letters, digits and underscores, not starting with
+				a digit.
+
+				templateWithSQL: keeps every template it compiles, so code
+				that builds the same statement over and over parses it once.
+				A template never changes once compiled and can be used from
+				any thread.
+*/
+
+#import <Foundation/Foundation.h>
+
+/*!
+    @class
+    @abstract    A compiled :name template.
+*/
+@interface PGSQLQueryTemplate : NSObject {
+	NSString *sql;
+	NSString *compiledSQL;
+	NSArray *parameterNames;		// in $n order
+	NSDictionary *parameterIndexes;	// name -> NSNumber, 0 based
+}
+
+/*!
+    @method
+    @abstract   The shared compiled template for sql, compiling it on first
+				use.
+*/
++(PGSQLQueryTemplate *)templateWithSQL:(NSString *)sqlText;
+
+/*!
+    @method
+    @abstract   Forget every shared template.
+*/
++(void)removeAllTemplates;
+
+-(id)initWithSQL:(NSString *)sqlText;
+
+/*!
+    @method
+    @abstract   The SQL as written, with its :name placeholders.
+*/
+-(NSString *)sql;
+
+/*!
+    @method
+    @abstract   The SQL with each placeholder replaced by $n.
+*/
+-(NSString *)compiledSQL;
+
+/*!
+    @method
+    @abstract   The parameter names, in the order of their $n.
+*/
+-(NSArray *)parameterNames;
+
+/*!
+    @method
+    @abstract   The 0 based position of a name's parameter, NSNotFound if the
+				template has no such placeholder.
+*/
+-(NSUInteger)indexOfParameter:(NSString *)name;
+
+/*!
+    @method
+    @abstract   The values for execute:parameters:, in $n order.
+    @discussion A value of NSNull binds NULL.  Keys that are not placeholders
+				are ignored.  Returns nil if a placeholder has no value,
+				naming it in error if error is not NULL.
+*/
+-(NSArray *)parametersFromDictionary:(NSDictionary *)values error:(NSString **)error;
+
+@end
@@ -0,0 +1,268 @@
+//
+//  PGSQLQueryTemplate.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLQueryTemplate.h"
+#import <string.h>
+
+// The shared cache is emptied when it reaches this many templates, so code
+// that compiles text built from data can't grow it without bound.
+#define PGSQLMaximumSharedTemplates	1024
+
+static NSMutableDictionary *sharedTemplates = nil;
+
+static BOOL
+PGSQLIsIdentifierStart(unsigned char c)
+{
+	return (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || (c == '_') || (c >= 0x80));
+}
+
+static BOOL
+PGSQLIsIdentifierChar(unsigned char c)
+{
+	return (PGSQLIsIdentifierStart(c) || ((c >= '0') && (c <= '9')));
+}
+
+// Where the quoted text starting at text[start], the opening quote, ends:
+// the index just past its closing quote.  A doubled quote is part of the
+// text, as is anything after a backslash when backslashes escape.
+static size_t
+PGSQLSkipQuoted(const char *text, size_t length, size_t start, char quote, BOOL backslashes)
+{
+	size_t i = start + 1;
+	while (i < length)
+	{
+		if (backslashes && (text[i] == '\\'))
+		{
+			i += 2;
+			continue;
+		}
+		if (text[i] == quote)
+		{
+			if ((i + 1 < length) && (text[i + 1] == quote))
+			{
+				i += 2;
+				continue;
+			}
+			return i + 1;
+		}
+		i++;
+	}
+	return length;
+}
+
+// A dollar quote's opening tag at text[start], $$ or $tag$, or 0 if there
+// is none there ($1 is a parameter, not a tag).
+static size_t
+PGSQLDollarTagLength(const char *text, size_t length, size_t start)
+{
+	size_t i = start + 1;
+	if ((i < length) && (text[i] >= '0') && (text[i] <= '9'))
+	{
+		return 0;
+	}
+	while ((i < length) && PGSQLIsIdentifierChar((unsigned char)text[i]))
+	{
+		i++;
+	}
+	return ((i < length) && (text[i] == '$')) ? (i + 1 - start) : 0;
+}
+
+@implementation PGSQLQueryTemplate
+
++(PGSQLQueryTemplate *)templateWithSQL:(NSString *)sqlText
+{
+	PGSQLQueryTemplate *queryTemplate;
+	@synchronized (self)
+	{
+		queryTemplate = [[sharedTemplates objectForKey:sqlText] retain];
+	}
+	if (queryTemplate != nil)
+	{
+		return [queryTemplate autorelease];
+	}
+
+	queryTemplate = [[PGSQLQueryTemplate alloc] initWithSQL:sqlText];
+	@synchronized (self)
+	{
+		if (sharedTemplates == nil)
+		{
+			sharedTemplates = [[NSMutableDictionary alloc] init];
+		}
+		if ([sharedTemplates count] >= PGSQLMaximumSharedTemplates)
+		{
+			[sharedTemplates removeAllObjects];
+		}
+		[sharedTemplates setObject:queryTemplate forKey:sqlText];
+	}
+	return [queryTemplate autorelease];
+}
+
++(void)removeAllTemplates
+{
+	@synchronized (self)
+	{
+		[sharedTemplates removeAllObjects];
+	}
+}
+
+-(id)initWithSQL:(NSString *)sqlText
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		sql = [sqlText copy];
+
+		const char *text = [sqlText UTF8String];
+		size_t length = strlen(text);
+		NSMutableData *compiled = [NSMutableData dataWithCapacity:length + 16];
+		NSMutableArray *names = [NSMutableArray array];
+		NSMutableDictionary *indexes = [NSMutableDictionary dictionary];
+
+		size_t copied = 0;	// text before this is in compiled
+		size_t i = 0;
+		while (i < length)
+		{
+			unsigned char c = (unsigned char)text[i];
+			BOOL afterIdentifier = ((i > 0) && PGSQLIsIdentifierChar((unsigned char)text[i - 1]));
+
+			if (c == '\'')
+			{
+				// E'...' strings take backslash escapes
+				BOOL escaped = ((i > 0) && ((text[i - 1] == 'e') || (text[i - 1] == 'E')) &&
+								!((i > 1) && PGSQLIsIdentifierChar((unsigned char)text[i - 2])));
+				i = PGSQLSkipQuoted(text, length, i, '\'', escaped);
+			} else if (c == '"') {
+				i = PGSQLSkipQuoted(text, length, i, '"', NO);
+			} else if ((c == '-') && (i + 1 < length) && (text[i + 1] == '-')) {
+				const char *end = memchr(text + i, '\n', length - i);
+				i = (end != NULL) ? (size_t)(end - text) + 1 : length;
+			} else if ((c == '/') && (i + 1 < length) && (text[i + 1] == '*')) {
+				// block comments nest
+				int depth = 1;
+				i += 2;
+				while ((i < length) && (depth > 0))
+				{
+					if ((text[i] == '/') && (i + 1 < length) && (text[i + 1] == '*')) { depth++; i += 2; }
+					else if ((text[i] == '*') && (i + 1 < length) && (text[i + 1] == '/')) { depth--; i += 2; }
+					else { i++; }
+				}
+			} else if ((c == '$') && !afterIdentifier) {
+				size_t tagLength = PGSQLDollarTagLength(text, length, i);
+				if (tagLength == 0)
+				{
+					i++;
+					continue;
+				}
+				const char *body = text + i + tagLength;
+				const char *end = NULL;
+				size_t remaining = length - (i + tagLength);
+				while (remaining >= tagLength)
+				{
+					const char *dollar = memchr(body, '$', remaining - tagLength + 1);
+					if (dollar == NULL) { break; }
+					if (memcmp(dollar, text + i, tagLength) == 0) { end = dollar; break; }
+					remaining -= (dollar + 1 - body);
+					body = dollar + 1;
+				}
+				i = (end != NULL) ? (size_t)(end - text) + tagLength : length;
+			} else if ((c == ':') && (i + 1 < length) && PGSQLIsIdentifierStart((unsigned char)text[i + 1]) &&
+					   !((i > 0) && (text[i - 1] == ':'))) {
+				size_t nameEnd = i + 1;
+				while ((nameEnd < length) && PGSQLIsIdentifierChar((unsigned char)text[nameEnd]))
+				{
+					nameEnd++;
+				}
+				NSString *name = [[[NSString alloc] initWithBytes:text + i + 1 length:nameEnd - i - 1
+														 encoding:NSUTF8StringEncoding] autorelease];
+				NSNumber *index = [indexes objectForKey:name];
+				if (index == nil)
+				{
+					index = [NSNumber numberWithUnsignedInteger:[names count]];
+					[indexes setObject:index forKey:name];
+					[names addObject:name];
+				}
+
+				[compiled appendBytes:text + copied length:i - copied];
+				const char *placeholder = [[NSString stringWithFormat:@"$%lu",
+											(unsigned long)[index unsignedIntegerValue] + 1] UTF8String];
+				[compiled appendBytes:placeholder length:strlen(placeholder)];
+				i = nameEnd;
+				copied = nameEnd;
+			} else {
+				i++;
+			}
+		}
+		[compiled appendBytes:text + copied length:length - copied];
+
+		compiledSQL = [[NSString alloc] initWithData:compiled encoding:NSUTF8StringEncoding];
+		parameterNames = [names copy];
+		parameterIndexes = [indexes copy];
+	}
+	return self;
+}
+
+-(void)dealloc
+{
+	[sql release];
+	[compiledSQL release];
+	[parameterNames release];
+	[parameterIndexes release];
+	[super dealloc];
+}
+
+-(NSUInteger)indexOfParameter:(NSString *)name
+{
+	NSNumber *index = [parameterIndexes objectForKey:name];
+	return (index != nil) ? [index unsignedIntegerValue] : NSNotFound;
+}
+
+-(NSArray *)parametersFromDictionary:(NSDictionary *)values error:(NSString **)error
+{
+	NSMutableArray *params = [NSMutableArray arrayWithCapacity:[parameterNames count]];
+	NSUInteger i;
+	for (i = 0; i < [parameterNames count]; i++)
+	{
+		NSString *name = [parameterNames objectAtIndex:i];
+		id value = [values objectForKey:name];
+		if (value == nil)
+		{
+			if (error != NULL)
+			{
+				*error = [NSString stringWithFormat:@"No value for parameter :%@.", name];
+			}
+			return nil;
+		}
+		[params addObject:value];
+	}
+	return params;
+}
+
+-(NSString *)description
+{
+	return compiledSQL;
+}
+
+#pragma mark -
+#pragma mark Simple Accessors
+
+-(NSString *)sql
+{
+	return sql;
+}
+
+-(NSString *)compiledSQL
+{
+	return compiledSQL;
+}
+
+-(NSArray *)parameterNames
+{
+	return parameterNames;
+}
+
+@end
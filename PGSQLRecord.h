@@ -56,26 +56,42 @@
 				 is rarely directly referenced in any but the most vague way.
 */
 @interface PGSQLRecord : NSObject {	
-	void *pgResult;
+	void *pgResult;		// a PGresult, or a PGSQLCompactResult when isCompact
+	BOOL  isCompact;
 	long  rowNumber;
 	NSArray *columns;
 	NSStringEncoding defaultEncoding;
 }
 
 -(id)initWithResult:(void *)result atRow:(long)atRow columns:(NSArray *)columncache;
+/*!
+	@function
+	@abstract   A record over a compacted recordset's values.
+	@discussion result is the recordset's PGSQLCompactResult.  See 
+				-[PGSQLRecordset compact].
+ */
+-(id)initWithCompactResult:(void *)result atRow:(long)atRow columns:(NSArray *)columncache;
 
 -(PGSQLField *)fieldByIndex:(long)fieldIndex;
 -(PGSQLField *)fieldByName:(NSString *)name;
 
 -(long)rowNumber;
+/*!
+	@function
+	@abstract   Point the record at another row of the same result.
+	@discussion Used by the recordset's enumerators to walk every row with a 
+				single record.  Fields already read from the record keep the 
+				row they were read from.
+ */
+-(void)setRowNumber:(long)value;
 
 /*!
 	@function
 	@abstract   Get the record's defaultEncoding for all string operations 
 				results.
-	@discussion The default setting is NSMacOSRoman.  While this default is 
-				used to maintain existing functionality, this will be changed 
-				NSUTF8StringEncoding when PostgreSQL9 is released.
+	@discussion The default setting is NSUTF8StringEncoding, inherited from 
+				the connection that produced the result.  The connection sets 
+				the server's client_encoding to match.
 	@result     returns the defaultEncoding as an NSSTringEncoding ( 
 				http://developer.apple.com/mac/library/documentation/Cocoa/Reference/Foundation/Classes/NSString_Class/Reference/NSString.html#//apple_ref/doc/c_ref/NSStringEncoding )
  */
@@ -84,9 +100,9 @@
 	@function
 	@abstract   Set the defaultEncoding for all string operations on the current
 				record
-	@discussion The default setting is NSMacOSRoman.  While this default is 
-				used to maintain existing functionality, this will be changed 
-				NSUTF8StringEncoding when PostgreSQL9 is released.
+	@discussion The default setting is NSUTF8StringEncoding, inherited from 
+				the connection that produced the result.  The connection sets 
+				the server's client_encoding to match.
 	@param      value the defaultEncoding as an NSSTringEncoding ( 
 				http://developer.apple.com/mac/library/documentation/Cocoa/Reference/Foundation/Classes/NSString_Class/Reference/NSString.html#//apple_ref/doc/c_ref/NSStringEncoding )
 	@result     void
@@ -35,8 +35,15 @@
  *******************************************************************************/
 
 #import "PGSQLRecord.h"
+#import "PGSQLCompactResult.h"
 #include "libpq-fe.h"
 
+@interface PGSQLRecord (Private)
+
+-(PGSQLField *)newFieldForColumn:(PGSQLColumn *)column;
+
+@end
+
 @implementation PGSQLRecord
 
 
@@ -45,15 +52,37 @@
 	[super init];
 
 	pgResult = result;
+	isCompact = NO;
 	columns = columncache;
 	rowNumber = atRow;
 	
-	// this will default to NSUTF8StringEncoding with PG9
-	defaultEncoding = NSMacOSRomanStringEncoding;
+	// the recordset passes its own encoding down after init
+	defaultEncoding = NSUTF8StringEncoding;
 	
 	return self;
 }
 
+-(id)initWithCompactResult:(void *)result atRow:(long)atRow columns:(NSArray *)columncache
+{
+	self = [self initWithResult:result atRow:atRow columns:columncache];
+	isCompact = YES;
+	return self;
+}
+
+-(PGSQLField *)newFieldForColumn:(PGSQLColumn *)column
+{
+	if (isCompact)
+	{
+		NSUInteger valueLength;
+		const char *value = PGSQLCompactResultValue(pgResult, rowNumber, [column index], &valueLength);
+		return [[PGSQLField alloc] initWithValue:value 
+										  length:valueLength 
+										  format:PGSQLCompactResultFormat(pgResult, [column index]) 
+									   forColumn:column];
+	}
+	return [[PGSQLField alloc] initWithResult:pgResult forColumn:column atRow:rowNumber];
+}
+
 -(PGSQLField *)fieldByName:(NSString *)fieldName
 {
 	// find the field index from the columns.
@@ -69,8 +98,7 @@
 		}
 	}
 	
-	PGSQLField *result = [[PGSQLField alloc] initWithResult:pgResult forColumn:column
-														   atRow:rowNumber];
+	PGSQLField *result = [self newFieldForColumn:column];
 	[result setDefaultEncoding:defaultEncoding];
 	
 	return [result autorelease];
@@ -79,8 +107,7 @@
 -(PGSQLField *)fieldByIndex:(long)fieldIndex
 {
 	// find the field index from the columns.
-	PGSQLField *result = [[PGSQLField alloc] initWithResult:pgResult forColumn:[columns objectAtIndex:fieldIndex]
-													  atRow:rowNumber];
+	PGSQLField *result = [self newFieldForColumn:[columns objectAtIndex:fieldIndex]];
 	[result setDefaultEncoding:defaultEncoding];
 
 	return [result autorelease];
@@ -91,6 +118,11 @@
 	return rowNumber;
 }
 
+-(void)setRowNumber:(long)value
+{
+	rowNumber = value;
+}
+
 -(NSStringEncoding)defaultEncoding
 {
 	return defaultEncoding;
@@ -57,6 +57,8 @@
 #import "PGSQLColumn.h"
 #import "PGSQLRecord.h"
 #import "PGSQLField.h"
+
+@class PGSQLCatalog;
 	
 /*!
     @class
@@ -74,26 +76,81 @@
 				 often eases consumption of the data in the realm of Cocoa 
 				 Bindings.
 */
-@interface PGSQLRecordset : NSObject {
+@interface PGSQLRecordset : NSObject <NSFastEnumeration> {
 	void *pgResult;
+	void *compactResult;	// replaces pgResult once compacted
 	
 	BOOL isEOF;
 	BOOL isOpen;
 	
 	long rowCount;
+	unsigned long mutations;	// bumped by close and compact, for fast enumeration
 	
 	NSMutableArray *columns;
 	
 	PGSQLRecord *currentRecord;
 	
 	NSStringEncoding defaultEncoding;
+	
+	PGSQLCatalog *catalog;
 }
 
 -(id)initWithResult:(void *)result;
+/*!
+	@function
+	@abstract   Open a recordset saved by writeToFile: without reading it.
+	@discussion The file is mmap'ed and the recordset is served straight from
+				the mapping, already compact.  Opening costs the same for any 
+				size of file, and the OS pages values in as they are read.  
+				The file must not be changed while it is open.  Returns nil if
+				the file can not be mapped or is not a recordset file of a 
+				version this kit reads.
+	@param      path the file written by writeToFile:
+ */
+-(id)initWithContentsOfMappedFile:(NSString *)path;
 -(PGSQLField *)fieldByIndex:(long)fieldIndex;
 -(PGSQLField *)fieldByName:(NSString *)fieldName;
 -(void)close;
 
+/*!
+	@function
+	@abstract   Repack the values into one compact block and free the PGresult.
+	@discussion A PGresult spends memory on a header per value and pointer 
+				arrays per row, and a long lived one fragments the heap.  
+				compact copies the values column by column into a single 
+				allocation (null bitmaps, offset tables and the value bytes)
+				and then PQclears the result.  The recordset, its records and
+				fields work as before.
+ 
+				compact must not run while other threads read the recordset, 
+				but afterwards the data never changes and any number of 
+				threads may read it at once.  Records obtained before compact 
+				must not be used after it.  Does nothing if already compact.
+ */
+-(void)compact;
+-(BOOL)isCompact;
+/*!
+	@function
+	@abstract   Bytes held by the compact form, 0 if not compacted.
+ */
+-(NSUInteger)compactSize;
+
+/*!
+	@function
+	@abstract   Save the recordset to a file that initWithContentsOfMappedFile:
+				can open.
+	@discussion The file holds a versioned header, each column's name, type,
+				size, modifier and format, and then the compact layout of the
+				values (null bitmaps, offset tables and value bytes) exactly as
+				compact lays them out in memory.  A compact recordset is 
+				written as it is, any other is packed on the way out.  The 
+				file is written beside path and renamed into place, so readers
+				never see a partial file.  Files are in the writing machine's 
+				byte order, and are refused by a machine with the other.
+	@result     NO if the file could not be written
+ */
+-(BOOL)writeToFile:(NSString *)path;
+
 -(NSArray *)columns;
 
 - (long)recordCount;
@@ -102,18 +159,128 @@
 -(PGSQLRecord *)movePrevious;
 -(PGSQLRecord *)moveNext;	
 -(PGSQLRecord *)moveLast;
+/*!
+	@function
+	@abstract   Make any row the current record, in constant time.
+	@param      rowIndex zero based row number
+	@result     the new current record, or nil (leaving the current record 
+				alone) when rowIndex is out of range
+ */
+-(PGSQLRecord *)moveToRow:(long)rowIndex;
 
 -(BOOL)isEOF;
 
+/*!
+	@function
+	@abstract   A record for any row, without moving the current record.
+	@discussion Like the current record, the returned record reads from the 
+				recordset's result and must not be used after the recordset 
+				is closed.
+	@param      rowIndex zero based row number
+	@result     the record, or nil when rowIndex is out of range
+ */
+-(PGSQLRecord *)recordAtIndex:(long)rowIndex;
+
+/*!
+	@function
+	@abstract   Call block with every row, in order, without a record per row.
+	@discussion One record is created and pointed at each row in turn, and an
+				autorelease pool around the calls is drained every few hundred
+				rows, so memory stays flat however many rows there are.  The 
+				record, and anything autoreleased by block, is only valid 
+				until block returns; retain or copy what is kept.  Set *stop 
+				to YES to end early.  The current record is not moved.  If
+				block closes or compacts the recordset, the enumeration ends
+				after that row.
+ 
+				for (PGSQLRecord *record in recordset) walks the rows the same
+				way with one reused record, but the loop's body has no pool 
+				of its own.  A PGSQLMergedRecordset still makes a record per 
+				row, since its rows come from several results.
+	@param      block called with the record and its row number
+ */
+-(void)enumerateRowsUsingBlock:(void (^)(PGSQLRecord *record, long rowIndex, BOOL *stop))block;
+
+/*!
+	@function
+	@abstract   The raw text of one value, without building a record or field.
+	@param      rowIndex zero based row number
+	@param      columnIndex zero based column number
+	@param      valueLength if not NULL, receives the length in bytes
+	@result     the value as sent by the server, or NULL for SQL NULL (or an 
+				index out of range).  Owned by the recordset.
+ */
+-(const char *)valueAtRow:(long)rowIndex column:(long)columnIndex length:(int *)valueLength;
+
+/*!
+	@function
+	@abstract   dictionaryFromRecord for every row, decoded on all cores.
+	@discussion The rows are split into chunks that are decoded concurrently
+				with dispatch_apply, each chunk under its own autorelease 
+				pool.  The result is in row order.  The current record is not
+				moved.
+	@result     an NSArray of NSDictionary, one per row
+ */
+-(NSArray *)dictionariesFromRecords;
+/*!
+	@function
+	@abstract   Convert every row to a model object, on all cores.
+	@discussion selector takes a PGSQLRecord and returns an object, and is 
+				called on target from several threads at once, so it must be 
+				thread safe (asDate is not, its formatter is shared).  The 
+				record is only valid for the length of the call.  A nil return
+				is stored as NSNull.
+	@result     an NSArray of the returned objects, in row order
+ */
+-(NSArray *)objectsFromRecordsWithTarget:(id)target selector:(SEL)selector;
+/*!
+	@function
+	@abstract   A column parsed into a C array of double, on all cores.
+	@discussion NULL values read as NAN.  Binary int2, int4, int8, float4 
+				and float8 values are decoded as they are; a binary column of
+				any other type, or an index out of range, returns nil.
+	@result     NSData holding recordCount doubles
+ */
+-(NSData *)doubleValuesForColumn:(long)columnIndex;
+/*!
+	@function
+	@abstract   A column parsed into a C array of long long, on all cores.
+	@discussion NULL values read as 0, use valueAtRow:column:length: to tell
+				them apart.  Binary columns are decoded as for 
+				doubleValuesForColumn:, floats truncated.
+	@result     NSData holding recordCount long longs
+ */
+-(NSData *)longLongValuesForColumn:(long)columnIndex;
+
 -(NSDictionary *)dictionaryFromRecord;
 
+/*!
+	@function
+	@abstract   Share one NSString per distinct value in a column.
+	@discussion Meant for status, country, category and other enum-like text
+				columns that repeat a handful of values across many rows.  
+				asString on fields in the column returns a shared immutable 
+				string for each distinct value rather than a new one.  A 
+				column that turns out to have high cardinality stops interning
+				on its own.
+	@param      value YES to intern the column's strings
+	@param      fieldName the column to intern, matched as fieldByName: does
+ */
+-(void)setInternsStrings:(BOOL)value forColumn:(NSString *)fieldName;
+/*!
+	@function
+	@abstract   Turn string interning on or off for every column.
+	@param      value YES to intern every column's strings
+ */
+-(void)setInternsStrings:(BOOL)value;
+
 /*!
 	@function
 	@abstract   Get the recordset's defaultEncoding for all string operations 
 				results.
-	@discussion The default setting is NSMacOSRoman.  While this default is 
-				used to maintain existing functionality, this will be changed 
-				NSUTF8StringEncoding when PostgreSQL9 is released.
+	@discussion The default setting is NSUTF8StringEncoding, inherited from 
+				the connection that produced the result.  The connection sets 
+				the server's client_encoding to match.
 	@result     returns the defaultEncoding as an NSSTringEncoding ( 
 				http://developer.apple.com/mac/library/documentation/Cocoa/Reference/Foundation/Classes/NSString_Class/Reference/NSString.html#//apple_ref/doc/c_ref/NSStringEncoding )
  */
@@ -122,14 +289,23 @@
 	@function
 	@abstract   Set the defaultEncoding for all string operations on the current
 				recordset
-	@discussion The default setting is NSMacOSRoman.  While this default is 
-				used to maintain existing functionality, this will be changed 
-				NSUTF8StringEncoding when PostgreSQL9 is released.
+	@discussion The default setting is NSUTF8StringEncoding, inherited from 
+				the connection that produced the result.  The connection sets 
+				the server's client_encoding to match.
 	@param      value the defaultEncoding as an NSSTringEncoding ( 
 				http://developer.apple.com/mac/library/documentation/Cocoa/Reference/Foundation/Classes/NSString_Class/Reference/NSString.html#//apple_ref/doc/c_ref/NSStringEncoding )
 	@result     void
  */
 -(void)setDefaultEncoding:(NSStringEncoding)value;
 
+/*!
+	@function
+	@abstract   The catalog of the server the result came from.
+	@discussion Set by the connection when it has loaded its catalog, and 
+				passed on to each column as its typeInfo.  nil otherwise.
+ */
+-(PGSQLCatalog *)catalog;
+-(void)setCatalog:(PGSQLCatalog *)value;
+
 @end
 
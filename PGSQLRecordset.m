@@ -8,6 +8,60 @@
 
 #import "PGSQLRecordset.h"
 #import "libpq-fe.h"
+#import "PGSQLCompactResult.h"
+#import "PGSQLCatalog.h"
+#import <dispatch/dispatch.h>
+#import <limits.h>
+#import <math.h>
+#import <stdio.h>
+#import <fcntl.h>
+#import <unistd.h>
+#import <sys/stat.h>
+#import <sys/mman.h>
+
+// The file written by writeToFile: is this header, then columnCount column
+// descriptions (PGSQLRecordsetFileColumn followed by the UTF-8 name, padded 
+// to 8 bytes), then the PGSQLCompactResult arena at arenaOffset.
+#define PGSQLRecordsetFileMagic		"PGSQLRS\0"
+#define PGSQLRecordsetFileVersion	1
+#define PGSQLRecordsetFileByteOrder	0x01020304
+
+typedef struct PGSQLRecordsetFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	int64_t rows;
+	int32_t columnCount;
+	int32_t reserved;
+	uint64_t columnsOffset;
+	uint64_t arenaOffset;
+	uint64_t arenaLength;
+} PGSQLRecordsetFileHeader;
+
+typedef struct PGSQLRecordsetFileColumn {
+	int32_t type;
+	int32_t size;
+	int32_t modifier;
+	int32_t format;
+	int32_t nameLength;
+	int32_t reserved;
+} PGSQLRecordsetFileColumn;
+
+// Rows handed to each worker by the parallel decoding methods.  Big enough 
+// that scheduling is noise next to the decoding, small enough to balance.
+#define PGSQLDecodeChunkRows	512
+
+// Rows between autorelease pool drains in enumerateRowsUsingBlock:.
+#define PGSQLEnumerationPoolRows	256
+
+@interface PGSQLRecordset (Private)
+
+-(NSDictionary *)dictionaryFromRecord:(PGSQLRecord *)record;
+-(void)setCurrentRecordWithRowIndex:(long)rowIndex;
+-(PGSQLRecord *)recordWithRowIndex:(long)rowIndex;
+-(PGSQLRecord *)cursor:(PGSQLRecord *)cursor movedToRow:(long)rowIndex;
+
+@end
 
 @implementation PGSQLRecordset
 
@@ -19,12 +73,13 @@
 		isOpen = YES;
 		isEOF = YES;
 		
-		// this will default to NSUTF8StringEncoding with PG9
-		// defaultEncoding = NSMacOSRomanStringEncoding;
+		// the connection overrides this with its own encoding
+		defaultEncoding = NSUTF8StringEncoding;
 		
 		columns = [[[[NSMutableArray alloc] init] retain] autorelease];
 		
 		pgResult = result;
+		compactResult = NULL;
 		
 		rowCount = -1;
 		rowCount = PQntuples(pgResult);
@@ -58,6 +113,109 @@
     return self;
 }
 
+-(id)initWithContentsOfMappedFile:(NSString *)path
+{
+	self = [super init];
+	if (self == nil)
+	{
+		return nil;
+	}
+	
+	isOpen = NO;
+	isEOF = YES;
+	defaultEncoding = NSUTF8StringEncoding;
+	pgResult = NULL;
+	compactResult = NULL;
+	
+	int fd = open([path fileSystemRepresentation], O_RDONLY);
+	if (fd < 0)
+	{
+		[self release];
+		return nil;
+	}
+	struct stat info;
+	void *mapping = MAP_FAILED;
+	size_t mappingLength = 0;
+	if ((fstat(fd, &info) == 0) && (info.st_size >= (off_t)sizeof(PGSQLRecordsetFileHeader)))
+	{
+		mappingLength = (size_t)info.st_size;
+		mapping = mmap(NULL, mappingLength, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		[self release];
+		return nil;
+	}
+	
+	const PGSQLRecordsetFileHeader *header = mapping;
+	NSMutableArray *loadedColumns = [[NSMutableArray alloc] init];
+	BOOL valid = ((memcmp(header->magic, PGSQLRecordsetFileMagic, 8) == 0) &&
+				  (header->version == PGSQLRecordsetFileVersion) &&
+				  (header->byteOrder == PGSQLRecordsetFileByteOrder) &&
+				  (header->columnCount >= 0) && (header->rows >= 0) && (header->rows <= LONG_MAX) &&
+				  (header->arenaOffset <= mappingLength) && (header->arenaLength <= mappingLength));
+	
+	uint64_t cursor = header->columnsOffset;
+	int c;
+	for (c = 0; valid && (c < header->columnCount); c++)
+	{
+		// compared by subtraction, cursor comes from the file and a sum could wrap
+		if ((cursor > mappingLength) || (sizeof(PGSQLRecordsetFileColumn) > mappingLength - cursor))
+		{
+			valid = NO;
+			break;
+		}
+		PGSQLRecordsetFileColumn description;
+		memcpy(&description, (const char *)mapping + cursor, sizeof(description));
+		cursor += sizeof(description);
+		
+		if ((description.nameLength < 0) || ((uint64_t)description.nameLength > mappingLength - cursor))
+		{
+			valid = NO;
+			break;
+		}
+		NSString *name = [[[NSString alloc] initWithBytes:(const char *)mapping + cursor 
+												   length:description.nameLength 
+												 encoding:NSUTF8StringEncoding] autorelease];
+		cursor += ((uint64_t)description.nameLength + 7) & ~((uint64_t)7);
+		
+		PGSQLColumn *column = [[PGSQLColumn alloc] initWithName:(name ? name : @"") 
+														  index:c 
+														   type:description.type 
+														   size:description.size 
+														 offset:description.modifier 
+														 format:description.format];
+		[loadedColumns addObject:column];
+		[column release];
+	}
+	
+	if (valid)
+	{
+		compactResult = PGSQLCompactResultCreateWithMapping(mapping, mappingLength, 
+															(size_t)header->arenaOffset, (size_t)header->arenaLength,
+															(long)header->rows, header->columnCount);
+	}
+	if (compactResult == NULL)
+	{
+		munmap(mapping, mappingLength);
+		[loadedColumns release];
+		[self release];
+		return nil;
+	}
+	
+	// the compact result owns the mapping from here on
+	columns = loadedColumns;
+	rowCount = (long)header->rows;
+	isOpen = YES;
+	if (rowCount > 0)
+	{
+		isEOF = NO;
+		[self moveFirst];
+	}
+	return self;
+}
+
 -(PGSQLField *)fieldByName:(NSString *)fieldName
 {
 	return [currentRecord fieldByName:fieldName];
@@ -81,10 +239,24 @@
 - (void)setCurrentRecordWithRowIndex:(long)rowIndex
 {
 	[currentRecord release];
-	currentRecord = [[PGSQLRecord alloc] initWithResult:pgResult
-														atRow:rowIndex
-													  columns:columns];
-	[currentRecord setDefaultEncoding:defaultEncoding];
+	currentRecord = [[self recordWithRowIndex:rowIndex] retain];
+}
+
+- (PGSQLRecord *)recordWithRowIndex:(long)rowIndex
+{
+	PGSQLRecord *record;
+	if (compactResult != NULL)
+	{
+		record = [[PGSQLRecord alloc] initWithCompactResult:compactResult
+													  atRow:rowIndex
+													columns:columns];
+	} else {
+		record = [[PGSQLRecord alloc] initWithResult:pgResult
+											   atRow:rowIndex
+											 columns:columns];
+	}
+	[record setDefaultEncoding:defaultEncoding];
+	return [record autorelease];
 }
 
 - (PGSQLRecord *)moveNext
@@ -137,6 +309,7 @@
 	
 	if (currentRowIndex < 0) {
 		isEOF = true;
+		[currentRecord release];
 		currentRecord = nil;
 		return nil;
 	}
@@ -150,13 +323,89 @@
 	if (rowCount == 0) {
 		return nil;
 	}
-	long currentRowIndex = rowCount;
-	isEOF = false;
+	return [self moveToRow:rowCount - 1];
+}
 
-	[self setCurrentRecordWithRowIndex:currentRowIndex];
+-(PGSQLRecord *)moveToRow:(long)rowIndex
+{
+	if ((rowIndex < 0) || (rowIndex >= rowCount)) {
+		return nil;
+	}
+	isEOF = false;
+	
+	[self setCurrentRecordWithRowIndex:rowIndex];
 	return [[currentRecord retain] autorelease];
 }
 
+-(PGSQLRecord *)cursor:(PGSQLRecord *)cursor movedToRow:(long)rowIndex
+{
+	if (cursor == nil)
+	{
+		return [self recordWithRowIndex:rowIndex];
+	}
+	[cursor setRowNumber:rowIndex];
+	return cursor;
+}
+
+-(void)enumerateRowsUsingBlock:(void (^)(PGSQLRecord *record, long rowIndex, BOOL *stop))block
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	PGSQLRecord *cursor = nil;
+	BOOL stop = NO;
+	
+	// the cursor points into the result, so a close or compact from within
+	// block ends the loop before it is moved again
+	unsigned long startMutations = mutations;
+	
+	long row;
+	for (row = 0; (row < rowCount) && !stop && (mutations == startMutations); row++)
+	{
+		PGSQLRecord *record = [self cursor:cursor movedToRow:row];
+		if (record != cursor)
+		{
+			[cursor release];
+			cursor = [record retain];
+		}
+		block(cursor, row, &stop);
+		
+		if ((row + 1) % PGSQLEnumerationPoolRows == 0)
+		{
+			[pool release];
+			pool = [[NSAutoreleasePool alloc] init];
+		}
+	}
+	
+	[cursor release];
+	[pool release];
+}
+
+-(NSUInteger)countByEnumeratingWithState:(NSFastEnumerationState *)state objects:(id *)stackbuf count:(NSUInteger)len
+{
+	// state is the next row and extra[0] the cursor, which is autoreleased 
+	// by cursor:movedToRow: once for the whole loop.  Every row is the same 
+	// object, so rows go out one at a time.  Closing or compacting the 
+	// recordset mid-loop frees what the cursor points into, so both bump 
+	// mutations, which the loop reports as a mutation.
+	if (state->state == 0)
+	{
+		state->mutationsPtr = &mutations;
+		state->extra[0] = 0;
+	}
+	
+	long row = (long)state->state;
+	if ((row >= rowCount) || (len == 0))
+	{
+		return 0;
+	}
+	
+	PGSQLRecord *cursor = [self cursor:(PGSQLRecord *)state->extra[0] movedToRow:row];
+	state->extra[0] = (unsigned long)cursor;
+	stackbuf[0] = cursor;
+	state->itemsPtr = stackbuf;
+	state->state = row + 1;
+	return 1;
+}
+
 -(void)close
 {
 	if (isOpen) {
@@ -164,9 +413,15 @@
 		columns = nil;
 		PQclear(pgResult);
 		pgResult = nil;
+		PGSQLCompactResultFree(compactResult);
+		compactResult = NULL;
+		mutations++;
 	}
+	rowCount = 0;
 	[currentRecord release];
 	currentRecord = nil;
+	[catalog release];
+	catalog = nil;
 	isOpen = NO;
 }
 
@@ -181,7 +436,391 @@
 	return isEOF;
 }
 
+-(void)compact
+{
+	if (!isOpen || (pgResult == NULL) || (compactResult != NULL))
+	{
+		return;
+	}
+	
+	PGSQLCompactResult *compacted = PGSQLCompactResultCreate(pgResult);
+	if (compacted == NULL)
+	{
+		// out of memory, the PGresult still works
+		return;
+	}
+	
+	compactResult = compacted;
+	PQclear(pgResult);
+	pgResult = NULL;
+	mutations++;
+	
+	// the current record pointed into the PGresult
+	if (currentRecord != nil)
+	{
+		[self setCurrentRecordWithRowIndex:[currentRecord rowNumber]];
+	}
+}
+
+static const char *
+PGSQLRecordsetValue(void *context, long row, int column, NSUInteger *length)
+{
+	int valueLength = 0;
+	const char *value = [(PGSQLRecordset *)context valueAtRow:row column:column length:&valueLength];
+	*length = (NSUInteger)valueLength;
+	return value;
+}
+
+-(BOOL)writeToFile:(NSString *)path
+{
+	if (!isOpen)
+	{
+		return NO;
+	}
+	
+	PGSQLCompactResult *packed = compactResult;
+	if (packed == NULL)
+	{
+		int columnCount = (int)[columns count];
+		int *formats = malloc(sizeof(int) * (columnCount > 0 ? columnCount : 1));
+		int c;
+		for (c = 0; c < columnCount; c++)
+		{
+			formats[c] = [[columns objectAtIndex:c] format];
+		}
+		packed = PGSQLCompactResultCreateWithAccessor(rowCount, columnCount, formats, PGSQLRecordsetValue, self);
+		free(formats);
+		if (packed == NULL)
+		{
+			return NO;
+		}
+	}
+	
+	NSMutableData *descriptions = [NSMutableData data];
+	long i;
+	for (i = 0; i < (long)[columns count]; i++)
+	{
+		PGSQLColumn *column = [columns objectAtIndex:i];
+		NSData *name = [[column name] dataUsingEncoding:NSUTF8StringEncoding];
+		
+		PGSQLRecordsetFileColumn description;
+		memset(&description, 0, sizeof(description));
+		description.type = [column type];
+		description.size = [column size];
+		description.modifier = [column offset];
+		description.format = [column format];
+		description.nameLength = (int32_t)[name length];
+		
+		[descriptions appendBytes:&description length:sizeof(description)];
+		[descriptions appendData:name];
+		[descriptions increaseLengthBy:(8 - ([name length] % 8)) % 8];
+	}
+	
+	size_t arenaLength;
+	const char *arena = PGSQLCompactResultArena(packed, &arenaLength);
+	
+	PGSQLRecordsetFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PGSQLRecordsetFileMagic, 8);
+	header.version = PGSQLRecordsetFileVersion;
+	header.byteOrder = PGSQLRecordsetFileByteOrder;
+	header.rows = rowCount;
+	header.columnCount = (int32_t)[columns count];
+	header.columnsOffset = sizeof(header);
+	header.arenaOffset = sizeof(header) + [descriptions length];
+	header.arenaLength = arenaLength;
+	
+	NSString *temporaryPath = [path stringByAppendingFormat:@".%d.tmp", getpid()];
+	FILE *file = fopen([temporaryPath fileSystemRepresentation], "wb");
+	BOOL written = NO;
+	if (file != NULL)
+	{
+		written = ((fwrite(&header, sizeof(header), 1, file) == 1) &&
+				   (([descriptions length] == 0) || (fwrite([descriptions bytes], [descriptions length], 1, file) == 1)) &&
+				   ((arenaLength == 0) || (fwrite(arena, arenaLength, 1, file) == 1)));
+		written = ((fclose(file) == 0) && written);
+	}
+	if (written)
+	{
+		written = (rename([temporaryPath fileSystemRepresentation], [path fileSystemRepresentation]) == 0);
+	}
+	if (!written)
+	{
+		unlink([temporaryPath fileSystemRepresentation]);
+	}
+	
+	if (packed != compactResult)
+	{
+		PGSQLCompactResultFree(packed);
+	}
+	return written;
+}
+
+-(BOOL)isCompact
+{
+	return (compactResult != NULL);
+}
+
+-(NSUInteger)compactSize
+{
+	if (compactResult == NULL)
+	{
+		return 0;
+	}
+	return PGSQLCompactResultSize(compactResult);
+}
+
+-(PGSQLRecord *)recordAtIndex:(long)rowIndex
+{
+	if ((rowIndex < 0) || (rowIndex >= rowCount))
+	{
+		return nil;
+	}
+	
+	return [self recordWithRowIndex:rowIndex];
+}
+
+-(const char *)valueAtRow:(long)rowIndex column:(long)columnIndex length:(int *)valueLength
+{
+	if (compactResult != NULL)
+	{
+		NSUInteger compactLength;
+		const char *value = PGSQLCompactResultValue(compactResult, rowIndex, (int)columnIndex, &compactLength);
+		if (valueLength != NULL) { *valueLength = (int)compactLength; }
+		return value;
+	}
+	
+	if ((rowIndex < 0) || (rowIndex >= rowCount) || 
+		(columnIndex < 0) || (columnIndex >= (long)[columns count]) ||
+		PQgetisnull(pgResult, (int)rowIndex, (int)columnIndex))
+	{
+		if (valueLength != NULL) { *valueLength = 0; }
+		return NULL;
+	}
+	
+	if (valueLength != NULL)
+	{
+		*valueLength = PQgetlength(pgResult, (int)rowIndex, (int)columnIndex);
+	}
+	return PQgetvalue(pgResult, (int)rowIndex, (int)columnIndex);
+}
+
+#pragma mark -
+#pragma mark Parallel Decoding
+
+// Fills objects[row] (retained) for every row, on as many cores as GCD will
+// give us.  Each chunk of rows runs under its own autorelease pool.
+static void
+PGSQLDecodeRowsConcurrently(long rows, id *objects, id (^decodeRow)(long row))
+{
+	size_t chunks = (size_t)((rows + PGSQLDecodeChunkRows - 1) / PGSQLDecodeChunkRows);
+	dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	
+	dispatch_apply(chunks, queue, ^(size_t chunk) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		long first = (long)chunk * PGSQLDecodeChunkRows;
+		long last = first + PGSQLDecodeChunkRows;
+		if (last > rows) { last = rows; }
+		
+		long row;
+		for (row = first; row < last; row++)
+		{
+			id object = decodeRow(row);
+			objects[row] = [(object ? object : [NSNull null]) retain];
+		}
+		[pool release];
+	});
+}
+
+static NSArray *
+PGSQLArrayFromDecodedObjects(id *objects, long rows)
+{
+	NSArray *result = [NSArray arrayWithObjects:objects count:(NSUInteger)rows];
+	long row;
+	for (row = 0; row < rows; row++)
+	{
+		[objects[row] release];
+	}
+	free(objects);
+	return result;
+}
+
+-(NSArray *)dictionariesFromRecords
+{
+	if (rowCount <= 0) { return [NSArray array]; }
+	
+	id *objects = malloc(sizeof(id) * rowCount);
+	PGSQLDecodeRowsConcurrently(rowCount, objects, ^id(long row) {
+		return [self dictionaryFromRecord:[self recordAtIndex:row]];
+	});
+	return PGSQLArrayFromDecodedObjects(objects, rowCount);
+}
+
+-(NSArray *)objectsFromRecordsWithTarget:(id)target selector:(SEL)selector
+{
+	if (rowCount <= 0) { return [NSArray array]; }
+	
+	id *objects = malloc(sizeof(id) * rowCount);
+	PGSQLDecodeRowsConcurrently(rowCount, objects, ^id(long row) {
+		return [target performSelector:selector withObject:[self recordAtIndex:row]];
+	});
+	return PGSQLArrayFromDecodedObjects(objects, rowCount);
+}
+
+// How a column's values are parsed: as text, as one of the binary number
+// types (a domain as the type it is over), or not at all.
+static int
+PGSQLNumberColumnType(NSArray *columns, long columnIndex, unsigned int *oid)
+{
+	*oid = 0;
+	if ((columnIndex < 0) || (columnIndex >= (long)[columns count]))
+	{
+		return -1;
+	}
+	PGSQLColumn *column = [columns objectAtIndex:columnIndex];
+	if ([column format] == 0)
+	{
+		return 0;
+	}
+	PGSQLType *info = [column typeInfo];
+	*oid = ((info != nil) && [info isDomain]) ? [info baseOID] : (unsigned int)[column type];
+	switch (*oid)
+	{
+		case 20:	// int8
+		case 21:	// int2
+		case 23:	// int4
+		case 700:	// float4
+		case 701:	// float8
+			return 1;
+		default:
+			return -1;
+	}
+}
+
+// A binary int2, int4, int8, float4 or float8, as both a double and a
+// long long.
+static void
+PGSQLBinaryNumber(unsigned int oid, const char *value, int length, long long *integer, double *real)
+{
+	uint64_t bits = 0;
+	int i;
+	for (i = 0; i < length; i++)
+	{
+		bits = (bits << 8) | (unsigned char)value[i];
+	}
+	
+	switch (oid)
+	{
+		case 21:	// int2
+			*integer = (int16_t)bits;
+			*real = (double)*integer;
+			break;
+		case 23:	// int4
+			*integer = (int32_t)bits;
+			*real = (double)*integer;
+			break;
+		case 20:	// int8
+			*integer = (int64_t)bits;
+			*real = (double)*integer;
+			break;
+		case 700:	// float4
+		{
+			uint32_t narrow = (uint32_t)bits;
+			float f;
+			memcpy(&f, &narrow, sizeof(f));
+			*real = f;
+			*integer = isnan(f) ? 0 : (long long)f;
+			break;
+		}
+		default:	// float8
+			memcpy(real, &bits, sizeof(*real));
+			*integer = isnan(*real) ? 0 : (long long)*real;
+			break;
+	}
+}
+
+-(NSData *)doubleValuesForColumn:(long)columnIndex
+{
+	unsigned int oid;
+	int binary = PGSQLNumberColumnType(columns, columnIndex, &oid);
+	if (binary < 0)
+	{
+		return nil;
+	}
+	
+	long rows = (rowCount > 0) ? rowCount : 0;
+	NSMutableData *data = [NSMutableData dataWithLength:sizeof(double) * rows];
+	double *values = [data mutableBytes];
+	size_t chunks = (size_t)((rows + PGSQLDecodeChunkRows - 1) / PGSQLDecodeChunkRows);
+	
+	dispatch_apply(chunks, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t chunk) {
+		long first = (long)chunk * PGSQLDecodeChunkRows;
+		long last = first + PGSQLDecodeChunkRows;
+		if (last > rows) { last = rows; }
+		
+		long row;
+		for (row = first; row < last; row++)
+		{
+			int length;
+			const char *value = [self valueAtRow:row column:columnIndex length:&length];
+			if (value == NULL)
+			{
+				values[row] = NAN;
+			} else if (binary) {
+				long long integer;
+				PGSQLBinaryNumber(oid, value, length, &integer, &values[row]);
+			} else {
+				values[row] = strtod(value, NULL);
+			}
+		}
+	});
+	return data;
+}
+
+-(NSData *)longLongValuesForColumn:(long)columnIndex
+{
+	unsigned int oid;
+	int binary = PGSQLNumberColumnType(columns, columnIndex, &oid);
+	if (binary < 0)
+	{
+		return nil;
+	}
+	
+	long rows = (rowCount > 0) ? rowCount : 0;
+	NSMutableData *data = [NSMutableData dataWithLength:sizeof(long long) * rows];
+	long long *values = [data mutableBytes];
+	size_t chunks = (size_t)((rows + PGSQLDecodeChunkRows - 1) / PGSQLDecodeChunkRows);
+	
+	dispatch_apply(chunks, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t chunk) {
+		long first = (long)chunk * PGSQLDecodeChunkRows;
+		long last = first + PGSQLDecodeChunkRows;
+		if (last > rows) { last = rows; }
+		
+		long row;
+		for (row = first; row < last; row++)
+		{
+			int length;
+			const char *value = [self valueAtRow:row column:columnIndex length:&length];
+			if (value == NULL)
+			{
+				values[row] = 0;
+			} else if (binary) {
+				double real;
+				PGSQLBinaryNumber(oid, value, length, &values[row], &real);
+			} else {
+				values[row] = strtoll(value, NULL, 10);
+			}
+		}
+	});
+	return data;
+}
+
 -(NSDictionary *)dictionaryFromRecord
+{
+	return [self dictionaryFromRecord:currentRecord];
+}
+
+-(NSDictionary *)dictionaryFromRecord:(PGSQLRecord *)record
 {
 	NSMutableDictionary *dict = [[NSMutableDictionary alloc] init];
 	long i;
@@ -221,7 +860,7 @@
 				break;
 */
 			case 16: // BOOL
-				if ([[self fieldByName:[column name]] asBoolean])
+				if ([[record fieldByName:[column name]] asBoolean])
 				{
 					[dict setValue:@"true" forKey:[column name]];
 				} else {
@@ -229,7 +868,7 @@
 				}
 				break;
 			default:
-				[dict setValue:[[self fieldByName:[column name]] asString:defaultEncoding] forKey:[column name]];
+				[dict setValue:[[record fieldByName:[column name]] asString:defaultEncoding] forKey:[column name]];
 				break;
 		}
 	}
@@ -238,6 +877,29 @@
 	return result;
 }
 
+-(void)setInternsStrings:(BOOL)value forColumn:(NSString *)fieldName
+{
+	long i;
+	for (i = 0; i < [columns count]; i++)
+	{
+		PGSQLColumn *column = [columns objectAtIndex:i];
+		if ([[column name] caseInsensitiveCompare:fieldName] == NSOrderedSame)
+		{
+			[column setInternsStrings:value];
+			break;
+		}
+	}
+}
+
+-(void)setInternsStrings:(BOOL)value
+{
+	long i;
+	for (i = 0; i < [columns count]; i++)
+	{
+		[[columns objectAtIndex:i] setInternsStrings:value];
+	}
+}
+
 -(NSStringEncoding)defaultEncoding
 {
 	return defaultEncoding;
@@ -247,9 +909,32 @@
 {
     if (defaultEncoding != value) {
         defaultEncoding = value;
+		
+		// the first record is built during init, before the connection has
+		// a chance to set the encoding
+		[currentRecord setDefaultEncoding:value];
     }	
 	
 }
 
+-(PGSQLCatalog *)catalog
+{
+	return [[catalog retain] autorelease];
+}
+
+-(void)setCatalog:(PGSQLCatalog *)value
+{
+	if (catalog != value) {
+		[catalog release];
+		catalog = [value retain];
+		
+		NSUInteger i;
+		for (i = 0; i < [columns count]; i++)
+		{
+			PGSQLColumn *column = [columns objectAtIndex:i];
+			[column setTypeInfo:[catalog typeWithOID:(unsigned int)[column type]]];
+		}
+	}
+}
 
 @end
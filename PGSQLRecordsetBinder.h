@@ -0,0 +1,132 @@
+//
+//  PGSQLRecordsetBinder.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLRecordsetBinder
+    @abstract   Fetch rows straight into C structs.
+    @discussion A binder maps result columns to fields of a struct the
+				caller defines, by offset and C type, and then fills an
+				array of those structs a batch of rows at a time, converting
+				from the values the server sent.  No object is made per row
+				or per value, and nothing is allocated per batch, so one
+				array can be refilled for every batch of every execution.
+
+				Each binding can also name an int32_t indicator in the
+				struct, which is set to PGSQLBindNullIndicator for NULL and
+				otherwise to the length of the value as sent, so a string or
+				byte value longer than its field shows as truncated.  A
+				NULL leaves the field zeroed.
+
+				Columns are matched by name when the binder is attached to
+				a recordset, using its column metadata; domains bind as the
+				type they are over.  Text and binary results both convert:
+				integers, floats, numeric and bool to any numeric type, and
+				anything to a string or bytes field.  Binary values of other
+				types are only made strings through -[PGSQLField asString],
+				which is the one path that does make objects.
+
+				A binder is not thread safe.
+*/
+
+#import <Foundation/Foundation.h>
+
+@class PGSQLRecordset;
+
+// The C type of a bound field.
+enum {
+	PGSQLBindInt16 = 0,			// int16_t
+	PGSQLBindInt32,				// int32_t
+	PGSQLBindInt64,				// int64_t
+	PGSQLBindFloat,				// float
+	PGSQLBindDouble,			// double
+	PGSQLBindBool,				// BOOL
+	PGSQLBindCString,			// char[length], always terminated
+	PGSQLBindBytes				// char[length], not terminated
+};
+
+enum {
+	PGSQLBindNullIndicator = -1
+};
+
+/*!
+    @class
+    @abstract    Binds result columns to fields of a C struct.
+*/
+@interface PGSQLRecordsetBinder : NSObject {
+	size_t rowSize;
+	NSMutableArray *columnNames;
+	void *bindings;				// one PGSQLBinding per bound column
+	NSUInteger bindingCount;
+
+	PGSQLRecordset *recordset;
+	long position;
+	NSString *lastError;
+}
+
+/*!
+    @method
+    @abstract   A binder for structs of rowSize bytes, sizeof the struct.
+*/
+-(id)initWithRowSize:(size_t)size;
+
+-(size_t)rowSize;
+
+/*!
+    @method
+    @abstract   Bind a column to a field.
+    @param      columnName the column's name in the result
+    @param      type one of the PGSQLBind types
+    @param      offset offsetof the field in the struct
+    @param      length the field's size in bytes, used for PGSQLBindCString
+				and PGSQLBindBytes and ignored otherwise
+    @param      indicatorOffset offsetof an int32_t indicator, or NSNotFound
+    @result     NO if the field or indicator does not fit in the struct.
+				A binding made while a recordset is attached takes effect at
+				the next attachRecordset:.
+*/
+-(BOOL)bindColumn:(NSString *)columnName type:(int)type offset:(size_t)offset
+		   length:(size_t)length indicatorOffset:(size_t)indicatorOffset;
+/*!
+    @method
+    @abstract   Remove every binding.
+*/
+-(void)unbindAll;
+
+/*!
+    @method
+    @abstract   Fetch from rs, starting at its first row.
+    @discussion Call again with the recordset of the next execution; the
+				bindings are matched to its columns again.
+    @result     NO if a bound column is not in the recordset, see lastError.
+				The binder is then detached and fetches nothing.
+*/
+-(BOOL)attachRecordset:(PGSQLRecordset *)rs;
+-(PGSQLRecordset *)recordset;
+
+/*!
+    @method
+    @abstract   Fill up to count structs with the next rows.
+    @param      rows an array of at least count structs of rowSize bytes
+    @result     The number of rows filled, 0 after the last row.
+*/
+-(long)fetchRows:(void *)rows count:(long)count;
+/*!
+    @method
+    @abstract   Fill one struct from a row, without moving the position.
+*/
+-(BOOL)fetchRow:(long)rowIndex into:(void *)row;
+
+/*!
+    @method
+    @abstract   The row the next fetch starts at.
+*/
+-(long)position;
+-(void)setPosition:(long)value;
+
+-(NSString *)lastError;
+
+@end
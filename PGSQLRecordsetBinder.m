@@ -0,0 +1,517 @@
+//
+//  PGSQLRecordsetBinder.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLRecordsetBinder.h"
+#import "PGSQLRecordset.h"
+#import "PGSQLRecord.h"
+#import "PGSQLField.h"
+#import "PGSQLColumn.h"
+#import "PGSQLCatalog.h"
+#import <math.h>
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+
+typedef const char *(*PGSQLValueAccessor)(id, SEL, long, long, int *);
+
+typedef struct {
+	int type;
+	size_t offset;
+	size_t length;
+	size_t indicatorOffset;
+
+	// set by attachRecordset:
+	long column;
+	unsigned int oid;
+	int format;
+} PGSQLBinding;
+
+static size_t
+PGSQLBindingSize(int type, size_t length)
+{
+	switch (type)
+	{
+		case PGSQLBindInt16:	return sizeof(int16_t);
+		case PGSQLBindInt32:	return sizeof(int32_t);
+		case PGSQLBindInt64:	return sizeof(int64_t);
+		case PGSQLBindFloat:	return sizeof(float);
+		case PGSQLBindDouble:	return sizeof(double);
+		case PGSQLBindBool:		return sizeof(BOOL);
+		default:				return length;
+	}
+}
+
+static uint64_t
+PGSQLBindBigEndian(const char *bytes, int length)
+{
+	uint64_t value = 0;
+	int i;
+	for (i = 0; i < length; i++)
+	{
+		value = (value << 8) | (unsigned char)bytes[i];
+	}
+	return value;
+}
+
+static BOOL
+PGSQLBindIsTextType(unsigned int oid)
+{
+	switch (oid)
+	{
+		case 18:	// char
+		case 19:	// name
+		case 25:	// text
+		case 114:	// json
+		case 142:	// xml
+		case 705:	// unknown
+		case 1042:	// bpchar
+		case 1043:	// varchar
+			return YES;
+		default:
+			return NO;
+	}
+}
+
+// A binary numeric: digit count, weight, sign and scale, then base 10000
+// digits, the first weighted 10000^weight.
+static double
+PGSQLBindBinaryNumeric(const char *value, int length)
+{
+	if (length < 8)
+	{
+		return 0;
+	}
+	int digitCount = (int16_t)PGSQLBindBigEndian(value, 2);
+	int weight = (int16_t)PGSQLBindBigEndian(value + 2, 2);
+	uint16_t sign = (uint16_t)PGSQLBindBigEndian(value + 4, 2);
+	if (sign == 0xC000)
+	{
+		return NAN;
+	}
+
+	double result = 0;
+	int i;
+	for (i = 0; (i < digitCount) && (8 + (i * 2) + 2 <= length); i++)
+	{
+		double digit = (double)PGSQLBindBigEndian(value + 8 + (i * 2), 2);
+		result += digit * pow(10000.0, weight - i);
+	}
+	return (sign == 0x4000) ? -result : result;
+}
+
+// A value as a number, either integer or real.  Text is parsed from a
+// terminated copy since binary text values have no terminator.
+static void
+PGSQLBindNumber(PGSQLBinding *binding, const char *value, int length, int64_t *integer, double *real, BOOL *isReal)
+{
+	*integer = 0;
+	*real = 0;
+	*isReal = NO;
+
+	unsigned int oid = binding->oid;
+	if ((binding->format == 0) || PGSQLBindIsTextType(oid))
+	{
+		if (oid == 16)
+		{
+			*integer = ((length > 0) && (value[0] == 't'));
+			return;
+		}
+		char text[64];
+		int copied = (length < (int)sizeof(text) - 1) ? length : (int)sizeof(text) - 1;
+		memcpy(text, value, copied);
+		text[copied] = '\0';
+		switch (oid)
+		{
+			case 20:	// int8
+			case 21:	// int2
+			case 23:	// int4
+			case 26:	// oid
+				*integer = strtoll(text, NULL, 10);
+				return;
+			default:
+				*real = strtod(text, NULL);
+				*isReal = YES;
+				return;
+		}
+	}
+
+	uint64_t bits = PGSQLBindBigEndian(value, length);
+	switch (oid)
+	{
+		case 16:	// bool
+			*integer = ((length > 0) && (value[0] != 0));
+			return;
+		case 21:	// int2
+			*integer = (int16_t)bits;
+			return;
+		case 23:	// int4
+			*integer = (int32_t)bits;
+			return;
+		case 26:	// oid
+			*integer = (uint32_t)bits;
+			return;
+		case 20:	// int8
+			*integer = (int64_t)bits;
+			return;
+		case 700:	// float4
+		{
+			uint32_t narrow = (uint32_t)bits;
+			float f;
+			memcpy(&f, &narrow, sizeof(f));
+			*real = f;
+			*isReal = YES;
+			return;
+		}
+		case 701:	// float8
+			memcpy(real, &bits, sizeof(*real));
+			*isReal = YES;
+			return;
+		case 1700:	// numeric
+			*real = PGSQLBindBinaryNumeric(value, length);
+			*isReal = YES;
+			return;
+		default:
+			return;
+	}
+}
+
+static void
+PGSQLBindStoreNumber(PGSQLBinding *binding, char *field, const char *value, int length)
+{
+	int64_t integer;
+	double real;
+	BOOL isReal;
+	PGSQLBindNumber(binding, value, length, &integer, &real, &isReal);
+	if (isReal && (binding->type != PGSQLBindFloat) && (binding->type != PGSQLBindDouble))
+	{
+		integer = isnan(real) ? 0 : (int64_t)real;
+	}
+
+	switch (binding->type)
+	{
+		case PGSQLBindInt16:
+		{
+			int16_t stored = (int16_t)integer;
+			memcpy(field, &stored, sizeof(stored));
+			break;
+		}
+		case PGSQLBindInt32:
+		{
+			int32_t stored = (int32_t)integer;
+			memcpy(field, &stored, sizeof(stored));
+			break;
+		}
+		case PGSQLBindInt64:
+			memcpy(field, &integer, sizeof(integer));
+			break;
+		case PGSQLBindFloat:
+		{
+			float stored = isReal ? (float)real : (float)integer;
+			memcpy(field, &stored, sizeof(stored));
+			break;
+		}
+		case PGSQLBindDouble:
+		{
+			double stored = isReal ? real : (double)integer;
+			memcpy(field, &stored, sizeof(stored));
+			break;
+		}
+		case PGSQLBindBool:
+		{
+			BOOL stored = (integer != 0);
+			memcpy(field, &stored, sizeof(stored));
+			break;
+		}
+	}
+}
+
+static void
+PGSQLBindStoreText(PGSQLBinding *binding, char *field, const char *text, size_t length)
+{
+	if (binding->length == 0)
+	{
+		return;
+	}
+	size_t room = (binding->type == PGSQLBindCString) ? binding->length - 1 : binding->length;
+	size_t copied = (length < room) ? length : room;
+	memcpy(field, text, copied);
+	if (copied < binding->length)
+	{
+		memset(field + copied, 0, binding->length - copied);
+	}
+}
+
+// A value into a string or bytes field.  Binary values of types with no
+// quick text form go through a field, the one path that makes objects.
+static void
+PGSQLBindStoreString(PGSQLBinding *binding, char *field, const char *value, int length,
+					 PGSQLRecordset *rs, long rowIndex)
+{
+	if ((binding->format == 0) || PGSQLBindIsTextType(binding->oid) || (binding->oid == 17))
+	{
+		PGSQLBindStoreText(binding, field, value, (size_t)length);
+		return;
+	}
+
+	char number[48];
+	int64_t integer;
+	double real;
+	BOOL isReal;
+	switch (binding->oid)
+	{
+		case 16:	// bool
+			PGSQLBindStoreText(binding, field, ((length > 0) && (value[0] != 0)) ? "t" : "f", 1);
+			return;
+		case 20:	// int8
+		case 21:	// int2
+		case 23:	// int4
+		case 26:	// oid
+			PGSQLBindNumber(binding, value, length, &integer, &real, &isReal);
+			PGSQLBindStoreText(binding, field, number, (size_t)snprintf(number, sizeof(number), "%lld", (long long)integer));
+			return;
+		case 700:	// float4
+		case 701:	// float8
+			PGSQLBindNumber(binding, value, length, &integer, &real, &isReal);
+			PGSQLBindStoreText(binding, field, number, (size_t)snprintf(number, sizeof(number), "%.*g",
+																		  (binding->oid == 700) ? 9 : 17, real));
+			return;
+		default:
+		{
+			NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+			NSString *string = [[[rs recordAtIndex:rowIndex] fieldByIndex:binding->column] asString];
+			NSData *bytes = [string dataUsingEncoding:[rs defaultEncoding] allowLossyConversion:YES];
+			PGSQLBindStoreText(binding, field, [bytes bytes], [bytes length]);
+			[pool drain];
+			return;
+		}
+	}
+}
+
+@interface PGSQLRecordsetBinder (Private)
+-(void)fillRow:(char *)row fromRow:(long)rowIndex accessor:(PGSQLValueAccessor)valueAt;
+@end
+
+@implementation PGSQLRecordsetBinder
+
+-(id)initWithRowSize:(size_t)size
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		rowSize = size;
+		columnNames = [[NSMutableArray alloc] init];
+		bindings = NULL;
+		bindingCount = 0;
+		recordset = nil;
+		position = 0;
+		lastError = nil;
+	}
+
+	return self;
+}
+
+-(void)dealloc
+{
+	[columnNames release];
+	free(bindings);
+	[recordset release];
+	[lastError release];
+	[super dealloc];
+}
+
+-(size_t)rowSize
+{
+	return rowSize;
+}
+
+-(BOOL)bindColumn:(NSString *)columnName type:(int)type offset:(size_t)offset
+		   length:(size_t)length indicatorOffset:(size_t)indicatorOffset
+{
+	size_t size = PGSQLBindingSize(type, length);
+	if ((columnName == nil) || (type < PGSQLBindInt16) || (type > PGSQLBindBytes) ||
+		(offset + size > rowSize) ||
+		((indicatorOffset != NSNotFound) && (indicatorOffset + sizeof(int32_t) > rowSize)))
+	{
+		return NO;
+	}
+
+	PGSQLBinding *grown = realloc(bindings, sizeof(PGSQLBinding) * (bindingCount + 1));
+	if (grown == NULL)
+	{
+		return NO;
+	}
+	bindings = grown;
+
+	PGSQLBinding *binding = &grown[bindingCount];
+	binding->type = type;
+	binding->offset = offset;
+	binding->length = size;
+	binding->indicatorOffset = indicatorOffset;
+	binding->column = -1;
+	binding->oid = 0;
+	binding->format = 0;
+	bindingCount++;
+	[columnNames addObject:columnName];
+	return YES;
+}
+
+-(void)unbindAll
+{
+	free(bindings);
+	bindings = NULL;
+	bindingCount = 0;
+	[columnNames removeAllObjects];
+}
+
+-(BOOL)attachRecordset:(PGSQLRecordset *)rs
+{
+	[rs retain];
+	[recordset release];
+	recordset = rs;
+	position = 0;
+
+	NSArray *columns = [rs columns];
+	NSUInteger b;
+	for (b = 0; b < bindingCount; b++)
+	{
+		PGSQLBinding *binding = &((PGSQLBinding *)bindings)[b];
+		NSString *name = [columnNames objectAtIndex:b];
+		binding->column = -1;
+
+		NSUInteger c;
+		for (c = 0; c < [columns count]; c++)
+		{
+			PGSQLColumn *column = [columns objectAtIndex:c];
+			if ([[column name] isEqualToString:name])
+			{
+				PGSQLType *info = [column typeInfo];
+				binding->column = (long)c;
+				binding->oid = ((info != nil) && [info isDomain]) ? [info baseOID] : (unsigned int)[column type];
+				binding->format = [column format];
+				break;
+			}
+		}
+
+		if (binding->column == -1)
+		{
+			// nothing is fetched until a recordset attaches whole, so no
+			// binding is left resolved against the last one
+			for (b = 0; b < bindingCount; b++)
+			{
+				((PGSQLBinding *)bindings)[b].column = -1;
+			}
+			[recordset release];
+			recordset = nil;
+			[lastError release];
+			lastError = [[NSString alloc] initWithFormat:@"Column %@ is not in the result.", name];
+			return NO;
+		}
+	}
+
+	[lastError release];
+	lastError = nil;
+	return YES;
+}
+
+-(PGSQLRecordset *)recordset
+{
+	return recordset;
+}
+
+-(long)fetchRows:(void *)rows count:(long)count
+{
+	if (recordset == nil)
+	{
+		return 0;
+	}
+
+	PGSQLValueAccessor valueAt = (PGSQLValueAccessor)[recordset methodForSelector:@selector(valueAtRow:column:length:)];
+	long available = [recordset recordCount] - position;
+	if (count > available)
+	{
+		count = available;
+	}
+
+	long r;
+	for (r = 0; r < count; r++)
+	{
+		[self fillRow:(char *)rows + (r * rowSize) fromRow:position + r accessor:valueAt];
+	}
+	position += (count > 0) ? count : 0;
+	return (count > 0) ? count : 0;
+}
+
+-(BOOL)fetchRow:(long)rowIndex into:(void *)row
+{
+	if ((recordset == nil) || (rowIndex < 0) || (rowIndex >= [recordset recordCount]))
+	{
+		return NO;
+	}
+	PGSQLValueAccessor valueAt = (PGSQLValueAccessor)[recordset methodForSelector:@selector(valueAtRow:column:length:)];
+	[self fillRow:row fromRow:rowIndex accessor:valueAt];
+	return YES;
+}
+
+-(long)position
+{
+	return position;
+}
+
+-(void)setPosition:(long)value
+{
+	position = (value > 0) ? value : 0;
+}
+
+-(NSString *)lastError
+{
+	return lastError;
+}
+
+@end
+
+@implementation PGSQLRecordsetBinder (Private)
+
+-(void)fillRow:(char *)row fromRow:(long)rowIndex accessor:(PGSQLValueAccessor)valueAt
+{
+	SEL valueSelector = @selector(valueAtRow:column:length:);
+	NSUInteger b;
+	for (b = 0; b < bindingCount; b++)
+	{
+		PGSQLBinding *binding = &((PGSQLBinding *)bindings)[b];
+		char *field = row + binding->offset;
+		int length = 0;
+		const char *value = (binding->column >= 0)
+			? valueAt(recordset, valueSelector, rowIndex, binding->column, &length)
+			: NULL;
+
+		if (binding->indicatorOffset != NSNotFound)
+		{
+			int32_t indicator = (value != NULL) ? (int32_t)length : PGSQLBindNullIndicator;
+			memcpy(row + binding->indicatorOffset, &indicator, sizeof(indicator));
+		}
+
+		if (value == NULL)
+		{
+			memset(field, 0, binding->length);
+			continue;
+		}
+
+		switch (binding->type)
+		{
+			case PGSQLBindCString:
+			case PGSQLBindBytes:
+				PGSQLBindStoreString(binding, field, value, length, recordset, rowIndex);
+				break;
+			default:
+				PGSQLBindStoreNumber(binding, field, value, length);
+				break;
+		}
+	}
+}
+
+@end
@@ -0,0 +1,114 @@
+//
+//  PGSQLRecordsetDiff.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLRecordsetDiff
+    @abstract   What changed between two runs of the same query.
+    @discussion Rows are matched by key columns, so the diff tells a view
+				which rows appeared, which went away and which changed,
+				wherever they sit in either result, and a redraw can be
+				limited to those.
+
+				The diff is computed from the raw value bytes of both
+				recordsets in time linear in their size.  Keys are hashed
+				into one open addressing table over the old rows, each new
+				row's key is looked up in it, and matched rows are compared
+				column by column.  No field or string objects are made; the
+				results are index sets and flat arrays.
+
+				Values are compared as the server sent them, so both
+				recordsets should come from the same statement with the same
+				result formats.  A NULL key matches another NULL key.  When a
+				key repeats, its rows are matched in order.
+*/
+
+#import <Foundation/Foundation.h>
+
+@class PGSQLRecordset;
+
+/*!
+    @class
+    @abstract    The differences from one recordset to another.
+*/
+@interface PGSQLRecordsetDiff : NSObject {
+	long oldRowCount;
+	long newRowCount;
+	int columnCount;
+
+	NSIndexSet *insertedRows;
+	NSIndexSet *deletedRows;
+	NSIndexSet *changedRows;
+
+	long *oldRowForNewRow;			// newRowCount entries, -1 for inserted rows
+	NSUInteger changeCount;
+	long *changeOldRows;			// changeCount entries each
+	long *changeNewRows;
+	uint64_t *changeColumns;		// changeCount bitmaps of columnWords words
+	int columnWords;
+}
+
+/*!
+    @method
+    @abstract   Compare two results of the same query.
+    @discussion keyColumns names the columns that identify a row.  Returns
+				nil if the recordsets do not have the same columns, or
+				keyColumns is empty or names a column they do not have.
+*/
++(PGSQLRecordsetDiff *)diffFromRecordset:(PGSQLRecordset *)oldRecordset
+							 toRecordset:(PGSQLRecordset *)newRecordset
+							  keyColumns:(NSArray *)keyColumns;
+
+-(id)initWithRecordset:(PGSQLRecordset *)oldRecordset
+		   toRecordset:(PGSQLRecordset *)newRecordset
+			keyColumns:(NSArray *)keyColumns;
+
+/*!
+    @method
+    @abstract   Whether anything was inserted, deleted or changed.
+*/
+-(BOOL)hasChanges;
+
+/*!
+    @method
+    @abstract   Rows of the new recordset whose key the old one lacked.
+*/
+-(NSIndexSet *)insertedRows;
+/*!
+    @method
+    @abstract   Rows of the old recordset whose key the new one lacks.
+*/
+-(NSIndexSet *)deletedRows;
+/*!
+    @method
+    @abstract   Rows of the new recordset whose key was in the old one with
+				different values.
+*/
+-(NSIndexSet *)changedRows;
+
+/*!
+    @method
+    @abstract   The old row a new row was matched to, or -1 for an inserted
+				row.  Unchanged rows are matched too, which tells a view
+				where they moved.
+*/
+-(long)oldRowForNewRow:(long)newRow;
+
+/*!
+    @method
+    @abstract   The changed rows as a list, in new row order.
+*/
+-(NSUInteger)changeCount;
+-(long)oldRowOfChangeAtIndex:(NSUInteger)changeIndex;
+-(long)newRowOfChangeAtIndex:(NSUInteger)changeIndex;
+/*!
+    @method
+    @abstract   The columns whose values differ in a change.
+*/
+-(NSIndexSet *)changedColumnsOfChangeAtIndex:(NSUInteger)changeIndex;
+-(BOOL)changeAtIndex:(NSUInteger)changeIndex changedColumn:(int)column;
+
+@end
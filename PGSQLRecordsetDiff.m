@@ -0,0 +1,375 @@
+//
+//  PGSQLRecordsetDiff.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLRecordsetDiff.h"
+#import "PGSQLRecordset.h"
+#import "PGSQLColumn.h"
+#import <stdlib.h>
+#import <string.h>
+
+typedef const char *(*PGSQLValueAccessor)(id, SEL, long, long, int *);
+
+// One value read through the recordset's valueAtRow:column:length:, with
+// the method looked up once rather than sent per value.
+typedef struct {
+	PGSQLRecordset *recordset;
+	PGSQLValueAccessor value;
+} PGSQLDiffSource;
+
+static const char *
+PGSQLDiffValue(PGSQLDiffSource *source, long row, long column, int *length)
+{
+	return source->value(source->recordset, @selector(valueAtRow:column:length:), row, column, length);
+}
+
+// FNV-1a over the key values, each followed by its length so "ab","c" and
+// "a","bc" differ, and NULL hashed apart from the empty string.
+static uint64_t
+PGSQLDiffKeyHash(PGSQLDiffSource *source, long row, const long *keys, int keyCount)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	int k;
+	for (k = 0; k < keyCount; k++)
+	{
+		int length;
+		const char *value = PGSQLDiffValue(source, row, keys[k], &length);
+		int i;
+		for (i = 0; (value != NULL) && (i < length); i++)
+		{
+			hash ^= (unsigned char)value[i];
+			hash *= 1099511628211ULL;
+		}
+		uint32_t marker = (value != NULL) ? (uint32_t)length : UINT32_MAX;
+		for (i = 0; i < 4; i++)
+		{
+			hash ^= (marker >> (i * 8)) & 0xff;
+			hash *= 1099511628211ULL;
+		}
+	}
+	return hash;
+}
+
+static BOOL
+PGSQLDiffValuesEqual(PGSQLDiffSource *a, long rowA, PGSQLDiffSource *b, long rowB, long column)
+{
+	int lengthA;
+	int lengthB;
+	const char *valueA = PGSQLDiffValue(a, rowA, column, &lengthA);
+	const char *valueB = PGSQLDiffValue(b, rowB, column, &lengthB);
+	if ((valueA == NULL) || (valueB == NULL))
+	{
+		return (valueA == valueB);
+	}
+	return ((lengthA == lengthB) && (memcmp(valueA, valueB, lengthA) == 0));
+}
+
+static BOOL
+PGSQLDiffKeysEqual(PGSQLDiffSource *a, long rowA, PGSQLDiffSource *b, long rowB, const long *keys, int keyCount)
+{
+	int k;
+	for (k = 0; k < keyCount; k++)
+	{
+		if (!PGSQLDiffValuesEqual(a, rowA, b, rowB, keys[k]))
+		{
+			return NO;
+		}
+	}
+	return YES;
+}
+
+@implementation PGSQLRecordsetDiff
+
++(PGSQLRecordsetDiff *)diffFromRecordset:(PGSQLRecordset *)oldRecordset
+							 toRecordset:(PGSQLRecordset *)newRecordset
+							  keyColumns:(NSArray *)keyColumns
+{
+	return [[[PGSQLRecordsetDiff alloc] initWithRecordset:oldRecordset
+											  toRecordset:newRecordset
+											   keyColumns:keyColumns] autorelease];
+}
+
+-(id)initWithRecordset:(PGSQLRecordset *)oldRecordset
+		   toRecordset:(PGSQLRecordset *)newRecordset
+			keyColumns:(NSArray *)keyColumns
+{
+	self = [super init];
+
+	if (self == nil)
+	{
+		return nil;
+	}
+
+	NSArray *oldColumns = [oldRecordset columns];
+	NSArray *newColumns = [newRecordset columns];
+	if ([oldColumns count] != [newColumns count])
+	{
+		[self release];
+		return nil;
+	}
+	columnCount = (int)[newColumns count];
+	NSMutableArray *names = [NSMutableArray arrayWithCapacity:columnCount];
+	int c;
+	for (c = 0; c < columnCount; c++)
+	{
+		NSString *name = [[newColumns objectAtIndex:c] name];
+		if (![name isEqualToString:[[oldColumns objectAtIndex:c] name]])
+		{
+			[self release];
+			return nil;
+		}
+		[names addObject:name];
+	}
+
+	int keyCount = (int)[keyColumns count];
+	if (keyCount == 0)
+	{
+		[self release];
+		return nil;
+	}
+	long keys[keyCount];
+	int k;
+	for (k = 0; k < keyCount; k++)
+	{
+		NSUInteger index = [names indexOfObject:[keyColumns objectAtIndex:k]];
+		if (index == NSNotFound)
+		{
+			[self release];
+			return nil;
+		}
+		keys[k] = (long)index;
+	}
+
+	PGSQLDiffSource oldSource = { oldRecordset, (PGSQLValueAccessor)[oldRecordset methodForSelector:@selector(valueAtRow:column:length:)] };
+	PGSQLDiffSource newSource = { newRecordset, (PGSQLValueAccessor)[newRecordset methodForSelector:@selector(valueAtRow:column:length:)] };
+	oldRowCount = [oldRecordset recordCount];
+	newRowCount = [newRecordset recordCount];
+	columnWords = (columnCount + 63) / 64;
+
+	// one slot per distinct key of the old rows, open addressing at half
+	// load or less.  slotKeyRows holds the key's first row, to compare
+	// against, and slotNextRows the next of its rows not yet matched; the
+	// rows sharing a key are chained through nextRows, so a repeated key
+	// costs the same to match as a unique one.
+	NSUInteger capacity = 16;
+	while (capacity < (NSUInteger)oldRowCount * 2)
+	{
+		capacity <<= 1;
+	}
+	uint64_t *slotHashes = malloc(sizeof(uint64_t) * capacity);
+	long *slotKeyRows = malloc(sizeof(long) * capacity);
+	long *slotNextRows = malloc(sizeof(long) * capacity);
+	long *nextRows = malloc(sizeof(long) * (oldRowCount > 0 ? oldRowCount : 1));
+	BOOL *matched = calloc(oldRowCount > 0 ? oldRowCount : 1, sizeof(BOOL));
+	NSUInteger s;
+	for (s = 0; s < capacity; s++)
+	{
+		slotKeyRows[s] = -1;
+	}
+	long row;
+	for (row = 0; row < oldRowCount; row++)
+	{
+		uint64_t hash = PGSQLDiffKeyHash(&oldSource, row, keys, keyCount);
+		nextRows[row] = -1;
+		for (s = (NSUInteger)hash & (capacity - 1); slotKeyRows[s] != -1; s = (s + 1) & (capacity - 1))
+		{
+			if ((slotHashes[s] == hash) && 
+				PGSQLDiffKeysEqual(&oldSource, slotKeyRows[s], &oldSource, row, keys, keyCount))
+			{
+				break;
+			}
+		}
+		if (slotKeyRows[s] == -1)
+		{
+			slotHashes[s] = hash;
+			slotKeyRows[s] = row;
+		} else {
+			// slotNextRows holds the chain's tail while building
+			nextRows[slotNextRows[s]] = row;
+		}
+		slotNextRows[s] = row;
+	}
+	for (s = 0; s < capacity; s++)
+	{
+		slotNextRows[s] = slotKeyRows[s];
+	}
+
+	oldRowForNewRow = malloc(sizeof(long) * (newRowCount > 0 ? newRowCount : 1));
+	changeOldRows = malloc(sizeof(long) * 16);
+	changeNewRows = malloc(sizeof(long) * 16);
+	changeColumns = malloc(sizeof(uint64_t) * columnWords * 16);
+	NSUInteger changeCapacity = 16;
+	uint64_t *columnsChanged = calloc(columnWords > 0 ? columnWords : 1, sizeof(uint64_t));
+
+	NSMutableIndexSet *inserted = [NSMutableIndexSet indexSet];
+	NSMutableIndexSet *changed = [NSMutableIndexSet indexSet];
+	for (row = 0; row < newRowCount; row++)
+	{
+		uint64_t hash = PGSQLDiffKeyHash(&newSource, row, keys, keyCount);
+		long match = -1;
+		for (s = (NSUInteger)hash & (capacity - 1); slotKeyRows[s] != -1; s = (s + 1) & (capacity - 1))
+		{
+			if ((slotHashes[s] == hash) && 
+				PGSQLDiffKeysEqual(&oldSource, slotKeyRows[s], &newSource, row, keys, keyCount))
+			{
+				// the key's next unmatched row, -1 once all are taken
+				match = slotNextRows[s];
+				if (match != -1)
+				{
+					slotNextRows[s] = nextRows[match];
+				}
+				break;
+			}
+		}
+
+		oldRowForNewRow[row] = match;
+		if (match == -1)
+		{
+			[inserted addIndex:row];
+			continue;
+		}
+		matched[match] = YES;
+
+		BOOL differs = NO;
+		memset(columnsChanged, 0, sizeof(uint64_t) * columnWords);
+		for (c = 0; c < columnCount; c++)
+		{
+			if (!PGSQLDiffValuesEqual(&oldSource, match, &newSource, row, c))
+			{
+				columnsChanged[c / 64] |= (1ULL << (c % 64));
+				differs = YES;
+			}
+		}
+		if (!differs)
+		{
+			continue;
+		}
+
+		if (changeCount == changeCapacity)
+		{
+			changeCapacity *= 2;
+			changeOldRows = realloc(changeOldRows, sizeof(long) * changeCapacity);
+			changeNewRows = realloc(changeNewRows, sizeof(long) * changeCapacity);
+			changeColumns = realloc(changeColumns, sizeof(uint64_t) * columnWords * changeCapacity);
+		}
+		changeOldRows[changeCount] = match;
+		changeNewRows[changeCount] = row;
+		memcpy(changeColumns + (changeCount * columnWords), columnsChanged, sizeof(uint64_t) * columnWords);
+		changeCount++;
+		[changed addIndex:row];
+	}
+
+	NSMutableIndexSet *deleted = [NSMutableIndexSet indexSet];
+	for (row = 0; row < oldRowCount; row++)
+	{
+		if (!matched[row])
+		{
+			[deleted addIndex:row];
+		}
+	}
+
+	free(slotHashes);
+	free(slotKeyRows);
+	free(slotNextRows);
+	free(nextRows);
+	free(matched);
+	free(columnsChanged);
+
+	insertedRows = [inserted copy];
+	deletedRows = [deleted copy];
+	changedRows = [changed copy];
+	return self;
+}
+
+-(void)dealloc
+{
+	[insertedRows release];
+	[deletedRows release];
+	[changedRows release];
+	free(oldRowForNewRow);
+	free(changeOldRows);
+	free(changeNewRows);
+	free(changeColumns);
+	[super dealloc];
+}
+
+-(BOOL)hasChanges
+{
+	return (([insertedRows count] > 0) || ([deletedRows count] > 0) || (changeCount > 0));
+}
+
+-(long)oldRowForNewRow:(long)newRow
+{
+	if ((newRow < 0) || (newRow >= newRowCount))
+	{
+		return -1;
+	}
+	return oldRowForNewRow[newRow];
+}
+
+-(long)oldRowOfChangeAtIndex:(NSUInteger)changeIndex
+{
+	return (changeIndex < changeCount) ? changeOldRows[changeIndex] : -1;
+}
+
+-(long)newRowOfChangeAtIndex:(NSUInteger)changeIndex
+{
+	return (changeIndex < changeCount) ? changeNewRows[changeIndex] : -1;
+}
+
+-(BOOL)changeAtIndex:(NSUInteger)changeIndex changedColumn:(int)column
+{
+	if ((changeIndex >= changeCount) || (column < 0) || (column >= columnCount))
+	{
+		return NO;
+	}
+	return ((changeColumns[(changeIndex * columnWords) + (column / 64)] & (1ULL << (column % 64))) != 0);
+}
+
+-(NSIndexSet *)changedColumnsOfChangeAtIndex:(NSUInteger)changeIndex
+{
+	NSMutableIndexSet *result = [NSMutableIndexSet indexSet];
+	int c;
+	for (c = 0; c < columnCount; c++)
+	{
+		if ([self changeAtIndex:changeIndex changedColumn:c])
+		{
+			[result addIndex:c];
+		}
+	}
+	return result;
+}
+
+-(NSString *)description
+{
+	return [NSString stringWithFormat:@"%lu inserted, %lu deleted, %lu changed",
+			(unsigned long)[insertedRows count], (unsigned long)[deletedRows count], (unsigned long)changeCount];
+}
+
+#pragma mark -
+#pragma mark Simple Accessors
+
+-(NSIndexSet *)insertedRows
+{
+	return insertedRows;
+}
+
+-(NSIndexSet *)deletedRows
+{
+	return deletedRows;
+}
+
+-(NSIndexSet *)changedRows
+{
+	return changedRows;
+}
+
+-(NSUInteger)changeCount
+{
+	return changeCount;
+}
+
+@end
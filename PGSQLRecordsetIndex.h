@@ -0,0 +1,140 @@
+//
+//  PGSQLRecordsetIndex.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLRecordsetIndex
+    @abstract   Find rows of an open recordset by value.
+    @discussion An index is built once over one or more columns of a
+				recordset and then answers lookups without walking it: a
+				hash index finds the rows with a given key in constant time,
+				a sorted index in logarithmic time, and a sorted index also
+				answers range queries, returning the rows in key order.
+				Client side joins become a lookup per row instead of a scan.
+
+				Keys are compared either on the bytes the server sent, which
+				is the fastest and right for equality on any type, or on
+				values decoded by type: integer types as 64 bit integers and
+				float4, float8 and numeric as doubles, so 9 sorts before 10.
+				Other types compare bytewise in both modes.  NULLs are equal
+				to each other and sort last.
+
+				The index reads values in place and keeps the recordset.
+				Build it after any call to -[PGSQLRecordset compact], which
+				moves the values.  A built index never changes and can be
+				read from several threads.
+*/
+
+#import <Foundation/Foundation.h>
+
+@class PGSQLRecordset;
+@class PGSQLRecord;
+
+enum {
+	PGSQLIndexCompareBytes = 0,
+	PGSQLIndexCompareTyped = 1
+};
+
+/*!
+    @class
+    @abstract    A hash or sorted index over recordset columns.
+*/
+@interface PGSQLRecordsetIndex : NSObject {
+	PGSQLRecordset *recordset;
+	NSArray *columnNames;
+	int keyCount;
+	int *keyColumns;
+	int *keyKinds;				// how each key column is compared
+	int comparison;
+	BOOL isSorted;
+
+	long rows;
+	void *keys;					// rows * keyCount decoded keys
+	long *order;				// sorted index: rows in key order
+	uint64_t *slotHashes;		// hash index: open addressing table
+	long *slotRows;
+	NSUInteger slotCount;
+}
+
+/*!
+    @method
+    @abstract   A hash index, for equality lookups.
+    @result     nil if a column is not in the recordset.
+*/
++(PGSQLRecordsetIndex *)hashIndexOnRecordset:(PGSQLRecordset *)rs columns:(NSArray *)names
+								  comparison:(int)comparisonMode;
+/*!
+    @method
+    @abstract   A sorted index, for equality and range lookups.
+    @result     nil if a column is not in the recordset.
+*/
++(PGSQLRecordsetIndex *)sortedIndexOnRecordset:(PGSQLRecordset *)rs columns:(NSArray *)names
+									comparison:(int)comparisonMode;
+
+-(id)initWithRecordset:(PGSQLRecordset *)rs columns:(NSArray *)names
+			comparison:(int)comparisonMode sorted:(BOOL)sorted;
+
+-(PGSQLRecordset *)recordset;
+-(NSArray *)columnNames;
+-(BOOL)isSorted;
+
+#pragma mark -
+#pragma mark Lookup
+
+/*!
+    @method
+    @abstract   The first row whose key equals values, -1 if there is none.
+    @discussion values holds one value per index column.  NSNull matches
+				NULL, NSData is compared as bytes, NSNumber as a number in
+				typed comparison, and anything else as the text of its
+				description.
+*/
+-(long)rowForValues:(NSArray *)values;
+/*!
+    @method
+    @abstract   Every row whose key equals values.
+*/
+-(NSIndexSet *)rowsForValues:(NSArray *)values;
+/*!
+    @method
+    @abstract   Move the recordset to the first row whose key equals values.
+    @result     The record, or nil if there is no such row.  The cursor does
+				not move when nothing matches.
+*/
+-(PGSQLRecord *)moveToValues:(NSArray *)values;
+
+#pragma mark -
+#pragma mark Sorted Indexes
+
+/*!
+    @method
+    @abstract   Rows in key order, position 0 holding the smallest key.
+*/
+-(NSUInteger)count;
+-(long)rowAtPosition:(NSUInteger)position;
+
+/*!
+    @method
+    @abstract   The positions of the keys from low to high, both included.
+    @discussion nil for low starts at the first key, nil for high runs to
+				the last.  A shorter array than the index has columns
+				compares only the leading columns, so a prefix selects every
+				key that starts with it.  Raises NSInternalInconsistencyException
+				on a hash index.
+*/
+-(NSRange)positionsFromValues:(NSArray *)low toValues:(NSArray *)high;
+/*!
+    @method
+    @abstract   The row numbers from low to high, in key order.
+*/
+-(NSArray *)rowsFromValues:(NSArray *)low toValues:(NSArray *)high;
+/*!
+    @method
+    @abstract   The records from low to high, in key order.
+*/
+-(NSArray *)recordsFromValues:(NSArray *)low toValues:(NSArray *)high;
+
+@end
@@ -0,0 +1,652 @@
+//
+//  PGSQLRecordsetIndex.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLRecordsetIndex.h"
+#import "PGSQLRecordset.h"
+#import "PGSQLColumn.h"
+#import "PGSQLCatalog.h"
+#import <stdlib.h>
+#import <string.h>
+
+enum {
+	PGSQLKeyBytes = 0,
+	PGSQLKeyInteger,
+	PGSQLKeyReal
+};
+
+// One decoded key value.  bytes points into the recordset's storage.
+typedef struct {
+	const char *bytes;
+	int64_t integer;
+	double real;
+	int length;
+	int isNull;
+} PGSQLIndexKey;
+
+static uint64_t
+PGSQLIndexBigEndian(const char *bytes, int length)
+{
+	uint64_t value = 0;
+	int i;
+	for (i = 0; i < length; i++)
+	{
+		value = (value << 8) | (unsigned char)bytes[i];
+	}
+	return value;
+}
+
+// The column's type, or for a domain the type it is over.
+static unsigned int
+PGSQLIndexTypeOfColumn(PGSQLColumn *column)
+{
+	PGSQLType *info = [column typeInfo];
+	if ((info != nil) && [info isDomain])
+	{
+		return [info baseOID];
+	}
+	return (unsigned int)[column type];
+}
+
+// The key kind for a column under typed comparison.
+static int
+PGSQLIndexKindOfColumn(PGSQLColumn *column)
+{
+	switch (PGSQLIndexTypeOfColumn(column))
+	{
+		case 16:	// bool
+		case 20:	// int8
+		case 21:	// int2
+		case 23:	// int4
+		case 26:	// oid
+			return PGSQLKeyInteger;
+		case 700:	// float4
+		case 701:	// float8
+			return PGSQLKeyReal;
+		case 1700:	// numeric, its binary form is not a double
+			return ([column format] == 0) ? PGSQLKeyReal : PGSQLKeyBytes;
+		default:
+			return PGSQLKeyBytes;
+	}
+}
+
+static void
+PGSQLIndexDecode(PGSQLIndexKey *key, int kind, unsigned int oid, int format, const char *value, int length)
+{
+	key->bytes = value;
+	key->length = length;
+	key->isNull = (value == NULL);
+	key->integer = 0;
+	key->real = 0;
+	if ((value == NULL) || (kind == PGSQLKeyBytes))
+	{
+		return;
+	}
+
+	if (format == 0)
+	{
+		if (oid == 16)
+		{
+			key->integer = (value[0] == 't');
+		} else if (kind == PGSQLKeyInteger) {
+			key->integer = strtoll(value, NULL, 10);
+		} else {
+			key->real = strtod(value, NULL);
+		}
+		return;
+	}
+
+	uint64_t bits = PGSQLIndexBigEndian(value, length);
+	if (kind == PGSQLKeyInteger)
+	{
+		switch (length)
+		{
+			case 1:		key->integer = (value[0] != 0); break;
+			case 2:		key->integer = (int16_t)bits; break;
+			case 4:		key->integer = (oid == 26) ? (int64_t)(uint32_t)bits : (int64_t)(int32_t)bits; break;
+			default:	key->integer = (int64_t)bits; break;
+		}
+	} else if (length == 4) {
+		uint32_t narrow = (uint32_t)bits;
+		float f;
+		memcpy(&f, &narrow, sizeof(f));
+		key->real = f;
+	} else {
+		double d;
+		memcpy(&d, &bits, sizeof(d));
+		key->real = d;
+	}
+}
+
+static int
+PGSQLIndexCompareKeys(const PGSQLIndexKey *a, const PGSQLIndexKey *b, int kind)
+{
+	if (a->isNull || b->isNull)
+	{
+		// NULLs last
+		return (a->isNull == b->isNull) ? 0 : (a->isNull ? 1 : -1);
+	}
+	switch (kind)
+	{
+		case PGSQLKeyInteger:
+			return (a->integer < b->integer) ? -1 : ((a->integer > b->integer) ? 1 : 0);
+		case PGSQLKeyReal:
+			return (a->real < b->real) ? -1 : ((a->real > b->real) ? 1 : 0);
+		default:
+		{
+			int shorter = (a->length < b->length) ? a->length : b->length;
+			int result = memcmp(a->bytes, b->bytes, shorter);
+			if (result != 0)
+			{
+				return (result < 0) ? -1 : 1;
+			}
+			return (a->length < b->length) ? -1 : ((a->length > b->length) ? 1 : 0);
+		}
+	}
+}
+
+static uint64_t
+PGSQLIndexMix(uint64_t hash, const void *bytes, size_t length)
+{
+	const unsigned char *p = bytes;
+	size_t i;
+	for (i = 0; i < length; i++)
+	{
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static uint64_t
+PGSQLIndexHash(const PGSQLIndexKey *keys, const int *kinds, int count)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	int k;
+	for (k = 0; k < count; k++)
+	{
+		const PGSQLIndexKey *key = &keys[k];
+		if (key->isNull)
+		{
+			hash = PGSQLIndexMix(hash, "\xff", 1);
+		} else if (kinds[k] == PGSQLKeyInteger) {
+			hash = PGSQLIndexMix(hash, &key->integer, sizeof(key->integer));
+		} else if (kinds[k] == PGSQLKeyReal) {
+			double real = (key->real == 0) ? 0 : key->real;	// -0.0 equals 0.0
+			hash = PGSQLIndexMix(hash, &real, sizeof(real));
+		} else {
+			hash = PGSQLIndexMix(hash, key->bytes, key->length);
+			hash = PGSQLIndexMix(hash, &key->length, sizeof(key->length));
+		}
+	}
+	return hash;
+}
+
+@interface PGSQLRecordsetIndex (Private)
+
+-(const PGSQLIndexKey *)keysOfRow:(long)row;
+-(int)compareRow:(long)row withKeys:(const PGSQLIndexKey *)probe count:(int)count;
+-(BOOL)probe:(PGSQLIndexKey *)probe fromValues:(NSArray *)values;
+-(NSUInteger)lowerBound:(const PGSQLIndexKey *)probe count:(int)count;
+-(NSUInteger)upperBound:(const PGSQLIndexKey *)probe count:(int)count;
+-(void)sortRows;
+
+@end
+
+@implementation PGSQLRecordsetIndex
+
++(PGSQLRecordsetIndex *)hashIndexOnRecordset:(PGSQLRecordset *)rs columns:(NSArray *)names
+								  comparison:(int)comparisonMode
+{
+	return [[[PGSQLRecordsetIndex alloc] initWithRecordset:rs columns:names
+												comparison:comparisonMode sorted:NO] autorelease];
+}
+
++(PGSQLRecordsetIndex *)sortedIndexOnRecordset:(PGSQLRecordset *)rs columns:(NSArray *)names
+									comparison:(int)comparisonMode
+{
+	return [[[PGSQLRecordsetIndex alloc] initWithRecordset:rs columns:names
+												comparison:comparisonMode sorted:YES] autorelease];
+}
+
+-(id)initWithRecordset:(PGSQLRecordset *)rs columns:(NSArray *)names
+			comparison:(int)comparisonMode sorted:(BOOL)sorted
+{
+	self = [super init];
+
+	if (self == nil)
+	{
+		return nil;
+	}
+
+	recordset = [rs retain];
+	columnNames = [names copy];
+	comparison = comparisonMode;
+	isSorted = sorted;
+	keyCount = (int)[names count];
+	if (keyCount == 0)
+	{
+		[self release];
+		return nil;
+	}
+	keyColumns = malloc(sizeof(int) * keyCount);
+	keyKinds = malloc(sizeof(int) * keyCount);
+	unsigned int oids[keyCount];
+	int formats[keyCount];
+
+	NSArray *columns = [rs columns];
+	int k;
+	for (k = 0; k < keyCount; k++)
+	{
+		keyColumns[k] = -1;
+		NSUInteger c;
+		for (c = 0; c < [columns count]; c++)
+		{
+			PGSQLColumn *column = [columns objectAtIndex:c];
+			if ([[column name] isEqualToString:[names objectAtIndex:k]])
+			{
+				keyColumns[k] = (int)c;
+				keyKinds[k] = (comparison == PGSQLIndexCompareTyped) ? PGSQLIndexKindOfColumn(column) : PGSQLKeyBytes;
+				oids[k] = PGSQLIndexTypeOfColumn(column);
+				formats[k] = [column format];
+				break;
+			}
+		}
+		if (keyColumns[k] == -1)
+		{
+			[self release];
+			return nil;
+		}
+	}
+
+	rows = [rs recordCount];
+	PGSQLIndexKey *decoded = malloc(sizeof(PGSQLIndexKey) * keyCount * (rows > 0 ? rows : 1));
+	keys = decoded;
+	long row;
+	for (row = 0; row < rows; row++)
+	{
+		for (k = 0; k < keyCount; k++)
+		{
+			int length = 0;
+			const char *value = [rs valueAtRow:row column:keyColumns[k] length:&length];
+			PGSQLIndexDecode(&decoded[(row * keyCount) + k], keyKinds[k], oids[k], formats[k], value, length);
+		}
+	}
+
+	if (isSorted)
+	{
+		[self sortRows];
+	} else {
+		// open addressing at half load or less
+		slotCount = 16;
+		while (slotCount < (NSUInteger)rows * 2)
+		{
+			slotCount <<= 1;
+		}
+		slotHashes = malloc(sizeof(uint64_t) * slotCount);
+		slotRows = malloc(sizeof(long) * slotCount);
+		NSUInteger s;
+		for (s = 0; s < slotCount; s++)
+		{
+			slotRows[s] = -1;
+		}
+		for (row = 0; row < rows; row++)
+		{
+			uint64_t hash = PGSQLIndexHash(&decoded[row * keyCount], keyKinds, keyCount);
+			s = (NSUInteger)hash & (slotCount - 1);
+			while (slotRows[s] != -1)
+			{
+				s = (s + 1) & (slotCount - 1);
+			}
+			slotHashes[s] = hash;
+			slotRows[s] = row;
+		}
+	}
+	return self;
+}
+
+-(void)dealloc
+{
+	[recordset release];
+	[columnNames release];
+	free(keyColumns);
+	free(keyKinds);
+	free(keys);
+	free(order);
+	free(slotHashes);
+	free(slotRows);
+	[super dealloc];
+}
+
+#pragma mark -
+#pragma mark Lookup
+
+-(long)rowForValues:(NSArray *)values
+{
+	PGSQLIndexKey probe[keyCount];
+	if (![self probe:probe fromValues:values])
+	{
+		return -1;
+	}
+	int count = (int)[values count];
+
+	if (isSorted)
+	{
+		NSUInteger position = [self lowerBound:probe count:count];
+		if ((position < (NSUInteger)rows) && ([self compareRow:order[position] withKeys:probe count:count] == 0))
+		{
+			return order[position];
+		}
+		return -1;
+	}
+
+	if (count != keyCount)
+	{
+		return -1;
+	}
+	// the chain is in slot order, not row order, so look at all of it
+	long found = -1;
+	uint64_t hash = PGSQLIndexHash(probe, keyKinds, keyCount);
+	NSUInteger s;
+	for (s = (NSUInteger)hash & (slotCount - 1); slotRows[s] != -1; s = (s + 1) & (slotCount - 1))
+	{
+		if ((slotHashes[s] == hash) && ((found == -1) || (slotRows[s] < found)) &&
+			([self compareRow:slotRows[s] withKeys:probe count:keyCount] == 0))
+		{
+			found = slotRows[s];
+		}
+	}
+	return found;
+}
+
+-(NSIndexSet *)rowsForValues:(NSArray *)values
+{
+	NSMutableIndexSet *result = [NSMutableIndexSet indexSet];
+	PGSQLIndexKey probe[keyCount];
+	if (![self probe:probe fromValues:values])
+	{
+		return result;
+	}
+	int count = (int)[values count];
+
+	if (isSorted)
+	{
+		NSUInteger position = [self lowerBound:probe count:count];
+		NSUInteger end = [self upperBound:probe count:count];
+		for (; position < end; position++)
+		{
+			[result addIndex:order[position]];
+		}
+		return result;
+	}
+
+	if (count != keyCount)
+	{
+		return result;
+	}
+	uint64_t hash = PGSQLIndexHash(probe, keyKinds, keyCount);
+	NSUInteger s;
+	for (s = (NSUInteger)hash & (slotCount - 1); slotRows[s] != -1; s = (s + 1) & (slotCount - 1))
+	{
+		if ((slotHashes[s] == hash) && ([self compareRow:slotRows[s] withKeys:probe count:keyCount] == 0))
+		{
+			[result addIndex:slotRows[s]];
+		}
+	}
+	return result;
+}
+
+-(PGSQLRecord *)moveToValues:(NSArray *)values
+{
+	long row = [self rowForValues:values];
+	return (row >= 0) ? [recordset moveToRow:row] : nil;
+}
+
+#pragma mark -
+#pragma mark Sorted Indexes
+
+-(NSUInteger)count
+{
+	return (NSUInteger)rows;
+}
+
+-(long)rowAtPosition:(NSUInteger)position
+{
+	if (!isSorted || (position >= (NSUInteger)rows))
+	{
+		return -1;
+	}
+	return order[position];
+}
+
+-(NSRange)positionsFromValues:(NSArray *)low toValues:(NSArray *)high
+{
+	if (!isSorted)
+	{
+		[NSException raise:NSInternalInconsistencyException format:@"Range lookups need a sorted index."];
+	}
+
+	PGSQLIndexKey lowProbe[keyCount];
+	PGSQLIndexKey highProbe[keyCount];
+	NSUInteger start = 0;
+	NSUInteger end = (NSUInteger)rows;
+	if (low != nil)
+	{
+		if (![self probe:lowProbe fromValues:low])
+		{
+			return NSMakeRange(0, 0);
+		}
+		start = [self lowerBound:lowProbe count:(int)[low count]];
+	}
+	if (high != nil)
+	{
+		if (![self probe:highProbe fromValues:high])
+		{
+			return NSMakeRange(0, 0);
+		}
+		end = [self upperBound:highProbe count:(int)[high count]];
+	}
+	return (end > start) ? NSMakeRange(start, end - start) : NSMakeRange(start, 0);
+}
+
+-(NSArray *)rowsFromValues:(NSArray *)low toValues:(NSArray *)high
+{
+	NSRange range = [self positionsFromValues:low toValues:high];
+	NSMutableArray *result = [NSMutableArray arrayWithCapacity:range.length];
+	NSUInteger position;
+	for (position = range.location; position < NSMaxRange(range); position++)
+	{
+		[result addObject:[NSNumber numberWithLong:order[position]]];
+	}
+	return result;
+}
+
+-(NSArray *)recordsFromValues:(NSArray *)low toValues:(NSArray *)high
+{
+	NSRange range = [self positionsFromValues:low toValues:high];
+	NSMutableArray *result = [NSMutableArray arrayWithCapacity:range.length];
+	NSUInteger position;
+	for (position = range.location; position < NSMaxRange(range); position++)
+	{
+		[result addObject:[recordset recordAtIndex:order[position]]];
+	}
+	return result;
+}
+
+#pragma mark -
+#pragma mark Simple Accessors
+
+-(PGSQLRecordset *)recordset
+{
+	return recordset;
+}
+
+-(NSArray *)columnNames
+{
+	return columnNames;
+}
+
+-(BOOL)isSorted
+{
+	return isSorted;
+}
+
+@end
+
+@implementation PGSQLRecordsetIndex (Private)
+
+-(const PGSQLIndexKey *)keysOfRow:(long)row
+{
+	return &((PGSQLIndexKey *)keys)[row * keyCount];
+}
+
+-(int)compareRow:(long)row withKeys:(const PGSQLIndexKey *)probe count:(int)count
+{
+	const PGSQLIndexKey *rowKeys = [self keysOfRow:row];
+	int k;
+	for (k = 0; k < count; k++)
+	{
+		int result = PGSQLIndexCompareKeys(&rowKeys[k], &probe[k], keyKinds[k]);
+		if (result != 0)
+		{
+			return result;
+		}
+	}
+	return 0;
+}
+
+// Decodes lookup values as the index's keys.  The bytes of text values
+// live in the autorelease pool, so a probe is only good in the calling
+// method.
+-(BOOL)probe:(PGSQLIndexKey *)probe fromValues:(NSArray *)values
+{
+	if (([values count] == 0) || ([values count] > (NSUInteger)keyCount))
+	{
+		return NO;
+	}
+
+	NSStringEncoding encoding = [recordset defaultEncoding];
+	NSUInteger k;
+	for (k = 0; k < [values count]; k++)
+	{
+		id value = [values objectAtIndex:k];
+		PGSQLIndexKey *key = &probe[k];
+		memset(key, 0, sizeof(PGSQLIndexKey));
+
+		if (value == [NSNull null])
+		{
+			key->isNull = 1;
+		} else if (keyKinds[k] == PGSQLKeyInteger) {
+			if ([value isKindOfClass:[NSNumber class]])
+			{
+				key->integer = [value longLongValue];
+			} else {
+				NSString *text = [value description];
+				key->integer = ([text isEqualToString:@"t"] || [text isEqualToString:@"true"]) ? 1 : [text longLongValue];
+			}
+		} else if (keyKinds[k] == PGSQLKeyReal) {
+			key->real = [value isKindOfClass:[NSNumber class]] ? [value doubleValue] : [[value description] doubleValue];
+		} else if ([value isKindOfClass:[NSData class]]) {
+			key->bytes = [value bytes];
+			key->length = (int)[value length];
+		} else {
+			const char *text = [[value description] cStringUsingEncoding:encoding];
+			if (text == NULL)
+			{
+				return NO;
+			}
+			key->bytes = text;
+			key->length = (int)strlen(text);
+		}
+	}
+	return YES;
+}
+
+// The first position whose key is not below probe.
+-(NSUInteger)lowerBound:(const PGSQLIndexKey *)probe count:(int)count
+{
+	NSUInteger low = 0;
+	NSUInteger high = (NSUInteger)rows;
+	while (low < high)
+	{
+		NSUInteger middle = low + ((high - low) / 2);
+		if ([self compareRow:order[middle] withKeys:probe count:count] < 0)
+		{
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+// The first position whose key is above probe.
+-(NSUInteger)upperBound:(const PGSQLIndexKey *)probe count:(int)count
+{
+	NSUInteger low = 0;
+	NSUInteger high = (NSUInteger)rows;
+	while (low < high)
+	{
+		NSUInteger middle = low + ((high - low) / 2);
+		if ([self compareRow:order[middle] withKeys:probe count:count] <= 0)
+		{
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+// A bottom up merge sort, stable so equal keys keep their row order.
+-(void)sortRows
+{
+	order = malloc(sizeof(long) * (rows > 0 ? rows : 1));
+	long *scratch = malloc(sizeof(long) * (rows > 0 ? rows : 1));
+	long i;
+	for (i = 0; i < rows; i++)
+	{
+		order[i] = i;
+	}
+
+	long *from = order;
+	long *to = scratch;
+	long width;
+	for (width = 1; width < rows; width *= 2)
+	{
+		long start;
+		for (start = 0; start < rows; start += 2 * width)
+		{
+			long middle = MIN(start + width, rows);
+			long end = MIN(start + (2 * width), rows);
+			long left = start;
+			long right = middle;
+			long out = start;
+			while ((left < middle) && (right < end))
+			{
+				if ([self compareRow:from[right] withKeys:[self keysOfRow:from[left]] count:keyCount] < 0)
+				{
+					to[out++] = from[right++];
+				} else {
+					to[out++] = from[left++];
+				}
+			}
+			while (left < middle) { to[out++] = from[left++]; }
+			while (right < end) { to[out++] = from[right++]; }
+		}
+		long *swap = from;
+		from = to;
+		to = swap;
+	}
+
+	if (from != order)
+	{
+		memcpy(order, from, sizeof(long) * rows);
+	}
+	free(scratch);
+}
+
+@end
@@ -0,0 +1,157 @@
+//
+//  PGSQLRecordsetWriter.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLRecordsetWriter
+    @abstract   Serialize a recordset to CSV or NDJSON in one pass.
+    @discussion A writer turns the rows of a recordset into bytes straight
+				from the values the server sent, without a record, field,
+				string or dictionary per cell, into a growing memory buffer
+				or a file descriptor such as a socket.
+
+				CSV follows RFC 4180: fields holding the delimiter, a quote,
+				CR or LF are quoted and their quotes doubled, rows end in
+				CRLF, and an optional header row names the columns.  A NULL
+				is an empty field and an empty string is "", as COPY writes
+				them.  Values keep the recordset's encoding.
+
+				NDJSON writes one JSON object per row and a newline.  The
+				column's type, or for a domain its base type, picks the JSON
+				type: integer types are numbers, float4, float8 and numeric
+				are numbers unless they are NaN or infinite, bool is true or
+				false, json and jsonb are written as they are, NULL is null
+				and everything else, arrays included, is a string.  Output is
+				UTF-8 whatever the recordset's encoding.
+
+				Values are scanned for the bytes that need quoting or
+				escaping eight at a time, and copied in runs between them.
+				Binary format values of the common types are formatted as
+				their text form; others go through -[PGSQLField asString].
+
+				A writer is not thread safe.  Reuse one with -reset to keep
+				its buffer.
+*/
+
+#import <Foundation/Foundation.h>
+
+@class PGSQLRecordset;
+
+enum {
+	PGSQLWriterFormatCSV = 0,
+	PGSQLWriterFormatNDJSON = 1
+};
+
+/*!
+    @class
+    @abstract    Streams recordsets to CSV or NDJSON.
+*/
+@interface PGSQLRecordsetWriter : NSObject {
+	int format;
+	void *output;				// the buffer and where it drains to
+	BOOL writesHeader;
+	BOOL wroteHeader;
+	char delimiter;
+	BOOL usesCRLF;
+}
+
+/*!
+    @method
+    @abstract   A recordset as CSV with a header row.
+*/
++(NSData *)CSVDataFromRecordset:(PGSQLRecordset *)rs;
+/*!
+    @method
+    @abstract   A recordset as NDJSON.
+*/
++(NSData *)NDJSONDataFromRecordset:(PGSQLRecordset *)rs;
+
+/*!
+    @method
+    @abstract   A writer that collects its output in memory, read with -data.
+*/
+-(id)initWithFormat:(int)outputFormat;
+/*!
+    @method
+    @abstract   A writer that writes its output to fd as the buffer fills.
+    @discussion The descriptor is not closed by the writer.  A non blocking
+				descriptor is waited on when it would block.
+*/
+-(id)initWithFormat:(int)outputFormat fileDescriptor:(int)fd;
+
+-(int)format;
+
+/*!
+    @method
+    @abstract   Write every row of a recordset.
+    @discussion A file descriptor writer has handed all of it to write()
+				when this returns.  The recordset's cursor does not move.
+    @result     NO if writing to the descriptor failed, see -lastError.
+*/
+-(BOOL)writeRecordset:(PGSQLRecordset *)rs;
+/*!
+    @method
+    @abstract   Write some rows of a recordset.
+    @discussion Rows past the end of the recordset are ignored, so a result
+				fetched in batches can be written batch by batch.  The CSV
+				header is written only before the first rows.
+*/
+-(BOOL)writeRecordset:(PGSQLRecordset *)rs rows:(NSRange)rows;
+
+/*!
+    @method
+    @abstract   Write out the buffer.  Does nothing for a memory writer.
+*/
+-(BOOL)flush;
+
+/*!
+    @method
+    @abstract   The buffered output, a copy.
+    @discussion For a file descriptor writer only what has not been written
+				out yet, which after a write is nothing.
+*/
+-(NSData *)data;
+-(const char *)bytes;
+-(NSUInteger)length;
+/*!
+    @method
+    @abstract   Every byte produced since the writer was made or reset.
+*/
+-(unsigned long long)totalLength;
+
+/*!
+    @method
+    @abstract   Empty the buffer and clear any error, keeping its memory.
+    @discussion The next CSV write starts with a header again.
+*/
+-(void)reset;
+
+/*!
+    @method
+    @abstract   Why the last write failed, or nil.
+*/
+-(NSString *)lastError;
+
+/*!
+    @method
+    @abstract   Whether CSV starts with a row of column names.  YES unless set.
+*/
+-(BOOL)writesHeader;
+-(void)setWritesHeader:(BOOL)value;
+/*!
+    @method
+    @abstract   The CSV field delimiter, a comma unless set.
+*/
+-(char)delimiter;
+-(void)setDelimiter:(char)value;
+/*!
+    @method
+    @abstract   Whether CSV rows end in CRLF, as RFC 4180 has them, or LF.
+*/
+-(BOOL)usesCRLF;
+-(void)setUsesCRLF:(BOOL)value;
+
+@end
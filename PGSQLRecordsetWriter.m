@@ -0,0 +1,848 @@
+//
+//  PGSQLRecordsetWriter.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLRecordsetWriter.h"
+#import "PGSQLRecordset.h"
+#import "PGSQLRecord.h"
+#import "PGSQLField.h"
+#import "PGSQLColumn.h"
+#import "PGSQLCatalog.h"
+#import <errno.h>
+#import <math.h>
+#import <poll.h>
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+#import <unistd.h>
+
+#define PGSQLWriterBufferSize	65536
+
+typedef const char *(*PGSQLValueAccessor)(id, SEL, long, long, int *);
+
+// The output buffer.  With a descriptor it drains to it when full.
+typedef struct {
+	char *bytes;
+	size_t length;
+	size_t capacity;
+	int fd;
+	int error;
+	unsigned long long total;
+
+	char *scratch;				// text forms of binary values
+	size_t scratchCapacity;
+	char number[48];
+} PGSQLWriterOutput;
+
+enum {
+	PGSQLJSONString = 0,
+	PGSQLJSONInteger,
+	PGSQLJSONReal,
+	PGSQLJSONBool,
+	PGSQLJSONRaw
+};
+
+// What a column is written as, worked out once per recordset.
+typedef struct {
+	unsigned int oid;
+	int format;
+	int kind;
+	char *key;					// NDJSON: the quoted name and a colon
+	size_t keyLength;
+} PGSQLWriterColumn;
+
+#pragma mark -
+#pragma mark Output
+
+static BOOL
+PGSQLWriterWriteAll(PGSQLWriterOutput *out, const char *bytes, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t written = write(out->fd, bytes, length);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+			{
+				struct pollfd wait = { out->fd, POLLOUT, 0 };
+				poll(&wait, 1, -1);
+				continue;
+			}
+			out->error = errno;
+			return NO;
+		}
+		bytes += written;
+		length -= (size_t)written;
+	}
+	return YES;
+}
+
+static BOOL
+PGSQLWriterFlush(PGSQLWriterOutput *out)
+{
+	if ((out->fd < 0) || (out->error != 0))
+	{
+		return (out->error == 0);
+	}
+	BOOL written = PGSQLWriterWriteAll(out, out->bytes, out->length);
+	out->length = 0;
+	return written;
+}
+
+static void
+PGSQLWriterAppend(PGSQLWriterOutput *out, const char *bytes, size_t length)
+{
+	if ((length == 0) || (out->error != 0))
+	{
+		return;
+	}
+	out->total += length;
+	if (out->length + length > out->capacity)
+	{
+		if (out->fd >= 0)
+		{
+			if (!PGSQLWriterFlush(out))
+			{
+				return;
+			}
+			if (length >= out->capacity)
+			{
+				// too big to be worth copying
+				PGSQLWriterWriteAll(out, bytes, length);
+				return;
+			}
+		} else {
+			size_t capacity = out->capacity;
+			while (capacity < out->length + length)
+			{
+				capacity *= 2;
+			}
+			char *grown = realloc(out->bytes, capacity);
+			if (grown == NULL)
+			{
+				out->error = ENOMEM;
+				return;
+			}
+			out->bytes = grown;
+			out->capacity = capacity;
+		}
+	}
+	memcpy(out->bytes + out->length, bytes, length);
+	out->length += length;
+}
+
+static inline void
+PGSQLWriterPut(PGSQLWriterOutput *out, char c)
+{
+	if ((out->length < out->capacity) && (out->error == 0))
+	{
+		out->bytes[out->length++] = c;
+		out->total++;
+		return;
+	}
+	PGSQLWriterAppend(out, &c, 1);
+}
+
+static char *
+PGSQLWriterScratch(PGSQLWriterOutput *out, size_t length)
+{
+	if (length > out->scratchCapacity)
+	{
+		size_t capacity = (out->scratchCapacity > 0) ? out->scratchCapacity : 256;
+		while (capacity < length)
+		{
+			capacity *= 2;
+		}
+		free(out->scratch);
+		out->scratch = malloc(capacity);
+		out->scratchCapacity = (out->scratch != NULL) ? capacity : 0;
+	}
+	return out->scratch;
+}
+
+#pragma mark -
+#pragma mark Scanning
+
+// Eight bytes at a time: a word has a byte equal to c when
+// PGSQLWordHasZero(word ^ (PGSQLLowBytes * c)) is not zero, and a byte
+// below n (n at most 128) when PGSQLWordHasLess(word, n) is not zero.
+#define PGSQLLowBytes	0x0101010101010101ULL
+#define PGSQLHighBits	0x8080808080808080ULL
+
+static inline uint64_t
+PGSQLWordHasZero(uint64_t word)
+{
+	return (word - PGSQLLowBytes) & ~word & PGSQLHighBits;
+}
+
+static inline uint64_t
+PGSQLWordHasLess(uint64_t word, unsigned char n)
+{
+	return (word - (PGSQLLowBytes * n)) & ~word & PGSQLHighBits;
+}
+
+// The first delimiter, quote, CR or LF, or end.
+static const char *
+PGSQLScanCSV(const char *p, const char *end, char delimiter)
+{
+	uint64_t delimiters = PGSQLLowBytes * (unsigned char)delimiter;
+	uint64_t quotes = PGSQLLowBytes * (unsigned char)'"';
+	uint64_t newlines = PGSQLLowBytes * (unsigned char)'\n';
+	uint64_t returns = PGSQLLowBytes * (unsigned char)'\r';
+	while (end - p >= 8)
+	{
+		uint64_t word;
+		memcpy(&word, p, sizeof(word));
+		if (PGSQLWordHasZero(word ^ delimiters) | PGSQLWordHasZero(word ^ quotes) |
+			PGSQLWordHasZero(word ^ newlines) | PGSQLWordHasZero(word ^ returns))
+		{
+			break;
+		}
+		p += 8;
+	}
+	for (; p < end; p++)
+	{
+		char c = *p;
+		if ((c == delimiter) || (c == '"') || (c == '\n') || (c == '\r'))
+		{
+			return p;
+		}
+	}
+	return end;
+}
+
+// The first quote, backslash or control character, or end.
+static const char *
+PGSQLScanJSON(const char *p, const char *end)
+{
+	uint64_t quotes = PGSQLLowBytes * (unsigned char)'"';
+	uint64_t backslashes = PGSQLLowBytes * (unsigned char)'\\';
+	while (end - p >= 8)
+	{
+		uint64_t word;
+		memcpy(&word, p, sizeof(word));
+		if (PGSQLWordHasZero(word ^ quotes) | PGSQLWordHasZero(word ^ backslashes) |
+			PGSQLWordHasLess(word, 0x20))
+		{
+			break;
+		}
+		p += 8;
+	}
+	for (; p < end; p++)
+	{
+		unsigned char c = (unsigned char)*p;
+		if ((c == '"') || (c == '\\') || (c < 0x20))
+		{
+			return p;
+		}
+	}
+	return end;
+}
+
+static void
+PGSQLWriteCSVValue(PGSQLWriterOutput *out, const char *value, size_t length, char delimiter)
+{
+	const char *end = value + length;
+	if (length == 0)
+	{
+		// told apart from NULL, which is nothing at all
+		PGSQLWriterAppend(out, "\"\"", 2);
+		return;
+	}
+	if (PGSQLScanCSV(value, end, delimiter) == end)
+	{
+		PGSQLWriterAppend(out, value, length);
+		return;
+	}
+
+	PGSQLWriterPut(out, '"');
+	const char *p = value;
+	while (p < end)
+	{
+		const char *quote = memchr(p, '"', (size_t)(end - p));
+		if (quote == NULL)
+		{
+			PGSQLWriterAppend(out, p, (size_t)(end - p));
+			break;
+		}
+		PGSQLWriterAppend(out, p, (size_t)(quote - p) + 1);
+		PGSQLWriterPut(out, '"');
+		p = quote + 1;
+	}
+	PGSQLWriterPut(out, '"');
+}
+
+static void
+PGSQLWriteJSONString(PGSQLWriterOutput *out, const char *value, size_t length)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char *end = value + length;
+	const char *p = value;
+
+	PGSQLWriterPut(out, '"');
+	while (p < end)
+	{
+		const char *special = PGSQLScanJSON(p, end);
+		PGSQLWriterAppend(out, p, (size_t)(special - p));
+		if (special == end)
+		{
+			break;
+		}
+
+		unsigned char c = (unsigned char)*special;
+		switch (c)
+		{
+			case '"':	PGSQLWriterAppend(out, "\\\"", 2); break;
+			case '\\':	PGSQLWriterAppend(out, "\\\\", 2); break;
+			case '\n':	PGSQLWriterAppend(out, "\\n", 2); break;
+			case '\r':	PGSQLWriterAppend(out, "\\r", 2); break;
+			case '\t':	PGSQLWriterAppend(out, "\\t", 2); break;
+			case '\b':	PGSQLWriterAppend(out, "\\b", 2); break;
+			case '\f':	PGSQLWriterAppend(out, "\\f", 2); break;
+			default:
+			{
+				char escaped[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+				PGSQLWriterAppend(out, escaped, sizeof(escaped));
+				break;
+			}
+		}
+		p = special + 1;
+	}
+	PGSQLWriterPut(out, '"');
+}
+
+#pragma mark -
+#pragma mark Values
+
+static unsigned int
+PGSQLWriterTypeOfColumn(PGSQLColumn *column)
+{
+	PGSQLType *info = [column typeInfo];
+	if ((info != nil) && [info isDomain])
+	{
+		return [info baseOID];
+	}
+	return (unsigned int)[column type];
+}
+
+static int
+PGSQLWriterKindOfType(unsigned int oid)
+{
+	switch (oid)
+	{
+		case 20:	// int8
+		case 21:	// int2
+		case 23:	// int4
+		case 26:	// oid
+			return PGSQLJSONInteger;
+		case 700:	// float4
+		case 701:	// float8
+		case 1700:	// numeric
+			return PGSQLJSONReal;
+		case 16:	// bool
+			return PGSQLJSONBool;
+		case 114:	// json
+		case 3802:	// jsonb
+			return PGSQLJSONRaw;
+		default:
+			return PGSQLJSONString;
+	}
+}
+
+static uint64_t
+PGSQLWriterBigEndian(const char *bytes, int length)
+{
+	uint64_t value = 0;
+	int i;
+	for (i = 0; i < length; i++)
+	{
+		value = (value << 8) | (unsigned char)bytes[i];
+	}
+	return value;
+}
+
+// A float the way the server writes one.
+static size_t
+PGSQLWriterFormatReal(char *buffer, size_t size, double value, int digits)
+{
+	if (isnan(value))
+	{
+		return (size_t)snprintf(buffer, size, "NaN");
+	}
+	if (isinf(value))
+	{
+		return (size_t)snprintf(buffer, size, (value > 0) ? "Infinity" : "-Infinity");
+	}
+	return (size_t)snprintf(buffer, size, "%.*g", digits, value);
+}
+
+// The text form of a value: the value itself when it is text already,
+// or its binary form formatted into the output's scratch space.
+static const char *
+PGSQLWriterText(PGSQLWriterOutput *out, PGSQLWriterColumn *column, PGSQLRecordset *rs,
+				long row, long columnIndex, const char *value, int length, size_t *textLength)
+{
+	if (column->format == 0)
+	{
+		*textLength = (size_t)length;
+		return value;
+	}
+
+	uint64_t bits = PGSQLWriterBigEndian(value, length);
+	switch (column->oid)
+	{
+		case 16:	// bool
+			*textLength = 1;
+			return ((length > 0) && (value[0] != 0)) ? "t" : "f";
+		case 21:	// int2
+			*textLength = (size_t)snprintf(out->number, sizeof(out->number), "%d", (int)(int16_t)bits);
+			return out->number;
+		case 23:	// int4
+			*textLength = (size_t)snprintf(out->number, sizeof(out->number), "%d", (int)(int32_t)bits);
+			return out->number;
+		case 26:	// oid
+			*textLength = (size_t)snprintf(out->number, sizeof(out->number), "%u", (unsigned int)bits);
+			return out->number;
+		case 20:	// int8
+			*textLength = (size_t)snprintf(out->number, sizeof(out->number), "%lld", (long long)(int64_t)bits);
+			return out->number;
+		case 700:	// float4
+		{
+			uint32_t narrow = (uint32_t)bits;
+			float f;
+			memcpy(&f, &narrow, sizeof(f));
+			*textLength = PGSQLWriterFormatReal(out->number, sizeof(out->number), f, 9);
+			return out->number;
+		}
+		case 701:	// float8
+		{
+			double d;
+			memcpy(&d, &bits, sizeof(d));
+			*textLength = PGSQLWriterFormatReal(out->number, sizeof(out->number), d, 17);
+			return out->number;
+		}
+		case 17:	// bytea, in the server's hex format
+		{
+			static const char hex[] = "0123456789abcdef";
+			char *text = PGSQLWriterScratch(out, 2 + ((size_t)length * 2));
+			if (text == NULL)
+			{
+				*textLength = 0;
+				return "";
+			}
+			text[0] = '\\';
+			text[1] = 'x';
+			int i;
+			for (i = 0; i < length; i++)
+			{
+				unsigned char c = (unsigned char)value[i];
+				text[2 + (i * 2)] = hex[c >> 4];
+				text[3 + (i * 2)] = hex[c & 0xf];
+			}
+			*textLength = 2 + ((size_t)length * 2);
+			return text;
+		}
+		case 3802:	// jsonb, a format version and the text
+			*textLength = (length > 0) ? (size_t)(length - 1) : 0;
+			return (length > 0) ? value + 1 : value;
+		case 18:	// char
+		case 19:	// name
+		case 25:	// text
+		case 114:	// json
+		case 142:	// xml
+		case 705:	// unknown
+		case 1042:	// bpchar
+		case 1043:	// varchar
+			*textLength = (size_t)length;
+			return value;
+		default:
+		{
+			NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+			NSStringEncoding encoding = [rs defaultEncoding];
+			NSString *string = [[[rs recordAtIndex:row] fieldByIndex:columnIndex] asString];
+			NSData *bytes = [string dataUsingEncoding:encoding allowLossyConversion:YES];
+			char *text = PGSQLWriterScratch(out, [bytes length]);
+			*textLength = (text != NULL) ? [bytes length] : 0;
+			if (*textLength > 0)
+			{
+				memcpy(text, [bytes bytes], *textLength);
+			}
+			[pool drain];
+			return (text != NULL) ? text : "";
+		}
+	}
+}
+
+// NDJSON is UTF-8; text from a recordset in another encoding is converted.
+static const char *
+PGSQLWriterUTF8Text(PGSQLWriterOutput *out, const char *text, size_t length,
+					NSStringEncoding encoding, size_t *utf8Length)
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	NSString *string = [[[NSString alloc] initWithBytes:text length:length encoding:encoding] autorelease];
+	const char *utf8 = (string != nil) ? [string UTF8String] : "";
+	size_t converted = strlen(utf8);
+	char *result = PGSQLWriterScratch(out, (converted > 0) ? converted : 1);
+	if (result != NULL)
+	{
+		memcpy(result, utf8, converted);
+	}
+	[pool drain];
+	*utf8Length = (result != NULL) ? converted : 0;
+	return (result != NULL) ? result : "";
+}
+
+static BOOL
+PGSQLWriterLooksNumeric(const char *text, size_t length)
+{
+	if ((length > 0) && (text[0] == '-'))
+	{
+		text++;
+		length--;
+	}
+	return ((length > 0) && (text[0] >= '0') && (text[0] <= '9'));
+}
+
+@interface PGSQLRecordsetWriter (Private)
+-(PGSQLWriterColumn *)newColumnsForRecordset:(PGSQLRecordset *)rs;
+-(void)writeCSVHeaderForRecordset:(PGSQLRecordset *)rs;
+@end
+
+@implementation PGSQLRecordsetWriter
+
++(NSData *)CSVDataFromRecordset:(PGSQLRecordset *)rs
+{
+	PGSQLRecordsetWriter *writer = [[PGSQLRecordsetWriter alloc] initWithFormat:PGSQLWriterFormatCSV];
+	[writer writeRecordset:rs];
+	NSData *result = [writer data];
+	[writer release];
+	return result;
+}
+
++(NSData *)NDJSONDataFromRecordset:(PGSQLRecordset *)rs
+{
+	PGSQLRecordsetWriter *writer = [[PGSQLRecordsetWriter alloc] initWithFormat:PGSQLWriterFormatNDJSON];
+	[writer writeRecordset:rs];
+	NSData *result = [writer data];
+	[writer release];
+	return result;
+}
+
+-(id)initWithFormat:(int)outputFormat
+{
+	return [self initWithFormat:outputFormat fileDescriptor:-1];
+}
+
+-(id)initWithFormat:(int)outputFormat fileDescriptor:(int)fd
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		format = outputFormat;
+		writesHeader = YES;
+		delimiter = ',';
+		usesCRLF = YES;
+
+		PGSQLWriterOutput *out = calloc(1, sizeof(PGSQLWriterOutput));
+		out->fd = fd;
+		out->capacity = (fd >= 0) ? PGSQLWriterBufferSize : 4096;
+		out->bytes = malloc(out->capacity);
+		output = out;
+	}
+
+	return self;
+}
+
+-(void)dealloc
+{
+	PGSQLWriterOutput *out = output;
+	free(out->bytes);
+	free(out->scratch);
+	free(out);
+	[super dealloc];
+}
+
+-(int)format
+{
+	return format;
+}
+
+-(BOOL)writeRecordset:(PGSQLRecordset *)rs
+{
+	return [self writeRecordset:rs rows:NSMakeRange(0, (NSUInteger)[rs recordCount])];
+}
+
+-(BOOL)writeRecordset:(PGSQLRecordset *)rs rows:(NSRange)rows
+{
+	PGSQLWriterOutput *out = output;
+	if (out->error != 0)
+	{
+		return NO;
+	}
+
+	long first = (long)rows.location;
+	long last = (long)NSMaxRange(rows);
+	if (last > [rs recordCount])
+	{
+		last = [rs recordCount];
+	}
+
+	if ((format == PGSQLWriterFormatCSV) && writesHeader && !wroteHeader)
+	{
+		[self writeCSVHeaderForRecordset:rs];
+	}
+	wroteHeader = YES;
+
+	long columnCount = (long)[[rs columns] count];
+	PGSQLWriterColumn *columns = [self newColumnsForRecordset:rs];
+	PGSQLValueAccessor valueAt = (PGSQLValueAccessor)[rs methodForSelector:@selector(valueAtRow:column:length:)];
+	SEL valueSelector = @selector(valueAtRow:column:length:);
+	NSStringEncoding encoding = [rs defaultEncoding];
+	BOOL utf8 = ((encoding == NSUTF8StringEncoding) || (encoding == NSASCIIStringEncoding));
+	const char *lineEnd = usesCRLF ? "\r\n" : "\n";
+	size_t lineEndLength = usesCRLF ? 2 : 1;
+
+	long row;
+	for (row = first; (row < last) && (out->error == 0); row++)
+	{
+		long c;
+		if (format == PGSQLWriterFormatCSV)
+		{
+			for (c = 0; c < columnCount; c++)
+			{
+				int length;
+				const char *value = valueAt(rs, valueSelector, row, c, &length);
+				if (c > 0)
+				{
+					PGSQLWriterPut(out, delimiter);
+				}
+				if (value == NULL)
+				{
+					continue;
+				}
+				size_t textLength;
+				const char *text = PGSQLWriterText(out, &columns[c], rs, row, c, value, length, &textLength);
+				PGSQLWriteCSVValue(out, text, textLength, delimiter);
+			}
+			PGSQLWriterAppend(out, lineEnd, lineEndLength);
+			continue;
+		}
+
+		PGSQLWriterPut(out, '{');
+		for (c = 0; c < columnCount; c++)
+		{
+			PGSQLWriterColumn *column = &columns[c];
+			PGSQLWriterAppend(out, column->key, column->keyLength);
+
+			int length;
+			const char *value = valueAt(rs, valueSelector, row, c, &length);
+			if (value == NULL)
+			{
+				PGSQLWriterAppend(out, "null", 4);
+				continue;
+			}
+			size_t textLength;
+			const char *text = PGSQLWriterText(out, column, rs, row, c, value, length, &textLength);
+			switch (column->kind)
+			{
+				case PGSQLJSONInteger:
+					if (textLength == 0)
+					{
+						PGSQLWriterAppend(out, "null", 4);
+					} else {
+						PGSQLWriterAppend(out, text, textLength);
+					}
+					break;
+				case PGSQLJSONReal:
+					// NaN and Infinity have no JSON number
+					if (PGSQLWriterLooksNumeric(text, textLength))
+					{
+						PGSQLWriterAppend(out, text, textLength);
+					} else {
+						PGSQLWriteJSONString(out, text, textLength);
+					}
+					break;
+				case PGSQLJSONBool:
+					if ((textLength > 0) && (text[0] == 't'))
+					{
+						PGSQLWriterAppend(out, "true", 4);
+					} else {
+						PGSQLWriterAppend(out, "false", 5);
+					}
+					break;
+				case PGSQLJSONRaw:
+					if (!utf8)
+					{
+						text = PGSQLWriterUTF8Text(out, text, textLength, encoding, &textLength);
+					}
+					PGSQLWriterAppend(out, text, textLength);
+					break;
+				default:
+					if (!utf8)
+					{
+						text = PGSQLWriterUTF8Text(out, text, textLength, encoding, &textLength);
+					}
+					PGSQLWriteJSONString(out, text, textLength);
+					break;
+			}
+		}
+		PGSQLWriterAppend(out, "}\n", 2);
+	}
+
+	long c;
+	for (c = 0; c < columnCount; c++)
+	{
+		free(columns[c].key);
+	}
+	free(columns);
+
+	return PGSQLWriterFlush(out);
+}
+
+-(BOOL)flush
+{
+	return PGSQLWriterFlush((PGSQLWriterOutput *)output);
+}
+
+-(NSData *)data
+{
+	PGSQLWriterOutput *out = output;
+	return [NSData dataWithBytes:out->bytes length:out->length];
+}
+
+-(const char *)bytes
+{
+	return ((PGSQLWriterOutput *)output)->bytes;
+}
+
+-(NSUInteger)length
+{
+	return ((PGSQLWriterOutput *)output)->length;
+}
+
+-(unsigned long long)totalLength
+{
+	return ((PGSQLWriterOutput *)output)->total;
+}
+
+-(void)reset
+{
+	PGSQLWriterOutput *out = output;
+	out->length = 0;
+	out->total = 0;
+	out->error = 0;
+	wroteHeader = NO;
+}
+
+-(NSString *)lastError
+{
+	PGSQLWriterOutput *out = output;
+	if (out->error == 0)
+	{
+		return nil;
+	}
+	return [NSString stringWithUTF8String:strerror(out->error)];
+}
+
+#pragma mark -
+#pragma mark Simple Accessors
+
+-(BOOL)writesHeader
+{
+	return writesHeader;
+}
+
+-(void)setWritesHeader:(BOOL)value
+{
+	writesHeader = value;
+}
+
+-(char)delimiter
+{
+	return delimiter;
+}
+
+-(void)setDelimiter:(char)value
+{
+	delimiter = value;
+}
+
+-(BOOL)usesCRLF
+{
+	return usesCRLF;
+}
+
+-(void)setUsesCRLF:(BOOL)value
+{
+	usesCRLF = value;
+}
+
+@end
+
+@implementation PGSQLRecordsetWriter (Private)
+
+// One entry per column, freed by the caller, keys and all.
+-(PGSQLWriterColumn *)newColumnsForRecordset:(PGSQLRecordset *)rs
+{
+	NSArray *columnList = [rs columns];
+	NSUInteger count = [columnList count];
+	PGSQLWriterColumn *columns = calloc((count > 0) ? count : 1, sizeof(PGSQLWriterColumn));
+
+	NSUInteger c;
+	for (c = 0; c < count; c++)
+	{
+		PGSQLColumn *column = [columnList objectAtIndex:c];
+		columns[c].oid = PGSQLWriterTypeOfColumn(column);
+		columns[c].format = [column format];
+		columns[c].kind = PGSQLWriterKindOfType(columns[c].oid);
+		if (format != PGSQLWriterFormatNDJSON)
+		{
+			continue;
+		}
+
+		// the key is escaped into a buffer of its own, which it keeps
+		PGSQLWriterOutput key;
+		memset(&key, 0, sizeof(key));
+		key.fd = -1;
+		key.capacity = 64;
+		key.bytes = malloc(key.capacity);
+		if (c > 0)
+		{
+			PGSQLWriterPut(&key, ',');
+		}
+		const char *name = [[column name] UTF8String];
+		PGSQLWriteJSONString(&key, name, strlen(name));
+		PGSQLWriterPut(&key, ':');
+		columns[c].key = key.bytes;
+		columns[c].keyLength = key.length;
+	}
+	return columns;
+}
+
+-(void)writeCSVHeaderForRecordset:(PGSQLRecordset *)rs
+{
+	PGSQLWriterOutput *out = output;
+	NSStringEncoding encoding = [rs defaultEncoding];
+	NSArray *columnList = [rs columns];
+	NSUInteger c;
+	for (c = 0; c < [columnList count]; c++)
+	{
+		if (c > 0)
+		{
+			PGSQLWriterPut(out, delimiter);
+		}
+		NSData *name = [[[columnList objectAtIndex:c] name] dataUsingEncoding:encoding allowLossyConversion:YES];
+		PGSQLWriteCSVValue(out, [name bytes], [name length], delimiter);
+	}
+	PGSQLWriterAppend(out, usesCRLF ? "\r\n" : "\n", usesCRLF ? 2 : 1);
+}
+
+@end
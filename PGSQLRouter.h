@@ -0,0 +1,141 @@
+//
+//  PGSQLRouter.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLRouter
+    @abstract   Splits reads and writes between a primary and its replicas.
+    @discussion The router holds one connection per server, each tagged as
+				the primary or as a replica.  open: and the query methods go
+				to the replica with the fewest requests in flight, while
+				commands and explicit transactions go to the primary.
+
+				A background thread measures each replica's replay lag with
+				pg_last_xact_replay_timestamp().  A replica that is still
+				streaming and has replayed all it received counts as
+				current, however long the primary has been idle.  A replica
+				further behind than maximumReplicaLag stops taking reads
+				until it catches up, and when no replica qualifies reads fall
+				back to the primary.  A replica that has not replayed
+				anything since it started reports no timestamp and is
+				treated as current.
+*/
+
+#import "PGSQLConnection.h"
+
+/*!
+    @class
+    @abstract    Read/write splitting across a primary and replicas.
+    @discussion  Safe to share between threads.  Every server gets a single
+				 PGSQLConnection, so statements to the same server still run
+				 one at a time.
+
+				 The lag monitor started by connect keeps the router
+				 retained until it ends, so a connected router is only freed
+				 after close.
+*/
+@interface PGSQLRouter : NSObject {
+	NSMutableArray *nodes;
+	NSLock *routerLock;
+
+	NSTimeInterval maximumReplicaLag;
+	NSTimeInterval lagCheckInterval;
+	BOOL isMonitoring;
+}
+
+#pragma mark -
+#pragma mark Configuration
+
+-(void)addPrimaryWithConnectionString:(NSString *)conninfo;
+-(void)addReplicaWithConnectionString:(NSString *)conninfo;
+
+/*!
+    @method
+    @abstract   Connects every configured server and starts the lag monitor.
+    @result     NO if the primary could not be reached.  Replicas that fail
+				to connect are left out of read routing.
+*/
+-(BOOL)connect;
+/*!
+    @method
+    @abstract   Closes every connection and stops the lag monitor.
+    @discussion Required before a connected router can be freed.
+*/
+-(void)close;
+
+#pragma mark -
+#pragma mark Routing
+
+/*!
+    @method
+    @abstract   Run a read on the least busy current replica.
+    @discussion Raises PGSQLError on failure, as -[PGSQLConnection open:]
+				does.
+*/
+-(PGSQLRecordset *)open:(NSString *)sql;
+-(PGSQLRecordset *)open:(NSString *)sql parameters:(NSArray *)params;
+/*!
+    @method
+    @abstract   Run a read on the least busy current replica and return the
+				full result.  Never raises.
+*/
+-(PGSQLCommandResult *)executeQuery:(NSString *)sql parameters:(NSArray *)params;
+
+/*!
+    @method
+    @abstract   Run a command on the primary.  Raises PGSQLError on failure.
+*/
+-(BOOL)execCommand:(NSString *)sql;
+-(BOOL)execCommand:(NSString *)sql parameters:(NSArray *)params;
+/*!
+    @method
+    @abstract   Run a command on the primary and return the full result.
+				Never raises.
+*/
+-(PGSQLCommandResult *)executeCommand:(NSString *)sql parameters:(NSArray *)params;
+
+/*!
+    @method
+    @abstract   Start a transaction on the primary.
+    @discussion Returns the primary's connection, locked to the calling
+				thread with BEGIN already run, or nil if BEGIN failed.  Run
+				the transaction's statements on it and finish with
+				commitTransaction: or rollbackTransaction:, which release the
+				lock.
+*/
+-(PGSQLConnection *)beginTransaction;
+-(BOOL)commitTransaction:(PGSQLConnection *)transaction;
+-(BOOL)rollbackTransaction:(PGSQLConnection *)transaction;
+
+-(PGSQLConnection *)primaryConnection;
+-(NSArray *)replicaConnections;
+
+#pragma mark -
+#pragma mark Simple Accessors
+
+/*!
+    @method
+    @abstract   Replay lag, in seconds, beyond which a replica stops taking
+				reads.  Defaults to 5.
+*/
+-(NSTimeInterval)maximumReplicaLag;
+-(void)setMaximumReplicaLag:(NSTimeInterval)value;
+
+/*!
+    @method
+    @abstract   Seconds between replica lag measurements.  Defaults to 1.
+*/
+-(NSTimeInterval)lagCheckInterval;
+-(void)setLagCheckInterval:(NSTimeInterval)value;
+
+/*!
+    @method
+    @abstract   Last measured replay lag for a replica connection, in
+				seconds, or -1 if it has not been measured.
+*/
+-(NSTimeInterval)replicationLagForConnection:(PGSQLConnection *)connection;
+
+@end
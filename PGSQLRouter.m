@@ -0,0 +1,564 @@
+//
+//  PGSQLRouter.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLRouter.h"
+
+// A server the router can send work to, with the bookkeeping used to pick
+// one.  Everything but the connection is guarded by the router's lock.
+@interface PGSQLRouterNode : NSObject {
+	PGSQLConnection *connection;
+	BOOL isPrimary;
+	BOOL isAvailable;
+	NSUInteger outstanding;
+	NSTimeInterval lag;
+}
+
+-(id)initWithConnectionString:(NSString *)conninfo primary:(BOOL)primary;
+-(PGSQLConnection *)connection;
+-(BOOL)isPrimary;
+-(BOOL)isAvailable;
+-(void)setAvailable:(BOOL)value;
+-(NSUInteger)outstanding;
+-(void)setOutstanding:(NSUInteger)value;
+-(NSTimeInterval)lag;
+-(void)setLag:(NSTimeInterval)value;
+
+@end
+
+@implementation PGSQLRouterNode
+
+-(id)initWithConnectionString:(NSString *)conninfo primary:(BOOL)primary
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		connection = [[PGSQLConnection alloc] init];
+		[connection setConnectionString:conninfo];
+		isPrimary = primary;
+		isAvailable = NO;
+		outstanding = 0;
+		lag = -1;
+	}
+	return self;
+}
+
+-(void)dealloc
+{
+	[connection close];
+	[connection release];
+	[super dealloc];
+}
+
+-(PGSQLConnection *)connection
+{
+	return connection;
+}
+
+-(BOOL)isPrimary
+{
+	return isPrimary;
+}
+
+-(BOOL)isAvailable
+{
+	return isAvailable;
+}
+
+-(void)setAvailable:(BOOL)value
+{
+	isAvailable = value;
+}
+
+-(NSUInteger)outstanding
+{
+	return outstanding;
+}
+
+-(void)setOutstanding:(NSUInteger)value
+{
+	outstanding = value;
+}
+
+-(NSTimeInterval)lag
+{
+	return lag;
+}
+
+-(void)setLag:(NSTimeInterval)value
+{
+	lag = value;
+}
+
+@end
+
+@interface PGSQLRouter (Private)
+
+-(PGSQLRouterNode *)checkOutNodeForRead:(BOOL)read;
+-(void)checkInNode:(PGSQLRouterNode *)node;
+-(PGSQLRouterNode *)primaryNode;
+-(BOOL)finishTransaction:(PGSQLConnection *)transaction withCommand:(NSString *)command;
+-(void)monitorReplicas;
+
+@end
+
+@implementation PGSQLRouter
+
+-(id)init
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		nodes = [[NSMutableArray alloc] init];
+		routerLock = [[NSLock alloc] init];
+		maximumReplicaLag = 5.0;
+		lagCheckInterval = 1.0;
+		isMonitoring = NO;
+	}
+	return self;
+}
+
+-(void)dealloc
+{
+	[self close];
+	[nodes release];
+	[routerLock release];
+	[super dealloc];
+}
+
+#pragma mark -
+#pragma mark Configuration
+
+-(void)addPrimaryWithConnectionString:(NSString *)conninfo
+{
+	PGSQLRouterNode *node = [[PGSQLRouterNode alloc] initWithConnectionString:conninfo primary:YES];
+	[routerLock lock];
+	[nodes addObject:node];
+	[routerLock unlock];
+	[node release];
+}
+
+-(void)addReplicaWithConnectionString:(NSString *)conninfo
+{
+	PGSQLRouterNode *node = [[PGSQLRouterNode alloc] initWithConnectionString:conninfo primary:NO];
+	[routerLock lock];
+	[nodes addObject:node];
+	[routerLock unlock];
+	[node release];
+}
+
+-(BOOL)connect
+{
+	[routerLock lock];
+	NSArray *snapshot = [[nodes copy] autorelease];
+	[routerLock unlock];
+
+	BOOL primaryConnected = NO;
+	NSUInteger i;
+	for (i = 0; i < [snapshot count]; i++)
+	{
+		PGSQLRouterNode *node = [snapshot objectAtIndex:i];
+		BOOL connected = [[node connection] connect];
+
+		[routerLock lock];
+		[node setAvailable:connected];
+		[routerLock unlock];
+
+		if ([node isPrimary] && connected)
+		{
+			primaryConnected = YES;
+		}
+	}
+
+	[routerLock lock];
+	if (!isMonitoring)
+	{
+		isMonitoring = YES;
+		[NSThread detachNewThreadSelector:@selector(monitorReplicas) toTarget:self withObject:nil];
+	}
+	[routerLock unlock];
+
+	return primaryConnected;
+}
+
+-(void)close
+{
+	[routerLock lock];
+	isMonitoring = NO;
+	NSArray *snapshot = [[nodes copy] autorelease];
+	NSUInteger i;
+	for (i = 0; i < [snapshot count]; i++)
+	{
+		[[snapshot objectAtIndex:i] setAvailable:NO];
+	}
+	[routerLock unlock];
+
+	for (i = 0; i < [snapshot count]; i++)
+	{
+		[[[snapshot objectAtIndex:i] connection] close];
+	}
+}
+
+#pragma mark -
+#pragma mark Node Selection
+
+-(PGSQLRouterNode *)primaryNode
+{
+	NSUInteger i;
+	for (i = 0; i < [nodes count]; i++)
+	{
+		PGSQLRouterNode *node = [nodes objectAtIndex:i];
+		if ([node isPrimary])
+		{
+			return node;
+		}
+	}
+	return nil;
+}
+
+// Picks the node for a request and counts it as in flight.  Reads go to the
+// available replica with the fewest requests outstanding that is within
+// maximumReplicaLag, anything else (or a read with no such replica) goes to
+// the primary.
+-(PGSQLRouterNode *)checkOutNodeForRead:(BOOL)read
+{
+	[routerLock lock];
+
+	PGSQLRouterNode *chosen = nil;
+	if (read)
+	{
+		NSUInteger i;
+		for (i = 0; i < [nodes count]; i++)
+		{
+			PGSQLRouterNode *node = [nodes objectAtIndex:i];
+			if ([node isPrimary] || ![node isAvailable] || ([node lag] > maximumReplicaLag))
+			{
+				continue;
+			}
+			if ((chosen == nil) || ([node outstanding] < [chosen outstanding]))
+			{
+				chosen = node;
+			}
+		}
+	}
+	if (chosen == nil)
+	{
+		chosen = [self primaryNode];
+	}
+
+	[chosen setOutstanding:[chosen outstanding] + 1];
+	[[chosen retain] autorelease];
+	[routerLock unlock];
+
+	return chosen;
+}
+
+-(void)checkInNode:(PGSQLRouterNode *)node
+{
+	[routerLock lock];
+	[node setOutstanding:[node outstanding] - 1];
+	[routerLock unlock];
+}
+
+#pragma mark -
+#pragma mark Routing
+
+-(PGSQLCommandResult *)executeQuery:(NSString *)sql parameters:(NSArray *)params
+{
+	PGSQLRouterNode *node = [self checkOutNodeForRead:YES];
+	if (node == nil)
+	{
+		return [[[PGSQLCommandResult alloc] initWithError:@"No primary configured." sql:sql executionTime:0] autorelease];
+	}
+
+	PGSQLCommandResult *result = [[node connection] execute:sql parameters:params];
+	[self checkInNode:node];
+	return result;
+}
+
+-(PGSQLCommandResult *)executeCommand:(NSString *)sql parameters:(NSArray *)params
+{
+	PGSQLRouterNode *node = [self checkOutNodeForRead:NO];
+	if (node == nil)
+	{
+		return [[[PGSQLCommandResult alloc] initWithError:@"No primary configured." sql:sql executionTime:0] autorelease];
+	}
+
+	PGSQLCommandResult *result = [[node connection] execute:sql parameters:params];
+	[self checkInNode:node];
+	return result;
+}
+
+-(PGSQLRecordset *)open:(NSString *)sql
+{
+	return [self open:sql parameters:nil];
+}
+
+-(PGSQLRecordset *)open:(NSString *)sql parameters:(NSArray *)params
+{
+	PGSQLCommandResult *result = [self executeQuery:sql parameters:params];
+	if (![result succeeded])
+	{
+        [[NSException exceptionWithName:@"PGSQLError" reason:[result lastError] userInfo:nil] raise];
+		return nil;
+	}
+	return [result recordset];
+}
+
+-(BOOL)execCommand:(NSString *)sql
+{
+	return [self execCommand:sql parameters:nil];
+}
+
+-(BOOL)execCommand:(NSString *)sql parameters:(NSArray *)params
+{
+	PGSQLCommandResult *result = [self executeCommand:sql parameters:params];
+	if (![result succeeded])
+	{
+        [[NSException exceptionWithName:@"PGSQLError" reason:[result lastError] userInfo:nil] raise];
+		return NO;
+	}
+	return YES;
+}
+
+-(PGSQLConnection *)beginTransaction
+{
+	PGSQLRouterNode *node = [self checkOutNodeForRead:NO];
+	if (node == nil)
+	{
+		return nil;
+	}
+
+	PGSQLConnection *transaction = [node connection];
+	[transaction lock];
+	if (![[transaction execute:@"BEGIN"] succeeded])
+	{
+		[transaction unlock];
+		[self checkInNode:node];
+		return nil;
+	}
+	return transaction;
+}
+
+-(BOOL)finishTransaction:(PGSQLConnection *)transaction withCommand:(NSString *)command
+{
+	BOOL result = [[transaction execute:command] succeeded];
+	[transaction unlock];
+
+	[routerLock lock];
+	PGSQLRouterNode *node = [self primaryNode];
+	[routerLock unlock];
+	[self checkInNode:node];
+
+	return result;
+}
+
+-(BOOL)commitTransaction:(PGSQLConnection *)transaction
+{
+	return [self finishTransaction:transaction withCommand:@"COMMIT"];
+}
+
+-(BOOL)rollbackTransaction:(PGSQLConnection *)transaction
+{
+	return [self finishTransaction:transaction withCommand:@"ROLLBACK"];
+}
+
+-(PGSQLConnection *)primaryConnection
+{
+	[routerLock lock];
+	PGSQLConnection *result = [[[[self primaryNode] connection] retain] autorelease];
+	[routerLock unlock];
+	return result;
+}
+
+-(NSArray *)replicaConnections
+{
+	NSMutableArray *result = [NSMutableArray array];
+
+	[routerLock lock];
+	NSUInteger i;
+	for (i = 0; i < [nodes count]; i++)
+	{
+		PGSQLRouterNode *node = [nodes objectAtIndex:i];
+		if (![node isPrimary])
+		{
+			[result addObject:[node connection]];
+		}
+	}
+	[routerLock unlock];
+
+	return result;
+}
+
+#pragma mark -
+#pragma mark Replica Monitoring
+
+-(void)monitorReplicas
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+	while (YES)
+	{
+		NSAutoreleasePool *loopPool = [[NSAutoreleasePool alloc] init];
+
+		[routerLock lock];
+		BOOL running = isMonitoring;
+		NSTimeInterval interval = lagCheckInterval;
+		NSArray *snapshot = [[nodes copy] autorelease];
+		[routerLock unlock];
+
+		if (!running)
+		{
+			[loopPool release];
+			break;
+		}
+
+		NSUInteger i;
+		for (i = 0; i < [snapshot count]; i++)
+		{
+			PGSQLRouterNode *node = [snapshot objectAtIndex:i];
+			if ([node isPrimary])
+			{
+				continue;
+			}
+
+			// a replica that went away is tried again on every check.  close
+			// may run while it connects, so the flag is checked under the lock
+			// close takes both before and after, and the connection dropped
+			// again if the router was closed in between.
+			PGSQLConnection *connection = [node connection];
+			if (![connection isConnected])
+			{
+				[routerLock lock];
+				running = isMonitoring;
+				[routerLock unlock];
+				if (!running)
+				{
+					break;
+				}
+
+				BOOL connected = [connection connect];
+
+				[routerLock lock];
+				running = isMonitoring;
+				if (running)
+				{
+					[node setAvailable:connected];
+				}
+				[routerLock unlock];
+				if (!running)
+				{
+					[connection close];
+					break;
+				}
+				if (!connected)
+				{
+					continue;
+				}
+			}
+
+			// The time since the last replayed commit grows while the primary
+			// is idle, so a replica that has replayed all it has received, and
+			// is still streaming from the primary, is current.  Without a
+			// streaming WAL receiver it may have received all it ever will,
+			// so only the replay time is used.  Users without
+			// pg_read_all_stats see the receiver's row but not its status.
+			// NULL until the replica has replayed something, count that as
+			// current too.  The functions were renamed in 10, and before 9.6
+			// there is no pg_stat_wal_receiver.
+			int version = [[connection catalog] serverVersion];
+			NSString *sql;
+			if (version >= 100000)
+			{
+				sql = @"select case when exists (select 1 from pg_stat_wal_receiver "
+					  @"where coalesce(status, 'streaming') = 'streaming') "
+					  @"and pg_last_wal_receive_lsn() = pg_last_wal_replay_lsn() then 0 "
+					  @"else extract(epoch from now() - pg_last_xact_replay_timestamp()) end";
+			} else if (version >= 90600) {
+				sql = @"select case when exists (select 1 from pg_stat_wal_receiver "
+					  @"where coalesce(status, 'streaming') = 'streaming') "
+					  @"and pg_last_xlog_receive_location() = pg_last_xlog_replay_location() then 0 "
+					  @"else extract(epoch from now() - pg_last_xact_replay_timestamp()) end";
+			} else {
+				sql = @"select extract(epoch from now() - pg_last_xact_replay_timestamp())";
+			}
+			PGSQLCommandResult *result = [connection execute:sql];
+			PGSQLRecordset *rs = [result recordset];
+			NSTimeInterval lag = 0;
+			if ((rs != nil) && ![rs isEOF] && ![[rs fieldByIndex:0] isNull])
+			{
+				lag = [[[rs fieldByIndex:0] asString] doubleValue];
+			}
+
+			// close marks every node unavailable, which this must not undo
+			[routerLock lock];
+			if (isMonitoring)
+			{
+				[node setAvailable:[result succeeded]];
+				[node setLag:lag];
+			}
+			[routerLock unlock];
+
+			[rs close];
+		}
+
+		[loopPool release];
+		[NSThread sleepForTimeInterval:interval];
+	}
+
+	[pool release];
+}
+
+#pragma mark -
+#pragma mark Simple Accessors
+
+-(NSTimeInterval)maximumReplicaLag
+{
+	return maximumReplicaLag;
+}
+
+-(void)setMaximumReplicaLag:(NSTimeInterval)value
+{
+	[routerLock lock];
+	maximumReplicaLag = value;
+	[routerLock unlock];
+}
+
+-(NSTimeInterval)lagCheckInterval
+{
+	return lagCheckInterval;
+}
+
+-(void)setLagCheckInterval:(NSTimeInterval)value
+{
+	[routerLock lock];
+	lagCheckInterval = value;
+	[routerLock unlock];
+}
+
+-(NSTimeInterval)replicationLagForConnection:(PGSQLConnection *)connection
+{
+	NSTimeInterval result = -1;
+
+	[routerLock lock];
+	NSUInteger i;
+	for (i = 0; i < [nodes count]; i++)
+	{
+		PGSQLRouterNode *node = [nodes objectAtIndex:i];
+		if ([node connection] == connection)
+		{
+			result = [node lag];
+			break;
+		}
+	}
+	[routerLock unlock];
+
+	return result;
+}
+
+@end
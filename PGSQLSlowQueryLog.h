@@ -0,0 +1,203 @@
+//
+//  PGSQLSlowQueryLog.h
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+/*!
+    @header PGSQLSlowQueryLog
+    @abstract   Client side capture of slow statements and their plans.
+    @discussion Give a connection a slow query log and every statement it
+				runs that takes longer than the log's threshold is recorded:
+				the SQL, its parameters, the time it took, the rows it
+				returned or touched and the error if it failed.  Statements
+				under the threshold cost one comparison.
+
+				A sample of the slow statements is also explained.  EXPLAIN
+				(FORMAT JSON) runs on a separate connection, on a background
+				queue, with the same parameters, and the plan is attached to
+				the entry when it arrives.  The statement is planned, not run
+				again.  Only SELECT, INSERT, UPDATE, DELETE, VALUES and WITH
+				statements are explained.
+
+				The log keeps the most recent entries up to its capacity,
+				dropping the oldest.  One log can be shared by several
+				connections, and read from any thread.
+*/
+
+#import <Foundation/Foundation.h>
+
+@class PGSQLConnection;
+
+/*!
+    @class
+    @abstract    One slow statement.
+*/
+@interface PGSQLSlowQuery : NSObject {
+	NSString *sql;
+	NSArray *parameters;
+	NSTimeInterval executionTime;
+	long rows;
+	NSString *error;
+	NSDate *date;
+	NSString *serverIdentity;
+	NSString *plan;
+}
+
+-(NSString *)sql;
+/*!
+    @method
+    @abstract   The parameters as recorded: text, after the log's redactor
+				had its say.  nil when the log does not record parameters.
+*/
+-(NSArray *)parameters;
+-(NSTimeInterval)executionTime;
+/*!
+    @method
+    @abstract   Rows returned, or affected for a command, -1 if unknown.
+*/
+-(long)rows;
+/*!
+    @method
+    @abstract   The error the statement failed with, nil if it succeeded.
+*/
+-(NSString *)error;
+-(NSDate *)date;
+-(NSString *)serverIdentity;
+/*!
+    @method
+    @abstract   The EXPLAIN (FORMAT JSON) output, once it has arrived.  nil
+				for statements that were not sampled, and until then.
+*/
+-(NSString *)plan;
+
+/*!
+    @method
+    @abstract   The entry as a property list dictionary.
+*/
+-(NSDictionary *)dictionaryRepresentation;
+
+@end
+
+/*!
+    @function
+    @abstract   Decides how a parameter is recorded.
+    @discussion Called with the statement, the 0 based parameter index and
+				the value as it was sent, an NSString for text or NSData for
+				binary.  Returns the text to record, or nil to record
+				"<redacted>".
+*/
+typedef NSString *(^PGSQLParameterRedactor)(NSString *sql, NSUInteger index, id value);
+
+/*!
+    @class
+    @abstract    A bounded store of slow statements.
+    @discussion  Attach with -[PGSQLConnection setSlowQueryLog:].
+*/
+@interface PGSQLSlowQueryLog : NSObject {
+	NSLock *logLock;				// guards everything below but the queue
+	NSMutableArray *entries;		// oldest first
+	NSUInteger capacity;
+	NSTimeInterval threshold;
+	double explainSampleRate;
+	BOOL recordsParameters;
+	PGSQLParameterRedactor parameterRedactor;
+	PGSQLConnection *explainConnection;
+	unsigned long long slowCount;
+
+	dispatch_queue_t explainQueue;
+}
+
+/*!
+    @method
+    @abstract   A log of up to capacity entries.
+    @discussion Defaults to a threshold of 1 second, recording parameters,
+				and explaining one slow statement in ten once an
+				explainConnection is set.
+*/
+-(id)initWithCapacity:(NSUInteger)maximumEntries;
+
+/*!
+    @method
+    @abstract   Seconds a statement must take to be recorded.
+*/
+-(NSTimeInterval)threshold;
+-(void)setThreshold:(NSTimeInterval)value;
+
+/*!
+    @method
+    @abstract   The share of slow statements to explain, 0 to 1.
+*/
+-(double)explainSampleRate;
+-(void)setExplainSampleRate:(double)value;
+
+/*!
+    @method
+    @abstract   The connection EXPLAINs run on.
+    @discussion Should be a connection of its own to the same database, so
+				explaining never waits behind, or holds up, the application's
+				statements.  Statements run on it are never recorded.  No
+				plans are captured without one.
+*/
+-(PGSQLConnection *)explainConnection;
+-(void)setExplainConnection:(PGSQLConnection *)conn;
+
+/*!
+    @method
+    @abstract   Whether parameters are recorded at all.  Defaults to YES.
+*/
+-(BOOL)recordsParameters;
+-(void)setRecordsParameters:(BOOL)value;
+
+/*!
+    @method
+    @abstract   The hook parameters are recorded through.
+    @discussion Without one, text is recorded as sent, cut at 256
+				characters, and binary as its length.
+*/
+-(PGSQLParameterRedactor)parameterRedactor;
+-(void)setParameterRedactor:(PGSQLParameterRedactor)redactor;
+
+-(NSUInteger)capacity;
+
+/*!
+    @method
+    @abstract   The recorded entries, oldest first.
+*/
+-(NSArray *)entries;
+
+/*!
+    @method
+    @abstract   Slow statements seen since the log was created or cleared,
+				including the ones since dropped for capacity.
+*/
+-(unsigned long long)slowCount;
+
+/*!
+    @method
+    @abstract   The entries as a JSON array.
+*/
+-(NSData *)JSONData;
+
+/*!
+    @method
+    @abstract   The entries as readable text, for a log file or the console.
+*/
+-(NSString *)dump;
+
+-(void)removeAllEntries;
+
+/*!
+    @method
+    @abstract   Called by the connection after every statement.
+    @discussion values, lengths and formats are the statement's parameters
+				as bound for libpq.  Does nothing for statements under the
+				threshold.
+*/
+-(void)connection:(PGSQLConnection *)conn ranSQL:(NSString *)sql
+   numberOfArguments:(int)nParams values:(const char **)paramValues
+			 lengths:(int *)paramLengths formats:(int *)paramFormats
+	   executionTime:(NSTimeInterval)elapsed rows:(long)rowCount error:(NSString *)errorMessage;
+
+@end
@@ -0,0 +1,456 @@
+//
+//  PGSQLSlowQueryLog.m
+//  PGSQLKit
+//
+//  Copyright 2010 Druware Software Designs. All rights reserved.
+//
+
+#import "PGSQLSlowQueryLog.h"
+#import "PGSQLConnection.h"
+#import <stdlib.h>
+
+// Text parameters longer than this are cut when there is no redactor.
+#define PGSQLSlowQueryParameterLength	256
+
+@interface PGSQLSlowQuery (Private)
+
+-(id)initWithSQL:(NSString *)sqlText parameters:(NSArray *)params executionTime:(NSTimeInterval)elapsed
+			rows:(long)rowCount error:(NSString *)errorMessage serverIdentity:(NSString *)identity;
+-(void)setPlan:(NSString *)value;
+
+@end
+
+@implementation PGSQLSlowQuery
+
+-(void)dealloc
+{
+	[sql release];
+	[parameters release];
+	[error release];
+	[date release];
+	[serverIdentity release];
+	[plan release];
+	[super dealloc];
+}
+
+-(NSDictionary *)dictionaryRepresentation
+{
+	NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+	[dict setObject:sql forKey:@"sql"];
+	[dict setObject:[NSNumber numberWithDouble:executionTime] forKey:@"executionTime"];
+	[dict setObject:[NSNumber numberWithLong:rows] forKey:@"rows"];
+	[dict setObject:[NSNumber numberWithDouble:[date timeIntervalSince1970]] forKey:@"date"];
+	if (parameters != nil) { [dict setObject:parameters forKey:@"parameters"]; }
+	if (error != nil) { [dict setObject:error forKey:@"error"]; }
+	if (serverIdentity != nil) { [dict setObject:serverIdentity forKey:@"server"]; }
+	NSString *currentPlan = [self plan];
+	if (currentPlan != nil) { [dict setObject:currentPlan forKey:@"plan"]; }
+	return dict;
+}
+
+-(NSString *)description
+{
+	NSMutableString *text = [NSMutableString stringWithFormat:@"%@ %.3fs %ld rows%@\n%@\n",
+							 date, executionTime, rows, (error != nil) ? @" FAILED" : @"", sql];
+	if ([parameters count] > 0)
+	{
+		[text appendFormat:@"parameters: %@\n", [parameters componentsJoinedByString:@", "]];
+	}
+	if (error != nil)
+	{
+		[text appendFormat:@"error: %@\n", error];
+	}
+	NSString *currentPlan = [self plan];
+	if (currentPlan != nil)
+	{
+		[text appendFormat:@"plan: %@\n", currentPlan];
+	}
+	return text;
+}
+
+#pragma mark -
+#pragma mark Simple Accessors
+
+-(NSString *)sql
+{
+	return sql;
+}
+
+-(NSArray *)parameters
+{
+	return parameters;
+}
+
+-(NSTimeInterval)executionTime
+{
+	return executionTime;
+}
+
+-(long)rows
+{
+	return rows;
+}
+
+-(NSString *)error
+{
+	return error;
+}
+
+-(NSDate *)date
+{
+	return date;
+}
+
+-(NSString *)serverIdentity
+{
+	return serverIdentity;
+}
+
+// set once from the explain queue, so read it under the same lock
+-(NSString *)plan
+{
+	@synchronized (self)
+	{
+		return [[plan retain] autorelease];
+	}
+}
+
+@end
+
+@implementation PGSQLSlowQuery (Private)
+
+-(id)initWithSQL:(NSString *)sqlText parameters:(NSArray *)params executionTime:(NSTimeInterval)elapsed
+			rows:(long)rowCount error:(NSString *)errorMessage serverIdentity:(NSString *)identity
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		sql = [sqlText copy];
+		parameters = [params copy];
+		executionTime = elapsed;
+		rows = rowCount;
+		error = [errorMessage copy];
+		date = [[NSDate alloc] init];
+		serverIdentity = [identity copy];
+		plan = nil;
+	}
+	return self;
+}
+
+-(void)setPlan:(NSString *)value
+{
+	@synchronized (self)
+	{
+		[plan release];
+		plan = [value copy];
+	}
+}
+
+@end
+
+@interface PGSQLSlowQueryLog (Private)
+
+-(void)explainEntry:(PGSQLSlowQuery *)entry parameters:(NSArray *)params;
+
+@end
+
+// Whether EXPLAIN takes the statement: it plans queries and DML, not
+// utility statements.
+static BOOL
+PGSQLIsExplainable(NSString *sql)
+{
+	NSScanner *scanner = [NSScanner scannerWithString:sql];
+	NSString *word = nil;
+	[scanner scanCharactersFromSet:[NSCharacterSet whitespaceAndNewlineCharacterSet] intoString:NULL];
+	if (![scanner scanCharactersFromSet:[NSCharacterSet letterCharacterSet] intoString:&word])
+	{
+		return NO;
+	}
+	word = [word uppercaseString];
+	return ([word isEqualToString:@"SELECT"] || [word isEqualToString:@"INSERT"] ||
+			[word isEqualToString:@"UPDATE"] || [word isEqualToString:@"DELETE"] ||
+			[word isEqualToString:@"VALUES"] || [word isEqualToString:@"WITH"]);
+}
+
+@implementation PGSQLSlowQueryLog
+
+-(id)init
+{
+	return [self initWithCapacity:100];
+}
+
+-(id)initWithCapacity:(NSUInteger)maximumEntries
+{
+	self = [super init];
+
+	if (self != nil)
+	{
+		logLock = [[NSLock alloc] init];
+		capacity = (maximumEntries > 0) ? maximumEntries : 1;
+		entries = [[NSMutableArray alloc] initWithCapacity:capacity];
+		threshold = 1;
+		explainSampleRate = 0.1;
+		recordsParameters = YES;
+		parameterRedactor = nil;
+		explainConnection = nil;
+		slowCount = 0;
+		explainQueue = dispatch_queue_create("com.druware.pgsqlkit.explain", NULL);
+	}
+	return self;
+}
+
+-(void)dealloc
+{
+	dispatch_release(explainQueue);
+	[logLock release];
+	[entries release];
+	[parameterRedactor release];
+	[explainConnection release];
+	[super dealloc];
+}
+
+-(void)connection:(PGSQLConnection *)conn ranSQL:(NSString *)sql
+   numberOfArguments:(int)nParams values:(const char **)paramValues
+			 lengths:(int *)paramLengths formats:(int *)paramFormats
+	   executionTime:(NSTimeInterval)elapsed rows:(long)rowCount error:(NSString *)errorMessage
+{
+	// read without the lock, the cheap test every statement pays
+	if (elapsed < threshold)
+	{
+		return;
+	}
+
+	[logLock lock];
+	BOOL records = recordsParameters;
+	PGSQLParameterRedactor redactor = [[parameterRedactor retain] autorelease];
+	PGSQLConnection *explainer = [[explainConnection retain] autorelease];
+	BOOL sampled = ((explainer != nil) && (explainSampleRate > 0) &&
+					(((double)arc4random() / (double)UINT32_MAX) < explainSampleRate));
+	[logLock unlock];
+
+	if (conn == explainer)
+	{
+		return;
+	}
+
+	// the values as sent, which only the EXPLAIN sees, and as recorded
+	NSMutableArray *sent = [NSMutableArray arrayWithCapacity:nParams];
+	NSMutableArray *recorded = records ? [NSMutableArray arrayWithCapacity:nParams] : nil;
+	int i;
+	for (i = 0; i < nParams; i++)
+	{
+		id value;
+		if (paramValues[i] == NULL)
+		{
+			value = [NSNull null];
+		} else if ((paramFormats != NULL) && (paramFormats[i] == 1)) {
+			value = [NSData dataWithBytes:paramValues[i] length:paramLengths[i]];
+		} else {
+			value = [NSString stringWithCString:paramValues[i] encoding:[conn defaultEncoding]];
+			if (value == nil)
+			{
+				value = [NSString stringWithUTF8String:paramValues[i]];
+			}
+			if (value == nil)
+			{
+				value = @"";
+			}
+		}
+		[sent addObject:value];
+
+		if (!records)
+		{
+			continue;
+		}
+		NSString *text;
+		if (redactor != nil)
+		{
+			text = redactor(sql, i, value);
+			if (text == nil) { text = @"<redacted>"; }
+		} else if (value == [NSNull null]) {
+			text = @"NULL";
+		} else if ([value isKindOfClass:[NSData class]]) {
+			text = [NSString stringWithFormat:@"<%lu bytes>", (unsigned long)[value length]];
+		} else if ([value length] > PGSQLSlowQueryParameterLength) {
+			text = [[value substringToIndex:PGSQLSlowQueryParameterLength] stringByAppendingString:@"..."];
+		} else {
+			text = value;
+		}
+		[recorded addObject:text];
+	}
+
+	PGSQLSlowQuery *entry = [[[PGSQLSlowQuery alloc] initWithSQL:sql parameters:recorded executionTime:elapsed
+															 rows:rowCount error:errorMessage
+												   serverIdentity:[conn serverIdentity]] autorelease];
+	[logLock lock];
+	if ([entries count] >= capacity)
+	{
+		[entries removeObjectAtIndex:0];
+	}
+	[entries addObject:entry];
+	slowCount++;
+	[logLock unlock];
+
+	if (sampled && (errorMessage == nil) && PGSQLIsExplainable(sql))
+	{
+		[self explainEntry:entry parameters:sent];
+	}
+}
+
+-(NSArray *)entries
+{
+	[logLock lock];
+	NSArray *result = [NSArray arrayWithArray:entries];
+	[logLock unlock];
+	return result;
+}
+
+-(NSData *)JSONData
+{
+	NSArray *current = [self entries];
+	NSMutableArray *dicts = [NSMutableArray arrayWithCapacity:[current count]];
+	NSUInteger i;
+	for (i = 0; i < [current count]; i++)
+	{
+		[dicts addObject:[[current objectAtIndex:i] dictionaryRepresentation]];
+	}
+	return [NSJSONSerialization dataWithJSONObject:dicts options:NSJSONWritingPrettyPrinted error:NULL];
+}
+
+-(NSString *)dump
+{
+	NSArray *current = [self entries];
+	NSMutableString *text = [NSMutableString stringWithFormat:@"%lu slow statements, %llu seen\n",
+							 (unsigned long)[current count], [self slowCount]];
+	NSUInteger i;
+	for (i = 0; i < [current count]; i++)
+	{
+		[text appendFormat:@"\n%@", [current objectAtIndex:i]];
+	}
+	return text;
+}
+
+-(void)removeAllEntries
+{
+	[logLock lock];
+	[entries removeAllObjects];
+	slowCount = 0;
+	[logLock unlock];
+}
+
+#pragma mark -
+#pragma mark Simple Accessors
+
+-(NSTimeInterval)threshold
+{
+	return threshold;
+}
+
+-(void)setThreshold:(NSTimeInterval)value
+{
+	[logLock lock];
+	threshold = value;
+	[logLock unlock];
+}
+
+-(double)explainSampleRate
+{
+	return explainSampleRate;
+}
+
+-(void)setExplainSampleRate:(double)value
+{
+	[logLock lock];
+	explainSampleRate = value;
+	[logLock unlock];
+}
+
+-(PGSQLConnection *)explainConnection
+{
+	[logLock lock];
+	PGSQLConnection *result = [[explainConnection retain] autorelease];
+	[logLock unlock];
+	return result;
+}
+
+-(void)setExplainConnection:(PGSQLConnection *)conn
+{
+	[logLock lock];
+	if (explainConnection != conn)
+	{
+		[explainConnection release];
+		explainConnection = [conn retain];
+	}
+	[logLock unlock];
+}
+
+-(BOOL)recordsParameters
+{
+	return recordsParameters;
+}
+
+-(void)setRecordsParameters:(BOOL)value
+{
+	[logLock lock];
+	recordsParameters = value;
+	[logLock unlock];
+}
+
+-(PGSQLParameterRedactor)parameterRedactor
+{
+	[logLock lock];
+	PGSQLParameterRedactor result = [[parameterRedactor retain] autorelease];
+	[logLock unlock];
+	return result;
+}
+
+-(void)setParameterRedactor:(PGSQLParameterRedactor)redactor
+{
+	[logLock lock];
+	[parameterRedactor release];
+	parameterRedactor = [redactor copy];
+	[logLock unlock];
+}
+
+-(NSUInteger)capacity
+{
+	return capacity;
+}
+
+-(unsigned long long)slowCount
+{
+	[logLock lock];
+	unsigned long long result = slowCount;
+	[logLock unlock];
+	return result;
+}
+
+@end
+
+@implementation PGSQLSlowQueryLog (Private)
+
+// One EXPLAIN at a time on the explain queue, so a burst of slow statements
+// queues its plans rather than opening a burst of work on the server.
+-(void)explainEntry:(PGSQLSlowQuery *)entry parameters:(NSArray *)params
+{
+	dispatch_async(explainQueue, ^{
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		PGSQLConnection *explainer = [self explainConnection];
+		if (explainer != nil)
+		{
+			PGSQLCommandResult *result = [explainer execute:[NSString stringWithFormat:@"EXPLAIN (FORMAT JSON) %@", [entry sql]]
+												 parameters:params];
+			if ([result succeeded])
+			{
+				[entry setPlan:[[[[result recordset] moveFirst] fieldByIndex:0] asString]];
+				[[result recordset] close];
+			} else {
+				[entry setPlan:[NSString stringWithFormat:@"EXPLAIN failed: %@", [result lastError]]];
+			}
+		}
+		[pool drain];
+	});
+}
+
+@end